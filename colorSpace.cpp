@@ -0,0 +1,216 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that convert images between color spaces and change
+ *          their hue, saturation and value
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function fills in the fixed point matrix that converts full
+  * range rgb to YCbCr, or back, for the weights of red and blue in the
+  * luma of a standard: 0.299 and 0.114 for BT.601, 0.2126 and 0.0722 for
+  * BT.709. Cb and Cr are centered on 128. The offsets include the
+  * rounding, so the kernels just shift.
+  *
+  * @param[in] kr - the weight of red in the luma.
+  * @param[in] kb - the weight of blue in the luma.
+  * @param[in] inverse - true for YCbCr to rgb.
+  * @param[out] matrix - the weights and offset of each output, in
+  *                      8192ths.
+  *
+  * @returns none
+  *
+  * @par Example:
+    @verbatim
+    int matrix[12];
+
+    ycbcrMatrix(0.299, 0.114, false, matrix);
+
+    matrix now turns rgb into BT.601 YCbCr.
+    @endverbatim
+
+  ***********************************************************************/
+
+static void ycbcrMatrix(double kr, double kb, bool inverse, int matrix[12])
+{
+    double kg = 1 - kr - kb;
+    double cb = 2 * (1 - kb); // how far blue is from the luma, by Cb
+    double cr = 2 * (1 - kr); // how far red is from the luma, by Cr
+    double weights[12] = { kr, kg, kb, 0, -kr / cb, -kg / cb, 0.5, 128,
+        0.5, -kg / cr, -kb / cr, 128 };
+    double inverseWeights[12] = { 1, 0, cr, -128 * cr,
+        1, -kb * cb / kg, -kr * cr / kg, 128 * (kb * cb + kr * cr) / kg,
+        1, cb, 0, -128 * cb };
+    double* use = inverse ? inverseWeights : weights;
+    int i = 0;
+
+    while (i < 12)
+    {
+        matrix[i] = (int)floor(use[i] * 8192 + 0.5);
+        if (i % 4 == 3)
+        {
+            matrix[i] += 4096;
+        }
+        i++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads the settings out of a color space option:
+ * --toYCbCr and --fromYCbCr, with =601 (the default) or =709 for the
+ * standard, --toHSV, --fromHSV, --toHSL and --fromHSL, or --hue=degrees,
+ * --saturation=amount or --value=amount, which change the hue, saturation
+ * or value of each pixel. The amounts go from 0 to 16, and 1 leaves it
+ * the same. The to options write the new color space into the red,
+ * green and blue planes, and the from options read it back out.
+ *
+ * @param[in] option - the option, like --hue=30.
+ * @param[out] change - what it does, in the fixed point of the kernels.
+ *
+ * @returns true if the option is a color space option with good
+ *          settings, false otherwise
+ *
+ * @par Example:
+   @verbatim
+   colorChange change;
+
+   parseColor("--saturation=1.5", change);
+
+   change.mode is now COLOR_ADJUST and change.saturation is 384.
+   @endverbatim
+
+ ***********************************************************************/
+
+bool parseColor(string option, colorChange& change)
+{
+    string name = option.substr(0, option.find('='));
+    string setting;
+    double amount = 0;
+
+    change.hue = 0;
+    change.saturation = 256;
+    change.value = 256;
+    if (option.find('=') != string::npos)
+    {
+        setting = option.substr(option.find('=') + 1);
+    }
+
+    if (name == "--toYCbCr" || name == "--fromYCbCr")
+    {
+        if (setting != "" && setting != "601" && setting != "709")
+        {
+            return false;
+        }
+        change.mode = name == "--toYCbCr" ? COLOR_TO_YCBCR :
+            COLOR_FROM_YCBCR;
+        ycbcrMatrix(setting == "709" ? 0.2126 : 0.299,
+            setting == "709" ? 0.0722 : 0.114,
+            change.mode == COLOR_FROM_YCBCR, change.matrix);
+        return true;
+    }
+    if (name == "--toHSV" || name == "--fromHSV" || name == "--toHSL" ||
+        name == "--fromHSL")
+    {
+        change.mode = name == "--toHSV" ? COLOR_TO_HSV :
+            name == "--fromHSV" ? COLOR_FROM_HSV :
+            name == "--toHSL" ? COLOR_TO_HSL : COLOR_FROM_HSL;
+        return option == name;
+    }
+    if (name != "--hue" && name != "--saturation" && name != "--value")
+    {
+        return false;
+    }
+
+    istringstream spec(setting);
+    if (!(spec >> amount) || spec.peek() != EOF)
+    {
+        return false;
+    }
+    change.mode = COLOR_ADJUST;
+    if (name == "--hue")
+    {
+        // any number of degrees, either way, as steps around the turn
+        change.hue = (int)(fmod(fmod(amount, 360) + 360, 360) / 360 *
+            HUE_TURN + 0.5) % HUE_TURN;
+        return true;
+    }
+    if (amount < 0 || amount > 16)
+    {
+        return false;
+    }
+    if (name == "--saturation")
+    {
+        change.saturation = (int)(amount * 256 + 0.5);
+    }
+    else
+    {
+        change.value = (int)(amount * 256 + 0.5);
+    }
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function converts the rows of an image to or from a color space,
+ * or changes their hue, saturation and value, on all the threads. Each
+ * row is done in one pass over its red, green and blue, in place, so no
+ * other planes are made. It can be called on the whole image or on one
+ * band of rows after another.
+ *
+ * @param[in,out] im - the image.
+ * @param[in] change - what to do, from parseColor.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   colorChange change;
+
+   parseColor("--hue=180", change);
+   changeColor(im, change);
+
+   the colors of im are now turned half way around.
+   @endverbatim
+
+ ***********************************************************************/
+
+void changeColor(image& im, const colorChange& change)
+{
+    const kernelTable& k = kernels();
+    bool matrix = change.mode == COLOR_TO_YCBCR ||
+        change.mode == COLOR_FROM_YCBCR;
+
+    parallelRows(im.rows, [&](int start, int end)
+    {
+        while (start < end)
+        {
+            if (matrix)
+            {
+                k.matrixRow(im.redGray[start], im.green[start],
+                    im.blue[start], im.cols, change.matrix);
+            }
+            else
+            {
+                k.hsvRow(im.redGray[start], im.green[start],
+                    im.blue[start], im.cols, change);
+            }
+            start++;
+        }
+    });
+}
@@ -0,0 +1,3394 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   row kernels built for several instruction sets, and the
+ *          code that picks one set when the program starts
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <algorithm>
+#include <atomic>
+
+#ifdef NETPBM_SSE2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// gcc and clang need to be told a function may use a newer instruction
+// set; msvc lets any function use any intrinsic
+#if defined(__GNUC__)
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define TARGET_SSE42
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+/*!
+ * @brief ISA_NAMES the name of each instruction set, by isaLevel
+ */
+
+static const char* const ISA_NAMES[] = { "scalar", "sse2", "sse4.2",
+    "avx2", "avx512" };
+
+/*!
+ * @brief MEDIAN9_NETWORK the compare and swaps, low one first, that move
+ * the median of 9 values to the middle one
+ */
+
+static const unsigned char MEDIAN9_NETWORK[19][2] = {
+    { 1, 2 }, { 4, 5 }, { 7, 8 }, { 0, 1 }, { 3, 4 }, { 6, 7 }, { 1, 2 },
+    { 4, 5 }, { 7, 8 }, { 0, 3 }, { 5, 8 }, { 4, 7 }, { 3, 6 }, { 1, 4 },
+    { 2, 5 }, { 4, 7 }, { 4, 2 }, { 6, 4 }, { 4, 2 } };
+
+/*!
+ * @brief MEDIAN25_NETWORK the compare and swaps, low one first, that
+ * move the median of 25 values to the middle one
+ */
+
+static const unsigned char MEDIAN25_NETWORK[99][2] = {
+    { 0, 1 }, { 3, 4 }, { 2, 4 }, { 2, 3 }, { 6, 7 }, { 5, 7 }, { 5, 6 },
+    { 9, 10 }, { 8, 10 }, { 8, 9 }, { 12, 13 }, { 11, 13 }, { 11, 12 },
+    { 15, 16 }, { 14, 16 }, { 14, 15 }, { 18, 19 }, { 17, 19 }, { 17, 18 },
+    { 21, 22 }, { 20, 22 }, { 20, 21 }, { 23, 24 }, { 2, 5 }, { 3, 6 },
+    { 0, 6 }, { 0, 3 }, { 4, 7 }, { 1, 7 }, { 1, 4 }, { 11, 14 }, { 8, 14 },
+    { 8, 11 }, { 12, 15 }, { 9, 15 }, { 9, 12 }, { 13, 16 }, { 10, 16 },
+    { 10, 13 }, { 20, 23 }, { 17, 23 }, { 17, 20 }, { 21, 24 }, { 18, 24 },
+    { 18, 21 }, { 19, 22 }, { 8, 17 }, { 9, 18 }, { 0, 18 }, { 0, 9 },
+    { 10, 19 }, { 1, 19 }, { 1, 10 }, { 11, 20 }, { 2, 20 }, { 2, 11 },
+    { 12, 21 }, { 3, 21 }, { 3, 12 }, { 13, 22 }, { 4, 22 }, { 4, 13 },
+    { 14, 23 }, { 5, 23 }, { 5, 14 }, { 15, 24 }, { 6, 24 }, { 6, 15 },
+    { 7, 16 }, { 7, 19 }, { 13, 21 }, { 15, 23 }, { 7, 13 }, { 7, 15 },
+    { 1, 9 }, { 3, 11 }, { 5, 17 }, { 11, 17 }, { 9, 17 }, { 4, 10 },
+    { 6, 12 }, { 7, 14 }, { 4, 6 }, { 4, 7 }, { 12, 14 }, { 10, 14 },
+    { 6, 7 }, { 10, 12 }, { 6, 10 }, { 6, 17 }, { 12, 17 }, { 7, 17 },
+    { 7, 10 }, { 12, 18 }, { 7, 12 }, { 10, 18 }, { 12, 20 }, { 10, 20 },
+    { 10, 12 } };
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function makes the red/gray values of a row the grayscale of
+  * the row, one pixel at a time.
+  *
+  * @param[in,out] red - the red values, which become the gray values.
+  * @param[in] green - the green values.
+  * @param[in] blue - the blue values.
+  * @param[in] count - the number of pixels.
+  *
+  * @returns none
+  *
+  * @par Example:
+    @verbatim
+    grayRowScalar(im.redGray[i], im.green[i], im.blue[i], im.cols);
+    @endverbatim
+
+  ***********************************************************************/
+
+static void grayRowScalar(pixel* red, const pixel* green,
+    const pixel* blue, int count)
+{
+    int j = 0;
+
+    while (j < count)
+    {
+        red[j] = (int)(.3 * red[j] + .6 * green[j] + .1 * blue[j]);
+        j++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function sepia tones a row, one pixel at a time. Values past
+ * 255 are set back to 255.
+ *
+ * @param[in,out] red - the red values.
+ * @param[in,out] green - the green values.
+ * @param[in,out] blue - the blue values.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   sepiaRowScalar(im.redGray[i], im.green[i], im.blue[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void sepiaRowScalar(pixel* red, pixel* green, pixel* blue,
+    int count)
+{
+    int val;
+    int r;
+    int g;
+    int b;
+    int j = 0;
+
+    while (j < count)
+    {
+        r = red[j];
+        g = green[j];
+        b = blue[j];
+        val = (int)(0.393 * r + 0.769 * g + 0.189 * b);
+        red[j] = val > 255 ? 255 : val;
+        val = (int)(0.349 * r + 0.686 * g + 0.168 * b);
+        green[j] = val > 255 ? 255 : val;
+        val = (int)(0.272 * r + 0.534 * g + 0.131 * b);
+        blue[j] = val > 255 ? 255 : val;
+        j++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reverses the order of the pixels of a row, swapping
+ * from both ends toward the middle.
+ *
+ * @param[in,out] row - the row to reverse.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   reverseRowScalar(im.redGray[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void reverseRowScalar(pixel* row, int count)
+{
+    int lo = 0;
+    int hi = count - 1;
+    pixel temp;
+
+    while (lo < hi)
+    {
+        temp = row[lo];
+        row[lo] = row[hi];
+        row[hi] = temp;
+        lo++;
+        hi--;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function swaps the pixels of two rows.
+ *
+ * @param[in,out] a - the first row.
+ * @param[in,out] b - the second row.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   swapRowsScalar(im.redGray[0], im.redGray[im.rows - 1], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void swapRowsScalar(pixel* a, pixel* b, int count)
+{
+    swap_ranges(a, a + count, b);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function transposes a 16x16 block of pixels one pixel at a time,
+ * so row k of dst becomes column k of src.
+ *
+ * @param[in] src - the 16 rows to read, each at its first column.
+ * @param[out] dst - the 16 rows to write, each at its first column.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   transpose16Scalar(src, dst);
+
+   dst[k][m] is now src[m][k].
+   @endverbatim
+
+ ***********************************************************************/
+
+static void transpose16Scalar(const pixel* const* src, pixel* const* dst)
+{
+    int k = 0;
+    int m;
+
+    while (k < 16)
+    {
+        m = 0;
+        while (m < 16)
+        {
+            dst[k][m] = src[m][k];
+            m++;
+        }
+        k++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function splits a row of interleaved red, green and blue into
+ * three arrays.
+ *
+ * @param[in] rgb - the interleaved row.
+ * @param[out] red - the red values.
+ * @param[out] green - the green values.
+ * @param[out] blue - the blue values.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   splitRowScalar(line, im.redGray[i], im.green[i], im.blue[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void splitRowScalar(const pixel* rgb, pixel* red, pixel* green,
+    pixel* blue, int count)
+{
+    int j = 0;
+
+    while (j < count)
+    {
+        red[j] = rgb[j * 3];
+        green[j] = rgb[j * 3 + 1];
+        blue[j] = rgb[j * 3 + 2];
+        j++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function joins three arrays into a row of interleaved red, green
+ * and blue.
+ *
+ * @param[in] red - the red values.
+ * @param[in] green - the green values.
+ * @param[in] blue - the blue values.
+ * @param[out] rgb - the interleaved row.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   joinRowScalar(im.redGray[i], im.green[i], im.blue[i], line, im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void joinRowScalar(const pixel* red, const pixel* green,
+    const pixel* blue, pixel* rgb, int count)
+{
+    int j = 0;
+
+    while (j < count)
+    {
+        rgb[j * 3] = red[j];
+        rgb[j * 3 + 1] = green[j];
+        rgb[j * 3 + 2] = blue[j];
+        j++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes values as ascii numbers, each followed by a
+ * newline, the same as out << (int)value << endl would. The text of
+ * every value is looked up in a table made the first time it is called.
+ *
+ * @param[in] values - the values to write.
+ * @param[in] count - the number of values.
+ * @param[out] text - room for at least 4 * count characters.
+ *
+ * @returns the number of characters written
+ *
+ * @par Example:
+   @verbatim
+   pixel values[3] = { 7, 42, 255 };
+   char text[12];
+
+   formatValuesScalar(values, 3, text);
+
+   output: 10, and text starts with "7\n42\n255\n"
+   @endverbatim
+
+ ***********************************************************************/
+
+static size_t formatValuesScalar(const pixel* values, int count,
+    char* text)
+{
+    // each entry holds the digits and newline, and its length
+    static const struct digitTable
+    {
+        char chars[256][4];
+        unsigned char length[256];
+
+        digitTable()
+        {
+            int v = 0;
+            while (v < 256)
+            {
+                string digits = to_string(v) + '\n';
+                memcpy(chars[v], digits.c_str(), digits.size());
+                length[v] = (unsigned char)digits.size();
+                v++;
+            }
+        }
+    } table;
+    char* start = text;
+    int j = 0;
+
+    while (j < count)
+    {
+        // always copy 4 bytes and then step by the real length
+        memcpy(text, table.chars[values[j]], 4);
+        text += table.length[values[j]];
+        j++;
+    }
+    return (size_t)(text - start);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function packs a row of gray values into bits, 8 pixels to a
+ * byte with the first pixel in the high bit, the way a P4 file holds
+ * them. A dark pixel, below 128, is a 1 (black) and a light one is a 0.
+ * The last byte is filled out with 0 bits.
+ *
+ * @param[in] gray - the gray values.
+ * @param[in] count - the number of pixels.
+ * @param[out] bits - room for (count + 7) / 8 bytes.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   pixel gray[10] = { 0, 255, 0, 255, 0, 255, 0, 255, 0, 0 };
+   pixel bits[2];
+
+   packRowScalar(gray, 10, bits);
+
+   bits is now { 0xAA, 0xC0 }
+   @endverbatim
+
+ ***********************************************************************/
+
+static void packRowScalar(const pixel* gray, int count, pixel* bits)
+{
+    pixel byte = 0;
+    int j = 0;
+
+    while (j < count)
+    {
+        byte = (pixel)(byte << 1 | (gray[j] < 128 ? 1 : 0));
+        j++;
+        if (j % 8 == 0)
+        {
+            bits[j / 8 - 1] = byte;
+            byte = 0;
+        }
+    }
+    if (count % 8 != 0)
+    {
+        bits[count / 8] = (pixel)(byte << (8 - count % 8));
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function blends a row of b into a row of a. Sums and differences
+ * stop at 0 and 255 instead of wrapping around. Products are divided by
+ * 255 and rounded, with the same shifts the simd versions use, so every
+ * version gives the same values.
+ *
+ * @param[in,out] a - the first image's values, which become the blend.
+ * @param[in] b - the second image's values.
+ * @param[in] count - the number of values.
+ * @param[in] mode - how to blend them.
+ * @param[in] weight - for BLEND_ALPHA, how much of b, 0 to 255.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   pixel a[2] = { 200, 10 };
+   pixel b[2] = { 100, 30 };
+
+   blendRowScalar(a, b, 2, BLEND_ADD, 0);
+
+   a is now { 255, 40 }
+   @endverbatim
+
+ ***********************************************************************/
+
+static void blendRowScalar(pixel* a, const pixel* b, int count,
+    blendMode mode, int weight)
+{
+    int t;
+    int j = 0;
+
+    while (j < count)
+    {
+        switch (mode)
+        {
+        case BLEND_ADD:
+            t = a[j] + b[j];
+            a[j] = (pixel)(t > 255 ? 255 : t);
+            break;
+        case BLEND_SUBTRACT:
+            t = a[j] - b[j];
+            a[j] = (pixel)(t < 0 ? 0 : t);
+            break;
+        case BLEND_DIFFERENCE:
+            t = a[j] - b[j];
+            a[j] = (pixel)(t < 0 ? -t : t);
+            break;
+        case BLEND_MULTIPLY:
+            t = a[j] * b[j] + 128;
+            a[j] = (pixel)((t + (t >> 8)) >> 8);
+            break;
+        case BLEND_SCREEN:
+            t = (255 - a[j]) * (255 - b[j]) + 128;
+            a[j] = (pixel)(255 - ((t + (t >> 8)) >> 8));
+            break;
+        default:
+            t = a[j] * (255 - weight) + b[j] * weight + 128;
+            a[j] = (pixel)((t + (t >> 8)) >> 8);
+            break;
+        }
+        j++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds how far apart the values of two rows are. far
+ * keeps the biggest difference at each pixel, so calling it on the red,
+ * green and blue rows of a pixel leaves the biggest difference of any
+ * of its colors there.
+ *
+ * @param[in] a - the first image's values.
+ * @param[in] b - the second image's values.
+ * @param[in,out] far - the biggest difference so far at each pixel.
+ * @param[in] count - the number of values.
+ *
+ * @returns the sum of the squares of the differences
+ *
+ * @par Example:
+   @verbatim
+   pixel a[2] = { 200, 10 };
+   pixel b[2] = { 100, 10 };
+   pixel far[2] = { 0, 0 };
+
+   long long squared = diffRowScalar(a, b, far, 2);
+
+   squared is 10000 and far is now { 100, 0 }.
+   @endverbatim
+
+ ***********************************************************************/
+
+static long long diffRowScalar(const pixel* a, const pixel* b, pixel* far,
+    int count)
+{
+    long long squared = 0;
+    int d;
+    int j = 0;
+
+    while (j < count)
+    {
+        d = a[j] - b[j];
+        d = d < 0 ? -d : d;
+        if (d > far[j])
+        {
+            far[j] = (pixel)d;
+        }
+        squared += d * d;
+        j++;
+    }
+    return squared;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function adds one row into the ssim sums of the blocks from
+ * first up to blocks, for ssimRowScalar and for the blocks left over at
+ * the end of the simd versions.
+ *
+ * @param[in] a - the first image's values.
+ * @param[in] b - the second image's values.
+ * @param[in] first - the first block to do.
+ * @param[in] blocks - the number of blocks in the row, 4 values each.
+ * @param[in,out] sums - 5 * blocks sums to add into.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ssimBlocks(im.redGray[i], other.redGray[i], 8, im.cols / 4, sums);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void ssimBlocks(const pixel* a, const pixel* b, int first,
+    int blocks, int* sums)
+{
+    int x;
+    int y;
+    int k = first;
+    int m;
+
+    while (k < blocks)
+    {
+        m = 0;
+        while (m < 4)
+        {
+            x = a[k * 4 + m];
+            y = b[k * 4 + m];
+            sums[k] += x;
+            sums[blocks + k] += y;
+            sums[2 * blocks + k] += x * x;
+            sums[3 * blocks + k] += y * y;
+            sums[4 * blocks + k] += x * y;
+            m++;
+        }
+        k++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function adds one row of two images into the sums ssim needs for
+ * each block of 4 columns: the sums of a, of b, of a squared, of b
+ * squared and of a times b. Calling it on 4 rows gives the sums of 4x4
+ * blocks. Each of the five sums has its own run of blocks ints in sums,
+ * in that order.
+ *
+ * @param[in] a - the first image's values.
+ * @param[in] b - the second image's values.
+ * @param[in] blocks - the number of blocks, 4 values each.
+ * @param[in,out] sums - 5 * blocks sums to add into.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   vector<int> sums(5 * (im.cols / 4), 0);
+
+   ssimRowScalar(im.redGray[i], other.redGray[i], im.cols / 4,
+       sums.data());
+   @endverbatim
+
+ ***********************************************************************/
+
+static void ssimRowScalar(const pixel* a, const pixel* b, int blocks,
+    int* sums)
+{
+    ssimBlocks(a, b, 0, blocks, sums);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function makes a row half as wide from two rows, each value the
+ * rounded average of a 2x2 block: two values side by side in top and
+ * the two under them in bottom.
+ *
+ * @param[in] top - the upper row, at least 2 * count values.
+ * @param[in] bottom - the lower row, at least 2 * count values.
+ * @param[out] half - the count averages.
+ * @param[in] count - the number of values to make.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   pixel top[2] = { 10, 20 };
+   pixel bottom[2] = { 30, 41 };
+   pixel half[1];
+
+   halveRowScalar(top, bottom, half, 1);
+
+   half is now { 25 }
+   @endverbatim
+
+ ***********************************************************************/
+
+static void halveRowScalar(const pixel* top, const pixel* bottom,
+    pixel* half, int count)
+{
+    int j = 0;
+
+    while (j < count)
+    {
+        half[j] = (pixel)((top[2 * j] + top[2 * j + 1] + bottom[2 * j] +
+            bottom[2 * j + 1] + 2) >> 2);
+        j++;
+    }
+}
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function multiplies each pixel of a row by a color matrix, one
+ * pixel at a time. Each output is red, green and blue times its three
+ * weights plus its offset, all in 8192ths, and is clamped to 0 to 255.
+ * It is all done in ints, so the vector versions get the same values.
+ *
+ * @param[in,out] red - the red values, which become the first output.
+ * @param[in,out] green - the green values, which become the second.
+ * @param[in,out] blue - the blue values, which become the third.
+ * @param[in] count - the number of pixels.
+ * @param[in] matrix - the weights and offset of each output, in order.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   matrixRowScalar(im.redGray[i], im.green[i], im.blue[i], im.cols,
+       change.matrix);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void matrixRowScalar(pixel* red, pixel* green, pixel* blue,
+    int count, const int* matrix)
+{
+    pixel* planes[3] = { red, green, blue };
+    int value;
+    int r;
+    int g;
+    int b;
+    int j = 0;
+    int c;
+
+    while (j < count)
+    {
+        r = red[j];
+        g = green[j];
+        b = blue[j];
+        c = 0;
+        while (c < 3)
+        {
+            value = (matrix[4 * c] * r + matrix[4 * c + 1] * g +
+                matrix[4 * c + 2] * b + matrix[4 * c + 3]) >> 13;
+            planes[c][j] = (pixel)(value < 0 ? 0 : value > 255 ? 255 :
+                value);
+            c++;
+        }
+        j++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function converts a row between rgb and hsv or hsl, or changes
+ * its hue, saturation and value, one pixel at a time. The hue is kept in
+ * HUE_TURN steps, the saturation up to FULL_SATURATION and the lightness
+ * doubled, which is fine enough that rgb to hsv or hsl and back gives
+ * the same pixel. In the planes the hue is 0 to 255 for a whole turn
+ * and the saturation 0 to 255. The math is all in ints, and every
+ * division is of a number below 2^23, so the vector versions can divide
+ * in floats and get the same values.
+ *
+ * @param[in,out] red - the red or hue values.
+ * @param[in,out] green - the green or saturation values.
+ * @param[in,out] blue - the blue or value or lightness values.
+ * @param[in] count - the number of pixels.
+ * @param[in] change - what to do, and by how much.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   hsvRowScalar(im.redGray[i], im.green[i], im.blue[i], im.cols, change);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void hsvRowScalar(pixel* red, pixel* green, pixel* blue, int count,
+    const colorChange& change)
+{
+    bool lightness = change.mode == COLOR_TO_HSL ||
+        change.mode == COLOR_FROM_HSL;
+    bool fromPlanes = change.mode == COLOR_FROM_HSV ||
+        change.mode == COLOR_FROM_HSL;
+    pixel* planes[3] = { red, green, blue };
+    int color[3];
+    int most;
+    int least;
+    int chroma;
+    int level; // the value, or twice the lightness
+    int span;  // the most chroma there can be at that level
+    int hue;
+    int saturation;
+    int sector;
+    int x;
+    int base;
+    int j = 0;
+    int c;
+
+    while (j < count)
+    {
+        color[0] = red[j];
+        color[1] = green[j];
+        color[2] = blue[j];
+        if (fromPlanes)
+        {
+            hue = color[0] * (HUE_TURN / 256);
+            saturation = (color[1] * FULL_SATURATION + 127) / 255;
+            level = lightness ? 2 * color[2] : color[2];
+        }
+        else
+        {
+            most = max(color[0], max(color[1], color[2]));
+            least = min(color[0], min(color[1], color[2]));
+            chroma = most - least;
+            level = lightness ? most + least : most;
+            span = lightness ? 255 - abs(level - 255) : most;
+            saturation = 0;
+            hue = 0;
+            if (chroma != 0)
+            {
+                saturation = (chroma * FULL_SATURATION + span / 2) / span;
+
+                // the hue starts at whichever color is most
+                if (most == color[0])
+                {
+                    hue = (color[1] - color[2]) * HUE_SECTOR / chroma;
+                }
+                else if (most == color[1])
+                {
+                    hue = 2 * HUE_SECTOR + (color[2] - color[0]) *
+                        HUE_SECTOR / chroma;
+                }
+                else
+                {
+                    hue = 4 * HUE_SECTOR + (color[0] - color[1]) *
+                        HUE_SECTOR / chroma;
+                }
+                hue += hue < 0 ? HUE_TURN : 0;
+            }
+        }
+
+        if (change.mode == COLOR_ADJUST)
+        {
+            hue += change.hue;
+            hue -= hue >= HUE_TURN ? HUE_TURN : 0;
+            saturation = min((saturation * change.saturation + 128) >> 8,
+                FULL_SATURATION);
+            level = min((level * change.value + 128) >> 8, 255);
+        }
+
+        if (change.mode == COLOR_TO_HSV || change.mode == COLOR_TO_HSL)
+        {
+            red[j] = (pixel)((hue + HUE_TURN / 512) / (HUE_TURN / 256));
+            green[j] = (pixel)((saturation * 255 + FULL_SATURATION / 2) /
+                FULL_SATURATION);
+            blue[j] = (pixel)(lightness ? (level + 1) >> 1 : level);
+        }
+        else
+        {
+            // each color is the chroma, x or none of it, by the sector
+            // of the hue, on top of the least color
+            span = lightness ? 255 - abs(level - 255) : level;
+            chroma = (span * saturation + FULL_SATURATION / 2) /
+                FULL_SATURATION;
+            base = lightness ? level - chroma : 2 * (level - chroma);
+            sector = hue / HUE_SECTOR;
+            x = hue % HUE_SECTOR;
+            x = (chroma * ((sector & 1) ? HUE_SECTOR - x : x) +
+                HUE_SECTOR / 2) / HUE_SECTOR;
+            color[0] = sector == 0 || sector == 5 ? chroma :
+                sector == 1 || sector == 4 ? x : 0;
+            color[1] = sector == 1 || sector == 2 ? chroma :
+                sector == 0 || sector == 3 ? x : 0;
+            color[2] = sector == 3 || sector == 4 ? chroma :
+                sector == 2 || sector == 5 ? x : 0;
+            c = 0;
+            while (c < 3)
+            {
+                planes[c][j] = (pixel)((2 * color[c] + base + 1) >> 1);
+                c++;
+            }
+        }
+        j++;
+    }
+}
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds the median of the 3x3 or 5x5 window around each
+ * pixel of a row, one pixel at a time, by running the window's values
+ * through a sorting network. Only the compares that can move the median
+ * are in the network, and the median ends up in the middle.
+ *
+ * @param[in] rows - the size rows of the window, each readable size / 2
+ *                   pixels before the first and past the last pixel.
+ * @param[in] size - 3 or 5.
+ * @param[out] out - the medians.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   medianRowScalar(window, 3, im.redGray[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void medianRowScalar(const pixel* const* rows, int size, pixel* out,
+    int count)
+{
+    const unsigned char (*network)[2] = size == 3 ? MEDIAN9_NETWORK :
+        MEDIAN25_NETWORK;
+    int pairs = size == 3 ? 19 : 99;
+    int half = size / 2;
+    int v[25];
+    int low;
+    int first;
+    int j = 0;
+    int i;
+    int k;
+    int a;
+    int b;
+
+    while (j < count)
+    {
+        i = 0;
+        while (i < size)
+        {
+            k = 0;
+            while (k < size)
+            {
+                v[i * size + k] = rows[i][j + k - half];
+                k++;
+            }
+            i++;
+        }
+        k = 0;
+        while (k < pairs)
+        {
+            a = network[k][0];
+            b = network[k][1];
+            // the difference if it is negative, else 0, so no branch
+            low = v[a] - v[b];
+            low &= low >> 31;
+            first = v[a];
+            v[a] = v[b] + low;
+            v[b] = first - low;
+            k++;
+        }
+        out[j] = (pixel)v[size * size / 2];
+        j++;
+    }
+}
+
+
+
+
+#ifdef NETPBM_SSE2
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function grayscales a row like grayRowScalar, 4 pixels at a time
+ * with sse2. The math is done in doubles in the same order, so the
+ * result is the same to the bit.
+ *
+ * @param[in,out] red - the red values, which become the gray values.
+ * @param[in] green - the green values.
+ * @param[in] blue - the blue values.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   grayRowSse2(im.redGray[i], im.green[i], im.blue[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void grayRowSse2(pixel* red, const pixel* green, const pixel* blue,
+    int count)
+{
+    const __m128d kr = _mm_set1_pd(.3);
+    const __m128d kg = _mm_set1_pd(.6);
+    const __m128d kb = _mm_set1_pd(.1);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i in[3];
+    __m128d lo[3];
+    __m128d hi[3];
+    __m128i sum;
+    const pixel* src[3] = { red, green, blue };
+    int word;
+    int j = 0;
+    int c;
+
+    while (j + 4 <= count)
+    {
+        // widen 4 values of each color to doubles
+        c = 0;
+        while (c < 3)
+        {
+            memcpy(&word, src[c] + j, 4);
+            in[c] = _mm_unpacklo_epi16(_mm_unpacklo_epi8(
+                _mm_cvtsi32_si128(word), zero), zero);
+            lo[c] = _mm_cvtepi32_pd(in[c]);
+            hi[c] = _mm_cvtepi32_pd(_mm_shuffle_epi32(in[c], 0x0E));
+            c++;
+        }
+        sum = _mm_unpacklo_epi64(
+            _mm_cvttpd_epi32(_mm_add_pd(_mm_add_pd(_mm_mul_pd(kr, lo[0]),
+                _mm_mul_pd(kg, lo[1])), _mm_mul_pd(kb, lo[2]))),
+            _mm_cvttpd_epi32(_mm_add_pd(_mm_add_pd(_mm_mul_pd(kr, hi[0]),
+                _mm_mul_pd(kg, hi[1])), _mm_mul_pd(kb, hi[2]))));
+        sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), zero);
+        word = _mm_cvtsi128_si32(sum);
+        memcpy(red + j, &word, 4);
+        j += 4;
+    }
+    grayRowScalar(red + j, green + j, blue + j, count - j);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function sepia tones a row like sepiaRowScalar, 4 pixels at a
+ * time with sse2. Packing with saturation does the clamp to 255.
+ *
+ * @param[in,out] red - the red values.
+ * @param[in,out] green - the green values.
+ * @param[in,out] blue - the blue values.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   sepiaRowSse2(im.redGray[i], im.green[i], im.blue[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void sepiaRowSse2(pixel* red, pixel* green, pixel* blue, int count)
+{
+    static const double weight[3][3] = { { 0.393, 0.769, 0.189 },
+        { 0.349, 0.686, 0.168 }, { 0.272, 0.534, 0.131 } };
+    const __m128i zero = _mm_setzero_si128();
+    __m128i in;
+    __m128d lo[3];
+    __m128d hi[3];
+    __m128i sum[3];
+    pixel* planes[3] = { red, green, blue };
+    int word;
+    int j = 0;
+    int c;
+
+    while (j + 4 <= count)
+    {
+        c = 0;
+        while (c < 3)
+        {
+            memcpy(&word, planes[c] + j, 4);
+            in = _mm_unpacklo_epi16(_mm_unpacklo_epi8(
+                _mm_cvtsi32_si128(word), zero), zero);
+            lo[c] = _mm_cvtepi32_pd(in);
+            hi[c] = _mm_cvtepi32_pd(_mm_shuffle_epi32(in, 0x0E));
+            c++;
+        }
+        c = 0;
+        while (c < 3)
+        {
+            __m128d kr = _mm_set1_pd(weight[c][0]);
+            __m128d kg = _mm_set1_pd(weight[c][1]);
+            __m128d kb = _mm_set1_pd(weight[c][2]);
+
+            sum[c] = _mm_unpacklo_epi64(
+                _mm_cvttpd_epi32(_mm_add_pd(_mm_add_pd(
+                    _mm_mul_pd(kr, lo[0]), _mm_mul_pd(kg, lo[1])),
+                    _mm_mul_pd(kb, lo[2]))),
+                _mm_cvttpd_epi32(_mm_add_pd(_mm_add_pd(
+                    _mm_mul_pd(kr, hi[0]), _mm_mul_pd(kg, hi[1])),
+                    _mm_mul_pd(kb, hi[2]))));
+            c++;
+        }
+        c = 0;
+        while (c < 3)
+        {
+            word = _mm_cvtsi128_si32(_mm_packus_epi16(
+                _mm_packs_epi32(sum[c], sum[c]), zero));
+            memcpy(planes[c] + j, &word, 4);
+            c++;
+        }
+        j += 4;
+    }
+    sepiaRowScalar(red + j, green + j, blue + j, count - j);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function swaps the pixels of two rows 16 at a time with sse2.
+ *
+ * @param[in,out] a - the first row.
+ * @param[in,out] b - the second row.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   swapRowsSse2(im.redGray[0], im.redGray[im.rows - 1], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void swapRowsSse2(pixel* a, pixel* b, int count)
+{
+    __m128i x;
+    __m128i y;
+    int j = 0;
+
+    while (j + 16 <= count)
+    {
+        x = _mm_loadu_si128((const __m128i*)(a + j));
+        y = _mm_loadu_si128((const __m128i*)(b + j));
+        _mm_storeu_si128((__m128i*)(a + j), y);
+        _mm_storeu_si128((__m128i*)(b + j), x);
+        j += 16;
+    }
+    swapRowsScalar(a + j, b + j, count - j);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function transposes a 16x16 block of pixels with sse2. Four
+ * rounds of interleaving row i with row i + 8 move every pixel to its
+ * transposed place.
+ *
+ * @param[in] src - the 16 rows to read, each at its first column.
+ * @param[out] dst - the 16 rows to write, each at its first column.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   transpose16Sse2(src, dst);
+
+   dst[k][m] is now src[m][k].
+   @endverbatim
+
+ ***********************************************************************/
+
+static void transpose16Sse2(const pixel* const* src, pixel* const* dst)
+{
+    __m128i a[16];
+    __m128i b[16];
+    int round = 0;
+    int i = 0;
+
+    while (i < 16)
+    {
+        a[i] = _mm_loadu_si128((const __m128i*)src[i]);
+        i++;
+    }
+    while (round < 4)
+    {
+        i = 0;
+        while (i < 8)
+        {
+            b[2 * i] = _mm_unpacklo_epi8(a[i], a[i + 8]);
+            b[2 * i + 1] = _mm_unpackhi_epi8(a[i], a[i + 8]);
+            i++;
+        }
+        memcpy(a, b, sizeof(a));
+        round++;
+    }
+    i = 0;
+    while (i < 16)
+    {
+        _mm_storeu_si128((__m128i*)dst[i], a[i]);
+        i++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function packs a row into bits like packRowScalar, 16 pixels at a
+ * time with sse2. The bytes of each group of 8 are put in reverse order
+ * so the first pixel lands in the high bit, and movemask takes the top
+ * bit of every pixel at once, which is set for the light ones.
+ *
+ * @param[in] gray - the gray values.
+ * @param[in] count - the number of pixels.
+ * @param[out] bits - room for (count + 7) / 8 bytes.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   packRowSse2(im.redGray[i], im.cols, bits);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void packRowSse2(const pixel* gray, int count, pixel* bits)
+{
+    __m128i v;
+    int mask;
+    int j = 0;
+
+    while (j + 16 <= count)
+    {
+        // reverse the words of each half, then the bytes of each word
+        v = _mm_loadu_si128((const __m128i*)(gray + j));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1B), 0x1B);
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        mask = ~_mm_movemask_epi8(v);
+        bits[j / 8] = (pixel)mask;
+        bits[j / 8 + 1] = (pixel)(mask >> 8);
+        j += 16;
+    }
+    packRowScalar(gray + j, count - j, bits + j / 8);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function divides 8 16-bit values by 255 with sse2, rounding to
+ * the nearest, for values up to 255 * 255. It is exact over that range.
+ *
+ * @param[in] t - the values.
+ *
+ * @returns the values divided by 255
+ *
+ * @par Example:
+   @verbatim
+   __m128i half = divide255Sse2(_mm_set1_epi16(255 * 128));
+
+   every value of half is now 128.
+   @endverbatim
+
+ ***********************************************************************/
+
+static inline __m128i divide255Sse2(__m128i t)
+{
+    t = _mm_add_epi16(t, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function blends a row like blendRowScalar, 16 values at a time
+ * with sse2. Add, subtract and difference use the saturating byte adds
+ * and subtracts; the products are done in 16 bits and divided by 255.
+ *
+ * @param[in,out] a - the first image's values, which become the blend.
+ * @param[in] b - the second image's values.
+ * @param[in] count - the number of values.
+ * @param[in] mode - how to blend them.
+ * @param[in] weight - for BLEND_ALPHA, how much of b, 0 to 255.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   blendRowSse2(im.redGray[i], other.redGray[i], im.cols,
+       BLEND_DIFFERENCE, 0);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void blendRowSse2(pixel* a, const pixel* b, int count,
+    blendMode mode, int weight)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8(-1);
+    const __m128i wa = _mm_set1_epi16((short)(255 - weight));
+    const __m128i wb = _mm_set1_epi16((short)weight);
+    __m128i x;
+    __m128i y;
+    __m128i lo;
+    __m128i hi;
+    int j = 0;
+
+    while (j + 16 <= count)
+    {
+        x = _mm_loadu_si128((const __m128i*)(a + j));
+        y = _mm_loadu_si128((const __m128i*)(b + j));
+        if (mode == BLEND_ADD)
+        {
+            x = _mm_adds_epu8(x, y);
+        }
+        else if (mode == BLEND_SUBTRACT)
+        {
+            x = _mm_subs_epu8(x, y);
+        }
+        else if (mode == BLEND_DIFFERENCE)
+        {
+            x = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+        }
+        else
+        {
+            // screen is multiply on the inverted values, inverted back
+            if (mode == BLEND_SCREEN)
+            {
+                x = _mm_xor_si128(x, ones);
+                y = _mm_xor_si128(y, ones);
+            }
+            if (mode == BLEND_ALPHA)
+            {
+                lo = _mm_add_epi16(
+                    _mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), wa),
+                    _mm_mullo_epi16(_mm_unpacklo_epi8(y, zero), wb));
+                hi = _mm_add_epi16(
+                    _mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), wa),
+                    _mm_mullo_epi16(_mm_unpackhi_epi8(y, zero), wb));
+            }
+            else
+            {
+                lo = _mm_mullo_epi16(_mm_unpacklo_epi8(x, zero),
+                    _mm_unpacklo_epi8(y, zero));
+                hi = _mm_mullo_epi16(_mm_unpackhi_epi8(x, zero),
+                    _mm_unpackhi_epi8(y, zero));
+            }
+            x = _mm_packus_epi16(divide255Sse2(lo), divide255Sse2(hi));
+            if (mode == BLEND_SCREEN)
+            {
+                x = _mm_xor_si128(x, ones);
+            }
+        }
+        _mm_storeu_si128((__m128i*)(a + j), x);
+        j += 16;
+    }
+    blendRowScalar(a + j, b + j, count - j, mode, weight);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds how far apart two rows are like diffRowScalar, 16
+ * values at a time with sse2. The differences are the two saturating
+ * subtracts put together, and their squares are summed in pairs by a
+ * multiply-add and then widened to 64 bits so long rows can't overflow.
+ *
+ * @param[in] a - the first image's values.
+ * @param[in] b - the second image's values.
+ * @param[in,out] far - the biggest difference so far at each pixel.
+ * @param[in] count - the number of values.
+ *
+ * @returns the sum of the squares of the differences
+ *
+ * @par Example:
+   @verbatim
+   squared += diffRowSse2(im.redGray[i], other.redGray[i], far, im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static long long diffRowSse2(const pixel* a, const pixel* b, pixel* far,
+    int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = _mm_setzero_si128();
+    __m128i x;
+    __m128i y;
+    __m128i d;
+    __m128i lo;
+    __m128i hi;
+    long long lanes[2];
+    int j = 0;
+
+    while (j + 16 <= count)
+    {
+        x = _mm_loadu_si128((const __m128i*)(a + j));
+        y = _mm_loadu_si128((const __m128i*)(b + j));
+        d = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+        _mm_storeu_si128((__m128i*)(far + j), _mm_max_epu8(d,
+            _mm_loadu_si128((const __m128i*)(far + j))));
+        lo = _mm_unpacklo_epi8(d, zero);
+        hi = _mm_unpackhi_epi8(d, zero);
+        d = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+        total = _mm_add_epi64(total, _mm_add_epi64(
+            _mm_unpacklo_epi32(d, zero), _mm_unpackhi_epi32(d, zero)));
+        j += 16;
+    }
+    _mm_storeu_si128((__m128i*)lanes, total);
+    return lanes[0] + lanes[1] +
+        diffRowScalar(a + j, b + j, far + j, count - j);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function adds a row into the ssim sums of its blocks like
+ * ssimRowScalar, 4 blocks at a time with sse2. A multiply-add sums each
+ * pair of values, and the even and odd pairs are picked out with a
+ * shuffle and added to give the sum of each block of 4.
+ *
+ * @param[in] a - the first image's values.
+ * @param[in] b - the second image's values.
+ * @param[in] blocks - the number of blocks, 4 values each.
+ * @param[in,out] sums - 5 * blocks sums to add into.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ssimRowSse2(im.redGray[i], other.redGray[i], im.cols / 4, sums);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void ssimRowSse2(const pixel* a, const pixel* b, int blocks,
+    int* sums)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    __m128i x;
+    __m128i y;
+    __m128i xl;
+    __m128i xh;
+    __m128i yl;
+    __m128i yh;
+    __m128i pairs[10];
+    __m128 lo;
+    __m128 hi;
+    int* sum;
+    int k = 0;
+    int n;
+
+    while (k + 4 <= blocks)
+    {
+        x = _mm_loadu_si128((const __m128i*)(a + k * 4));
+        y = _mm_loadu_si128((const __m128i*)(b + k * 4));
+        xl = _mm_unpacklo_epi8(x, zero);
+        xh = _mm_unpackhi_epi8(x, zero);
+        yl = _mm_unpacklo_epi8(y, zero);
+        yh = _mm_unpackhi_epi8(y, zero);
+        pairs[0] = _mm_madd_epi16(xl, one);
+        pairs[1] = _mm_madd_epi16(yl, one);
+        pairs[2] = _mm_madd_epi16(xl, xl);
+        pairs[3] = _mm_madd_epi16(yl, yl);
+        pairs[4] = _mm_madd_epi16(xl, yl);
+        pairs[5] = _mm_madd_epi16(xh, one);
+        pairs[6] = _mm_madd_epi16(yh, one);
+        pairs[7] = _mm_madd_epi16(xh, xh);
+        pairs[8] = _mm_madd_epi16(yh, yh);
+        pairs[9] = _mm_madd_epi16(xh, yh);
+        n = 0;
+        while (n < 5)
+        {
+            // the pairs of blocks 0 and 1 are in the first five, 2 and 3
+            // in the last five
+            lo = _mm_castsi128_ps(pairs[n]);
+            hi = _mm_castsi128_ps(pairs[n + 5]);
+            sum = sums + n * blocks + k;
+            _mm_storeu_si128((__m128i*)sum, _mm_add_epi32(
+                _mm_loadu_si128((const __m128i*)sum), _mm_add_epi32(
+                _mm_castps_si128(_mm_shuffle_ps(lo, hi, 0x88)),
+                _mm_castps_si128(_mm_shuffle_ps(lo, hi, 0xDD)))));
+            n++;
+        }
+        k += 4;
+    }
+    ssimBlocks(a, b, k, blocks, sums);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function makes a row half as wide like halveRowScalar, 8 values
+ * at a time with sse2. The two rows are added in 16 bits, a
+ * multiply-add by 1 adds each pair side by side, and the sums are
+ * rounded and packed back down to bytes.
+ *
+ * @param[in] top - the upper row, at least 2 * count values.
+ * @param[in] bottom - the lower row, at least 2 * count values.
+ * @param[out] half - the count averages.
+ * @param[in] count - the number of values to make.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   halveRowSse2(im.redGray[2 * i], im.redGray[2 * i + 1], half, cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void halveRowSse2(const pixel* top, const pixel* bottom,
+    pixel* half, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi32(2);
+    __m128i t;
+    __m128i b;
+    __m128i lo;
+    __m128i hi;
+    int j = 0;
+
+    while (j + 8 <= count)
+    {
+        t = _mm_loadu_si128((const __m128i*)(top + 2 * j));
+        b = _mm_loadu_si128((const __m128i*)(bottom + 2 * j));
+        lo = _mm_add_epi16(_mm_unpacklo_epi8(t, zero),
+            _mm_unpacklo_epi8(b, zero));
+        hi = _mm_add_epi16(_mm_unpackhi_epi8(t, zero),
+            _mm_unpackhi_epi8(b, zero));
+        lo = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(lo, one), two), 2);
+        hi = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(hi, one), two), 2);
+        lo = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64((__m128i*)(half + j), _mm_packus_epi16(lo, lo));
+        j += 8;
+    }
+    halveRowScalar(top + 2 * j, bottom + 2 * j, half + j, count - j);
+}
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function multiplies a row by a color matrix like matrixRowScalar,
+ * 16 pixels at a time with sse2. Red and green are paired up so one
+ * multiply-add does both of their weights, and blue is paired with 0.
+ * Packing with saturation does the clamp to 0 to 255.
+ *
+ * @param[in,out] red - the red values, which become the first output.
+ * @param[in,out] green - the green values, which become the second.
+ * @param[in,out] blue - the blue values, which become the third.
+ * @param[in] count - the number of pixels.
+ * @param[in] matrix - the weights and offset of each output, in order.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   matrixRowSse2(im.redGray[i], im.green[i], im.blue[i], im.cols,
+       change.matrix);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void matrixRowSse2(pixel* red, pixel* green, pixel* blue,
+    int count, const int* matrix)
+{
+    const __m128i zero = _mm_setzero_si128();
+    pixel* planes[3] = { red, green, blue };
+    __m128i weightRG[3];
+    __m128i weightB[3];
+    __m128i offset[3];
+    __m128i in[3];
+    __m128i rg[4];
+    __m128i b0[4];
+    __m128i sum[4];
+    __m128i out[3];
+    __m128i lo;
+    __m128i hi;
+    int j = 0;
+    int c = 0;
+    int k;
+
+    while (c < 3)
+    {
+        weightRG[c] = _mm_unpacklo_epi16(
+            _mm_set1_epi16((short)matrix[4 * c]),
+            _mm_set1_epi16((short)matrix[4 * c + 1]));
+        weightB[c] = _mm_unpacklo_epi16(
+            _mm_set1_epi16((short)matrix[4 * c + 2]), zero);
+        offset[c] = _mm_set1_epi32(matrix[4 * c + 3]);
+        c++;
+    }
+    while (j + 16 <= count)
+    {
+        c = 0;
+        while (c < 3)
+        {
+            in[c] = _mm_loadu_si128((const __m128i*)(planes[c] + j));
+            c++;
+        }
+
+        // pairs of red and green, and of blue and 0, 4 pixels to each
+        lo = _mm_unpacklo_epi8(in[0], zero);
+        hi = _mm_unpacklo_epi8(in[1], zero);
+        rg[0] = _mm_unpacklo_epi16(lo, hi);
+        rg[1] = _mm_unpackhi_epi16(lo, hi);
+        lo = _mm_unpackhi_epi8(in[0], zero);
+        hi = _mm_unpackhi_epi8(in[1], zero);
+        rg[2] = _mm_unpacklo_epi16(lo, hi);
+        rg[3] = _mm_unpackhi_epi16(lo, hi);
+        lo = _mm_unpacklo_epi8(in[2], zero);
+        hi = _mm_unpackhi_epi8(in[2], zero);
+        b0[0] = _mm_unpacklo_epi16(lo, zero);
+        b0[1] = _mm_unpackhi_epi16(lo, zero);
+        b0[2] = _mm_unpacklo_epi16(hi, zero);
+        b0[3] = _mm_unpackhi_epi16(hi, zero);
+
+        c = 0;
+        while (c < 3)
+        {
+            k = 0;
+            while (k < 4)
+            {
+                sum[k] = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(
+                    _mm_madd_epi16(rg[k], weightRG[c]),
+                    _mm_madd_epi16(b0[k], weightB[c])), offset[c]), 13);
+                k++;
+            }
+            out[c] = _mm_packus_epi16(_mm_packs_epi32(sum[0], sum[1]),
+                _mm_packs_epi32(sum[2], sum[3]));
+            c++;
+        }
+        c = 0;
+        while (c < 3)
+        {
+            _mm_storeu_si128((__m128i*)(planes[c] + j), out[c]);
+            c++;
+        }
+        j += 16;
+    }
+    matrixRowScalar(red + j, green + j, blue + j, count - j, matrix);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds the medians of a row like medianRowScalar, 16
+ * pixels at a time with sse2. Each value of the window is a vector of
+ * 16 neighbors, so the same network gives 16 medians.
+ *
+ * @param[in] rows - the size rows of the window, each readable size / 2
+ *                   pixels before the first and past the last pixel.
+ * @param[in] size - 3 or 5.
+ * @param[out] out - the medians.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   medianRowSse2(window, 5, im.redGray[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void medianRowSse2(const pixel* const* rows, int size, pixel* out,
+    int count)
+{
+    const unsigned char (*network)[2] = size == 3 ? MEDIAN9_NETWORK :
+        MEDIAN25_NETWORK;
+    int pairs = size == 3 ? 19 : 99;
+    int half = size / 2;
+    const pixel* rest[5];
+    __m128i v[25];
+    __m128i low;
+    int j = 0;
+    int i;
+    int k;
+    int a;
+    int b;
+
+    while (j + 16 <= count)
+    {
+        i = 0;
+        while (i < size)
+        {
+            k = 0;
+            while (k < size)
+            {
+                v[i * size + k] = _mm_loadu_si128((const __m128i*)(rows[i] +
+                    j + k - half));
+                k++;
+            }
+            i++;
+        }
+        k = 0;
+        while (k < pairs)
+        {
+            a = network[k][0];
+            b = network[k][1];
+            low = _mm_min_epu8(v[a], v[b]);
+            v[b] = _mm_max_epu8(v[a], v[b]);
+            v[a] = low;
+            k++;
+        }
+        _mm_storeu_si128((__m128i*)(out + j), v[size * size / 2]);
+        j += 16;
+    }
+    i = 0;
+    while (i < size)
+    {
+        rest[i] = rows[i] + j;
+        i++;
+    }
+    medianRowScalar(rest, size, out + j, count - j);
+}
+
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reverses a row 16 pixels at a time from both ends,
+ * using a byte shuffle (ssse3, part of the sse4.2 level) to reverse
+ * each block.
+ *
+ * @param[in,out] row - the row to reverse.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   reverseRowSse42(im.redGray[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_SSE42 static void reverseRowSse42(pixel* row, int count)
+{
+    const __m128i mask = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7,
+        6, 5, 4, 3, 2, 1, 0);
+    __m128i x;
+    __m128i y;
+    int lo = 0;
+    int hi = count;
+
+    while (hi - lo >= 32)
+    {
+        x = _mm_loadu_si128((const __m128i*)(row + lo));
+        y = _mm_loadu_si128((const __m128i*)(row + hi - 16));
+        _mm_storeu_si128((__m128i*)(row + lo), _mm_shuffle_epi8(y, mask));
+        _mm_storeu_si128((__m128i*)(row + hi - 16),
+            _mm_shuffle_epi8(x, mask));
+        lo += 16;
+        hi -= 16;
+    }
+    reverseRowScalar(row + lo, hi - lo);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function splits interleaved rgb into three arrays 16 pixels at
+ * a time. Each color is gathered out of the three 16 byte blocks with
+ * byte shuffles and or'd together.
+ *
+ * @param[in] rgb - the interleaved row.
+ * @param[out] red - the red values.
+ * @param[out] green - the green values.
+ * @param[out] blue - the blue values.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   splitRowSse42(line, im.redGray[i], im.green[i], im.blue[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_SSE42 static void splitRowSse42(const pixel* rgb, pixel* red,
+    pixel* green, pixel* blue, int count)
+{
+    // mask[c][v] picks the bytes of color c out of block v
+    const __m128i mask[3][3] = {
+        { _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1),
+          _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1,
+            -1, -1, -1),
+          _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4,
+            7, 10, 13) },
+        { _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1),
+          _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1,
+            -1, -1, -1),
+          _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5,
+            8, 11, 14) },
+        { _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1),
+          _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1,
+            -1, -1, -1),
+          _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6,
+            9, 12, 15) } };
+    pixel* planes[3] = { red, green, blue };
+    __m128i block[3];
+    int j = 0;
+    int c;
+
+    while (j + 16 <= count)
+    {
+        block[0] = _mm_loadu_si128((const __m128i*)(rgb + j * 3));
+        block[1] = _mm_loadu_si128((const __m128i*)(rgb + j * 3 + 16));
+        block[2] = _mm_loadu_si128((const __m128i*)(rgb + j * 3 + 32));
+        c = 0;
+        while (c < 3)
+        {
+            _mm_storeu_si128((__m128i*)(planes[c] + j), _mm_or_si128(
+                _mm_or_si128(_mm_shuffle_epi8(block[0], mask[c][0]),
+                _mm_shuffle_epi8(block[1], mask[c][1])),
+                _mm_shuffle_epi8(block[2], mask[c][2])));
+            c++;
+        }
+        j += 16;
+    }
+    splitRowScalar(rgb + j * 3, red + j, green + j, blue + j, count - j);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function joins three arrays into interleaved rgb 16 pixels at a
+ * time, building each 16 byte block out of byte shuffles of the three
+ * colors.
+ *
+ * @param[in] red - the red values.
+ * @param[in] green - the green values.
+ * @param[in] blue - the blue values.
+ * @param[out] rgb - the interleaved row.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   joinRowSse42(im.redGray[i], im.green[i], im.blue[i], line, im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_SSE42 static void joinRowSse42(const pixel* red, const pixel* green,
+    const pixel* blue, pixel* rgb, int count)
+{
+    // mask[v][c] places the bytes of color c in block v
+    const __m128i mask[3][3] = {
+        { _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1,
+            -1, 5),
+          _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4,
+            -1, -1),
+          _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1,
+            4, -1) },
+        { _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1,
+            10, -1),
+          _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1,
+            -1, 10),
+          _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9,
+            -1, -1) },
+        { _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1,
+            15, -1, -1),
+          _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1,
+            -1, 15, -1),
+          _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14,
+            -1, -1, 15) } };
+    __m128i color[3];
+    int j = 0;
+    int v;
+
+    while (j + 16 <= count)
+    {
+        color[0] = _mm_loadu_si128((const __m128i*)(red + j));
+        color[1] = _mm_loadu_si128((const __m128i*)(green + j));
+        color[2] = _mm_loadu_si128((const __m128i*)(blue + j));
+        v = 0;
+        while (v < 3)
+        {
+            _mm_storeu_si128((__m128i*)(rgb + j * 3 + v * 16), _mm_or_si128(
+                _mm_or_si128(_mm_shuffle_epi8(color[0], mask[v][0]),
+                _mm_shuffle_epi8(color[1], mask[v][1])),
+                _mm_shuffle_epi8(color[2], mask[v][2])));
+            v++;
+        }
+        j += 16;
+    }
+    joinRowScalar(red + j, green + j, blue + j, rgb + j * 3, count - j);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function packs a row into bits like packRowSse2, with a single
+ * shuffle to reverse each group of 8 pixels.
+ *
+ * @param[in] gray - the gray values.
+ * @param[in] count - the number of pixels.
+ * @param[out] bits - room for (count + 7) / 8 bytes.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   packRowSse42(im.redGray[i], im.cols, bits);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_SSE42 static void packRowSse42(const pixel* gray, int count,
+    pixel* bits)
+{
+    const __m128i order = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14,
+        13, 12, 11, 10, 9, 8);
+    __m128i v;
+    int mask;
+    int j = 0;
+
+    while (j + 16 <= count)
+    {
+        v = _mm_loadu_si128((const __m128i*)(gray + j));
+        mask = ~_mm_movemask_epi8(_mm_shuffle_epi8(v, order));
+        bits[j / 8] = (pixel)mask;
+        bits[j / 8 + 1] = (pixel)(mask >> 8);
+        j += 16;
+    }
+    packRowScalar(gray + j, count - j, bits + j / 8);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function grayscales a row like grayRowScalar, 8 pixels at a time
+ * with avx2, in doubles in the same order so the result is the same.
+ *
+ * @param[in,out] red - the red values, which become the gray values.
+ * @param[in] green - the green values.
+ * @param[in] blue - the blue values.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   grayRowAvx2(im.redGray[i], im.green[i], im.blue[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static void grayRowAvx2(pixel* red, const pixel* green,
+    const pixel* blue, int count)
+{
+    const __m256d kr = _mm256_set1_pd(.3);
+    const __m256d kg = _mm256_set1_pd(.6);
+    const __m256d kb = _mm256_set1_pd(.1);
+    const pixel* src[3] = { red, green, blue };
+    __m256i in;
+    __m256d lo[3];
+    __m256d hi[3];
+    __m128i sum;
+    int j = 0;
+    int c;
+
+    while (j + 8 <= count)
+    {
+        c = 0;
+        while (c < 3)
+        {
+            in = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64((const __m128i*)(src[c] + j)));
+            lo[c] = _mm256_cvtepi32_pd(_mm256_castsi256_si128(in));
+            hi[c] = _mm256_cvtepi32_pd(_mm256_extracti128_si256(in, 1));
+            c++;
+        }
+        sum = _mm_packs_epi32(
+            _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_add_pd(
+                _mm256_mul_pd(kr, lo[0]), _mm256_mul_pd(kg, lo[1])),
+                _mm256_mul_pd(kb, lo[2]))),
+            _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_add_pd(
+                _mm256_mul_pd(kr, hi[0]), _mm256_mul_pd(kg, hi[1])),
+                _mm256_mul_pd(kb, hi[2]))));
+        _mm_storel_epi64((__m128i*)(red + j), _mm_packus_epi16(sum, sum));
+        j += 8;
+    }
+    grayRowScalar(red + j, green + j, blue + j, count - j);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function sepia tones a row like sepiaRowScalar, 8 pixels at a
+ * time with avx2.
+ *
+ * @param[in,out] red - the red values.
+ * @param[in,out] green - the green values.
+ * @param[in,out] blue - the blue values.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   sepiaRowAvx2(im.redGray[i], im.green[i], im.blue[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static void sepiaRowAvx2(pixel* red, pixel* green,
+    pixel* blue, int count)
+{
+    static const double weight[3][3] = { { 0.393, 0.769, 0.189 },
+        { 0.349, 0.686, 0.168 }, { 0.272, 0.534, 0.131 } };
+    pixel* planes[3] = { red, green, blue };
+    __m256i in;
+    __m256d lo[3];
+    __m256d hi[3];
+    __m128i sum[3];
+    int j = 0;
+    int c;
+
+    while (j + 8 <= count)
+    {
+        c = 0;
+        while (c < 3)
+        {
+            in = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64((const __m128i*)(planes[c] + j)));
+            lo[c] = _mm256_cvtepi32_pd(_mm256_castsi256_si128(in));
+            hi[c] = _mm256_cvtepi32_pd(_mm256_extracti128_si256(in, 1));
+            c++;
+        }
+        c = 0;
+        while (c < 3)
+        {
+            __m256d kr = _mm256_set1_pd(weight[c][0]);
+            __m256d kg = _mm256_set1_pd(weight[c][1]);
+            __m256d kb = _mm256_set1_pd(weight[c][2]);
+
+            sum[c] = _mm_packs_epi32(
+                _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_add_pd(
+                    _mm256_mul_pd(kr, lo[0]), _mm256_mul_pd(kg, lo[1])),
+                    _mm256_mul_pd(kb, lo[2]))),
+                _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_add_pd(
+                    _mm256_mul_pd(kr, hi[0]), _mm256_mul_pd(kg, hi[1])),
+                    _mm256_mul_pd(kb, hi[2]))));
+            c++;
+        }
+        c = 0;
+        while (c < 3)
+        {
+            _mm_storel_epi64((__m128i*)(planes[c] + j),
+                _mm_packus_epi16(sum[c], sum[c]));
+            c++;
+        }
+        j += 8;
+    }
+    sepiaRowScalar(red + j, green + j, blue + j, count - j);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reverses a row 32 pixels at a time from both ends with
+ * avx2: a byte shuffle reverses each half and a lane swap puts the
+ * halves in order.
+ *
+ * @param[in,out] row - the row to reverse.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   reverseRowAvx2(im.redGray[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static void reverseRowAvx2(pixel* row, int count)
+{
+    const __m256i mask = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4,
+        3, 2, 1, 0);
+    __m256i x;
+    __m256i y;
+    int lo = 0;
+    int hi = count;
+
+    while (hi - lo >= 64)
+    {
+        x = _mm256_loadu_si256((const __m256i*)(row + lo));
+        y = _mm256_loadu_si256((const __m256i*)(row + hi - 32));
+        x = _mm256_shuffle_epi8(x, mask);
+        y = _mm256_shuffle_epi8(y, mask);
+        _mm256_storeu_si256((__m256i*)(row + lo),
+            _mm256_permute2x128_si256(y, y, 1));
+        _mm256_storeu_si256((__m256i*)(row + hi - 32),
+            _mm256_permute2x128_si256(x, x, 1));
+        lo += 32;
+        hi -= 32;
+    }
+    reverseRowScalar(row + lo, hi - lo);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function swaps the pixels of two rows 32 at a time with avx2.
+ *
+ * @param[in,out] a - the first row.
+ * @param[in,out] b - the second row.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   swapRowsAvx2(im.redGray[0], im.redGray[im.rows - 1], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static void swapRowsAvx2(pixel* a, pixel* b, int count)
+{
+    __m256i x;
+    __m256i y;
+    int j = 0;
+
+    while (j + 32 <= count)
+    {
+        x = _mm256_loadu_si256((const __m256i*)(a + j));
+        y = _mm256_loadu_si256((const __m256i*)(b + j));
+        _mm256_storeu_si256((__m256i*)(a + j), y);
+        _mm256_storeu_si256((__m256i*)(b + j), x);
+        j += 32;
+    }
+    swapRowsScalar(a + j, b + j, count - j);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function packs a row into bits like packRowSse42, 32 pixels at a
+ * time with avx2.
+ *
+ * @param[in] gray - the gray values.
+ * @param[in] count - the number of pixels.
+ * @param[out] bits - room for (count + 7) / 8 bytes.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   packRowAvx2(im.redGray[i], im.cols, bits);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static void packRowAvx2(const pixel* gray, int count,
+    pixel* bits)
+{
+    const __m256i order = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14,
+        13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11,
+        10, 9, 8);
+    __m256i v;
+    unsigned int mask;
+    int j = 0;
+
+    while (j + 32 <= count)
+    {
+        v = _mm256_loadu_si256((const __m256i*)(gray + j));
+        mask = ~(unsigned int)_mm256_movemask_epi8(
+            _mm256_shuffle_epi8(v, order));
+        memcpy(bits + j / 8, &mask, 4);
+        j += 32;
+    }
+    packRowScalar(gray + j, count - j, bits + j / 8);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function divides 16 16-bit values by 255 with avx2, like
+ * divide255Sse2.
+ *
+ * @param[in] t - the values.
+ *
+ * @returns the values divided by 255
+ *
+ * @par Example:
+   @verbatim
+   __m256i half = divide255Avx2(_mm256_set1_epi16(255 * 128));
+
+   every value of half is now 128.
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static inline __m256i divide255Avx2(__m256i t)
+{
+    t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)),
+        8);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function blends a row like blendRowSse2, 32 values at a time with
+ * avx2. The unpacks and the pack both work within each 16-byte half, so
+ * the values come back out in the order they went in.
+ *
+ * @param[in,out] a - the first image's values, which become the blend.
+ * @param[in] b - the second image's values.
+ * @param[in] count - the number of values.
+ * @param[in] mode - how to blend them.
+ * @param[in] weight - for BLEND_ALPHA, how much of b, 0 to 255.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   blendRowAvx2(im.redGray[i], other.redGray[i], im.cols, BLEND_SCREEN,
+       0);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static void blendRowAvx2(pixel* a, const pixel* b, int count,
+    blendMode mode, int weight)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi8(-1);
+    const __m256i wa = _mm256_set1_epi16((short)(255 - weight));
+    const __m256i wb = _mm256_set1_epi16((short)weight);
+    __m256i x;
+    __m256i y;
+    __m256i lo;
+    __m256i hi;
+    int j = 0;
+
+    while (j + 32 <= count)
+    {
+        x = _mm256_loadu_si256((const __m256i*)(a + j));
+        y = _mm256_loadu_si256((const __m256i*)(b + j));
+        if (mode == BLEND_ADD)
+        {
+            x = _mm256_adds_epu8(x, y);
+        }
+        else if (mode == BLEND_SUBTRACT)
+        {
+            x = _mm256_subs_epu8(x, y);
+        }
+        else if (mode == BLEND_DIFFERENCE)
+        {
+            x = _mm256_or_si256(_mm256_subs_epu8(x, y),
+                _mm256_subs_epu8(y, x));
+        }
+        else
+        {
+            if (mode == BLEND_SCREEN)
+            {
+                x = _mm256_xor_si256(x, ones);
+                y = _mm256_xor_si256(y, ones);
+            }
+            if (mode == BLEND_ALPHA)
+            {
+                lo = _mm256_add_epi16(
+                    _mm256_mullo_epi16(_mm256_unpacklo_epi8(x, zero), wa),
+                    _mm256_mullo_epi16(_mm256_unpacklo_epi8(y, zero), wb));
+                hi = _mm256_add_epi16(
+                    _mm256_mullo_epi16(_mm256_unpackhi_epi8(x, zero), wa),
+                    _mm256_mullo_epi16(_mm256_unpackhi_epi8(y, zero), wb));
+            }
+            else
+            {
+                lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(x, zero),
+                    _mm256_unpacklo_epi8(y, zero));
+                hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(x, zero),
+                    _mm256_unpackhi_epi8(y, zero));
+            }
+            x = _mm256_packus_epi16(divide255Avx2(lo), divide255Avx2(hi));
+            if (mode == BLEND_SCREEN)
+            {
+                x = _mm256_xor_si256(x, ones);
+            }
+        }
+        _mm256_storeu_si256((__m256i*)(a + j), x);
+        j += 32;
+    }
+    blendRowScalar(a + j, b + j, count - j, mode, weight);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds how far apart two rows are like diffRowSse2, 32
+ * values at a time with avx2.
+ *
+ * @param[in] a - the first image's values.
+ * @param[in] b - the second image's values.
+ * @param[in,out] far - the biggest difference so far at each pixel.
+ * @param[in] count - the number of values.
+ *
+ * @returns the sum of the squares of the differences
+ *
+ * @par Example:
+   @verbatim
+   squared += diffRowAvx2(im.redGray[i], other.redGray[i], far, im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static long long diffRowAvx2(const pixel* a, const pixel* b,
+    pixel* far, int count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i total = _mm256_setzero_si256();
+    __m256i x;
+    __m256i y;
+    __m256i d;
+    __m256i lo;
+    __m256i hi;
+    long long lanes[4];
+    int j = 0;
+
+    while (j + 32 <= count)
+    {
+        x = _mm256_loadu_si256((const __m256i*)(a + j));
+        y = _mm256_loadu_si256((const __m256i*)(b + j));
+        d = _mm256_or_si256(_mm256_subs_epu8(x, y), _mm256_subs_epu8(y, x));
+        _mm256_storeu_si256((__m256i*)(far + j), _mm256_max_epu8(d,
+            _mm256_loadu_si256((const __m256i*)(far + j))));
+        lo = _mm256_unpacklo_epi8(d, zero);
+        hi = _mm256_unpackhi_epi8(d, zero);
+        d = _mm256_add_epi32(_mm256_madd_epi16(lo, lo),
+            _mm256_madd_epi16(hi, hi));
+        total = _mm256_add_epi64(total, _mm256_add_epi64(
+            _mm256_unpacklo_epi32(d, zero), _mm256_unpackhi_epi32(d, zero)));
+        j += 32;
+    }
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+        diffRowScalar(a + j, b + j, far + j, count - j);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function adds a row into the ssim sums of its blocks like
+ * ssimRowSse2, 8 blocks at a time with avx2. The unpacks work within
+ * each 16-byte half, so each half holds 4 blocks in order and the
+ * shuffle that adds the pairs keeps them that way.
+ *
+ * @param[in] a - the first image's values.
+ * @param[in] b - the second image's values.
+ * @param[in] blocks - the number of blocks, 4 values each.
+ * @param[in,out] sums - 5 * blocks sums to add into.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ssimRowAvx2(im.redGray[i], other.redGray[i], im.cols / 4, sums);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static void ssimRowAvx2(const pixel* a, const pixel* b,
+    int blocks, int* sums)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    __m256i x;
+    __m256i y;
+    __m256i xl;
+    __m256i xh;
+    __m256i yl;
+    __m256i yh;
+    __m256i pairs[10];
+    __m256 lo;
+    __m256 hi;
+    int* sum;
+    int k = 0;
+    int n;
+
+    while (k + 8 <= blocks)
+    {
+        x = _mm256_loadu_si256((const __m256i*)(a + k * 4));
+        y = _mm256_loadu_si256((const __m256i*)(b + k * 4));
+        xl = _mm256_unpacklo_epi8(x, zero);
+        xh = _mm256_unpackhi_epi8(x, zero);
+        yl = _mm256_unpacklo_epi8(y, zero);
+        yh = _mm256_unpackhi_epi8(y, zero);
+        pairs[0] = _mm256_madd_epi16(xl, one);
+        pairs[1] = _mm256_madd_epi16(yl, one);
+        pairs[2] = _mm256_madd_epi16(xl, xl);
+        pairs[3] = _mm256_madd_epi16(yl, yl);
+        pairs[4] = _mm256_madd_epi16(xl, yl);
+        pairs[5] = _mm256_madd_epi16(xh, one);
+        pairs[6] = _mm256_madd_epi16(yh, one);
+        pairs[7] = _mm256_madd_epi16(xh, xh);
+        pairs[8] = _mm256_madd_epi16(yh, yh);
+        pairs[9] = _mm256_madd_epi16(xh, yh);
+        n = 0;
+        while (n < 5)
+        {
+            lo = _mm256_castsi256_ps(pairs[n]);
+            hi = _mm256_castsi256_ps(pairs[n + 5]);
+            sum = sums + n * blocks + k;
+            _mm256_storeu_si256((__m256i*)sum, _mm256_add_epi32(
+                _mm256_loadu_si256((const __m256i*)sum), _mm256_add_epi32(
+                _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, 0x88)),
+                _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, 0xDD)))));
+            n++;
+        }
+        k += 8;
+    }
+    ssimBlocks(a, b, k, blocks, sums);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function makes a row half as wide like halveRowSse2, 16 values
+ * at a time with avx2. The packs work within each 16-byte half, so the
+ * two 8-byte runs of averages are pulled together before the store.
+ *
+ * @param[in] top - the upper row, at least 2 * count values.
+ * @param[in] bottom - the lower row, at least 2 * count values.
+ * @param[out] half - the count averages.
+ * @param[in] count - the number of values to make.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   halveRowAvx2(im.redGray[2 * i], im.redGray[2 * i + 1], half, cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static void halveRowAvx2(const pixel* top, const pixel* bottom,
+    pixel* half, int count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    __m256i t;
+    __m256i b;
+    __m256i lo;
+    __m256i hi;
+    int j = 0;
+
+    while (j + 16 <= count)
+    {
+        t = _mm256_loadu_si256((const __m256i*)(top + 2 * j));
+        b = _mm256_loadu_si256((const __m256i*)(bottom + 2 * j));
+        lo = _mm256_add_epi16(_mm256_unpacklo_epi8(t, zero),
+            _mm256_unpacklo_epi8(b, zero));
+        hi = _mm256_add_epi16(_mm256_unpackhi_epi8(t, zero),
+            _mm256_unpackhi_epi8(b, zero));
+        lo = _mm256_srli_epi32(_mm256_add_epi32(
+            _mm256_madd_epi16(lo, one), two), 2);
+        hi = _mm256_srli_epi32(_mm256_add_epi32(
+            _mm256_madd_epi16(hi, one), two), 2);
+        lo = _mm256_packs_epi32(lo, hi);
+        lo = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, lo), 0x08);
+        _mm_storeu_si128((__m128i*)(half + j),
+            _mm256_castsi256_si128(lo));
+        j += 16;
+    }
+    halveRowScalar(top + 2 * j, bottom + 2 * j, half + j, count - j);
+}
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function multiplies a row by a color matrix like matrixRowSse2,
+ * 32 pixels at a time with avx2. The unpacks and packs both work within
+ * each 16 byte lane, so the pixels come out in the order they went in.
+ *
+ * @param[in,out] red - the red values, which become the first output.
+ * @param[in,out] green - the green values, which become the second.
+ * @param[in,out] blue - the blue values, which become the third.
+ * @param[in] count - the number of pixels.
+ * @param[in] matrix - the weights and offset of each output, in order.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   matrixRowAvx2(im.redGray[i], im.green[i], im.blue[i], im.cols,
+       change.matrix);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static void matrixRowAvx2(pixel* red, pixel* green,
+    pixel* blue, int count, const int* matrix)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    pixel* planes[3] = { red, green, blue };
+    __m256i weightRG[3];
+    __m256i weightB[3];
+    __m256i offset[3];
+    __m256i in[3];
+    __m256i rg[4];
+    __m256i b0[4];
+    __m256i sum[4];
+    __m256i out[3];
+    __m256i lo;
+    __m256i hi;
+    int j = 0;
+    int c = 0;
+    int k;
+
+    while (c < 3)
+    {
+        weightRG[c] = _mm256_unpacklo_epi16(
+            _mm256_set1_epi16((short)matrix[4 * c]),
+            _mm256_set1_epi16((short)matrix[4 * c + 1]));
+        weightB[c] = _mm256_unpacklo_epi16(
+            _mm256_set1_epi16((short)matrix[4 * c + 2]), zero);
+        offset[c] = _mm256_set1_epi32(matrix[4 * c + 3]);
+        c++;
+    }
+    while (j + 32 <= count)
+    {
+        c = 0;
+        while (c < 3)
+        {
+            in[c] = _mm256_loadu_si256((const __m256i*)(planes[c] + j));
+            c++;
+        }
+        lo = _mm256_unpacklo_epi8(in[0], zero);
+        hi = _mm256_unpacklo_epi8(in[1], zero);
+        rg[0] = _mm256_unpacklo_epi16(lo, hi);
+        rg[1] = _mm256_unpackhi_epi16(lo, hi);
+        lo = _mm256_unpackhi_epi8(in[0], zero);
+        hi = _mm256_unpackhi_epi8(in[1], zero);
+        rg[2] = _mm256_unpacklo_epi16(lo, hi);
+        rg[3] = _mm256_unpackhi_epi16(lo, hi);
+        lo = _mm256_unpacklo_epi8(in[2], zero);
+        hi = _mm256_unpackhi_epi8(in[2], zero);
+        b0[0] = _mm256_unpacklo_epi16(lo, zero);
+        b0[1] = _mm256_unpackhi_epi16(lo, zero);
+        b0[2] = _mm256_unpacklo_epi16(hi, zero);
+        b0[3] = _mm256_unpackhi_epi16(hi, zero);
+
+        c = 0;
+        while (c < 3)
+        {
+            k = 0;
+            while (k < 4)
+            {
+                sum[k] = _mm256_srai_epi32(_mm256_add_epi32(
+                    _mm256_add_epi32(_mm256_madd_epi16(rg[k], weightRG[c]),
+                    _mm256_madd_epi16(b0[k], weightB[c])), offset[c]), 13);
+                k++;
+            }
+            out[c] = _mm256_packus_epi16(
+                _mm256_packs_epi32(sum[0], sum[1]),
+                _mm256_packs_epi32(sum[2], sum[3]));
+            c++;
+        }
+        c = 0;
+        while (c < 3)
+        {
+            _mm256_storeu_si256((__m256i*)(planes[c] + j), out[c]);
+            c++;
+        }
+        j += 32;
+    }
+    matrixRowScalar(red + j, green + j, blue + j, count - j, matrix);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function divides whole numbers below 2^23 by whole numbers up to
+ * 4095, 8 at a time, in floats. The quotient is rounded right and is
+ * never within 2^-12 of the next whole number unless it is one, so
+ * cutting off the fraction gives the same value as dividing ints.
+ *
+ * @param[in] n - the numbers to divide.
+ * @param[in] d - what to divide them by.
+ *
+ * @returns the quotients, cut toward 0
+ *
+ * @par Example:
+   @verbatim
+   __m256i q = quotientAvx2(_mm256_set1_epi32(-7),
+       _mm256_set1_epi32(2));
+
+   q is now 8 of -3.
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static inline __m256i quotientAvx2(__m256i n, __m256i d)
+{
+    return _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(n),
+        _mm256_cvtepi32_ps(d)));
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function converts a row between rgb and hsv or hsl, or changes
+ * its hue, saturation and value, like hsvRowScalar, 8 pixels at a time
+ * with avx2. Each pixel is worked on in a 32 bit lane, the choices by
+ * which color is most or which sector the hue is in are made with
+ * masks, and the divisions are done in floats, which give the same
+ * values as the ints of hsvRowScalar.
+ *
+ * @param[in,out] red - the red or hue values.
+ * @param[in,out] green - the green or saturation values.
+ * @param[in,out] blue - the blue or value or lightness values.
+ * @param[in] count - the number of pixels.
+ * @param[in] change - what to do, and by how much.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   hsvRowAvx2(im.redGray[i], im.green[i], im.blue[i], im.cols, change);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static void hsvRowAvx2(pixel* red, pixel* green, pixel* blue,
+    int count, const colorChange& change)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i top = _mm256_set1_epi32(255);
+    const __m256i full = _mm256_set1_epi32(FULL_SATURATION);
+    const __m256i sector = _mm256_set1_epi32(HUE_SECTOR);
+    const __m256i turn = _mm256_set1_epi32(HUE_TURN);
+    const __m256i step = _mm256_set1_epi32(HUE_TURN / 256);
+    bool lightness = change.mode == COLOR_TO_HSL ||
+        change.mode == COLOR_FROM_HSL;
+    bool fromPlanes = change.mode == COLOR_FROM_HSV ||
+        change.mode == COLOR_FROM_HSL;
+    pixel* planes[3] = { red, green, blue };
+    __m256i color[3];
+    __m256i inSector[6];
+    __m256i most;
+    __m256i least;
+    __m256i chroma;
+    __m256i level;
+    __m256i span;
+    __m256i hue;
+    __m256i saturation;
+    __m256i start;
+    __m256i mask;
+    __m256i isRed;
+    __m256i x;
+    __m256i base;
+    __m128i packed;
+    int j = 0;
+    int c;
+
+    while (j + 8 <= count)
+    {
+        c = 0;
+        while (c < 3)
+        {
+            color[c] = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64((const __m128i*)(planes[c] + j)));
+            c++;
+        }
+        if (fromPlanes)
+        {
+            hue = _mm256_mullo_epi32(color[0], step);
+            saturation = quotientAvx2(_mm256_add_epi32(
+                _mm256_mullo_epi32(color[1], full), _mm256_set1_epi32(127)),
+                top);
+            level = lightness ? _mm256_slli_epi32(color[2], 1) : color[2];
+        }
+        else
+        {
+            most = _mm256_max_epi32(color[0],
+                _mm256_max_epi32(color[1], color[2]));
+            least = _mm256_min_epi32(color[0],
+                _mm256_min_epi32(color[1], color[2]));
+            chroma = _mm256_sub_epi32(most, least);
+            level = lightness ? _mm256_add_epi32(most, least) : most;
+            span = lightness ? _mm256_sub_epi32(top, _mm256_abs_epi32(
+                _mm256_sub_epi32(level, top))) : most;
+            saturation = quotientAvx2(_mm256_add_epi32(
+                _mm256_mullo_epi32(chroma, full),
+                _mm256_srli_epi32(span, 1)), span);
+
+            // the hue starts at whichever color is most, red first, then
+            // green, then blue
+            isRed = _mm256_cmpeq_epi32(most, color[0]);
+            mask = _mm256_andnot_si256(isRed,
+                _mm256_cmpeq_epi32(most, color[1]));
+            x = _mm256_blendv_epi8(
+                _mm256_sub_epi32(color[0], color[1]),
+                _mm256_sub_epi32(color[2], color[0]), mask);
+            x = _mm256_blendv_epi8(x,
+                _mm256_sub_epi32(color[1], color[2]), isRed);
+            start = _mm256_blendv_epi8(_mm256_set1_epi32(4 * HUE_SECTOR),
+                _mm256_set1_epi32(2 * HUE_SECTOR), mask);
+            start = _mm256_andnot_si256(isRed, start);
+            hue = _mm256_add_epi32(start, quotientAvx2(
+                _mm256_mullo_epi32(x, sector), chroma));
+            hue = _mm256_add_epi32(hue, _mm256_and_si256(
+                _mm256_cmpgt_epi32(zero, hue), turn));
+
+            // gray has no hue or saturation
+            mask = _mm256_cmpeq_epi32(chroma, zero);
+            hue = _mm256_andnot_si256(mask, hue);
+            saturation = _mm256_andnot_si256(mask, saturation);
+        }
+
+        if (change.mode == COLOR_ADJUST)
+        {
+            hue = _mm256_add_epi32(hue, _mm256_set1_epi32(change.hue));
+            hue = _mm256_sub_epi32(hue, _mm256_andnot_si256(
+                _mm256_cmpgt_epi32(turn, hue), turn));
+            saturation = _mm256_min_epi32(_mm256_srli_epi32(
+                _mm256_add_epi32(_mm256_mullo_epi32(saturation,
+                _mm256_set1_epi32(change.saturation)),
+                _mm256_set1_epi32(128)), 8), full);
+            level = _mm256_min_epi32(_mm256_srli_epi32(
+                _mm256_add_epi32(_mm256_mullo_epi32(level,
+                _mm256_set1_epi32(change.value)),
+                _mm256_set1_epi32(128)), 8), top);
+        }
+
+        if (change.mode == COLOR_TO_HSV || change.mode == COLOR_TO_HSL)
+        {
+            color[0] = _mm256_and_si256(quotientAvx2(_mm256_add_epi32(hue,
+                _mm256_set1_epi32(HUE_TURN / 512)), step), top);
+            color[1] = quotientAvx2(_mm256_add_epi32(
+                _mm256_mullo_epi32(saturation, top),
+                _mm256_set1_epi32(FULL_SATURATION / 2)), full);
+            color[2] = lightness ? _mm256_srli_epi32(
+                _mm256_add_epi32(level, one), 1) : level;
+        }
+        else
+        {
+            span = lightness ? _mm256_sub_epi32(top, _mm256_abs_epi32(
+                _mm256_sub_epi32(level, top))) : level;
+            chroma = quotientAvx2(_mm256_add_epi32(
+                _mm256_mullo_epi32(span, saturation),
+                _mm256_set1_epi32(FULL_SATURATION / 2)), full);
+            base = _mm256_sub_epi32(level, chroma);
+            base = lightness ? base : _mm256_slli_epi32(base, 1);
+
+            // x runs up over the even sectors and down over the odd ones
+            start = _mm256_srli_epi32(hue, 12);
+            x = _mm256_and_si256(hue, _mm256_set1_epi32(HUE_SECTOR - 1));
+            x = _mm256_blendv_epi8(x, _mm256_sub_epi32(sector, x),
+                _mm256_cmpeq_epi32(_mm256_and_si256(start, one), one));
+            x = _mm256_srli_epi32(_mm256_add_epi32(
+                _mm256_mullo_epi32(chroma, x),
+                _mm256_set1_epi32(HUE_SECTOR / 2)), 12);
+            c = 0;
+            while (c < 6)
+            {
+                inSector[c] = _mm256_cmpeq_epi32(start,
+                    _mm256_set1_epi32(c));
+                c++;
+            }
+
+            // red is the chroma in sectors 0 and 5 and x in 1 and 4,
+            // green and blue are the same two sectors on each time
+            c = 0;
+            while (c < 3)
+            {
+                color[c] = _mm256_or_si256(_mm256_and_si256(
+                    _mm256_or_si256(inSector[(2 * c + 6) % 6],
+                    inSector[(2 * c + 5) % 6]), chroma),
+                    _mm256_and_si256(_mm256_or_si256(
+                    inSector[(2 * c + 1) % 6], inSector[(2 * c + 4) % 6]),
+                    x));
+                c++;
+            }
+            c = 0;
+            while (c < 3)
+            {
+                color[c] = _mm256_srli_epi32(_mm256_add_epi32(
+                    _mm256_add_epi32(_mm256_slli_epi32(color[c], 1), base),
+                    one), 1);
+                c++;
+            }
+        }
+
+        c = 0;
+        while (c < 3)
+        {
+            packed = _mm_packs_epi32(_mm256_castsi256_si128(color[c]),
+                _mm256_extracti128_si256(color[c], 1));
+            _mm_storel_epi64((__m128i*)(planes[c] + j),
+                _mm_packus_epi16(packed, packed));
+            c++;
+        }
+        j += 8;
+    }
+    hsvRowScalar(red + j, green + j, blue + j, count - j, change);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds the medians of a row like medianRowSse2, 32 pixels
+ * at a time with avx2.
+ *
+ * @param[in] rows - the size rows of the window, each readable size / 2
+ *                   pixels before the first and past the last pixel.
+ * @param[in] size - 3 or 5.
+ * @param[out] out - the medians.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   medianRowAvx2(window, 5, im.redGray[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX2 static void medianRowAvx2(const pixel* const* rows, int size,
+    pixel* out, int count)
+{
+    const unsigned char (*network)[2] = size == 3 ? MEDIAN9_NETWORK :
+        MEDIAN25_NETWORK;
+    int pairs = size == 3 ? 19 : 99;
+    int half = size / 2;
+    const pixel* rest[5];
+    __m256i v[25];
+    __m256i low;
+    int j = 0;
+    int i;
+    int k;
+    int a;
+    int b;
+
+    while (j + 32 <= count)
+    {
+        i = 0;
+        while (i < size)
+        {
+            k = 0;
+            while (k < size)
+            {
+                v[i * size + k] = _mm256_loadu_si256((const __m256i*)(rows[i] +
+                    j + k - half));
+                k++;
+            }
+            i++;
+        }
+        k = 0;
+        while (k < pairs)
+        {
+            a = network[k][0];
+            b = network[k][1];
+            low = _mm256_min_epu8(v[a], v[b]);
+            v[b] = _mm256_max_epu8(v[a], v[b]);
+            v[a] = low;
+            k++;
+        }
+        _mm256_storeu_si256((__m256i*)(out + j), v[size * size / 2]);
+        j += 32;
+    }
+    i = 0;
+    while (i < size)
+    {
+        rest[i] = rows[i] + j;
+        i++;
+    }
+    medianRowScalar(rest, size, out + j, count - j);
+}
+
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reverses a row 64 pixels at a time from both ends with
+ * avx-512: a byte shuffle reverses each 16 byte lane and a lane shuffle
+ * puts the four lanes in reverse order.
+ *
+ * @param[in,out] row - the row to reverse.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   reverseRowAvx512(im.redGray[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX512 static void reverseRowAvx512(pixel* row, int count)
+{
+    static const pixel reverse[64] = { 15, 14, 13, 12, 11, 10, 9, 8, 7, 6,
+        5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2,
+        1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15,
+        14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+    const __m512i mask = _mm512_loadu_si512((const void*)reverse);
+    __m512i x;
+    __m512i y;
+    int lo = 0;
+    int hi = count;
+
+    while (hi - lo >= 128)
+    {
+        x = _mm512_loadu_si512((const void*)(row + lo));
+        y = _mm512_loadu_si512((const void*)(row + hi - 64));
+        x = _mm512_shuffle_epi8(x, mask);
+        y = _mm512_shuffle_epi8(y, mask);
+        _mm512_storeu_si512((void*)(row + lo),
+            _mm512_maskz_shuffle_i64x2(0xFF, y, y, 0x1B));
+        _mm512_storeu_si512((void*)(row + hi - 64),
+            _mm512_maskz_shuffle_i64x2(0xFF, x, x, 0x1B));
+        lo += 64;
+        hi -= 64;
+    }
+    reverseRowScalar(row + lo, hi - lo);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function swaps the pixels of two rows 64 at a time with avx-512.
+ *
+ * @param[in,out] a - the first row.
+ * @param[in,out] b - the second row.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   swapRowsAvx512(im.redGray[0], im.redGray[im.rows - 1], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX512 static void swapRowsAvx512(pixel* a, pixel* b, int count)
+{
+    __m512i x;
+    __m512i y;
+    int j = 0;
+
+    while (j + 64 <= count)
+    {
+        x = _mm512_loadu_si512((const void*)(a + j));
+        y = _mm512_loadu_si512((const void*)(b + j));
+        _mm512_storeu_si512((void*)(a + j), y);
+        _mm512_storeu_si512((void*)(b + j), x);
+        j += 64;
+    }
+    swapRowsScalar(a + j, b + j, count - j);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function packs a row into bits like packRowAvx2, 64 pixels at a
+ * time with avx-512, which hands back the top bits as a mask register.
+ *
+ * @param[in] gray - the gray values.
+ * @param[in] count - the number of pixels.
+ * @param[out] bits - room for (count + 7) / 8 bytes.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   packRowAvx512(im.redGray[i], im.cols, bits);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX512 static void packRowAvx512(const pixel* gray, int count,
+    pixel* bits)
+{
+    const __m512i order = _mm512_set_epi64(0x08090A0B0C0D0E0FLL,
+        0x0001020304050607LL, 0x08090A0B0C0D0E0FLL, 0x0001020304050607LL,
+        0x08090A0B0C0D0E0FLL, 0x0001020304050607LL, 0x08090A0B0C0D0E0FLL,
+        0x0001020304050607LL);
+    __m512i v;
+    unsigned long long mask;
+    int j = 0;
+
+    while (j + 64 <= count)
+    {
+        v = _mm512_loadu_si512((const void*)(gray + j));
+        mask = ~(unsigned long long)_mm512_movepi8_mask(
+            _mm512_shuffle_epi8(v, order));
+        memcpy(bits + j / 8, &mask, 8);
+        j += 64;
+    }
+    packRowScalar(gray + j, count - j, bits + j / 8);
+}
+
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds the medians of a row like medianRowAvx2, 64 pixels
+ * at a time with avx-512.
+ *
+ * @param[in] rows - the size rows of the window, each readable size / 2
+ *                   pixels before the first and past the last pixel.
+ * @param[in] size - 3 or 5.
+ * @param[out] out - the medians.
+ * @param[in] count - the number of pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   medianRowAvx512(window, 5, im.redGray[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+TARGET_AVX512 static void medianRowAvx512(const pixel* const* rows, int size,
+    pixel* out, int count)
+{
+    const unsigned char (*network)[2] = size == 3 ? MEDIAN9_NETWORK :
+        MEDIAN25_NETWORK;
+    int pairs = size == 3 ? 19 : 99;
+    int half = size / 2;
+    const pixel* rest[5];
+    __m512i v[25];
+    __m512i low;
+    int j = 0;
+    int i;
+    int k;
+    int a;
+    int b;
+
+    while (j + 64 <= count)
+    {
+        i = 0;
+        while (i < size)
+        {
+            k = 0;
+            while (k < size)
+            {
+                v[i * size + k] = _mm512_loadu_si512((const void*)(rows[i] +
+                    j + k - half));
+                k++;
+            }
+            i++;
+        }
+        k = 0;
+        while (k < pairs)
+        {
+            a = network[k][0];
+            b = network[k][1];
+            low = _mm512_min_epu8(v[a], v[b]);
+            v[b] = _mm512_max_epu8(v[a], v[b]);
+            v[a] = low;
+            k++;
+        }
+        _mm512_storeu_si512((void*)(out + j), v[size * size / 2]);
+        j += 64;
+    }
+    i = 0;
+    while (i < size)
+    {
+        rest[i] = rows[i] + j;
+        i++;
+    }
+    medianRowScalar(rest, size, out + j, count - j);
+}
+#endif
+
+
+
+/*!
+ * @brief KERNEL_TABLES the kernels for each isaLevel. A level without a
+ * faster version of a kernel uses the one from the level below it; the
+ * color math stays at 4 doubles wide since avx-512 would also bring in
+ * fused multiply-adds, which round differently.
+ */
+
+static const kernelTable KERNEL_TABLES[] = {
+    { "scalar", grayRowScalar, sepiaRowScalar, reverseRowScalar,
+      swapRowsScalar, transpose16Scalar, splitRowScalar, joinRowScalar,
+      formatValuesScalar, packRowScalar, blendRowScalar, diffRowScalar,
+      ssimRowScalar, halveRowScalar, matrixRowScalar, hsvRowScalar,
+      medianRowScalar },
+#ifdef NETPBM_SSE2
+    { "sse2", grayRowSse2, sepiaRowSse2, reverseRowScalar, swapRowsSse2,
+      transpose16Sse2, splitRowScalar, joinRowScalar,
+      formatValuesScalar, packRowSse2, blendRowSse2, diffRowSse2,
+      ssimRowSse2, halveRowSse2, matrixRowSse2, hsvRowScalar,
+      medianRowSse2 },
+    { "sse4.2", grayRowSse2, sepiaRowSse2, reverseRowSse42, swapRowsSse2,
+      transpose16Sse2, splitRowSse42, joinRowSse42, formatValuesScalar,
+      packRowSse42, blendRowSse2, diffRowSse2, ssimRowSse2,
+      halveRowSse2, matrixRowSse2, hsvRowScalar, medianRowSse2 },
+    { "avx2", grayRowAvx2, sepiaRowAvx2, reverseRowAvx2, swapRowsAvx2,
+      transpose16Sse2, splitRowSse42, joinRowSse42, formatValuesScalar,
+      packRowAvx2, blendRowAvx2, diffRowAvx2, ssimRowAvx2,
+      halveRowAvx2, matrixRowAvx2, hsvRowAvx2, medianRowAvx2 },
+    { "avx512", grayRowAvx2, sepiaRowAvx2, reverseRowAvx512,
+      swapRowsAvx512, transpose16Sse2, splitRowSse42, joinRowSse42,
+      formatValuesScalar, packRowAvx512, blendRowAvx2, diffRowAvx2,
+      ssimRowAvx2, halveRowAvx2, matrixRowAvx2, hsvRowAvx2,
+      medianRowAvx512 },
+#endif
+};
+
+/*!
+ * @brief activeKernels the kernels in use, picked the first time they
+ * are needed
+ */
+
+static atomic<const kernelTable*> activeKernels(nullptr);
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds the best instruction set this cpu and operating
+ * system can run, using cpuid. Builds without sse2 only have the
+ * scalar kernels.
+ *
+ * @returns the best isaLevel there are kernels for
+ *
+ * @par Example:
+   @verbatim
+   isaLevel level = detectIsa();
+
+   level is ISA_AVX2 on a machine with avx2 but not avx-512.
+   @endverbatim
+
+ ***********************************************************************/
+
+isaLevel detectIsa()
+{
+#ifdef NETPBM_SSE2
+    unsigned int leaf1[4] = { 0, 0, 0, 0 }; // eax, ebx, ecx, edx
+    unsigned int leaf7[4] = { 0, 0, 0, 0 };
+    unsigned int maxLeaf;
+    unsigned long long xcr0 = 0;
+    bool avx;
+
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuid(info, 0);
+    maxLeaf = (unsigned int)info[0];
+    __cpuidex(info, 1, 0);
+    memcpy(leaf1, info, sizeof(leaf1));
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        memcpy(leaf7, info, sizeof(leaf7));
+    }
+#else
+    maxLeaf = __get_cpuid_max(0, nullptr);
+    __cpuid_count(1, 0, leaf1[0], leaf1[1], leaf1[2], leaf1[3]);
+    if (maxLeaf >= 7)
+    {
+        __cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+    }
+#endif
+
+    // the os has to save the wide registers too (osxsave, then xcr0)
+    if (leaf1[2] & (1u << 27))
+    {
+#ifdef _MSC_VER
+        xcr0 = _xgetbv(0);
+#else
+        unsigned int lo;
+        unsigned int hi;
+
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = ((unsigned long long)hi << 32) | lo;
+#endif
+    }
+    avx = (leaf1[2] & (1u << 28)) && (xcr0 & 0x6) == 0x6;
+
+    if (avx && (leaf7[1] & (1u << 5)) && (leaf7[1] & (1u << 16)) &&
+        (leaf7[1] & (1u << 30)) && (xcr0 & 0xE6) == 0xE6)
+    {
+        return ISA_AVX512;
+    }
+    if (avx && (leaf7[1] & (1u << 5)))
+    {
+        return ISA_AVX2;
+    }
+    // ssse3, sse4.1 and sse4.2
+    if ((leaf1[2] & (1u << 9)) && (leaf1[2] & (1u << 19)) &&
+        (leaf1[2] & (1u << 20)))
+    {
+        return ISA_SSE42;
+    }
+    return ISA_SSE2;
+#else
+    return ISA_SCALAR;
+#endif
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function picks the kernels to use from here on. "auto" picks the
+ * best the cpu can run; otherwise it is the name of an instruction set,
+ * and a set the cpu can't run falls back to the best one it can.
+ *
+ * @param[in] name - auto, scalar, sse2, sse4.2, avx2 or avx512.
+ * @param[out] chosen - a line saying which kernels are in use.
+ *
+ * @returns true if the name is known, false if not
+ *
+ * @par Example:
+   @verbatim
+   string chosen;
+
+   selectKernels("avx512", chosen);
+
+   chosen is "avx2 kernels (avx512 is not supported here)" on a
+   machine without avx-512.
+   @endverbatim
+
+ ***********************************************************************/
+
+bool selectKernels(string name, string& chosen)
+{
+    int best = (int)detectIsa();
+    int level = best;
+    int i = 0;
+
+    if (name != "auto")
+    {
+        level = -1;
+        while (i <= (int)ISA_AVX512)
+        {
+            if (name == ISA_NAMES[i])
+            {
+                level = i;
+            }
+            i++;
+        }
+        if (level < 0)
+        {
+            return false;
+        }
+    }
+
+    chosen = (string)ISA_NAMES[level < best ? level : best] + " kernels";
+    if (level > best)
+    {
+        chosen += " (" + name + " is not supported here)";
+        level = best;
+    }
+    activeKernels = &KERNEL_TABLES[level];
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function returns the kernels in use. The first call picks the
+ * best ones for the cpu unless selectKernels already picked.
+ *
+ * @returns the kernel table
+ *
+ * @par Example:
+   @verbatim
+   kernels().reverseRow(im.redGray[i], im.cols);
+   @endverbatim
+
+ ***********************************************************************/
+
+const kernelTable& kernels()
+{
+    const kernelTable* table = activeKernels;
+    string chosen;
+
+    if (table == nullptr)
+    {
+        selectKernels("auto", chosen);
+        table = activeKernels;
+    }
+    return *table;
+}
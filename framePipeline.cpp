@@ -0,0 +1,203 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   runs a stream of frames through decode, process and encode
+ *          stages on their own threads
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+
+/*!
+ * @brief FRAMES_WAITING frames a stage may get ahead of the next one
+ */
+
+const size_t FRAMES_WAITING = 2;
+
+/*!
+ * @brief frameQueue hands frames from one stage to the next. A stage
+ * that gets FRAMES_WAITING frames ahead waits, so only a few frames are
+ * ever in memory at once.
+ */
+
+class frameQueue
+{
+public:
+    /*!
+    * @brief adds a frame, waiting while the queue is full, or returns
+    * false if the queue was closed because the next stage stopped
+    */
+
+    bool push(imageFrame&& frame)
+    {
+        unique_lock<mutex> hold(lock);
+
+        wake.wait(hold, [this]
+        {
+            return frames.size() < FRAMES_WAITING || closed;
+        });
+        if (closed)
+        {
+            return false;
+        }
+        frames.push_back(move(frame));
+        wake.notify_all();
+        return true;
+    }
+
+    /*!
+    * @brief takes the next frame, waiting for one, or returns false once
+    * the queue is closed and empty
+    */
+
+    bool pop(imageFrame& frame)
+    {
+        unique_lock<mutex> hold(lock);
+
+        wake.wait(hold, [this] { return !frames.empty() || closed; });
+        if (frames.empty())
+        {
+            return false;
+        }
+        frame = move(frames.front());
+        frames.pop_front();
+        wake.notify_all();
+        return true;
+    }
+
+    /*!
+    * @brief says no more frames are coming, or that no more are wanted
+    */
+
+    void close()
+    {
+        lock_guard<mutex> hold(lock);
+
+        closed = true;
+        wake.notify_all();
+    }
+
+private:
+    mutex lock;
+    condition_variable wake;
+    deque<imageFrame> frames;
+    bool closed = false;
+};
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function runs every frame of a stream through three stages. The
+ * decode stage reads frame N+1 on one thread while this thread processes
+ * frame N and a third thread encodes frame N-1. Frames are moved from
+ * stage to stage, never copied. Once a frame is encoded it is freed, and
+ * its planes go back to the buffer pool for the next frame of the same
+ * size. Frames come out in the order they went in. If a stage throws,
+ * all three stop and it is thrown again here.
+ *
+ * @param[in] decode - reads the next frame, false when there are no more.
+ * @param[in] process - changes a frame.
+ * @param[in] encode - writes a frame out.
+ *
+ * @returns the number of frames
+ *
+ * @par Example:
+   @verbatim
+   long long count = pipelineFrames(
+       [&](imageFrame& f) { return readNext(in, f); },
+       [&](imageFrame& f) { flipX(f.picture.get()); },
+       [&](imageFrame& f) { writeBinary(out, f.picture.get(),
+           f.maxValue); });
+
+   every frame in "in" is now flipped in out.
+   @endverbatim
+
+ ***********************************************************************/
+
+long long pipelineFrames(const function<bool(imageFrame&)>& decode,
+    const function<void(imageFrame&)>& process,
+    const function<void(imageFrame&)>& encode)
+{
+    frameQueue decoded;
+    frameQueue processed;
+    imageFrame frame;
+    exception_ptr failed[3]; // what stopped each stage, if anything
+    long long count = 0;
+
+    // a stage that fails closes the queues on both sides of it, so the
+    // others stop too, and what it threw is thrown again at the end
+    thread reader([&]
+    {
+        imageFrame next;
+
+        traceThread("decode");
+        try
+        {
+            while (decode(next) && decoded.push(move(next)))
+            {
+                next = imageFrame();
+            }
+        }
+        catch (...)
+        {
+            failed[0] = current_exception();
+        }
+        decoded.close();
+    });
+    thread writer([&]
+    {
+        imageFrame done;
+
+        traceThread("encode");
+        try
+        {
+            while (processed.pop(done))
+            {
+                encode(done);
+                done = imageFrame();
+            }
+        }
+        catch (...)
+        {
+            failed[2] = current_exception();
+        }
+        processed.close();
+    });
+
+    try
+    {
+        while (decoded.pop(frame))
+        {
+            process(frame);
+            if (!processed.push(move(frame)))
+            {
+                break;
+            }
+            frame = imageFrame();
+            count++;
+        }
+    }
+    catch (...)
+    {
+        failed[1] = current_exception();
+    }
+    decoded.close();
+    processed.close();
+    reader.join();
+    writer.join();
+    for (exception_ptr& stage : failed)
+    {
+        if (stage)
+        {
+            rethrow_exception(stage);
+        }
+    }
+    return count;
+}
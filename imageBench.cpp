@@ -0,0 +1,434 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief times whole jobs, from reading the file to writing it, for every
+ *        input type, option and output type.
+ *
+ * @par Usage:
+   @verbatim
+   c:\> imageBench.exe [--size WxH] [--pattern name] [--repeat n]
+                       report.json [option ...]
+
+        WxH - the size of the synthetic input images, 1024x1024 by
+              default
+        name - gradient, checker, bars or noise (the default)
+        n - how many times to run each job, 3 by default
+        report.json - where to write the times
+        option - the options to time, none for no option, all the ones
+                 that need one image by default
+   @endverbatim
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <chrono>
+
+/*!
+ * @brief INPUT_TYPES the magic numbers of the inputs the jobs read
+ */
+
+static const char* const INPUT_TYPES[] = { "P3", "P6", "qoif" };
+
+/*!
+ * @brief OUTPUT_TYPES the output types the jobs write
+ */
+
+static const char* const OUTPUT_TYPES[] = { "--ascii", "--binary", "--qoi" };
+
+/*!
+ * @brief BENCH_OUTPUT the basename the jobs write to
+ */
+
+static const string BENCH_OUTPUT = "bench_output";
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function gives the name of the input file of one type.
+  *
+  * @param[in] magicNumber - the type of the input.
+  *
+  * @returns the file name
+  *
+  * @par Example:
+    @verbatim
+    string name = inputName("P6");
+
+    name is now "bench_input_P6.ppm".
+    @endverbatim
+
+  ***********************************************************************/
+
+static string inputName(string magicNumber)
+{
+    return "bench_input_" + magicNumber +
+        (magicNumber == "qoif" ? ".qoi" : ".ppm");
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function removes whatever a job wrote: an image in any of the
+ * types, a json file, or the levels of a pyramid.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   removeOutputs();
+   @endverbatim
+
+ ***********************************************************************/
+
+static void removeOutputs()
+{
+    const char* extensions[] = { ".ppm", ".pgm", ".pbm", ".qoi", ".json" };
+    int level = 1;
+
+    for (const char* extension : extensions)
+    {
+        remove((BENCH_OUTPUT + extension).c_str());
+    }
+    while (remove((BENCH_OUTPUT + "_" + to_string(level) + ".ppm").c_str())
+        == 0)
+    {
+        level++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function tells if the program can run an option from one input
+ * type to one output type. --pyramid only works from a ppm to ppm files.
+ *
+ * @param[in] input - the magic number of the input.
+ * @param[in] option - the option, or "" for none.
+ * @param[in] output - the output type.
+ *
+ * @returns true if the job can run, false if the program turns it down
+ *
+ * @par Example:
+   @verbatim
+   bool runs = supported("qoif", "--pyramid", "--binary");
+
+   runs is now false.
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool supported(string input, string option, string output)
+{
+    if (option == "--pyramid")
+    {
+        return input != "qoif" && output != "--qoi";
+    }
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function runs one job the way the program would, with the same
+ * arguments, and times it from start to end, reading and writing the
+ * files included. What the job reports is thrown away.
+ *
+ * @param[in] args - the arguments, without the program name.
+ * @param[out] status - what the job returned.
+ *
+ * @returns the seconds the job took
+ *
+ * @par Example:
+   @verbatim
+   int status;
+   double seconds = timeJob({ "--sepia", "--binary", "out", "in.ppm" },
+       status);
+   @endverbatim
+
+ ***********************************************************************/
+
+static double timeJob(vector<string> args, int& status)
+{
+    vector<char*> argv;
+    ostringstream report;
+    chrono::steady_clock::time_point start;
+
+    args.insert(args.begin(), "thpExam1.exe");
+    for (string& arg : args)
+    {
+        argv.push_back(&arg[0]);
+    }
+    start = chrono::steady_clock::now();
+    status = runJob((int)argv.size(), argv.data(), report);
+    return chrono::duration<double>(chrono::steady_clock::now() -
+        start).count();
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes one run of the report: the job, what it returned,
+ * the best and median time of the runs that worked, and the rates from
+ * the best time, in megabytes of input and megapixels a second. They are
+ * null if no run worked.
+ *
+ * @param[in] out - the report.
+ * @param[in] input - the magic number of the input.
+ * @param[in] option - the option, or "" for none.
+ * @param[in] output - the output type.
+ * @param[in] status - what the first run that failed returned, or 0.
+ * @param[in] times - the seconds of each run that worked, sorted.
+ * @param[in] bytes - the size of the input file.
+ * @param[in] pixels - the pixels in the input.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   writeRun(out, "P6", "--sepia", "--binary", 0, times, bytes, pixels);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void writeRun(ostream& out, string input, string option,
+    string output, int status, vector<double>& times, long long bytes,
+    long long pixels)
+{
+    double best;
+
+    out << "    { \"input\": \"" << input << "\", \"option\": \""
+        << option << "\", \"output\": \"" << output << "\"," << endl;
+
+    // a job that never worked has no times
+    if (times.empty())
+    {
+        out << "      \"status\": " << status << ", \"best\": null, "
+            << "\"median\": null," << endl;
+        out << "      \"MBPerSecond\": null, \"megapixelsPerSecond\": "
+            << "null }";
+        return;
+    }
+    best = max(times.front(), 1e-9);
+    out << "      \"status\": " << status << ", \"best\": " << fixed
+        << setprecision(6) << times.front() << ", \"median\": "
+        << times[times.size() / 2] << "," << endl;
+    out << "      \"MBPerSecond\": " << setprecision(3) << bytes / best /
+        1e6 << ", \"megapixelsPerSecond\": " << pixels / best / 1e6
+        << " }";
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This is the starting point to the benchmark. It writes a synthetic
+ * image as a P3, a P6 and a qoi file, and runs every job the program
+ * can do with one of them: each input type, with each option, to each
+ * output type the option works with. Each job runs --repeat times, and
+ * the times go to the report as json, with the size, pattern, threads
+ * and instruction set, so reports from different builds and machines
+ * can be compared. The input and output files are removed at the end.
+ *
+ * @param[in] argc - the number of arguments from the command prompt.
+ * @param[in] argv - a 2d array of characters containing the arguments.
+ *
+ * @returns 0 if the report was written, 1 otherwise
+ *
+ * @verbatim
+    imageBench.exe --size 4096x4096 --repeat 5 report.json --sepia none
+
+    report.json has the times of 18 jobs, sepia and no option from each
+    of the three input types to each of the three output types.
+    @endverbatim
+ *
+ ***********************************************************************/
+
+int main(int argc, char** argv)
+{
+    vector<string> options;
+    vector<double> times;
+    double seconds;
+    ofstream file;
+    ofstream report;
+    string arg;
+    string reportName;
+    string patternName = "noise";
+    synthPattern pattern = SYNTH_NOISE;
+    long long bytes;
+    int cols = 1024;
+    int rows = 1024;
+    int repeat = 3;
+    int status = 0;
+    int ran;
+    int i = 1;
+    int run;
+    bool first = true;
+    char by = ' ';
+
+    while (i < argc && reportName == "")
+    {
+        arg = argv[i];
+        if (arg == "--size" && i + 1 < argc)
+        {
+            istringstream size(argv[i + 1]);
+            if (!(size >> cols >> by >> rows) || by != 'x' || cols < 1 ||
+                rows < 1)
+            {
+                cout << "Invalid size: " << argv[i + 1] << endl;
+                return 1;
+            }
+            i++;
+        }
+        else if (arg == "--pattern" && i + 1 < argc)
+        {
+            if (!parsePattern(argv[i + 1], pattern))
+            {
+                cout << "Invalid pattern: " << argv[i + 1] << endl;
+                return 1;
+            }
+            patternName = argv[i + 1];
+            i++;
+        }
+        else if (arg == "--repeat" && i + 1 < argc)
+        {
+            repeat = atoi(argv[i + 1]);
+            i++;
+        }
+        else
+        {
+            reportName = arg;
+        }
+        i++;
+    }
+    if (reportName == "" || reportName.compare(0, 2, "--") == 0 ||
+        repeat < 1)
+    {
+        cout << "Usage: imageBench.exe [--size WxH] [--pattern name] "
+            << "[--repeat n]" << endl;
+        cout << "                      report.json [option ...]" << endl;
+        return 1;
+    }
+    while (i < argc)
+    {
+        options.push_back(argv[i] == (string)"none" ? "" : argv[i]);
+        i++;
+    }
+    if (options.empty())
+    {
+        options = { "", "--flipX", "--flipY", "--rotateCW", "--rotateCCW",
+            "--grayscale", "--sepia", "--autolevels", "--equalize",
+            "--threshold", "--dither", "--histogram",
+            "--resize=" + to_string(max(cols / 2, 1)) + "x0,bilinear",
+            "--rotate=30", "--pyramid", "--toYCbCr", "--fromYCbCr",
+            "--toHSV", "--fromHSV", "--toHSL", "--fromHSL", "--hue=30",
+            "--saturation=1.5", "--value=0.8", "--median=1", "--median=2",
+            "--median=8" };
+    }
+    if (!openOutput(report, reportName))
+    {
+        return 1;
+    }
+
+    // the same image in each input type
+    for (const char* input : INPUT_TYPES)
+    {
+        if (!openOutput(file, inputName(input)))
+        {
+            return 1;
+        }
+        writeSynthetic(file, input, rows, cols, pattern, 1);
+        file.close();
+    }
+
+    report << "{" << endl;
+    report << "  \"width\": " << cols << ", \"height\": " << rows
+        << ", \"pattern\": \"" << patternName << "\"," << endl;
+    report << "  \"repeat\": " << repeat << ", \"threads\": "
+        << threadCount() << ", \"isa\": \"" << kernels().name << "\","
+        << endl;
+    report << "  \"runs\": [" << endl;
+    for (const char* input : INPUT_TYPES)
+    {
+        ifstream in(inputName(input), ios::binary | ios::ate);
+        bytes = (long long)in.tellg();
+
+        for (string& option : options)
+        {
+            for (const char* output : OUTPUT_TYPES)
+            {
+                vector<string> args = { output, BENCH_OUTPUT,
+                    inputName(input) };
+
+                if (!supported(input, option, output))
+                {
+                    continue;
+                }
+                if (option != "")
+                {
+                    args.insert(args.begin(), option);
+                }
+                // the first run that fails gives the status, and only
+                // the runs that worked are timed
+                times.clear();
+                status = 0;
+                run = 0;
+                while (run < repeat)
+                {
+                    seconds = timeJob(args, ran);
+                    if (ran == 0)
+                    {
+                        times.push_back(seconds);
+                    }
+                    else if (status == 0)
+                    {
+                        status = ran;
+                    }
+                    removeOutputs();
+                    run++;
+                }
+                sort(times.begin(), times.end());
+
+                cout << input << " " << (option == "" ? "none" : option)
+                    << " " << output << ": ";
+                if (times.empty())
+                {
+                    cout << "failed" << endl;
+                }
+                else
+                {
+                    cout << fixed << setprecision(3) << times.front()
+                        << " s" << (status != 0 ? " (failed)" : "") << endl;
+                }
+                report << (first ? "" : ",\n");
+                writeRun(report, input, option, output, status, times,
+                    bytes, (long long)rows * cols);
+                first = false;
+            }
+        }
+    }
+    report << endl << "  ]" << endl;
+    report << "}" << endl;
+
+    for (const char* input : INPUT_TYPES)
+    {
+        remove(inputName(input).c_str());
+    }
+    return 0;
+}
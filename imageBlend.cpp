@@ -0,0 +1,136 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that put two images together
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+/*!
+ * @brief BLEND_NAMES the name of each blendMode after --blend=, in order
+ */
+
+static const char* const BLEND_NAMES[] =
+{
+    "alpha",
+    "add",
+    "subtract",
+    "multiply",
+    "screen",
+    "difference"
+};
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function reads the settings out of a --blend= option. The mode
+  * comes first. alpha can be followed by how much of the second image
+  * to use, from 0 to 1, which is 0.5 if it is left off.
+  *
+  * @param[in] option - the option, like --blend=alpha,0.25.
+  * @param[out] mode - how to blend the two images.
+  * @param[out] weight - how much of the second image alpha uses, 0 to
+  *                      255.
+  *
+  * @returns true if the option is a --blend= with good settings, false
+  *          otherwise
+  *
+  * @par Example:
+    @verbatim
+    blendMode mode;
+    int weight;
+
+    parseBlend("--blend=alpha,0.25", mode, weight);
+
+    mode is now BLEND_ALPHA and weight is 64.
+    @endverbatim
+
+  ***********************************************************************/
+
+bool parseBlend(string option, blendMode& mode, int& weight)
+{
+    string prefix = "--blend=";
+    string name;
+    double amount = 0.5;
+    int i = 0;
+
+    if (option.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
+    istringstream spec(option.substr(prefix.size()));
+    getline(spec, name, ',');
+
+    // anything after the mode is alpha's amount
+    if (!spec.eof())
+    {
+        if (name != "alpha" || !(spec >> amount) || spec.peek() != EOF ||
+            amount < 0 || amount > 1)
+        {
+            return false;
+        }
+    }
+    weight = (int)(amount * 255 + 0.5);
+
+    while (i < (int)(sizeof(BLEND_NAMES) / sizeof(BLEND_NAMES[0])))
+    {
+        if (name == BLEND_NAMES[i])
+        {
+            mode = (blendMode)i;
+            return true;
+        }
+        i++;
+    }
+    return false;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function blends the rows of b into the rows of a, red with red,
+ * green with green and blue with blue, on all the threads. The two have
+ * to be the same size. They can be whole images or the same band of
+ * rows of two images being read in together.
+ *
+ * @param[in,out] a - the first image, which becomes the blend.
+ * @param[in] b - the second image.
+ * @param[in] mode - how to blend them.
+ * @param[in] weight - how much of b alpha uses, 0 to 255.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   image first;
+   image second;
+
+   blendRows(first, second, BLEND_DIFFERENCE, 0);
+
+   first now holds how far each of its values is from second's.
+   @endverbatim
+
+ ***********************************************************************/
+
+void blendRows(image& a, image& b, blendMode mode, int weight)
+{
+    const kernelTable& k = kernels();
+
+    parallelRows(a.rows, [&](int start, int end)
+    {
+        while (start < end)
+        {
+            k.blendRow(a.redGray[start], b.redGray[start], a.cols, mode,
+                weight);
+            k.blendRow(a.green[start], b.green[start], a.cols, mode,
+                weight);
+            k.blendRow(a.blue[start], b.blue[start], a.cols, mode, weight);
+            start++;
+        }
+    });
+}
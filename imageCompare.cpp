@@ -0,0 +1,538 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that measure how far apart two images are
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <algorithm>
+#include <mutex>
+
+/*!
+ * @brief SSIM_C1 keeps the ssim of the means steady near black, (0.01 *
+ * 255) squared
+ */
+
+const double SSIM_C1 = 6.5025;
+
+/*!
+ * @brief SSIM_C2 keeps the ssim of the contrasts steady in flat areas,
+ * (0.03 * 255) squared
+ */
+
+const double SSIM_C2 = 58.5225;
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function reads the settings out of a --compare option. --compare
+  * measures everything; --compare=first stops at the first pixel that
+  * is different, for a quick same or not.
+  *
+  * @param[in] option - the option, like --compare=first.
+  * @param[out] first - true if it stops at the first difference.
+  *
+  * @returns true if the option is a --compare, false otherwise
+  *
+  * @par Example:
+    @verbatim
+    bool first;
+
+    parseCompare("--compare=first", first);
+
+    first is now true.
+    @endverbatim
+
+  ***********************************************************************/
+
+bool parseCompare(string option, bool& first)
+{
+    first = option == "--compare=first";
+    return first || option == "--compare";
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function works out the ssim of one 8x8 window from the sums of
+ * the four 4x4 blocks in it, two from the block row above and two from
+ * the one below. It compares the means, the contrasts and the structure
+ * of the two images in the window, and is 1 when they are the same.
+ *
+ * @param[in] top - the sums of the upper block row of one color.
+ * @param[in] bottom - the sums of the lower block row of the color.
+ * @param[in] blocks - the number of blocks in a block row.
+ * @param[in] j - the left block of the window.
+ *
+ * @returns the ssim of the window, up to 1
+ *
+ * @par Example:
+   @verbatim
+   double ssim = windowSsim(top, bottom, im.cols / 4, 0);
+
+   ssim is the ssim of the top left window.
+   @endverbatim
+
+ ***********************************************************************/
+
+static double windowSsim(const int* top, const int* bottom, int blocks,
+    int j)
+{
+    double sum[5];
+    double meanA;
+    double meanB;
+    double varA;
+    double varB;
+    double cov;
+    int n = 0;
+
+    while (n < 5)
+    {
+        sum[n] = (double)top[n * blocks + j] + top[n * blocks + j + 1] +
+            bottom[n * blocks + j] + bottom[n * blocks + j + 1];
+        n++;
+    }
+    meanA = sum[0] / 64;
+    meanB = sum[1] / 64;
+    varA = sum[2] / 64 - meanA * meanA;
+    varB = sum[3] / 64 - meanB * meanB;
+    cov = sum[4] / 64 - meanA * meanB;
+    return (2 * meanA * meanB + SSIM_C1) * (2 * cov + SSIM_C2) /
+        ((meanA * meanA + meanB * meanB + SSIM_C1) * (varA + varB +
+        SSIM_C2));
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function compares the rows of a with the rows of b, the same
+ * size, and adds what it finds into stats: the pixels where any color
+ * is different, the biggest difference, the squared differences of
+ * each color, and the ssim of each 8x8 window, stepping 4 pixels at a
+ * time. It can be called on the whole images at once, or on one band of
+ * rows after another as they are read in. The sums of the last 4 rows
+ * are carried in carried so the windows across two bands are counted;
+ * every band but the last has to be a multiple of 4 rows. All of it
+ * runs on all the threads with the diffRow and ssimRow kernels.
+ *
+ * @param[in] a - the first image.
+ * @param[in] b - the second image.
+ * @param[in,out] stats - what has been found so far.
+ * @param[in,out] carried - the sums of the last 4 rows, empty at the
+ *                          first row.
+ * @param[in] firstRow - the row of the whole image the band starts at.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   compareStats stats = {};
+   vector<int> carried;
+
+   stats.firstX = -1;
+   stats.firstY = -1;
+   compareRows(first, second, stats, carried, 0);
+
+   stats now holds how far apart the two images are.
+   @endverbatim
+
+ ***********************************************************************/
+
+void compareRows(image& a, image& b, compareStats& stats,
+    vector<int>& carried, int firstRow)
+{
+    const kernelTable& k = kernels();
+    int blocks = a.cols / 4;
+    int blockRows = a.rows / 4;
+    size_t width = (size_t)blocks * 5; // the sums of a block row, a color
+    vector<int> last(width * 3);
+    mutex merge;
+
+    // the differences, a row at a time
+    parallelRows(a.rows, [&](int start, int end)
+    {
+        pixel** planesA[3] = { a.redGray, a.green, a.blue };
+        pixel** planesB[3] = { b.redGray, b.green, b.blue };
+        vector<pixel> far(a.cols);
+        long long squared[3] = { 0, 0, 0 };
+        long long rowSquared;
+        long long got;
+        long long differing = 0;
+        int maxError = 0;
+        int firstX = -1;
+        int firstY = -1;
+        int c;
+        int j;
+
+        while (start < end)
+        {
+            memset(far.data(), 0, far.size());
+            rowSquared = 0;
+            c = 0;
+            while (c < 3)
+            {
+                got = k.diffRow(planesA[c][start], planesB[c][start],
+                    far.data(), a.cols);
+                squared[c] += got;
+                rowSquared += got;
+                c++;
+            }
+
+            // a row that is the same has nothing to count
+            j = 0;
+            while (rowSquared > 0 && j < a.cols)
+            {
+                if (far[j] != 0)
+                {
+                    if (firstY < 0)
+                    {
+                        firstX = j;
+                        firstY = firstRow + start;
+                    }
+                    differing++;
+                    maxError = max(maxError, (int)far[j]);
+                }
+                j++;
+            }
+            start++;
+        }
+
+        // add this band into the totals
+        lock_guard<mutex> lock(merge);
+        c = 0;
+        while (c < 3)
+        {
+            stats.squared[c] += squared[c];
+            c++;
+        }
+        stats.differing += differing;
+        stats.maxError = max(stats.maxError, maxError);
+        if (firstY >= 0 && (stats.firstY < 0 || firstY < stats.firstY ||
+            (firstY == stats.firstY && firstX < stats.firstX)))
+        {
+            stats.firstX = firstX;
+            stats.firstY = firstY;
+        }
+    });
+
+    // the windows, a block row at a time, each with the one above it
+    parallelRows(blockRows, [&](int start, int end)
+    {
+        pixel** planesA[3] = { a.redGray, a.green, a.blue };
+        pixel** planesB[3] = { b.redGray, b.green, b.blue };
+        vector<int> sums(width * 6);
+        int* above = sums.data();
+        int* below = sums.data() + width * 3;
+        double ssim[3] = { 0, 0, 0 };
+        long long windows = 0;
+        bool haveAbove = false;
+        int r = start;
+        int c;
+        int i;
+        int j;
+
+        // the block row above the first one is the last of the band
+        // before, or one more to add up
+        if (start == 0 && !carried.empty())
+        {
+            copy(carried.begin(), carried.end(), above);
+            haveAbove = true;
+        }
+        else if (start > 0)
+        {
+            r = start - 1;
+        }
+        while (r < end)
+        {
+            fill(below, below + width * 3, 0);
+            c = 0;
+            while (c < 3)
+            {
+                i = r * 4;
+                while (i < r * 4 + 4)
+                {
+                    k.ssimRow(planesA[c][i], planesB[c][i], blocks,
+                        below + width * c);
+                    i++;
+                }
+                c++;
+            }
+            if (haveAbove)
+            {
+                c = 0;
+                while (c < 3)
+                {
+                    j = 0;
+                    while (j + 1 < blocks)
+                    {
+                        ssim[c] += windowSsim(above + width * c,
+                            below + width * c, blocks, j);
+                        j++;
+                    }
+                    c++;
+                }
+                windows += max(blocks - 1, 0);
+            }
+            swap(above, below);
+            haveAbove = true;
+            r++;
+        }
+
+        lock_guard<mutex> lock(merge);
+        if (end == blockRows && end > start)
+        {
+            copy(above, above + width * 3, last.begin());
+        }
+        c = 0;
+        while (c < 3)
+        {
+            stats.ssim[c] += ssim[c];
+            c++;
+        }
+        stats.windows += windows;
+    });
+    if (blockRows > 0)
+    {
+        carried = last;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function compares two P3 or P6 images of the same size a band of
+ * rows at a time, reading the two side by side so only the bands are
+ * ever in memory. The header of in is read here; the header of with has
+ * to have been read already, with the single space after it for P6.
+ * When first is true it stops at the first pixel that is different.
+ *
+ * @param[in] in - the first image, just past the magic number.
+ * @param[in] with - the second image, just past its header.
+ * @param[in] inputMagic - P3 or P6 for in.
+ * @param[in] secondMagic - P3 or P6 for with.
+ * @param[in] first - true to stop at the first difference.
+ * @param[out] stats - how far apart the images are.
+ * @param[in] limit - the most bytes of rows of both to hold at once.
+ *
+ * @returns true if the images were compared, false if one of them ended
+ *          early
+ *
+ * @par Example:
+   @verbatim
+   compareStats stats;
+
+   compareStreams(in, with, "P6", "P3", false, stats, 32 << 20);
+
+   stats now holds how far apart the two images are.
+   @endverbatim
+
+ ***********************************************************************/
+
+bool compareStreams(istream& in, istream& with, string inputMagic,
+    string secondMagic, bool first, compareStats& stats, long long limit)
+{
+    image header;
+    int maxValue = 0;
+    vector<int> carried;
+    long long bandRows;
+    int done = 0;
+    int i;
+    int c;
+    int j;
+    pixel space;
+
+    readHeader(in, header, maxValue);
+    if (inputMagic == "P6")
+    {
+        in.read((char*)&space, sizeof(pixel));
+    }
+    memset(&stats, 0, sizeof(compareStats));
+    stats.rows = header.rows;
+    stats.cols = header.cols;
+    stats.firstX = -1;
+    stats.firstY = -1;
+
+    // both bands hold their arrays, and a band is whole blocks of rows
+    bandRows = limit / ((long long)header.cols * 6) / 4 * 4;
+    if (bandRows > header.rows)
+    {
+        bandRows = header.rows;
+    }
+    if (bandRows < 4)
+    {
+        bandRows = 4;
+    }
+    netImage bandA((int)bandRows, header.cols);
+    netImage bandB((int)bandRows, header.cols);
+    image& a = bandA.get();
+    image& b = bandB.get();
+    pixel** planesA[3] = { a.redGray, a.green, a.blue };
+    pixel** planesB[3] = { b.redGray, b.green, b.blue };
+
+    while (done < header.rows && in && with)
+    {
+        a.rows = (int)min(bandRows, (long long)header.rows - done);
+        b.rows = a.rows;
+        readRows(in, a, inputMagic);
+        readRows(with, b, secondMagic);
+        if (in.fail() || with.fail())
+        {
+            break;
+        }
+        if (!first)
+        {
+            compareRows(a, b, stats, carried, done);
+            done += a.rows;
+            continue;
+        }
+
+        // just find the first row that isn't the same, and where in it
+        i = 0;
+        while (i < a.rows)
+        {
+            c = 0;
+            while (c < 3)
+            {
+                if (memcmp(planesA[c][i], planesB[c][i], a.cols) != 0)
+                {
+                    j = 0;
+                    while (planesA[c][i][j] == planesB[c][i][j])
+                    {
+                        j++;
+                    }
+                    if (stats.firstY < 0 || j < stats.firstX)
+                    {
+                        stats.firstX = j;
+                        stats.firstY = done + i;
+                    }
+                }
+                c++;
+            }
+            if (stats.firstY >= 0)
+            {
+                a.rows = (int)bandRows;
+                b.rows = (int)bandRows;
+                return true;
+            }
+            i++;
+        }
+        done += a.rows;
+    }
+    a.rows = (int)bandRows;
+    b.rows = (int)bandRows;
+    return done == header.rows && !in.fail() && !with.fail();
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes what compareRows or compareStreams found as
+ * json: whether the images are the same and where they first differ,
+ * and unless it stopped at the first difference, how many pixels are
+ * different, by how much at most, and the mse, psnr and ssim of each
+ * color and of all three together. The psnr is null for images that
+ * are the same, and the ssim is null for images too small for an 8x8
+ * window.
+ *
+ * @param[in] out - the output stream.
+ * @param[in] stats - what was found.
+ * @param[in] first - true if it stopped at the first difference.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   writeCompareJson(out, stats, false);
+
+   out now has something like
+   {
+     "width": 735,
+     "height": 486,
+     "same": false,
+     "first": { "x": 12, "y": 0 },
+     ...
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeCompareJson(ostream& out, compareStats& stats, bool first)
+{
+    const char* names[4] = { "red", "green", "blue", "all" };
+    long long pixels = (long long)stats.rows * stats.cols;
+    long long squared;
+    double ssim;
+    double mse;
+    int c = 0;
+
+    out << "{" << endl;
+    out << "  \"width\": " << stats.cols << "," << endl;
+    out << "  \"height\": " << stats.rows << "," << endl;
+    out << "  \"same\": " << (stats.firstY < 0 ? "true" : "false") << ","
+        << endl;
+    out << "  \"first\": ";
+    if (stats.firstY < 0)
+    {
+        out << "null";
+    }
+    else
+    {
+        out << "{ \"x\": " << stats.firstX << ", \"y\": " << stats.firstY
+            << " }";
+    }
+    if (first)
+    {
+        out << endl << "}" << endl;
+        return;
+    }
+    out << "," << endl;
+    out << "  \"differing\": " << stats.differing << "," << endl;
+    out << "  \"maxError\": " << stats.maxError << "," << endl;
+    while (c < 4)
+    {
+        // all is the three colors together
+        squared = c < 3 ? stats.squared[c] : stats.squared[0] +
+            stats.squared[1] + stats.squared[2];
+        ssim = c < 3 ? stats.ssim[c] : (stats.ssim[0] + stats.ssim[1] +
+            stats.ssim[2]) / 3;
+        mse = pixels > 0 ? (double)squared / pixels / (c < 3 ? 1 : 3) : 0;
+
+        out << "  \"" << names[c] << "\": { \"mse\": " << fixed
+            << setprecision(6) << mse << ", \"psnr\": ";
+        if (squared == 0)
+        {
+            out << "null";
+        }
+        else
+        {
+            out << 10 * log10(255.0 * 255.0 / mse);
+        }
+        out << ", \"ssim\": ";
+        if (stats.windows == 0)
+        {
+            out << "null";
+        }
+        else
+        {
+            out << ssim / stats.windows;
+        }
+        out << " }" << (c < 3 ? "," : "") << endl;
+        c++;
+    }
+    out << "}" << endl;
+}
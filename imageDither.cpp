@@ -0,0 +1,233 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that turn an image into black and white pixels
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+/*!
+ * @brief BAYER the 8x8 ordered dither matrix, each of 0 to 63 once, with
+ * neighbors as far apart as they can be
+ */
+
+static const int BAYER[8][8] =
+{
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function reads the settings out of a --threshold or --dither
+  * option. --threshold makes every pixel below the level black and the
+  * rest white, 128 unless a level is given. --dither spreads the error
+  * of each pixel to the ones after it with Floyd-Steinberg, or with
+  * =bayer compares each pixel against an 8x8 ordered matrix instead.
+  *
+  * @param[in] option - the option, like --threshold=100 or --dither=bayer.
+  * @param[out] method - how to pick black or white.
+  * @param[out] level - the gray level that is white and up.
+  *
+  * @returns true if the option is a --threshold or --dither with good
+  *          settings, false otherwise
+  *
+  * @par Example:
+    @verbatim
+    ditherType method;
+    int level;
+
+    parseDither("--threshold=100", method, level);
+
+    method is now DITHER_THRESHOLD and level is 100.
+    @endverbatim
+
+  ***********************************************************************/
+
+bool parseDither(string option, ditherType& method, int& level)
+{
+    string threshold = "--threshold=";
+    string dither = "--dither=";
+    string name;
+
+    level = 128;
+    if (option == "--threshold")
+    {
+        method = DITHER_THRESHOLD;
+        return true;
+    }
+    if (option.compare(0, threshold.size(), threshold) == 0)
+    {
+        istringstream spec(option.substr(threshold.size()));
+        method = DITHER_THRESHOLD;
+        return spec >> level && spec.peek() == EOF && level >= 0 &&
+            level <= 256;
+    }
+    if (option == "--dither")
+    {
+        method = DITHER_FLOYD;
+        return true;
+    }
+    if (option.compare(0, dither.size(), dither) == 0)
+    {
+        name = option.substr(dither.size());
+        method = name == "bayer" ? DITHER_BAYER : DITHER_FLOYD;
+        return name == "bayer" || name == "floyd";
+    }
+    return false;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function turns the gray values of rows of an image to black (0)
+ * or white (255), in place in the red/gray array. It can be called on
+ * the whole image at once, or on one band of rows after another as they
+ * are read in. Floyd-Steinberg carries the error still owed to the next
+ * two rows in errors, two rows of it at a time, so each band picks up
+ * where the last one stopped; the ordered dither only needs to know
+ * which row of the matrix the band starts on. The threshold and ordered
+ * dither do their rows on all the threads.
+ *
+ * @param[in,out] im - the gray rows, which become black and white.
+ * @param[in] method - how to pick black or white.
+ * @param[in] level - the gray level that is white and up.
+ * @param[in,out] errors - the error owed to the next rows, empty at the
+ *                         first row.
+ * @param[in] firstRow - the row of the whole image the band starts at.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   vector<int> errors;
+
+   ditherRows(band, DITHER_FLOYD, 128, errors, 0);
+   ditherRows(nextBand, DITHER_FLOYD, 128, errors, band.rows);
+
+   both bands are now black and white, as if they were one image.
+   @endverbatim
+
+ ***********************************************************************/
+
+void ditherRows(image& im, ditherType method, int level,
+    vector<int>& errors, int firstRow)
+{
+    size_t width = (size_t)im.cols + 2; // one spare on both ends
+    int* here;
+    int* next;
+    int value;
+    int owed;
+    int i = 0;
+    int j;
+
+    if (method != DITHER_FLOYD)
+    {
+        parallelRows(im.rows, [&](int start, int end)
+        {
+            const int* matrix;
+            pixel* row;
+            int x;
+
+            while (start < end)
+            {
+                row = im.redGray[start];
+                matrix = BAYER[(firstRow + start) % 8];
+                x = 0;
+                while (x < im.cols)
+                {
+                    // 65/256 spreads 0 to 255 over the 65 steps 0 to 64
+                    if (method == DITHER_BAYER)
+                    {
+                        row[x] = (row[x] * 65 >> 8) > matrix[x % 8] ?
+                            255 : 0;
+                    }
+                    else
+                    {
+                        row[x] = row[x] >= level ? 255 : 0;
+                    }
+                    x++;
+                }
+                start++;
+            }
+        });
+        return;
+    }
+
+    // the error rows trade places every row, by the parity of the row
+    if (errors.size() != width * 2)
+    {
+        errors.assign(width * 2, 0);
+    }
+    while (i < im.rows)
+    {
+        here = &errors[(size_t)((firstRow + i) % 2) * width + 1];
+        next = &errors[(size_t)((firstRow + i + 1) % 2) * width + 1];
+        j = 0;
+        while (j < im.cols)
+        {
+            // the errors are kept in sixteenths of a gray level
+            value = im.redGray[i][j] + ((here[j] + 8) >> 4);
+            im.redGray[i][j] = value >= level ? 255 : 0;
+            owed = value - im.redGray[i][j];
+            here[j + 1] += owed * 7;
+            next[j - 1] += owed * 3;
+            next[j] += owed * 5;
+            next[j + 1] += owed;
+            j++;
+        }
+
+        // this row's errors are used up, so it starts the row after next
+        memset(here - 1, 0, width * sizeof(int));
+        i++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function turns an image into black and white. It is grayscaled
+ * first, with the same luminance as --grayscale, and then each gray
+ * value is made black or white by method.
+ *
+ * @param[in,out] im - the image, which becomes black and white in its
+ *                     red/gray array.
+ * @param[in] method - how to pick black or white.
+ * @param[in] level - the gray level that is white and up.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   image im;
+
+   dither(im, DITHER_FLOYD, 128);
+
+   the red/gray array of im now only has 0 and 255 in it.
+   @endverbatim
+
+ ***********************************************************************/
+
+void dither(image& im, ditherType method, int level)
+{
+    vector<int> errors;
+
+    grayscale(im);
+    ditherRows(im, method, level, errors, 0);
+}
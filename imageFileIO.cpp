@@ -6,6 +6,12 @@
 
 #include "netPBM.h"
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+
  /** *********************************************************************
   * @author David Hill
   *
@@ -86,76 +92,159 @@ bool openOutput(ofstream& out, string file)
 
 
 
+/*!
+ * @brief pipeBuffer reads a file that can't seek, like stdin, through a
+ * large buffer. The readers only ever seek forward, which is done by
+ * reading, or back to somewhere still in the buffer, like the header.
+ * Each refill keeps the last few bytes passed, so a reader can always
+ * back up that far.
+ */
+
+class pipeBuffer : public streambuf
+{
+public:
+    /*!
+    * @brief reads file through a buffer of size bytes, keeping the last
+    * keep bytes passed when it refills
+    */
+
+    pipeBuffer(FILE* file, size_t size, size_t keep) : file(file),
+        buffer(size), keep(keep)
+    {
+        setg(buffer.data(), buffer.data(), buffer.data());
+    }
+
+protected:
+    /*!
+    * @brief refills the buffer once everything in it has been read
+    */
+
+    int_type underflow() override
+    {
+        size_t count;
+        size_t kept = (size_t)(egptr() - eback());
+
+        if (gptr() < egptr())
+        {
+            return traits_type::to_int_type(*gptr());
+        }
+
+        // slide the last keep bytes to the front and read in after them
+        kept = kept < keep ? kept : keep;
+        memmove(buffer.data(), egptr() - kept, kept);
+        start += (egptr() - eback()) - (off_type)kept;
+        count = fread(buffer.data() + kept, 1, buffer.size() - kept, file);
+        setg(buffer.data(), buffer.data() + kept,
+            buffer.data() + kept + count);
+        if (count == 0)
+        {
+            return traits_type::eof();
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+    /*!
+    * @brief moves the read position, like seekg, but not back past the
+    * start of the buffer or from the end
+    */
+
+    pos_type seekoff(off_type off, ios_base::seekdir dir,
+        ios_base::openmode which) override
+    {
+        off_type target = off;
+
+        if (!(which & ios_base::in) || dir == ios_base::end)
+        {
+            return pos_type(off_type(-1));
+        }
+        if (dir == ios_base::cur)
+        {
+            target += start + (gptr() - eback());
+        }
+        if (target < start)
+        {
+            return pos_type(off_type(-1));
+        }
+
+        // skip ahead a buffer at a time until target is in it
+        while (target > start + (egptr() - eback()))
+        {
+            setg(eback(), egptr(), egptr());
+            if (underflow() == traits_type::eof())
+            {
+                return pos_type(off_type(-1));
+            }
+        }
+        setg(eback(), eback() + (target - start), egptr());
+        return pos_type(target);
+    }
+
+    /*!
+    * @brief moves the read position to pos, like seekg
+    */
+
+    pos_type seekpos(pos_type pos, ios_base::openmode which) override
+    {
+        return seekoff(off_type(pos), ios_base::beg, which);
+    }
+
+private:
+    FILE* file;           // where the bytes come from
+    vector<char> buffer;  // the bytes kept and the bytes read in
+    size_t keep;          // bytes already passed that a refill keeps
+    off_type start = 0;   // the place in the file of buffer[0]
+};
+
+
+
 /** *********************************************************************
  * @author David Hill
  *
  * @par Description:
- * This function reads in the image data in ascii, allocates the arrays,
- * and stores the data in the arrays of im.
+ * This function points a stream at the named file, or at stdin if the
+ * name is -. Stdin is read through a 16 MB pipeBuffer that keeps the
+ * last 8 MB, so the readers work on it even when it is a pipe.
  *
- * @param[in] in - the input stream.
- * @param[in] im - the image to fill.
- * @param[in] maxValue - the max value of the pixels
+ * @param[out] in - the stream to read with.
+ * @param[in] file - opened for the stream when the name is a file.
+ * @param[in] name - the file name, or - for stdin.
  *
- * @returns none
+ * @returns true if the stream is ready to read, false if the file did
+ * not open.
  *
  * @par Example:
    @verbatim
-   ifstream in;
-   image im;
-   int maxValue = 255;
+   ifstream file;
+   istream in(nullptr);
 
-   readAscii(in, im, maxValue);
+   openInputStream(in, file, "-");
 
-   im now contains all the data that "in" read in.
+   "in" now reads from stdin.
    @endverbatim
 
  ***********************************************************************/
 
-void readAscii(ifstream& in, image& im, int& maxValue)
+bool openInputStream(istream& in, ifstream& file, string name)
 {
-    int i = 0;
-    int j = 0;
-    int num;
-    string com;
-    getline(in, com); // read rest of line after magic number
-
-    // while first character of next line is # (35 in ascii) 
-    // add this line to in.comment
-    while (in.peek() == 35)
-    {
-        getline(in, com);
-        im.comment += com + '\n';
-    }
-
-    // read in columns and rows
-    in >> im.cols;
-    in >> im.rows;
-
-    // allocate arrays with these sizes
-    allocateArray(im.redGray, im.rows, im.cols);
-    allocateArray(im.green, im.rows, im.cols);
-    allocateArray(im.blue, im.rows, im.cols);
-
-    // read in maxValue
-    in >> maxValue;
-
-    // fill arrays with data in file
-    while (i < im.rows)
+    if (name != "-")
     {
-        while (j < im.cols)
+        if (!openInput(file, name))
         {
-            in >> num;
-            im.redGray[i][j] = num;
-            in >> num;
-            im.green[i][j] = num;
-            in >> num;
-            im.blue[i][j] = num;
-            j++;
+            return false;
         }
-        i++;
-        j = 0;
+        in.rdbuf(file.rdbuf());
+        return true;
     }
+
+    // there is just the one stdin, so there is just the one buffer, and
+    // it keeps whatever was read ahead for the next image
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    static pipeBuffer standardInput(stdin, STDIN_BUFFER,
+        STDIN_BUFFER / 2);
+    in.rdbuf(&standardInput);
+    return true;
 }
 
 
@@ -164,51 +253,44 @@ void readAscii(ifstream& in, image& im, int& maxValue)
  * @author David Hill
  *
  * @par Description:
- * This function writes out the image data in ascii.
+ * This function points a stream at the named file, or at stdout if the
+ * name is -.
  *
- * @param[in] out - the out stream.
- * @param[in] im - the image to write out.
- * @param[in] maxValue - the max value of the pixels
+ * @param[out] out - the stream to write with.
+ * @param[in] file - opened for the stream when the name is a file.
+ * @param[in] name - the file name, or - for stdout.
  *
- * @returns none
+ * @returns true if the stream is ready to write, false if the file did
+ * not open.
  *
  * @par Example:
    @verbatim
-   ofstream out;
-   image im;
-   int maxValue = 255;
+   ofstream file;
+   ostream out(nullptr);
 
-   writeAscii(out, im, maxValue);
+   openOutputStream(out, file, "-");
 
-   out now contains all of the image data stored in "im".
+   "out" now writes to stdout.
    @endverbatim
 
  ***********************************************************************/
 
-void writeAscii(ofstream& out, image& im, int& maxValue)
+bool openOutputStream(ostream& out, ofstream& file, string name)
 {
-    int i = 0;
-    int j = 0;
-
-    // output magic number, any comments, columns and rows, and maxValue
-    out << im.magicNumber << endl;
-    out << im.comment;
-    out << im.cols << " " << im.rows << endl;
-    out << maxValue << endl;
-
-    // output values from each array
-    while (i < im.rows)
+    if (name != "-")
     {
-        while (j < im.cols)
+        if (!openOutput(file, name))
         {
-            out << (int)im.redGray[i][j] << endl;
-            out << (int)im.green[i][j] << endl;
-            out << (int)im.blue[i][j] << endl;
-            j++;
+            return false;
         }
-        i++;
-        j = 0;
+        out.rdbuf(file.rdbuf());
+        return true;
     }
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    out.rdbuf(cout.rdbuf());
+    return true;
 }
 
 
@@ -217,11 +299,12 @@ void writeAscii(ofstream& out, image& im, int& maxValue)
  * @author David Hill
  *
  * @par Description:
- * This function reads in the image data in binary, allocates the arrays,
- * and stores the data in the arrays of im.
+ * This function reads the rest of the header after the magic number:
+ * any comment lines, the columns and rows, and the maxValue. The
+ * stream is left on the whitespace that follows maxValue.
  *
  * @param[in] in - the input stream.
- * @param[in] im - the image to fill.
+ * @param[in] im - the image to fill in the comment and size of.
  * @param[in] maxValue - the max value of the pixels
  *
  * @returns none
@@ -230,20 +313,18 @@ void writeAscii(ofstream& out, image& im, int& maxValue)
    @verbatim
    ifstream in;
    image im;
-   int maxValue = 255;
+   int maxValue = 0;
 
-   readBinary(in, im, maxValue);
+   in >> im.magicNumber;
+   readHeader(in, im, maxValue);
 
-   im now contains all the data that "in" read in.
+   im.cols, im.rows and maxValue are now filled in.
    @endverbatim
 
  ***********************************************************************/
 
-void readBinary(ifstream& in, image& im, int& maxValue)
+void readHeader(istream& in, image& im, int& maxValue)
 {
-    int i = 0;
-    int j = 0;
-    pixel space;
     string com;
     getline(in, com); // read rest of line after magic number
 
@@ -259,30 +340,59 @@ void readBinary(ifstream& in, image& im, int& maxValue)
     in >> im.cols;
     in >> im.rows;
 
-    // allocate arrays with these sizes
-    allocateArray(im.redGray, im.rows, im.cols);
-    allocateArray(im.green, im.rows, im.cols);
-    allocateArray(im.blue, im.rows, im.cols);
-
     // read in maxValue
     in >> maxValue;
+}
 
-    // read in single space after maxValue
-    in.read((char*)&space, sizeof(pixel));
 
-    // fill arrays with data in file
-    while (i < im.rows)
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads the header after the magic number of a P3, P6 or
+ * QOI image and tells if the readers can take it: a size of at least
+ * one pixel that fits in an int, and a maxValue from 1 to 255. It is
+ * checked before anything is allocated, so a bad header can't ask for
+ * more memory than there is.
+ *
+ * @param[in] in - the input stream, just past the magic number.
+ * @param[in] magicNumber - P3, P6 or qoif.
+ * @param[out] header - gets the comment, rows and columns.
+ * @param[out] maxValue - the max value of the pixels.
+ *
+ * @returns true if the header is a good one, false otherwise
+ *
+ * @par Example:
+   @verbatim
+   image header;
+   int maxValue;
+
+   readMagic(in, header.magicNumber);
+   if (!checkHeader(in, header.magicNumber, header, maxValue))
+       cout << "Invalid image header" << endl;
+   @endverbatim
+
+ ***********************************************************************/
+
+bool checkHeader(istream& in, string magicNumber, image& header,
+    int& maxValue)
+{
+    int channels;
+
+    if (magicNumber == "qoif")
     {
-        while (j < im.cols)
-        {
-            in.read((char*)&im.redGray[i][j], sizeof(pixel));
-            in.read((char*)&im.green[i][j], sizeof(pixel));
-            in.read((char*)&im.blue[i][j], sizeof(pixel));
-            j++;
-        }
-        i++;
-        j = 0;
+        maxValue = 255;
+        return readQoiHeader(in, header, channels);
     }
+    header.comment = "";
+    header.rows = 0;
+    header.cols = 0;
+    maxValue = 0;
+    readHeader(in, header, maxValue);
+    return in && header.rows > 0 && header.cols > 0 && maxValue > 0 &&
+        maxValue <= 255 && (long long)header.rows * header.cols <=
+        (long long)INT_MAX;
 }
 
 
@@ -291,53 +401,91 @@ void readBinary(ifstream& in, image& im, int& maxValue)
  * @author David Hill
  *
  * @par Description:
- * This function writes out the image data in binary.
+ * This function tells if a character is whitespace between ascii
+ * values, the same ones isspace takes in the C locale.
  *
- * @param[in] out - the out stream.
- * @param[in] im - the image to write out.
- * @param[in] maxValue - the max value of the pixels
+ * @param[in] c - the character.
  *
- * @returns none
+ * @returns true if it is whitespace
  *
  * @par Example:
    @verbatim
-   ofstream out;
-   image im;
-   int maxValue = 255;
-
-   writeBinary(out, im, maxValue);
+   bool space = asciiSpace('\n');
 
-   out now contains all of the image data stored in "im".
+   space is now true
    @endverbatim
 
  ***********************************************************************/
 
-void writeBinary(ofstream& out, image& im, int& maxValue)
+static inline bool asciiSpace(char c)
 {
-    int i = 0;
-    int j = 0;
-    pixel space = '\n'; // use this to print after maxValue
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
 
-    // output magic number, any comments, columns and rows, and maxValue
-    // with a space afterwards
-    out << im.magicNumber << endl;
-    out << im.comment;
-    out << im.cols << " " << im.rows << endl;
-    out << maxValue;
-    out.write((char*)&space, sizeof(pixel));
 
-    // output values from each array
-    while (i < im.rows)
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function parses the whitespace separated numbers from text up to
+ * end and adds them to values, the way in >> num would read them. It
+ * stops at anything that is not a number.
+ *
+ * @param[in] text - the first character.
+ * @param[in] end - one past the last character.
+ * @param[out] values - gets the numbers, as pixels.
+ *
+ * @returns true if it was all numbers
+ *
+ * @par Example:
+   @verbatim
+   const char text[] = "255 0\n17\n";
+   vector<pixel> values;
+
+   parseAsciiChunk(text, text + 10, values);
+
+   values is now 255, 0, 17
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool parseAsciiChunk(const char* text, const char* end,
+    vector<pixel>& values)
+{
+    unsigned int num;
+    bool negative;
+
+    while (true)
     {
-        while (j < im.cols)
+        while (text < end && asciiSpace(*text))
         {
-            out.write((char*)&im.redGray[i][j], sizeof(pixel));
-            out.write((char*)&im.green[i][j], sizeof(pixel));
-            out.write((char*)&im.blue[i][j], sizeof(pixel));
-            j++;
+            text++;
         }
-        i++;
-        j = 0;
+        if (text == end)
+        {
+            return true;
+        }
+        negative = *text == '-';
+        if (negative)
+        {
+            text++;
+        }
+        if (text == end || *text < '0' || *text > '9')
+        {
+            return false;
+        }
+        num = 0;
+        while (text < end && *text >= '0' && *text <= '9')
+        {
+            num = num * 10 + (unsigned int)(*text - '0');
+            text++;
+        }
+        if (text < end && !asciiSpace(*text))
+        {
+            return false;
+        }
+        values.push_back((pixel)(negative ? 0u - num : num));
     }
 }
 
@@ -347,49 +495,42 @@ void writeBinary(ofstream& out, image& im, int& maxValue)
  * @author David Hill
  *
  * @par Description:
- * This function writes out the image data in ascii for grayscale images.
+ * This function finds where the count'th number in text ends.
  *
- * @param[in] out - the out stream.
- * @param[in] im - the image to write out.
- * @param[in] maxValue - the max value of the pixels
+ * @param[in] text - the first character.
+ * @param[in] end - one past the last character.
+ * @param[in] count - the number of numbers to skip.
  *
- * @returns none
+ * @returns how many characters from text it ends
  *
  * @par Example:
    @verbatim
-   ofstream out;
-   image im;
-   int maxValue = 255;
-
-   writeGrayscaleAscii(out, im, maxValue);
+   const char text[] = "255 0\n17\n";
+   size_t end = skipAsciiValues(text, text + 10, 2);
 
-   out now contains the grayscale image from "im".
+   end is now 5
    @endverbatim
 
  ***********************************************************************/
 
-void writeGrayscaleAscii(ofstream& out, image& im, int& maxValue)
+static size_t skipAsciiValues(const char* text, const char* end,
+    size_t count)
 {
-    int i = 0;
-    int j = 0;
-
-    // output magic number, any comments, columns and rows, and maxValue
-    out << im.magicNumber << endl;
-    out << im.comment;
-    out << im.cols << " " << im.rows << endl;
-    out << maxValue << endl;
+    const char* start = text;
 
-    // output values from just the redGray array
-    while (i < im.rows)
+    while (count > 0)
     {
-        while (j < im.cols)
+        while (text < end && asciiSpace(*text))
         {
-            out << (int)im.redGray[i][j] << endl;
-            j++;
+            text++;
         }
-        i++;
-        j = 0;
+        while (text < end && !asciiSpace(*text))
+        {
+            text++;
+        }
+        count--;
     }
+    return (size_t)(text - start);
 }
 
 
@@ -398,50 +539,1612 @@ void writeGrayscaleAscii(ofstream& out, image& im, int& maxValue)
  * @author David Hill
  *
  * @par Description:
- * This function writes out the image data in binary for grayscale images.
+ * This function reads count whitespace separated numbers, the body of
+ * a P3 or P2 file, in parallel. The text is read a block at a time and
+ * each block is cut at whitespace into a chunk per thread. Each thread
+ * parses its chunk into its own values, then a running total of how
+ * many values each chunk had tells where its values go, and place is
+ * called for every chunk at once to put them there. The stream is left
+ * just past the last number, going back in the block if it read ahead.
  *
- * @param[in] out - the out stream.
- * @param[in] im - the image to write out.
- * @param[in] maxValue - the max value of the pixels
+ * @param[in] in - the input stream.
+ * @param[in] count - the number of values to read.
+ * @param[in] place - given the index of the first value of a chunk, the
+ *                    values and how many there are. It is called from
+ *                    several threads at once for different values.
  *
- * @returns none
+ * @returns true if count numbers were read, false if the text ran out
+ *          or had something that is not a number in it
  *
  * @par Example:
    @verbatim
-   ofstream out;
-   image im;
-   int maxValue = 255;
+   vector<pixel> line(cols * 3);
 
-   writeGrayscaleBinary(out, im, maxValue);
+   readAsciiValues(in, line.size(), [&](size_t first,
+       const pixel* values, size_t n)
+   {
+       memcpy(&line[first], values, n);
+   });
 
-   out now contains the grayscale image from "im".
+   line now holds the next row of a P3 file.
    @endverbatim
 
  ***********************************************************************/
 
-void writeGrayscaleBinary(ofstream& out, image& im, int& maxValue)
+bool readAsciiValues(istream& in, size_t count,
+    const function<void(size_t, const pixel*, size_t)>& place)
 {
-    int i = 0;
-    int j = 0;
-    pixel space = '\n'; // use this to print after maxValue
-
-    // output magic number, any comments, columns and rows, and maxValue
-    // with a space afterwards
-    out << im.magicNumber << endl;
-    out << im.comment;
-    out << im.cols << " " << im.rows << endl;
-    out << maxValue;
-    out.write((char*)&space, sizeof(pixel));
-
-    // output values from just the redGray array
-    while (i < im.rows)
+    int n = threadCount();
+    vector<char> block;
+    vector<vector<pixel>> values(n);
+    vector<size_t> bounds((size_t)n + 1);
+    vector<size_t> starts(n);
+    vector<char> good(n);
+    streamoff blockStart = in.tellg();
+    size_t carry = 0; // bytes of a number cut off at the end of a block
+    size_t done = 0;
+    size_t length;
+    size_t want;
+    size_t cut;
+    size_t total;
+    int parsed;
+    int t;
+    bool atEnd;
+
+    if (blockStart < 0)
     {
-        while (j < im.cols)
+        in.setstate(ios::failbit);
+        return false;
+    }
+    while (done < count)
+    {
+        // read a block, after whatever number was cut off last time, but
+        // not much past what the values left could take up
+        want = (count - done) * 4 + 64;
+        want = want < ASCII_BLOCK ? want : ASCII_BLOCK;
+        block.resize(carry + want);
+        in.read(block.data() + carry, (streamsize)want);
+        length = carry + (size_t)in.gcount();
+        atEnd = (size_t)in.gcount() < want;
+
+        // only go up to the last whitespace, unless there is no more
+        cut = length;
+        if (!atEnd)
         {
-            out.write((char*)&im.redGray[i][j], sizeof(pixel));
-            j++;
+            while (cut > 0 && !asciiSpace(block[cut - 1]))
+            {
+                cut--;
+            }
         }
-        i++;
-        j = 0;
+
+        // cut it into a chunk for each thread, at whitespace
+        bounds[0] = 0;
+        bounds[n] = cut;
+        t = 1;
+        while (t < n)
+        {
+            bounds[t] = cut / n * t;
+            if (bounds[t] < bounds[t - 1])
+            {
+                bounds[t] = bounds[t - 1];
+            }
+            while (bounds[t] < cut && !asciiSpace(block[bounds[t]]))
+            {
+                bounds[t]++;
+            }
+            t++;
+        }
+        parallelRows(n, [&](int first, int last)
+        {
+            while (first < last)
+            {
+                values[first].clear();
+                values[first].reserve((bounds[first + 1] -
+                    bounds[first]) / 2 + 1);
+                good[first] = parseAsciiChunk(block.data() + bounds[first],
+                    block.data() + bounds[first + 1], values[first]);
+                first++;
+            }
+        });
+
+        // add up the counts to find where each chunk's values start,
+        // stopping after a chunk that had something bad in it
+        total = done;
+        parsed = 0;
+        while (parsed < n)
+        {
+            starts[parsed] = total;
+            total += values[parsed].size();
+            parsed++;
+            if (!good[parsed - 1])
+            {
+                break;
+            }
+        }
+        parallelRows(parsed, [&](int first, int last)
+        {
+            while (first < last)
+            {
+                if (starts[first] < count)
+                {
+                    place(starts[first], values[first].data(),
+                        min(values[first].size(), count - starts[first]));
+                }
+                first++;
+            }
+        });
+
+        // with every value in, go back to just past the last one
+        if (total >= count)
+        {
+            t = 0;
+            while (starts[t] + values[t].size() < count)
+            {
+                t++;
+            }
+            in.clear();
+            in.seekg(blockStart + (streamoff)(bounds[t] + skipAsciiValues(
+                block.data() + bounds[t], block.data() + bounds[t + 1],
+                count - starts[t])));
+            return true;
+        }
+        if (parsed < n || !good[n - 1] || atEnd)
+        {
+            in.setstate(ios::failbit);
+            return false;
+        }
+
+        // keep the cut off number for the front of the next block
+        done = total;
+        carry = length - cut;
+        memmove(block.data(), block.data() + cut, carry);
+        blockStart += (streamoff)cut;
+    }
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads in the image data in ascii, allocates the arrays,
+ * and stores the data in the arrays of im.
+ *
+ * @param[in] in - the input stream.
+ * @param[in] im - the image to fill.
+ * @param[in] maxValue - the max value of the pixels
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ifstream in;
+   image im;
+   int maxValue = 255;
+
+   readAscii(in, im, maxValue);
+
+   im now contains all the data that "in" read in.
+   @endverbatim
+
+ ***********************************************************************/
+
+void readAscii(istream& in, image& im, int& maxValue)
+{
+    // read in comments, columns, rows and maxValue
+    readHeader(in, im, maxValue);
+
+    // allocate arrays with these sizes
+    allocateArray(im.redGray, im.rows, im.cols);
+    allocateArray(im.green, im.rows, im.cols);
+    allocateArray(im.blue, im.rows, im.cols);
+
+    // fill arrays with data in file
+    readAsciiRows(in, im);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads the next im.rows rows of ascii values into the
+ * arrays of im, which are already allocated. The header has to have
+ * been read already, or the rows before these.
+ *
+ * @param[in] in - the input stream.
+ * @param[in] im - the image to fill.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   netImage band(16, cols);
+
+   readAsciiRows(in, band.get());
+
+   band has the next 16 rows of the input.
+   @endverbatim
+
+ ***********************************************************************/
+
+void readAsciiRows(istream& in, image& im)
+{
+    pixel** planes[3] = { im.redGray, im.green, im.blue };
+
+    // fill arrays with data in file, red, green and blue in turn
+    readAsciiValues(in, (size_t)im.rows * im.cols * 3, [&](size_t first,
+        const pixel* values, size_t n)
+    {
+        size_t at = first / 3;
+        int c = (int)(first % 3);
+        int i = (int)(at / im.cols);
+        int j = (int)(at % im.cols);
+        size_t k = 0;
+
+        while (k < n)
+        {
+            planes[c][i][j] = values[k];
+            c++;
+            if (c == 3)
+            {
+                c = 0;
+                j++;
+                if (j == im.cols)
+                {
+                    j = 0;
+                    i++;
+                }
+            }
+            k++;
+        }
+    });
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads the next im.rows rows of a P3 or P6 image into
+ * the arrays of im, which are already allocated. The header has to have
+ * been read already, and for P6 the single space after it, or the rows
+ * before these.
+ *
+ * @param[in] in - the input stream.
+ * @param[in] im - the image to fill.
+ * @param[in] magicNumber - P3 or P6.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   netImage band(16, cols);
+
+   readRows(in, band.get(), "P6");
+
+   band has the next 16 rows of the input.
+   @endverbatim
+
+ ***********************************************************************/
+
+void readRows(istream& in, image& im, string magicNumber)
+{
+    const kernelTable& k = kernels();
+    vector<pixel> line;
+    int i = 0;
+
+    if (magicNumber != "P6")
+    {
+        readAsciiRows(in, im);
+        return;
+    }
+
+    // a row at a time, split into its colors
+    line.resize((size_t)im.cols * 3);
+    while (i < im.rows)
+    {
+        in.read((char*)line.data(), (streamsize)line.size());
+        k.splitRow(line.data(), im.redGray[i], im.green[i], im.blue[i],
+            im.cols);
+        i++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes rows of pixels out in ascii, one value to a
+ * line. Bands of rows are turned into text on all the threads at once,
+ * each into its own buffer, and the buffers are written out in order,
+ * so the text is the same as writing it one row at a time. Without
+ * green and blue only red is written.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] red - the red or gray rows.
+ * @param[in] green - the green rows, or nullptr.
+ * @param[in] blue - the blue rows, or nullptr.
+ * @param[in] rows - the number of rows.
+ * @param[in] cols - the number of columns.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   image im;
+
+   writeAsciiRows(cout, im.redGray, nullptr, nullptr, im.rows, im.cols);
+
+   cout now has every gray value of im, one to a line.
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeAsciiRows(ostream& out, pixel** red, pixel** green,
+    pixel** blue, int rows, int cols)
+{
+    const kernelTable& k = kernels();
+    int channels = green == nullptr ? 1 : 3;
+    size_t rowText = (size_t)cols * channels * 4;
+    int bandRows = (int)(ASCII_BAND / rowText);
+    int bands = threadCount();
+    vector<vector<char>> text(bands);
+    vector<size_t> used(bands);
+    int i = 0;
+    int b;
+    int count;
+
+    if (bandRows < 1)
+    {
+        bandRows = 1;
+    }
+    while (i < rows)
+    {
+        // turn the next bands of rows into text, a band to a buffer
+        count = (rows - i + bandRows - 1) / bandRows;
+        if (count > bands)
+        {
+            count = bands;
+        }
+        parallelRows(count, [&](int first, int last)
+        {
+            vector<pixel> line(channels == 3 ? (size_t)cols * 3 : 0);
+
+            while (first < last)
+            {
+                int row = i + first * bandRows;
+                int end = row + bandRows < rows ? row + bandRows : rows;
+                vector<char>& band = text[first];
+                const pixel* values = nullptr;
+                size_t at = 0;
+
+                band.resize(rowText * (end - row));
+                while (row < end)
+                {
+                    values = red[row];
+                    if (channels == 3)
+                    {
+                        k.joinRow(red[row], green[row], blue[row],
+                            line.data(), cols);
+                        values = line.data();
+                    }
+                    at += k.formatValues(values, cols * channels,
+                        band.data() + at);
+                    row++;
+                }
+                used[first] = at;
+                first++;
+            }
+        });
+
+        // and write them out in order
+        b = 0;
+        while (b < count)
+        {
+            out.write(text[b].data(), (streamsize)used[b]);
+            b++;
+        }
+        i += count * bandRows;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes out the image data in ascii.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] im - the image to write out.
+ * @param[in] maxValue - the max value of the pixels
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ofstream out;
+   image im;
+   int maxValue = 255;
+
+   writeAscii(out, im, maxValue);
+
+   out now contains all of the image data stored in "im".
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeAscii(ostream& out, image& im, int& maxValue)
+{
+    // output magic number, any comments, columns and rows, and maxValue
+    out << im.magicNumber << endl;
+    out << im.comment;
+    out << im.cols << " " << im.rows << endl;
+    out << maxValue << endl;
+
+    // output values from each array, red, green and blue in turn
+    writeAsciiRows(out, im.redGray, im.green, im.blue, im.rows, im.cols);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads in the image data in binary, allocates the arrays,
+ * and stores the data in the arrays of im.
+ *
+ * @param[in] in - the input stream.
+ * @param[in] im - the image to fill.
+ * @param[in] maxValue - the max value of the pixels
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ifstream in;
+   image im;
+   int maxValue = 255;
+
+   readBinary(in, im, maxValue);
+
+   im now contains all the data that "in" read in.
+   @endverbatim
+
+ ***********************************************************************/
+
+void readBinary(istream& in, image& im, int& maxValue)
+{
+    const kernelTable& k = kernels();
+    int i = 0;
+    pixel space;
+
+    // read in comments, columns, rows and maxValue
+    readHeader(in, im, maxValue);
+
+    // allocate arrays with these sizes
+    allocateArray(im.redGray, im.rows, im.cols);
+    allocateArray(im.green, im.rows, im.cols);
+    allocateArray(im.blue, im.rows, im.cols);
+
+    // read in single space after maxValue
+    in.read((char*)&space, sizeof(pixel));
+
+    // fill arrays with data in file a row at a time
+    vector<pixel> line((size_t)im.cols * 3);
+    while (i < im.rows)
+    {
+        in.read((char*)line.data(), (streamsize)line.size());
+        k.splitRow(line.data(), im.redGray[i], im.green[i], im.blue[i],
+            im.cols);
+        i++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes rows of pixels out in binary, red, green and
+ * blue together for each pixel. Without green and blue only red is
+ * written.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] red - the red or gray rows.
+ * @param[in] green - the green rows, or nullptr.
+ * @param[in] blue - the blue rows, or nullptr.
+ * @param[in] rows - the number of rows.
+ * @param[in] cols - the number of columns.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   image im;
+
+   writeBinaryRows(out, im.redGray, im.green, im.blue, im.rows, im.cols);
+
+   out now has every pixel of im, three bytes to a pixel.
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeBinaryRows(ostream& out, pixel** red, pixel** green,
+    pixel** blue, int rows, int cols)
+{
+    const kernelTable& k = kernels();
+    vector<pixel> line(green == nullptr ? 0 : (size_t)cols * 3);
+    int i = 0;
+
+    while (i < rows)
+    {
+        if (green == nullptr)
+        {
+            out.write((char*)red[i], cols);
+        }
+        else
+        {
+            k.joinRow(red[i], green[i], blue[i], line.data(), cols);
+            out.write((char*)line.data(), (streamsize)line.size());
+        }
+        i++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes out the image data in binary.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] im - the image to write out.
+ * @param[in] maxValue - the max value of the pixels
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ofstream out;
+   image im;
+   int maxValue = 255;
+
+   writeBinary(out, im, maxValue);
+
+   out now contains all of the image data stored in "im".
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeBinary(ostream& out, image& im, int& maxValue)
+{
+    pixel space = '\n'; // use this to print after maxValue
+
+    // output magic number, any comments, columns and rows, and maxValue
+    // with a space afterwards
+    out << im.magicNumber << endl;
+    out << im.comment;
+    out << im.cols << " " << im.rows << endl;
+    out << maxValue;
+    out.write((char*)&space, sizeof(pixel));
+
+    // output values from each array a row at a time
+    writeBinaryRows(out, im.redGray, im.green, im.blue, im.rows, im.cols);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes out the image data in ascii for grayscale images.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] im - the image to write out.
+ * @param[in] maxValue - the max value of the pixels
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ofstream out;
+   image im;
+   int maxValue = 255;
+
+   writeGrayscaleAscii(out, im, maxValue);
+
+   out now contains the grayscale image from "im".
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeGrayscaleAscii(ostream& out, image& im, int& maxValue)
+{
+    // output magic number, any comments, columns and rows, and maxValue
+    out << im.magicNumber << endl;
+    out << im.comment;
+    out << im.cols << " " << im.rows << endl;
+    out << maxValue << endl;
+
+    // output values from just the redGray array
+    writeAsciiRows(out, im.redGray, nullptr, nullptr, im.rows, im.cols);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes out the image data in binary for grayscale images.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] im - the image to write out.
+ * @param[in] maxValue - the max value of the pixels
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ofstream out;
+   image im;
+   int maxValue = 255;
+
+   writeGrayscaleBinary(out, im, maxValue);
+
+   out now contains the grayscale image from "im".
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeGrayscaleBinary(ostream& out, image& im, int& maxValue)
+{
+    pixel space = '\n'; // use this to print after maxValue
+
+    // output magic number, any comments, columns and rows, and maxValue
+    // with a space afterwards
+    out << im.magicNumber << endl;
+    out << im.comment;
+    out << im.cols << " " << im.rows << endl;
+    out << maxValue;
+    out.write((char*)&space, sizeof(pixel));
+
+    // output values from just the redGray array, a row at a time
+    writeBinaryRows(out, im.redGray, nullptr, nullptr, im.rows, im.cols);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes rows of a black and white image out one bit to a
+ * pixel, 1 for black. In binary the bits are packed 8 to a byte, first
+ * pixel in the high bit, with each row starting on a new byte. In ascii
+ * each bit is a 0 or 1 on its own line. Red/gray values below 128 are
+ * black.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] gray - the red/gray rows.
+ * @param[in] rows - the number of rows.
+ * @param[in] cols - the number of columns.
+ * @param[in] ascii - true for P1, false for P4.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   image im;
+
+   writeBitmapRows(out, im.redGray, im.rows, im.cols, false);
+
+   out now has the rows of im packed 8 pixels to a byte.
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeBitmapRows(ostream& out, pixel** gray, int rows, int cols,
+    bool ascii)
+{
+    const kernelTable& k = kernels();
+    vector<pixel> bits(((size_t)cols + 7) / 8);
+    vector<char> text(ascii ? (size_t)cols * 2 : 0);
+    int i = 0;
+    int j;
+
+    while (i < rows)
+    {
+        if (ascii)
+        {
+            j = 0;
+            while (j < cols)
+            {
+                text[(size_t)j * 2] = gray[i][j] < 128 ? '1' : '0';
+                text[(size_t)j * 2 + 1] = '\n';
+                j++;
+            }
+            out.write(text.data(), (streamsize)text.size());
+        }
+        else
+        {
+            k.packRow(gray[i], cols, bits.data());
+            out.write((char*)bits.data(), (streamsize)bits.size());
+        }
+        i++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes out a black and white image in ascii, as P1. A
+ * bitmap has no max value in its header.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] im - the image to write out.
+ * @param[in] maxValue - not used, bitmaps are always 0 or 1
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ofstream out;
+   image im;
+   int maxValue = 255;
+
+   dither(im, DITHER_FLOYD, 128);
+   im.magicNumber = "P1";
+   writeBitmapAscii(out, im, maxValue);
+
+   out now contains the dithered image from "im".
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeBitmapAscii(ostream& out, image& im, int& maxValue)
+{
+    (void)maxValue;
+
+    // output magic number, any comments, and columns and rows
+    out << im.magicNumber << endl;
+    out << im.comment;
+    out << im.cols << " " << im.rows << endl;
+
+    // output just the redGray array, a bit to a line
+    writeBitmapRows(out, im.redGray, im.rows, im.cols, true);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes out a black and white image in binary, as P4,
+ * with 8 pixels to a byte. A bitmap has no max value in its header.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] im - the image to write out.
+ * @param[in] maxValue - not used, bitmaps are always 0 or 1
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ofstream out;
+   image im;
+   int maxValue = 255;
+
+   dither(im, DITHER_BAYER, 128);
+   im.magicNumber = "P4";
+   writeBitmapBinary(out, im, maxValue);
+
+   out now contains the dithered image from "im", packed into bits.
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeBitmapBinary(ostream& out, image& im, int& maxValue)
+{
+    (void)maxValue;
+
+    // output magic number, any comments, and columns and rows
+    out << im.magicNumber << endl;
+    out << im.comment;
+    out << im.cols << " " << im.rows << endl;
+
+    // output just the redGray array, packed into bits a row at a time
+    writeBitmapRows(out, im.redGray, im.rows, im.cols, false);
+}
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads the rectangle out of a crop option. The option
+ * looks like x,y,w,h where x and y are the top left corner.
+ *
+ * @param[in] spec - the text after --crop.
+ * @param[out] area - the rectangle to crop to.
+ *
+ * @returns true if the rectangle is valid, false if not.
+ *
+ * @par Example:
+   @verbatim
+   cropRegion area;
+
+   parseCrop("100,50,512,512", area);
+
+   output: true, area is 512 x 512 starting at column 100, row 50
+   @endverbatim
+
+ ***********************************************************************/
+
+bool parseCrop(string spec, cropRegion& area)
+{
+    istringstream values(spec);
+    char sep[3] = { 0, 0, 0 };
+
+    if (!(values >> area.x >> sep[0] >> area.y >> sep[1] >> area.w >>
+        sep[2] >> area.h) || values.peek() != EOF)
+    {
+        return false;
+    }
+    if (sep[0] != ',' || sep[1] != ',' || sep[2] != ',')
+    {
+        return false;
+    }
+    return area.x >= 0 && area.y >= 0 && area.w > 0 && area.h > 0;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function trims a crop rectangle so it lies inside the image. If
+ * nothing would be left, the rectangle becomes the whole image and
+ * false is returned, so callers that checked already can ignore it.
+ *
+ * @param[in] area - the rectangle to trim.
+ * @param[in] rows - the number of rows of the image.
+ * @param[in] cols - the number of columns of the image.
+ *
+ * @returns true if the rectangle overlaps the image, false if not.
+ *
+ * @par Example:
+   @verbatim
+   cropRegion area = { 700, 0, 100, 100 };
+
+   clipRegion(area, 486, 735);
+
+   output: true, area.w is now 35.
+   @endverbatim
+
+ ***********************************************************************/
+
+bool clipRegion(cropRegion& area, int rows, int cols)
+{
+    if (area.x >= cols || area.y >= rows)
+    {
+        area.x = 0;
+        area.y = 0;
+        area.w = cols;
+        area.h = rows;
+        return false;
+    }
+    if ((long long)area.x + area.w > cols)
+    {
+        area.w = cols - area.x;
+    }
+    if ((long long)area.y + area.h > rows)
+    {
+        area.h = rows - area.y;
+    }
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads rows of a crop rectangle straight out of binary
+ * data. Every binary pixel is 3 bytes, so the rows and columns under
+ * the rectangle can be found without reading anything else. When the
+ * rectangle is the full width, the rows are read in one piece.
+ *
+ * @param[in] in - the input stream.
+ * @param[in] data - the position of the first pixel in the stream.
+ * @param[in] cols - the number of columns of the whole image.
+ * @param[in] area - the rectangle, already clipped to the image.
+ * @param[in] row - the first row to read, counted from the top of area.
+ * @param[in] count - the number of rows to read.
+ * @param[out] buffer - count rows of area.w interleaved pixels.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   vector<pixel> buffer(area.w * 3 * 16);
+
+   readBinaryRows(in, data, im.cols, area, 0, 16, buffer.data());
+
+   buffer now holds the first 16 rows of the rectangle.
+   @endverbatim
+
+ ***********************************************************************/
+
+void readBinaryRows(istream& in, streampos data, int cols,
+    cropRegion area, int row, int count, pixel* buffer)
+{
+    streamoff rowBytes = (streamoff)cols * 3;
+    streamoff spanBytes = (streamoff)area.w * 3;
+    int i = 0;
+
+    if (area.x == 0 && area.w == cols)
+    {
+        in.seekg(data + (streamoff)(area.y + row) * rowBytes);
+        in.read((char*)buffer, spanBytes * count);
+        return;
+    }
+
+    // jump to just the span of each row under the rectangle
+    while (i < count)
+    {
+        in.seekg(data + (streamoff)(area.y + row + i) * rowBytes +
+            (streamoff)area.x * 3);
+        in.read((char*)buffer + spanBytes * i, spanBytes);
+        i++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads in only the part of a binary image that lies
+ * under a crop rectangle, allocates the arrays at that size, and stores
+ * the data in the arrays of im. The rest of the file is never read.
+ *
+ * @param[in] in - the input stream.
+ * @param[in] im - the image to fill.
+ * @param[in] maxValue - the max value of the pixels
+ * @param[in] area - the rectangle to read.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ifstream in;
+   image im;
+   int maxValue = 255;
+   cropRegion area = { 1000, 2000, 512, 512 };
+
+   readBinaryRegion(in, im, maxValue, area);
+
+   im now holds the 512 x 512 tile at column 1000, row 2000.
+   @endverbatim
+
+ ***********************************************************************/
+
+void readBinaryRegion(istream& in, image& im, int& maxValue,
+    cropRegion area)
+{
+    const int BATCH = 64; // rows read at a time
+    const kernelTable& k = kernels();
+    pixel space;
+    streampos data;
+    int rows;
+    int cols;
+    int count;
+    int i = 0;
+    int r;
+
+    // read in the header and the single space after maxValue
+    readHeader(in, im, maxValue);
+    in.read((char*)&space, sizeof(pixel));
+    data = in.tellg();
+    rows = im.rows;
+    cols = im.cols;
+    clipRegion(area, im.rows, im.cols);
+
+    // allocate arrays with the size of the rectangle
+    im.rows = area.h;
+    im.cols = area.w;
+    allocateArray(im.redGray, im.rows, im.cols);
+    allocateArray(im.green, im.rows, im.cols);
+    allocateArray(im.blue, im.rows, im.cols);
+
+    // read a batch of rows at a time and split them into the arrays
+    vector<pixel> buffer((size_t)BATCH * area.w * 3);
+    while (i < im.rows)
+    {
+        count = im.rows - i < BATCH ? im.rows - i : BATCH;
+        readBinaryRows(in, data, cols, area, i, count, buffer.data());
+        r = 0;
+        while (r < count)
+        {
+            k.splitRow(&buffer[(size_t)r * area.w * 3], im.redGray[i + r],
+                im.green[i + r], im.blue[i + r], im.cols);
+            r++;
+        }
+        i += count;
+    }
+
+    // leave the stream at the end of the image, where any next one starts
+    in.seekg(data + (streamoff)rows * cols * 3);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads in an ascii image and keeps only the part under a
+ * crop rectangle.
+ *
+ * @param[in] in - the input stream.
+ * @param[in] im - the image to fill.
+ * @param[in] maxValue - the max value of the pixels
+ * @param[in] area - the rectangle to keep.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ifstream in;
+   image im;
+   int maxValue = 255;
+   cropRegion area = { 0, 0, 100, 100 };
+
+   readAsciiRegion(in, im, maxValue, area);
+
+   im now holds the top left 100 x 100 pixels.
+   @endverbatim
+
+ ***********************************************************************/
+
+void readAsciiRegion(istream& in, image& im, int& maxValue,
+    cropRegion area)
+{
+    readAscii(in, im, maxValue);
+    crop(im, area);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function returns the magic number to write out for an option
+ * and output type. Grayscale writes gray images, --threshold and
+ * --dither write black and white bitmaps, everything else writes color
+ * images. QOI has just the one type for all of them.
+ *
+ * @param[in] optionCode - the option, or empty for none.
+ * @param[in] outputType - --ascii, --binary or --qoi.
+ *
+ * @returns P1, P2, P3, P4, P5, P6 or qoif.
+ *
+ * @par Example:
+   @verbatim
+   string magic = outputMagic("--grayscale", "--binary");
+
+   magic is now "P5"
+   @endverbatim
+
+ ***********************************************************************/
+
+string outputMagic(string optionCode, string outputType)
+{
+    ditherType method;
+    int level;
+
+    if (outputType == "--qoi")
+    {
+        return "qoif";
+    }
+    if (optionCode == "--grayscale")
+    {
+        return outputType == "--ascii" ? "P2" : "P5";
+    }
+    if (parseDither(optionCode, method, level))
+    {
+        return outputType == "--ascii" ? "P1" : "P4";
+    }
+    return outputType == "--ascii" ? "P3" : "P6";
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads the magic number at the start of a file. Netpbm
+ * magic numbers are a word like P6, but a QOI file starts with the four
+ * bytes "qoif" and binary right after them, so those are read as bytes.
+ *
+ * @param[in] in - the input stream.
+ * @param[out] magicNumber - P2 through P6, qoif, or whatever was there.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ifstream in;
+   string magic;
+
+   readMagic(in, magic);
+
+   magic is now "qoif" if "in" is a qoi file.
+   @endverbatim
+
+ ***********************************************************************/
+
+void readMagic(istream& in, string& magicNumber)
+{
+    char bytes[4] = { 0, 0, 0, 0 };
+
+    if (in.peek() != 'q')
+    {
+        in >> magicNumber;
+        return;
+    }
+    in.read(bytes, 4);
+    magicNumber.assign(bytes, (size_t)in.gcount());
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads the rest of a QOI header after the magic bytes:
+ * the width and height, big endian, then the number of channels and
+ * the color space.
+ *
+ * @param[in] in - the input stream.
+ * @param[out] im - gets the rows and columns.
+ * @param[out] channels - 3 for rgb, 4 for rgba.
+ *
+ * @returns true if the header is a good one
+ *
+ * @par Example:
+   @verbatim
+   ifstream in;
+   image im;
+   int channels;
+
+   readMagic(in, im.magicNumber);
+   readQoiHeader(in, im, channels);
+
+   im.rows and im.cols now hold the size of the image.
+   @endverbatim
+
+ ***********************************************************************/
+
+bool readQoiHeader(istream& in, image& im, int& channels)
+{
+    unsigned char bytes[10];
+    unsigned long long width;
+    unsigned long long height;
+
+    im.comment = "";
+    im.rows = 0;
+    im.cols = 0;
+    in.read((char*)bytes, sizeof(bytes));
+    if (in.gcount() != (streamsize)sizeof(bytes))
+    {
+        return false;
+    }
+    width = (unsigned long long)bytes[0] << 24 | bytes[1] << 16 |
+        bytes[2] << 8 | bytes[3];
+    height = (unsigned long long)bytes[4] << 24 | bytes[5] << 16 |
+        bytes[6] << 8 | bytes[7];
+    channels = bytes[8];
+    if (width == 0 || height == 0 || width * height > (unsigned)INT_MAX ||
+        (channels != 3 && channels != 4))
+    {
+        return false;
+    }
+    im.rows = (int)height;
+    im.cols = (int)width;
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads in a QOI image after its magic bytes, allocates
+ * the arrays, and stores the data in the arrays of im. Any alpha is
+ * dropped. The bytes are pulled straight from the stream buffer, so
+ * nothing past the end marker is read.
+ *
+ * @param[in] in - the input stream.
+ * @param[in] im - the image to fill.
+ * @param[out] maxValue - set to 255, the only depth qoi has.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ifstream in;
+   image im;
+   int maxValue;
+
+   readMagic(in, im.magicNumber);
+   readQoi(in, im, maxValue);
+
+   im now contains all the data that "in" read in.
+   @endverbatim
+
+ ***********************************************************************/
+
+void readQoi(istream& in, image& im, int& maxValue)
+{
+    streambuf* buffer = in.rdbuf();
+    pixel index[64][4];
+    pixel px[4] = { 0, 0, 0, 255 };
+    int channels = 3;
+    int run = 0;
+    int code;
+    int next;
+    int diff;
+    int i = 0;
+    int j;
+
+    maxValue = 255;
+    if (!readQoiHeader(in, im, channels))
+    {
+        in.setstate(ios::failbit);
+        return;
+    }
+    allocateArray(im.redGray, im.rows, im.cols);
+    allocateArray(im.green, im.rows, im.cols);
+    allocateArray(im.blue, im.rows, im.cols);
+    memset(index, 0, sizeof(index));
+
+    while (i < im.rows)
+    {
+        j = 0;
+        while (j < im.cols)
+        {
+            if (run > 0)
+            {
+                run--;
+            }
+            else
+            {
+                code = buffer->sbumpc();
+                if (code == EOF)
+                {
+                    in.setstate(ios::failbit | ios::eofbit);
+                    return;
+                }
+                if (code == 0xfe || code == 0xff)
+                {
+                    // a whole pixel, with alpha for 0xff
+                    px[0] = (pixel)buffer->sbumpc();
+                    px[1] = (pixel)buffer->sbumpc();
+                    px[2] = (pixel)buffer->sbumpc();
+                    if (code == 0xff)
+                    {
+                        px[3] = (pixel)buffer->sbumpc();
+                    }
+                }
+                else if ((code & 0xc0) == 0x00)
+                {
+                    // a pixel seen before
+                    memcpy(px, index[code], 4);
+                }
+                else if ((code & 0xc0) == 0x40)
+                {
+                    // small changes to each color
+                    px[0] = (pixel)(px[0] + ((code >> 4) & 3) - 2);
+                    px[1] = (pixel)(px[1] + ((code >> 2) & 3) - 2);
+                    px[2] = (pixel)(px[2] + (code & 3) - 2);
+                }
+                else if ((code & 0xc0) == 0x80)
+                {
+                    // a change to green, and red and blue near it
+                    next = buffer->sbumpc();
+                    diff = (code & 0x3f) - 32;
+                    px[0] = (pixel)(px[0] + diff + ((next >> 4) & 15) - 8);
+                    px[1] = (pixel)(px[1] + diff);
+                    px[2] = (pixel)(px[2] + diff + (next & 15) - 8);
+                }
+                else
+                {
+                    // the same pixel again, this one and run more
+                    run = code & 0x3f;
+                }
+                memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 +
+                    px[3] * 11) % 64], px, 4);
+            }
+            im.redGray[i][j] = px[0];
+            im.green[i][j] = px[1];
+            im.blue[i][j] = px[2];
+            j++;
+        }
+        i++;
+    }
+
+    // step over the end marker of seven zeros and a one
+    j = 0;
+    while (j < 8 && buffer->sbumpc() != EOF)
+    {
+        j++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads in a QOI image and keeps only the part under a
+ * crop rectangle.
+ *
+ * @param[in] in - the input stream.
+ * @param[in] im - the image to fill.
+ * @param[in] maxValue - the max value of the pixels
+ * @param[in] area - the rectangle to keep.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ifstream in;
+   image im;
+   int maxValue;
+   cropRegion area = { 0, 0, 100, 100 };
+
+   readQoiRegion(in, im, maxValue, area);
+
+   im now holds the top left 100 x 100 of the image.
+   @endverbatim
+
+ ***********************************************************************/
+
+void readQoiRegion(istream& in, image& im, int& maxValue,
+    cropRegion area)
+{
+    readQoi(in, im, maxValue);
+    crop(im, area);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes out rows of pixels as a QOI image, using the
+ * same choice of chunks as the reference encoder. The chunks for each
+ * row are gathered in a buffer and written out together.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] red - the red arrays.
+ * @param[in] green - the green arrays.
+ * @param[in] blue - the blue arrays.
+ * @param[in] rows - the number of rows.
+ * @param[in] cols - the number of columns.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   writeQoiPlanes(out, im.redGray, im.green, im.blue, im.rows, im.cols);
+
+   out now contains the image as qoi.
+   @endverbatim
+
+ ***********************************************************************/
+
+static void writeQoiPlanes(ostream& out, pixel** red, pixel** green,
+    pixel** blue, int rows, int cols)
+{
+    const unsigned char END[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    unsigned char header[14] = { 'q', 'o', 'i', 'f' };
+    vector<unsigned char> chunks((size_t)cols * 5 + 2);
+    pixel index[64][4];
+    pixel prev[4] = { 0, 0, 0, 255 };
+    pixel px[4] = { 0, 0, 0, 255 };
+    size_t length;
+    int slot;
+    int run = 0;
+    int dr;
+    int dg;
+    int db;
+    int i = 0;
+    int j;
+
+    header[4] = (unsigned char)(cols >> 24);
+    header[5] = (unsigned char)(cols >> 16);
+    header[6] = (unsigned char)(cols >> 8);
+    header[7] = (unsigned char)cols;
+    header[8] = (unsigned char)(rows >> 24);
+    header[9] = (unsigned char)(rows >> 16);
+    header[10] = (unsigned char)(rows >> 8);
+    header[11] = (unsigned char)rows;
+    header[12] = 3;
+    header[13] = 0;
+    out.write((char*)header, sizeof(header));
+
+    // the slots start out black with no alpha, so opaque black is not
+    // in them until it has been seen
+    memset(index, 0, sizeof(index));
+
+    while (i < rows)
+    {
+        length = 0;
+        j = 0;
+        while (j < cols)
+        {
+            px[0] = red[i][j];
+            px[1] = green[i][j];
+            px[2] = blue[i][j];
+            if (px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2])
+            {
+                run++;
+                if (run == 62)
+                {
+                    chunks[length++] = (unsigned char)(0xc0 | (run - 1));
+                    run = 0;
+                }
+                j++;
+                continue;
+            }
+            if (run > 0)
+            {
+                chunks[length++] = (unsigned char)(0xc0 | (run - 1));
+                run = 0;
+            }
+
+            slot = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+            if (memcmp(index[slot], px, 4) == 0)
+            {
+                chunks[length++] = (unsigned char)slot;
+            }
+            else
+            {
+                memcpy(index[slot], px, 4);
+                dr = (signed char)(px[0] - prev[0]);
+                dg = (signed char)(px[1] - prev[1]);
+                db = (signed char)(px[2] - prev[2]);
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 &&
+                    db >= -2 && db <= 1)
+                {
+                    chunks[length++] = (unsigned char)(0x40 |
+                        (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                }
+                else if (dg >= -32 && dg <= 31 && dr - dg >= -8 &&
+                    dr - dg <= 7 && db - dg >= -8 && db - dg <= 7)
+                {
+                    chunks[length++] = (unsigned char)(0x80 | (dg + 32));
+                    chunks[length++] = (unsigned char)((dr - dg + 8) << 4 |
+                        (db - dg + 8));
+                }
+                else
+                {
+                    chunks[length++] = 0xfe;
+                    chunks[length++] = px[0];
+                    chunks[length++] = px[1];
+                    chunks[length++] = px[2];
+                }
+            }
+            memcpy(prev, px, 3);
+            j++;
+        }
+
+        // a run that reaches the last pixel is ended there
+        if (i == rows - 1 && run > 0)
+        {
+            chunks[length++] = (unsigned char)(0xc0 | (run - 1));
+        }
+        out.write((char*)chunks.data(), (streamsize)length);
+        i++;
     }
-}
\ No newline at end of file
+    out.write((const char*)END, sizeof(END));
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes out the image data as QOI.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] im - the image to write out.
+ * @param[in] maxValue - the max value of the pixels
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ofstream out;
+   image im;
+   int maxValue = 255;
+
+   writeQoi(out, im, maxValue);
+
+   out now contains all of the image data stored in "im".
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeQoi(ostream& out, image& im, int& maxValue)
+{
+    (void)maxValue;
+    writeQoiPlanes(out, im.redGray, im.green, im.blue, im.rows, im.cols);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes out the image data as QOI for grayscale images.
+ * QOI has no gray type, so the red/gray array is used for all three
+ * colors.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] im - the image to write out.
+ * @param[in] maxValue - the max value of the pixels
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ofstream out;
+   image im;
+   int maxValue = 255;
+
+   writeGrayscaleQoi(out, im, maxValue);
+
+   out now contains the grayscale image from "im".
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeGrayscaleQoi(ostream& out, image& im, int& maxValue)
+{
+    (void)maxValue;
+    writeQoiPlanes(out, im.redGray, im.redGray, im.redGray, im.rows,
+        im.cols);
+}
@@ -0,0 +1,93 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief makes synthetic images of any size for testing and benchmarking.
+ *
+ * @par Usage:
+   @verbatim
+   c:\> imageGen.exe type WxH pattern [seed] image.ppm
+
+        type - P2, P3, P5, P6 or qoi
+        WxH - the width and height of the image
+        pattern - gradient, checker, bars or noise
+        seed - which noise, 1 by default
+        image.ppm - the file to write, or - to write to stdout
+   @endverbatim
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This is the starting point to the generator. It writes an image of
+  * the given type, size and pattern. The same arguments always write the
+  * same file, and P2, P3, P5 and P6 are written a band of rows at a time,
+  * so images far bigger than memory can be made.
+  *
+  * @param[in] argc - the number of arguments from the command prompt.
+  * @param[in] argv - a 2d array of characters containing the arguments.
+  *
+  * @returns 0 if the image was written, 1 otherwise
+  *
+  * @verbatim
+    imageGen.exe P6 40000x25000 noise 3 big.ppm
+
+    big.ppm is now a gigapixel image of noise.
+    @endverbatim
+  *
+  ***********************************************************************/
+
+int main(int argc, char** argv)
+{
+    ofstream file;
+    string type;
+    synthPattern pattern;
+    unsigned int seed = 1;
+    int cols = 0;
+    int rows = 0;
+    char by = ' ';
+
+    if (argc != 5 && argc != 6)
+    {
+        cout << "Usage: imageGen.exe type WxH pattern [seed] image.ppm"
+            << endl;
+        cout << "        type - P2, P3, P5, P6 or qoi" << endl;
+        cout << "        pattern - gradient, checker, bars or noise" << endl;
+        return 1;
+    }
+    type = argv[1] == (string)"qoi" ? "qoif" : argv[1];
+    if (type != "P2" && type != "P3" && type != "P5" && type != "P6" &&
+        type != "qoif")
+    {
+        cout << "Invalid type: " << argv[1] << endl;
+        return 1;
+    }
+    istringstream size(argv[2]);
+    if (!(size >> cols >> by >> rows) || by != 'x' || cols < 1 ||
+        rows < 1 || size.peek() != EOF)
+    {
+        cout << "Invalid size: " << argv[2] << endl;
+        return 1;
+    }
+    if (!parsePattern(argv[3], pattern))
+    {
+        cout << "Invalid pattern: " << argv[3] << endl;
+        return 1;
+    }
+    if (argc == 6)
+    {
+        seed = (unsigned int)strtoul(argv[4], nullptr, 10);
+    }
+
+    ostream out(nullptr);
+    if (!openOutputStream(out, file, argv[argc - 1]))
+    {
+        return 1;
+    }
+    writeSynthetic(out, type, rows, cols, pattern, seed);
+    out.flush();
+    return out ? 0 : 1;
+}
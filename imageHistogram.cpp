@@ -0,0 +1,460 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that count pixel values and remap them
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <mutex>
+
+/*!
+ * @brief LEVELS_CLIP the fraction of pixels autolevels ignores at each end
+ */
+
+const double LEVELS_CLIP = 0.005;
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function counts how many times each value shows up in each
+  * color of an image. Every thread counts its own band of rows into a
+  * private histogram, so there is no sharing while counting, and the
+  * bands are added together when they finish.
+  *
+  * @param[in] im - the image to count.
+  * @param[out] hist - the counts for red/gray, green and blue.
+  *
+  * @returns none
+  *
+  * @par Example:
+    @verbatim
+    image im;
+    histogram hist;
+
+    buildHistogram(im, hist);
+
+    hist.count[0][255] is now the number of pixels with full red.
+    @endverbatim
+
+  ***********************************************************************/
+
+void buildHistogram(image& im, histogram& hist)
+{
+    mutex merge;
+
+    memset(&hist, 0, sizeof(histogram));
+    parallelRows(im.rows, [&](int start, int end)
+    {
+        // four sets of counters per color so runs of the same value
+        // don't wait on each other
+        vector<long long> local(4 * 3 * 256, 0);
+        pixel** planes[3] = { im.redGray, im.green, im.blue };
+        long long* count;
+        const pixel* row;
+        int i = start;
+        int j;
+        int c;
+        int k;
+
+        while (i < end)
+        {
+            c = 0;
+            while (c < 3)
+            {
+                count = &local[(size_t)c * 4 * 256];
+                row = planes[c][i];
+                j = 0;
+                while (j + 4 <= im.cols)
+                {
+                    count[row[j]]++;
+                    count[256 + row[j + 1]]++;
+                    count[512 + row[j + 2]]++;
+                    count[768 + row[j + 3]]++;
+                    j += 4;
+                }
+                while (j < im.cols)
+                {
+                    count[row[j]]++;
+                    j++;
+                }
+                c++;
+            }
+            i++;
+        }
+
+        // add this band into the totals
+        lock_guard<mutex> lock(merge);
+        c = 0;
+        while (c < 3)
+        {
+            j = 0;
+            while (j < 256)
+            {
+                k = 0;
+                while (k < 4)
+                {
+                    hist.count[c][j] += local[((size_t)c * 4 + k) * 256 + j];
+                    k++;
+                }
+                j++;
+            }
+            c++;
+        }
+    });
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function makes a lookup table for each color that stretches the
+ * values so the darkest half percent become 0 and the brightest half
+ * percent become 255.
+ *
+ * @param[in] hist - the histogram of the image.
+ * @param[in] total - the number of pixels in the image.
+ * @param[out] lut - the new value for each old value of each color.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   pixel lut[3][256];
+
+   levelsTable(hist, im.rows * im.cols, lut);
+
+   lut[0][v] is now the stretched red value for v.
+   @endverbatim
+
+ ***********************************************************************/
+
+void levelsTable(histogram& hist, long long total, pixel lut[3][256])
+{
+    long long clip = (long long)(total * LEVELS_CLIP);
+    long long seen;
+    int low;
+    int high;
+    int val;
+    int c = 0;
+    int v;
+
+    while (c < 3)
+    {
+        // walk in from each end past the clipped pixels
+        low = 0;
+        seen = hist.count[c][0];
+        while (low < 255 && seen <= clip)
+        {
+            low++;
+            seen += hist.count[c][low];
+        }
+        high = 255;
+        seen = hist.count[c][255];
+        while (high > 0 && seen <= clip)
+        {
+            high--;
+            seen += hist.count[c][high];
+        }
+
+        v = 0;
+        while (v < 256)
+        {
+            if (high <= low)
+            {
+                val = v;
+            }
+            else
+            {
+                val = (int)((v - low) * 255.0 / (high - low) + 0.5);
+            }
+            lut[c][v] = (pixel)(val < 0 ? 0 : (val > 255 ? 255 : val));
+            v++;
+        }
+        c++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function makes a lookup table for each color that spreads the
+ * values out evenly, using the running total of the histogram.
+ *
+ * @param[in] hist - the histogram of the image.
+ * @param[in] total - the number of pixels in the image.
+ * @param[out] lut - the new value for each old value of each color.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   pixel lut[3][256];
+
+   equalizeTable(hist, im.rows * im.cols, lut);
+
+   lut[0][v] is now the equalized red value for v.
+   @endverbatim
+
+ ***********************************************************************/
+
+void equalizeTable(histogram& hist, long long total, pixel lut[3][256])
+{
+    long long sum;
+    long long first;
+    int c = 0;
+    int v;
+
+    while (c < 3)
+    {
+        // the count of the darkest value present maps to 0
+        v = 0;
+        while (v < 255 && hist.count[c][v] == 0)
+        {
+            v++;
+        }
+        first = hist.count[c][v];
+
+        sum = 0;
+        v = 0;
+        while (v < 256)
+        {
+            sum += hist.count[c][v];
+            if (total == first)
+            {
+                lut[c][v] = (pixel)v;
+            }
+            else if (sum <= first)
+            {
+                lut[c][v] = 0;
+            }
+            else
+            {
+                lut[c][v] = (pixel)((double)(sum - first) * 255.0 /
+                    (total - first) + 0.5);
+            }
+            v++;
+        }
+        c++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function replaces every value in each color with its entry in
+ * that color's lookup table. Bands of rows are done on separate
+ * threads, 8 pixels at a time.
+ *
+ * @param[in] im - the image to be manipulated
+ * @param[in] lut - the new value for each old value of each color.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   applyTable(im, lut);
+
+   every pixel of "im" has gone through lut.
+   @endverbatim
+
+ ***********************************************************************/
+
+void applyTable(image& im, pixel lut[3][256])
+{
+    parallelRows(im.rows, [&](int start, int end)
+    {
+        pixel** planes[3] = { im.redGray, im.green, im.blue };
+        const pixel* table;
+        pixel* row;
+        int i = start;
+        int j;
+        int c;
+
+        while (i < end)
+        {
+            c = 0;
+            while (c < 3)
+            {
+                table = lut[c];
+                row = planes[c][i];
+                j = 0;
+                while (j + 8 <= im.cols)
+                {
+                    row[j] = table[row[j]];
+                    row[j + 1] = table[row[j + 1]];
+                    row[j + 2] = table[row[j + 2]];
+                    row[j + 3] = table[row[j + 3]];
+                    row[j + 4] = table[row[j + 4]];
+                    row[j + 5] = table[row[j + 5]];
+                    row[j + 6] = table[row[j + 6]];
+                    row[j + 7] = table[row[j + 7]];
+                    j += 8;
+                }
+                while (j < im.cols)
+                {
+                    row[j] = table[row[j]];
+                    j++;
+                }
+                c++;
+            }
+            i++;
+        }
+    });
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function stretches each color of an image to the full 0 - 255
+ * range.
+ *
+ * @param[in] im - the image to be manipulated
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   image im;
+
+   autolevels(im);
+
+   each color of "im" now runs from 0 to 255.
+   @endverbatim
+
+ ***********************************************************************/
+
+void autolevels(image& im)
+{
+    histogram hist;
+    pixel lut[3][256];
+
+    buildHistogram(im, hist);
+    levelsTable(hist, (long long)im.rows * im.cols, lut);
+    applyTable(im, lut);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function equalizes the histogram of each color of an image.
+ *
+ * @param[in] im - the image to be manipulated
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   image im;
+
+   equalize(im);
+
+   the values of each color of "im" are now spread out evenly.
+   @endverbatim
+
+ ***********************************************************************/
+
+void equalize(image& im)
+{
+    histogram hist;
+    pixel lut[3][256];
+
+    buildHistogram(im, hist);
+    equalizeTable(hist, (long long)im.rows * im.cols, lut);
+    applyTable(im, lut);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes out a histogram as JSON: the size of the image,
+ * and for each color the 256 counts along with the min, max and mean.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] im - the image the histogram is of.
+ * @param[in] hist - the histogram to write out.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   writeHistogramJson(out, im, hist);
+
+   out now contains
+   {
+     "width": 735,
+     "height": 486,
+     "red": { "min": 0, "max": 255, "mean": 111.77, "counts": [...] },
+     ...
+   }
+   @endverbatim
+
+ ***********************************************************************/
+
+void writeHistogramJson(ostream& out, image& im, histogram& hist)
+{
+    const char* names[3] = { "red", "green", "blue" };
+    long long total = (long long)im.rows * im.cols;
+    double sum;
+    int low;
+    int high;
+    int c = 0;
+    int v;
+
+    out << "{" << endl;
+    out << "  \"width\": " << im.cols << "," << endl;
+    out << "  \"height\": " << im.rows << "," << endl;
+    while (c < 3)
+    {
+        low = -1;
+        high = -1;
+        sum = 0;
+        v = 0;
+        while (v < 256)
+        {
+            if (hist.count[c][v] > 0)
+            {
+                if (low < 0)
+                {
+                    low = v;
+                }
+                high = v;
+            }
+            sum += (double)hist.count[c][v] * v;
+            v++;
+        }
+
+        out << "  \"" << names[c] << "\": { \"min\": " << low
+            << ", \"max\": " << high << ", \"mean\": " << fixed
+            << setprecision(4) << (total > 0 ? sum / total : 0.0)
+            << ", \"counts\": [";
+        v = 0;
+        while (v < 256)
+        {
+            out << (v > 0 ? ", " : "") << hist.count[c][v];
+            v++;
+        }
+        out << "] }" << (c < 2 ? "," : "") << endl;
+        c++;
+    }
+    out << "}" << endl;
+}
@@ -0,0 +1,1102 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   runs one job from its command line arguments
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <chrono>
+
+/*!
+ * @brief FRAME_BUFFERS bytes of freed planes kept for the next frames
+ * with --frames
+ */
+
+const size_t FRAME_BUFFERS = (size_t)256 * 1024 * 1024;
+
+/*!
+ * @brief STREAM_BAND bytes of rows held at once by --blend=, --compare
+ * and --pyramid without --max-memory
+ */
+
+const long long STREAM_BAND = 32LL << 20;
+
+/*!
+ * @brief an option that changes the image and takes no settings
+ */
+typedef void (*imageOperation)(image& im);
+
+/*!
+ * @brief reads an image, keeping just the part under a rectangle
+ */
+typedef void (*imageReader)(istream& in, image& im, int& maxValue,
+    cropRegion area);
+
+/*!
+ * @brief writes an image
+ */
+typedef void (*imageWriter)(ostream& out, image& im, int& maxValue);
+
+/*!
+ * @brief the options that take no settings, by name
+ */
+static const struct
+{
+    const char* name;
+    imageOperation run;
+} OPERATIONS[] =
+{
+    { "--flipX", flipX },
+    { "--flipY", flipY },
+    { "--rotateCW", rotateCW },
+    { "--rotateCCW", rotateCCW },
+    { "--grayscale", grayscale },
+    { "--sepia", sepia },
+    { "--autolevels", autolevels },
+    { "--equalize", equalize }
+};
+
+/*!
+ * @brief the readers, by the magic number of the input
+ */
+static const struct
+{
+    const char* magic;
+    imageReader read;
+} READERS[] =
+{
+    { "P3", readAsciiRegion },
+    { "P6", readBinaryRegion },
+    { "qoif", readQoiRegion }
+};
+
+/*!
+ * @brief the writers, by the magic number of the output and whether
+ * just the red/gray array is written
+ */
+static const struct
+{
+    const char* magic;
+    bool gray;
+    imageWriter write;
+} WRITERS[] =
+{
+    { "P2", true, writeGrayscaleAscii },
+    { "P3", false, writeAscii },
+    { "P5", true, writeGrayscaleBinary },
+    { "P6", false, writeBinary },
+    { "P1", true, writeBitmapAscii },
+    { "P4", true, writeBitmapBinary },
+    { "qoif", false, writeQoi },
+    { "qoif", true, writeGrayscaleQoi }
+};
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function looks up an option that takes no settings.
+ *
+ * @param[in] optionCode - the option, like --flipX.
+ *
+ * @returns the function for the option, or nullptr if it is not one.
+ *
+ * @par Example:
+   @verbatim
+   imageOperation run = findOperation("--sepia");
+
+   run(im) now makes im sepia.
+   @endverbatim
+
+ ***********************************************************************/
+
+static imageOperation findOperation(string optionCode)
+{
+    for (const auto& entry : OPERATIONS)
+    {
+        if (optionCode == entry.name)
+        {
+            return entry.run;
+        }
+    }
+    return nullptr;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function looks up the reader for an input magic number. Only P3,
+ * P6 and qoif get this far, anything else is turned down first.
+ *
+ * @param[in] magicNumber - P3, P6 or qoif.
+ *
+ * @returns the reader for it.
+ *
+ * @par Example:
+   @verbatim
+   findReader("P6")(in, im, maxValue, area);
+
+   im now holds the binary image in "in".
+   @endverbatim
+
+ ***********************************************************************/
+
+static imageReader findReader(string magicNumber)
+{
+    for (const auto& entry : READERS)
+    {
+        if (magicNumber == entry.magic)
+        {
+            return entry.read;
+        }
+    }
+    return readBinaryRegion;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function looks up the writer for an output magic number, which
+ * is always one of the ones outputMagic gives. P2 and P5 are always
+ * gray, P1 and P4 are black and white from the red/gray array, qoif can
+ * be either.
+ *
+ * @param[in] magicNumber - P1 to P6 or qoif.
+ * @param[in] gray - true to write just the red/gray array.
+ *
+ * @returns the writer for it.
+ *
+ * @par Example:
+   @verbatim
+   findWriter("P2", true)(out, im, maxValue);
+
+   out now holds the red/gray array of im in ascii.
+   @endverbatim
+
+ ***********************************************************************/
+
+static imageWriter findWriter(string magicNumber, bool gray)
+{
+    for (const auto& entry : WRITERS)
+    {
+        if (magicNumber == entry.magic && gray == entry.gray)
+        {
+            return entry.write;
+        }
+    }
+    return writeBinary;
+}
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function runs one job, given the same arguments the program
+  * takes. It will check the arguments to see if they were put in
+  * correctly. If there is an incorrect number of arguments, or they
+  * were not put in correctly, an error message is output to report and
+  * the job stops. Otherwise, it will read in what output type, files,
+  * and manipulation, if one exists, and start reading in the file. It
+  * will dynamically allocate 3 2d arrays for the RGB values of the
+  * image, perform a manipulation if there exists one, and then write
+  * out the data to the output file in the format of the output type.
+  *
+  * @param[in] argc - the number of arguments, including the program.
+  * @param[in] argv - a 2d array of characters containing the arguments.
+  * @param[in] report - where to output error messages.
+  *
+  * @returns 0 if the job worked, 1 if it did not or --compare found the
+  *          images are different.
+  *
+  * @par Example:
+    @verbatim
+    char* args[] = { "thpExam1.exe", "--sepia", "--binary", "out",
+        "image.ppm" };
+
+    jobSteps(5, args, cout);
+
+    out.ppm is now a sepia copy of image.ppm.
+    @endverbatim
+  *
+  ***********************************************************************/
+
+static int jobSteps(int argc, char** argv, ostream& report)
+{
+    string outputType;
+    string optionCode; // only exists if there are 5 arguments
+    string outputName; // name of output file
+    int newCols = 0;   // size and filter for --resize=WxH[,filter]
+    int newRows = 0;
+    filterType filter = FILTER_LANCZOS3;
+    bool resizing = false;
+    double degrees = 0;  // angle, sampling and background for --rotate=
+    bool bilinear = true;
+    pixel fill[3] = { 0, 0, 0 };
+    bool rotating = false;
+    ditherType ditherMethod = DITHER_FLOYD; // --threshold and --dither
+    int ditherLevel = 128;
+    bool dithering = false;
+    vector<int> ditherErrors; // error owed to the next band of rows
+    int ditherRow = 0;        // the row the next band starts at
+    blendMode blend = BLEND_ALPHA; // --blend= with the image from --with
+    int blendWeight = 128;
+    bool blending = false;
+    colorChange color;    // --toYCbCr, --hue= and the other color options
+    bool coloring = false;
+    int medianRadius = 0; // --median= window, and its band of medians
+    bool median = false;
+    netImage medians;
+    bool comparing = false; // --compare with the image from --with
+    bool compareFirst = false;
+    compareStats compared;
+    bool pyramid = false; // every halving to basename_N with --pyramid
+    int levels = 0;
+    string secondName;    // the image blended in or compared with
+    string secondMagic;
+    string secondKey;
+    image secondHeader;
+    netImage second;      // the band of rows of the second image
+    ifstream secondFile;
+    istream with(nullptr); // reads secondFile, or stdin for -
+    cropRegion area = { 0, 0, INT_MAX, INT_MAX }; // whole image by default
+    bool cropping = false;
+    long long budget = 0; // bytes of tiles mapped at once with --tiled
+    bool tiled = false;
+    string cacheDir;      // finished outputs are kept here with --cache
+    long long cacheLimit = 1LL << 30;
+    string cacheKeyText;
+    ostringstream job;    // the options the output depends on
+    string chosenKernels; // what --isa picked, when it was given
+    string chosenPlacement; // what --numa picked, when it was given
+    long long localTiles = 0;  // tiles run on their own NUMA node and
+    long long remoteTiles = 0; // on another, before the job
+    string traceName;     // where --trace writes the timeline
+    long long traceStart = 0;
+    bool frames = false;  // every image in the input with --frames
+    long long frameCount = 0;
+    chrono::steady_clock::time_point begin;
+    double seconds;
+    string nextMagic;     // the magic number of the first frame
+    string frameError;    // why reading the frames stopped early
+    size_t keptBuffers;   // the buffer pool limit before --frames
+    long long maxMemory = 0; // bytes the job may use with --max-memory
+    bool differ = false;  // --compare found the images are different
+    memoryPlan plan = { PLAN_IN_PLACE, 0, 0 };
+    image header;         // just the size, read before the pixels
+    netImage picture;     // its arrays are freed on every return
+    image& im = picture.get();
+    imageOperation operation = nullptr; // the option, if it is one of
+                                        // the ones in OPERATIONS
+    int maxValue = 0; // will always be 255 for this assignment
+    ifstream inFile;
+    ofstream outFile;
+    istream in(nullptr);  // reads inFile, or stdin for -
+    ostream out(nullptr); // writes outFile, or stdout for -
+
+    // a leading --crop x,y,w,h or --tiled MB applies to every option,
+    // so take them off and handle the rest of the arguments as usual
+    while (argc >= 3 && ((string)argv[1] == "--crop" ||
+        (string)argv[1] == "--tiled" || (string)argv[1] == "--cache" ||
+        (string)argv[1] == "--cache-size" || (string)argv[1] == "--isa" ||
+        (string)argv[1] == "--frames" || (string)argv[1] == "--max-memory" ||
+        (string)argv[1] == "--with" || (string)argv[1] == "--numa" ||
+        (string)argv[1] == "--trace"))
+    {
+        // --frames is the one that stands alone
+        if ((string)argv[1] == "--frames")
+        {
+            frames = true;
+            argv++;
+            argc--;
+            continue;
+        }
+        if ((string)argv[1] == "--isa")
+        {
+            if (!selectKernels(argv[2], chosenKernels))
+            {
+                report << "Usage: thpExam1.exe --isa auto|scalar|sse2|"
+                    << "sse4.2|avx2|avx512 [option] "
+                    << "--outputtype basename image.ppm" << endl;
+                return 1;
+            }
+            report << "Using " << chosenKernels << endl;
+        }
+        if ((string)argv[1] == "--numa")
+        {
+            if (!setNumaPlacement(argv[2], chosenPlacement))
+            {
+                report << "Usage: thpExam1.exe --numa local|interleave|off "
+                    << "[option] --outputtype basename image.ppm" << endl;
+                return 1;
+            }
+            report << "Using " << chosenPlacement << endl;
+            numaTraffic(localTiles, remoteTiles);
+        }
+        if ((string)argv[1] == "--crop" && !parseCrop(argv[2], area))
+        {
+            report << "Usage: thpExam1.exe --crop x,y,w,h [option] "
+                << "--outputtype basename image.ppm"
+                << endl;
+            return 1;
+        }
+        if ((string)argv[1] == "--tiled")
+        {
+            istringstream megabytes(argv[2]);
+            if (!(megabytes >> budget) || budget <= 0)
+            {
+                report << "Usage: thpExam1.exe --tiled MB [option] "
+                    << "--outputtype basename image.ppm"
+                    << endl;
+                return 1;
+            }
+            budget <<= 20;
+            tiled = true;
+        }
+        if ((string)argv[1] == "--max-memory")
+        {
+            istringstream megabytes(argv[2]);
+            if (!(megabytes >> maxMemory) || maxMemory <= 0)
+            {
+                report << "Usage: thpExam1.exe --max-memory MB [option] "
+                    << "--outputtype basename image.ppm"
+                    << endl;
+                return 1;
+            }
+            maxMemory <<= 20;
+        }
+        if ((string)argv[1] == "--cache")
+        {
+            cacheDir = argv[2];
+        }
+        if ((string)argv[1] == "--with")
+        {
+            secondName = argv[2];
+        }
+        if ((string)argv[1] == "--trace")
+        {
+            traceName = argv[2];
+        }
+        if ((string)argv[1] == "--cache-size")
+        {
+            istringstream megabytes(argv[2]);
+            if (!(megabytes >> cacheLimit) || cacheLimit <= 0)
+            {
+                report << "Usage: thpExam1.exe --cache dir --cache-size MB "
+                    << "[option] --outputtype basename image.ppm"
+                    << endl;
+                return 1;
+            }
+            cacheLimit <<= 20;
+        }
+        cropping = cropping || (string)argv[1] == "--crop";
+        argv += 2;
+        argc -= 2;
+    }
+
+    // output error message for invalid # of arguments
+    if (argc != 4 && argc != 5)
+    {
+        report << "Usage: thpExam1.exe --outputtype basename image.ppm"
+            << endl
+            << "or:    thpExam1.exe [option] "
+            << "--outputtype basename image.ppm"
+            << endl;
+        return 1;
+    }
+    if (argc == 4)
+    {
+        // extension will be ppm since grayscale cannot be used here,
+        // or qoi for a qoi file
+        outputType = argv[1];
+        outputName = (string)argv[2] +
+            (outputType == "--qoi" ? ".qoi" : ".ppm");
+        if ((string)argv[2] == "-")
+        {
+            outputName = "-";
+        }
+
+        // output error message for invalid outputType
+        if (outputType != "--ascii" && outputType != "--binary" &&
+            outputType != "--qoi")
+        {
+            report << "Usage: thpExam1.exe "
+                << "--outputtype basename image.ppm"
+                << endl;
+            return 1;
+        }
+
+        // check if files open correctly, - is stdin and stdout
+        if (!openInputStream(in, inFile, argv[3]))
+        {
+            inFile.close();
+            return 1;
+        }
+        if (!openOutputStream(out, outFile, outputName))
+        {
+            outFile.close();
+            return 1;
+        }
+    }
+    if (argc == 5)
+    {
+        optionCode = argv[1];
+        outputType = argv[2];
+
+        // output error message for incorrect optionCode
+        resizing = parseResize(optionCode, newCols, newRows, filter);
+        rotating = parseRotate(optionCode, degrees, bilinear, fill);
+        dithering = parseDither(optionCode, ditherMethod, ditherLevel);
+        blending = parseBlend(optionCode, blend, blendWeight);
+        coloring = parseColor(optionCode, color);
+        median = parseMedian(optionCode, medianRadius);
+        comparing = parseCompare(optionCode, compareFirst);
+        pyramid = optionCode == "--pyramid";
+        operation = findOperation(optionCode);
+        if (operation == nullptr && optionCode != "--histogram" &&
+            !resizing && !rotating && !dithering && !blending &&
+            !comparing && !pyramid && !coloring && !median)
+        {
+            report << "Usage: thpExam1.exe [option] "
+                << "--outputtype basename "
+                << "image.ppm" << endl;
+            return 1;
+        }
+
+        // output error message for incorrect outputType
+        if (outputType != "--ascii" && outputType != "--binary" &&
+            outputType != "--qoi")
+        {
+            report << "Usage: thpExam1.exe [option] "
+                << "--outputtype basename "
+                << "image.ppm" << endl;
+            return 1;
+        }
+
+        // change extension name to pgm for grayscale; 
+        // otherwise, use ppm, and qoi for any qoi file
+        if (optionCode == "--histogram" || comparing)
+        {
+            outputName = (string)argv[3] + ".json";
+        }
+        else if (outputType == "--qoi")
+        {
+            outputName = (string)argv[3] + ".qoi";
+        }
+        else if (optionCode == "--grayscale")
+        {
+            outputName = (string)argv[3] + ".pgm";
+        }
+        else if (dithering)
+        {
+            outputName = (string)argv[3] + ".pbm";
+        }
+        else
+        {
+            outputName = (string)argv[3] + ".ppm";
+        }
+        if ((string)argv[3] == "-")
+        {
+            outputName = "-";
+        }
+
+        // check if files open correctly, - is stdin and stdout.
+        // --pyramid opens its own file for each level
+        if (!openInputStream(in, inFile, argv[4]))
+        {
+            inFile.close();
+            return 1;
+        }
+        if (!pyramid && !openOutputStream(out, outFile, outputName))
+        {
+            outFile.close();
+            return 1;
+        }
+    }
+
+    // --blend= and --compare take their second image from --with, and
+    // nothing else does
+    if ((blending || comparing) != (secondName != ""))
+    {
+        report << "Usage: thpExam1.exe --with image.ppm "
+            << "--blend=mode|--compare --outputtype basename image.ppm"
+            << endl;
+        inFile.close();
+        outFile.close();
+        return 1;
+    }
+
+    // with a cache, a job that was done before is just copied out. A
+    // pipe can't be hashed or copied, so those jobs aren't cached, and
+    // neither is a compare, whose status says if the images differ, or a
+    // pyramid, which is many files
+    if (cacheDir != "" && outputName != "-" && !comparing && !pyramid &&
+        (string)argv[argc - 1] != "-" && secondName != "-" &&
+        (!blending || cacheKey(secondName, "", secondKey)))
+    {
+        job << outputType << " ";
+        if (frames)
+        {
+            job << "--frames ";
+        }
+        if (cropping)
+        {
+            job << "--crop " << area.x << "," << area.y << "," << area.w
+                << "," << area.h << " ";
+        }
+        if (resizing)
+        {
+            job << "--resize=" << newCols << "x" << newRows << ","
+                << filter;
+        }
+        else if (rotating)
+        {
+            job << "--rotate=" << setprecision(17) << degrees << ","
+                << bilinear << "," << (int)fill[0] << ":" << (int)fill[1]
+                << ":" << (int)fill[2];
+        }
+        else
+        {
+            job << optionCode;
+        }
+        if (blending)
+        {
+            job << " --with " << secondKey;
+        }
+        if (cacheKey(argv[argc - 1], job.str(), cacheKeyText))
+        {
+            outFile.close();
+            if (fetchCached(cacheDir, cacheKeyText, outputName))
+            {
+                inFile.close();
+                return 0;
+            }
+            openOutputStream(out, outFile, outputName);
+        }
+    }
+
+    // read in magic number
+    readMagic(in, im.magicNumber);
+    
+    // for input, we can only have ppm or qoi files, not grayscale ones
+    // if magic number doesn't match the three we can have,
+    // output error message and close files
+    if (im.magicNumber != "P3" && im.magicNumber != "P6" &&
+        im.magicNumber != "qoif")
+    {
+        report << "Invalid magic number" << endl;
+        inFile.close();
+        outFile.close();
+        return 1;
+    }
+    
+    // check the header before any reader allocates what it asks for,
+    // check the crop against its size, and get the size to plan with,
+    // then go back so the readers see the header too. Out of core, the
+    // size only has to fit in 64 bits
+    {
+        streampos start = in.tellg();
+        cropRegion check = area;
+        string comment;
+        long long rows = 0;
+        long long cols = 0;
+        bool good;
+        if (tiled && im.magicNumber != "qoif")
+        {
+            readHeaderLarge(in, comment, rows, cols, maxValue);
+            good = in && rows > 0 && cols > 0 && maxValue > 0 &&
+                maxValue <= 255;
+        }
+        else
+        {
+            good = checkHeader(in, im.magicNumber, header, maxValue);
+        }
+        if (!good)
+        {
+            report << "Invalid image header" << endl;
+            inFile.close();
+            outFile.close();
+            return 1;
+        }
+        if (cropping && !tiled &&
+            !clipRegion(check, header.rows, header.cols))
+        {
+            report << "Crop region is outside the image" << endl;
+            inFile.close();
+            outFile.close();
+            return 1;
+        }
+        in.seekg(start);
+    }
+
+    // frames are all kept in memory and each one is written as an image
+    if (frames && (tiled || optionCode == "--histogram"))
+    {
+        report << "--frames does not work with --tiled or --histogram"
+            << endl;
+        inFile.close();
+        outFile.close();
+        return 1;
+    }
+
+    // the two images of a blend or compare are read a band of rows at a
+    // time, side by side, so they have to be netpbm files of the same size
+    if (blending || comparing)
+    {
+        if (cropping || tiled || frames || outputType == "--qoi" ||
+            im.magicNumber == "qoif")
+        {
+            report << "--blend= and --compare work on two ppm files, "
+                << "without --crop, --tiled, --frames or --qoi" << endl;
+            inFile.close();
+            outFile.close();
+            return 1;
+        }
+        if (secondName == "-" && (string)argv[argc - 1] == "-")
+        {
+            report << "Only one of the two images can be read from stdin"
+                << endl;
+            inFile.close();
+            outFile.close();
+            return 1;
+        }
+        if (!openInputStream(with, secondFile, secondName))
+        {
+            inFile.close();
+            outFile.close();
+            return 1;
+        }
+        readMagic(with, secondMagic);
+        if (secondMagic != "P3" && secondMagic != "P6")
+        {
+            report << "Invalid magic number" << endl;
+            inFile.close();
+            outFile.close();
+            return 1;
+        }
+
+        // the single space after maxValue of a binary file too, so the
+        // rows come next
+        if (!checkHeader(with, secondMagic, secondHeader, maxValue))
+        {
+            report << "Invalid image header" << endl;
+            inFile.close();
+            outFile.close();
+            return 1;
+        }
+        if (secondMagic == "P6")
+        {
+            with.get();
+        }
+        if (secondHeader.rows != header.rows ||
+            secondHeader.cols != header.cols)
+        {
+            report << "The two images are not the same size" << endl;
+            inFile.close();
+            outFile.close();
+            return 1;
+        }
+        plan.strategy = PLAN_ROWS;
+        plan.limit = STREAM_BAND;
+    }
+
+    // the levels of a pyramid are made as a ppm file is read, and each
+    // goes to its own file
+    if (pyramid)
+    {
+        if (cropping || tiled || frames || outputType == "--qoi" ||
+            im.magicNumber == "qoif" || outputName == "-")
+        {
+            report << "--pyramid works on a ppm file and writes files, "
+                << "without --crop, --tiled, --frames or --qoi" << endl;
+            inFile.close();
+            return 1;
+        }
+        plan.strategy = PLAN_ROWS;
+        plan.limit = STREAM_BAND;
+    }
+
+    // with a budget, pick how the job runs from the size in the header,
+    // unless --tiled already says how
+    if (maxMemory > 0 && !tiled)
+    {
+        plan = planMemory(maxMemory, header, area, im.magicNumber,
+            outputMagic(optionCode, outputType), optionCode, frames,
+            (string)argv[argc - 1] == "-" || secondName == "-");
+        if (plan.strategy == PLAN_TOO_BIG)
+        {
+            report << "The job needs about " << (plan.inMemory >> 20)
+                << " MB, more than --max-memory allows" << endl;
+            inFile.close();
+            outFile.close();
+            return 1;
+        }
+        report << "Memory plan: " << planName(plan.strategy)
+            << " (about " << (plan.inMemory >> 20) << " MB in memory, "
+            << (maxMemory >> 20) << " MB allowed)" << endl;
+        if (plan.strategy == PLAN_TILED)
+        {
+            tiled = true;
+            budget = plan.limit;
+        }
+    }
+
+    // out of core, the input goes through a tiled scratch file instead
+    // of the arrays
+    if (tiled && (cropping || resizing || rotating || dithering ||
+        coloring || median || outputType == "--qoi" ||
+        im.magicNumber == "qoif"))
+    {
+        report << "--tiled works with --flipX, --flipY, --rotateCW, "
+            << "--rotateCCW, --grayscale and --sepia on ppm files"
+            << endl;
+        inFile.close();
+        outFile.close();
+        return 1;
+    }
+
+    // read in with the reader for the input magic number, change the
+    // magic number to the one for the outputType, perform the option,
+    // and write out with the writer for the new magic number. With
+    // --frames these three steps run on every image in the input, each
+    // on its own thread
+    auto readFrame = [&](imageFrame& frame)
+    {
+        traceSpan span("read");
+        image& f = frame.picture.get();
+
+        // the first magic number was read in above
+        frame.inputMagic = nextMagic;
+        nextMagic = "";
+        if (frame.inputMagic == "")
+        {
+            readMagic(in, frame.inputMagic);
+        }
+        if (frame.inputMagic != "P3" && frame.inputMagic != "P6" &&
+            frame.inputMagic != "qoif")
+        {
+            if (frame.inputMagic != "")
+            {
+                frameError = "Invalid magic number";
+            }
+            return false;
+        }
+
+        // each image of a stream has its own header to check
+        {
+            streampos start = in.tellg();
+            image header;
+            if (!checkHeader(in, frame.inputMagic, header, frame.maxValue))
+            {
+                frameError = "Invalid image header";
+                return false;
+            }
+            in.seekg(start);
+        }
+        f.magicNumber = outputMagic(optionCode, outputType);
+        if (resizing && frame.inputMagic == "P6")
+        {
+            readBinaryResized(in, f, frame.maxValue, area, newRows,
+                newCols, filter);
+        }
+        else
+        {
+            findReader(frame.inputMagic)(in, f, frame.maxValue, area);
+        }
+        if (frame.inputMagic == "qoif" && in.fail())
+        {
+            frameError = "Invalid qoi file";
+            return false;
+        }
+        return true;
+    };
+    auto changeFrame = [&](imageFrame& frame)
+    {
+        traceSpan span("change");
+        image& f = frame.picture.get();
+
+        // a binary input was already resized while it was read
+        if (resizing)
+        {
+            if (frame.inputMagic != "P6")
+            {
+                resize(f, newRows, newCols, filter);
+            }
+        }
+        else if (rotating)
+        {
+            rotateAngle(f, degrees, bilinear, fill);
+        }
+        else if (dithering)
+        {
+            dither(f, ditherMethod, ditherLevel);
+        }
+        else if (coloring)
+        {
+            changeColor(f, color);
+        }
+        else if (median)
+        {
+            medianFilter(f, medianRadius);
+        }
+        else if (operation != nullptr)
+        {
+            operation(f);
+        }
+    };
+    auto writeFrame = [&](imageFrame& frame)
+    {
+        traceSpan span("write");
+        image& f = frame.picture.get();
+
+        findWriter(f.magicNumber, optionCode == "--grayscale" ||
+            dithering)(out, f, frame.maxValue);
+    };
+
+    // with --trace, every thread's spans from here on are kept
+    if (traceName != "")
+    {
+        traceThread("job");
+        traceStart = startTrace();
+    }
+
+    nextMagic = im.magicNumber;
+    if (tiled)
+    {
+        traceSpan span("tiled");
+        processTiled(in, out, im.magicNumber, outputMagic(optionCode,
+            outputType), optionCode, argc == 5 ? argv[3] : argv[2],
+            budget);
+    }
+    else if (pyramid)
+    {
+        // written out level by level instead of as one image
+        traceSpan span("pyramid");
+        if (!streamPyramid(in, im.magicNumber, outputMagic(optionCode,
+            outputType), argv[3], plan.limit, levels))
+        {
+            frameError = "The pyramid could not be finished";
+        }
+        else if (levels == 0)
+        {
+            report << "The image is 1x1, so it has no smaller levels"
+                << endl;
+        }
+        else
+        {
+            report << "Wrote " << levels << (levels == 1 ? " level, " :
+                " levels, ") << argv[3] << "_1.ppm to " << argv[3] << "_"
+                << levels << ".ppm" << endl;
+        }
+    }
+    else if (comparing)
+    {
+        // the report is written out instead of an image
+        traceSpan span("compare");
+        if (!compareStreams(in, with, im.magicNumber, secondMagic,
+            compareFirst, compared, plan.limit))
+        {
+            frameError = "One of the images ended early";
+        }
+        else
+        {
+            writeCompareJson(out, compared, compareFirst);
+            differ = compared.firstY >= 0;
+            if (!differ)
+            {
+                report << "The images are the same" << endl;
+            }
+            else if (compareFirst)
+            {
+                report << "The images first differ at " << compared.firstX
+                    << "," << compared.firstY << endl;
+            }
+            else
+            {
+                report << "The images differ at " << compared.differing
+                    << " of " << (long long)compared.rows * compared.cols
+                    << " pixels, first at " << compared.firstX << ","
+                    << compared.firstY << endl;
+            }
+        }
+    }
+    else if (plan.strategy == PLAN_ROWS)
+    {
+        // a band of rows at a time, changed like a whole image would be.
+        // A blend holds the same band of the second image as well, and a
+        // median its band of medians
+        streamRows(in, out, im.magicNumber, outputMagic(optionCode,
+            outputType), [&](image& band)
+        {
+            if (blending)
+            {
+                if (second.get().redGray == nullptr)
+                {
+                    second = netImage(band.rows, band.cols);
+                }
+                second.get().rows = band.rows;
+                readRows(with, second.get(), secondMagic);
+                blendRows(band, second.get(), blend, blendWeight);
+            }
+            else if (dithering)
+            {
+                // the error owed carries over from band to band
+                grayscale(band);
+                ditherRows(band, ditherMethod, ditherLevel, ditherErrors,
+                    ditherRow);
+                ditherRow += band.rows;
+            }
+            else if (coloring)
+            {
+                changeColor(band, color);
+            }
+            else if (median)
+            {
+                // the band has the rows around it the window reaches
+                medianBand(band, medianRadius, medians);
+            }
+            else if (operation != nullptr)
+            {
+                operation(band);
+            }
+        }, blending || median ? plan.limit / 2 : plan.limit, medianRadius);
+        if (blending && !with)
+        {
+            frameError = "The second image ended early";
+        }
+    }
+    else if (optionCode == "--histogram")
+    {
+        // the histogram is written out instead of the image
+        traceSpan span("histogram");
+        histogram hist;
+        findReader(im.magicNumber)(in, im, maxValue, area);
+        buildHistogram(im, hist);
+        writeHistogramJson(out, im, hist);
+    }
+    else if (frames)
+    {
+        // frames of the same size use the same planes over and over
+        keptBuffers = setBufferPool(FRAME_BUFFERS);
+        begin = chrono::steady_clock::now();
+        frameCount = pipelineFrames(readFrame, changeFrame, writeFrame);
+        seconds = chrono::duration<double>(chrono::steady_clock::now() -
+            begin).count();
+        report << frameCount << " frames in " << fixed << setprecision(3)
+            << seconds << " s (" << setprecision(1)
+            << (seconds > 0 ? frameCount / seconds : 0)
+            << " frames per second)" << endl;
+        setBufferPool(keptBuffers);
+    }
+    else
+    {
+        imageFrame frame;
+        if (readFrame(frame))
+        {
+            changeFrame(frame);
+            writeFrame(frame);
+        }
+    }
+    if (traceName != "" && !finishTrace(traceName, traceStart))
+    {
+        frameError = "The trace could not be written";
+    }
+    if (frameError != "")
+    {
+        report << frameError << endl;
+        inFile.close();
+        outFile.close();
+        return 1;
+    }
+    
+    // close files, the arrays are freed along with picture
+    inFile.close();
+    outFile.close();
+    if (maxMemory > 0)
+    {
+        // a job kept in memory says what the plan thought it would
+        // take, to check the plan against
+        report << "Peak memory: " << (peakMemory() >> 20) << " MB";
+        if (plan.inMemory > 0 && (plan.strategy == PLAN_IN_MEMORY ||
+            plan.strategy == PLAN_IN_PLACE))
+        {
+            report << " (planned about " << (plan.inMemory >> 20)
+                << " MB)";
+        }
+        report << endl;
+    }
+    if (chosenPlacement != "" && numaNodes() > 1)
+    {
+        long long local;
+        long long remote;
+
+        numaTraffic(local, remote);
+        report << "Tiles of rows on their own NUMA node: "
+            << local - localTiles << ", on another node: "
+            << remote - remoteTiles << endl;
+    }
+
+    // keep the output for the next time this job comes in
+    if (cacheKeyText != "")
+    {
+        storeCached(cacheDir, cacheKeyText, outputName, cacheLimit);
+    }
+    return differ ? 1 : 0;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function runs one job, given the same arguments the program
+ * takes, the way jobSteps does. A job that runs out of memory or can't
+ * make its scratch file is turned down with an error message in report
+ * instead of ending the program, so a server can go on to its next job.
+ *
+ * @param[in] argc - the number of arguments, including the program.
+ * @param[in] argv - a 2d array of characters containing the arguments.
+ * @param[in] report - where to output error messages.
+ *
+ * @returns 0 if the job worked, 1 if it did not or --compare found the
+ *          images are different.
+ *
+ * @par Example:
+   @verbatim
+   char* args[] = { "thpExam1.exe", "--sepia", "--binary", "out",
+       "image.ppm" };
+
+   runJob(5, args, cout);
+
+   out.ppm is now a sepia copy of image.ppm.
+   @endverbatim
+
+ ***********************************************************************/
+
+int runJob(int argc, char** argv, ostream& report)
+{
+    try
+    {
+        return jobSteps(argc, argv, report);
+    }
+    catch (bad_alloc&)
+    {
+        report << "Unable to allocate memory" << endl;
+    }
+    catch (exception& e)
+    {
+        report << e.what() << endl;
+    }
+    return 1;
+}
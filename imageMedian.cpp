@@ -0,0 +1,518 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that replace each pixel with the median of the window
+ *          around it, to take out salt and pepper noise
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function reads the radius out of a --median=r option. The window
+  * is the 2r + 1 by 2r + 1 square around each pixel, and r goes from 1
+  * to MAX_MEDIAN_RADIUS.
+  *
+  * @param[in] option - the option, like --median=2.
+  * @param[out] radius - the radius of the window.
+  *
+  * @returns true if the option is --median= with a good radius, false
+  *          otherwise
+  *
+  * @par Example:
+    @verbatim
+    int radius;
+
+    parseMedian("--median=4", radius);
+
+    radius is now 4, a 9x9 window.
+    @endverbatim
+
+  ***********************************************************************/
+
+bool parseMedian(string option, int& radius)
+{
+    if (option.compare(0, 9, "--median=") != 0)
+    {
+        return false;
+    }
+
+    istringstream spec(option.substr(9));
+    if (!(spec >> radius) || spec.peek() != EOF)
+    {
+        return false;
+    }
+    return radius >= 1 && radius <= MAX_MEDIAN_RADIUS;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function gives one row of a plane for a window, the first or
+ * last row the plane has for the rows past its top and bottom, so the
+ * edges of the image are repeated out as far as the window reaches.
+ *
+ * @param[in] plane - the rows of the plane.
+ * @param[in] y - the row wanted.
+ * @param[in] first - the first row the plane has, 0 or less.
+ * @param[in] last - the last row the plane has.
+ *
+ * @returns the row
+ *
+ * @par Example:
+   @verbatim
+   const pixel* row = windowRow(im.redGray, -2, 0, im.rows - 1);
+
+   row is the top row of im.
+   @endverbatim
+
+ ***********************************************************************/
+
+static const pixel* windowRow(pixel** plane, int y, int first, int last)
+{
+    return plane[y < first ? first : y > last ? last : y];
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds the medians of rows start to end - 1 of a plane
+ * with the 3x3 or 5x5 sorting network of the kernels. Each row of the
+ * window is copied once with the edge pixels repeated radius times on
+ * each side, into a ring of 2r + 1 rows, so the kernels never have to
+ * check for the edge.
+ *
+ * @param[in] src - the rows of the plane.
+ * @param[out] dst - the rows of the medians.
+ * @param[in] start - the first row to do.
+ * @param[in] end - one past the last row to do.
+ * @param[in] first - the first row src has, 0 or less.
+ * @param[in] last - the last row src has.
+ * @param[in] cols - the columns of the plane.
+ * @param[in] radius - 1 or 2.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   networkRows(im.redGray, filtered.redGray, 0, im.rows, 0, im.rows - 1,
+       im.cols, 1);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void networkRows(pixel** src, pixel** dst, int start, int end,
+    int first, int last, int cols, int radius)
+{
+    const kernelTable& k = kernels();
+    int size = 2 * radius + 1;
+    size_t stride = (size_t)cols + 2 * radius;
+    vector<pixel> ring(size * stride);
+    const pixel* rows[5];
+    int y = start - radius;
+    int i;
+
+    // copy a row into its place in the ring, edges repeated out
+    auto padRow = [&](int row)
+    {
+        const pixel* from = windowRow(src, row, first, last);
+        pixel* to = &ring[((row % size + size) % size) * stride];
+
+        memset(to, from[0], radius);
+        memcpy(to + radius, from, cols);
+        memset(to + radius + cols, from[cols - 1], radius);
+    };
+
+    while (y < start + radius)
+    {
+        padRow(y);
+        y++;
+    }
+    y = start;
+    while (y < end)
+    {
+        padRow(y + radius);
+        i = 0;
+        while (i < size)
+        {
+            rows[i] = &ring[(((y - radius + i) % size + size) % size) *
+                stride + radius];
+            i++;
+        }
+        k.medianRow(rows, size, dst[y], cols);
+        y++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds the medians of rows start to end - 1 of a plane
+ * in constant time per pixel, whatever the radius, the way Perreault and
+ * Hebert do. Each column keeps a histogram of its 2r + 1 rows of the
+ * window, which moves down a row by adding one value and taking one
+ * out. The window's histogram moves across a column by adding one
+ * column's histogram and taking one out. Each histogram is kept twice:
+ * 16 coarse counts of the top 4 bits, and 256 fine counts. Only the
+ * coarse counts of the window move with every pixel; they show which
+ * 16 fine counts the median is in, and just those are brought up to the
+ * column, from where they were last used. The columns are done a strip
+ * at a time, which keeps the histograms small enough for the cache.
+ *
+ * @param[in] src - the rows of the plane.
+ * @param[out] dst - the rows of the medians.
+ * @param[in] start - the first row to do.
+ * @param[in] end - one past the last row to do.
+ * @param[in] first - the first row src has, 0 or less.
+ * @param[in] last - the last row src has.
+ * @param[in] cols - the columns of the plane.
+ * @param[in] radius - 1 to MAX_MEDIAN_RADIUS.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   histogramRows(im.redGray, filtered.redGray, 0, im.rows, 0,
+       im.rows - 1, im.cols, 10);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void histogramRows(pixel** src, pixel** dst, int start, int end,
+    int first, int last, int cols, int radius)
+{
+    const int STRIP = 256; // columns of medians found at a time
+    int size = 2 * radius + 1;
+    int below = size * size / 2; // values smaller than the median
+    int width = min(STRIP + 2 * radius, cols);
+    vector<unsigned short> coarse((size_t)width * 16);
+    vector<unsigned short> fine((size_t)width * 256);
+    unsigned short windowCoarse[16];
+    unsigned short windowFine[256];
+    int synced[16]; // the column each 16 of windowFine were moved to
+    unsigned short* add;
+    unsigned short* take;
+    unsigned short* counts;
+    const pixel* row;
+    int left = 0;
+    int right;
+    int low;  // the first column the strip's histograms are kept for
+    int high; // one past the last
+    int y;
+    int x;
+    int j;
+    int part;
+    int seen;
+
+    // a strip of columns at a time, so its histograms stay in the cache
+    while (left < cols)
+    {
+        right = min(left + STRIP, cols);
+        low = max(left - radius, 0);
+        high = min(right + radius, cols);
+        fill(coarse.begin(), coarse.end(), 0);
+        fill(fine.begin(), fine.end(), 0);
+
+        // the columns start out with the window of the first row
+        y = start - radius;
+        while (y <= start + radius)
+        {
+            row = windowRow(src, y, first, last);
+            x = low;
+            while (x < high)
+            {
+                coarse[(x - low) * 16 + (row[x] >> 4)]++;
+                fine[(x - low) * 256 + row[x]]++;
+                x++;
+            }
+            y++;
+        }
+
+        y = start;
+        while (y < end)
+        {
+            // move the columns down to this row
+            if (y > start)
+            {
+                row = windowRow(src, y + radius, first, last);
+                x = low;
+                while (x < high)
+                {
+                    coarse[(x - low) * 16 + (row[x] >> 4)]++;
+                    fine[(x - low) * 256 + row[x]]++;
+                    x++;
+                }
+                row = windowRow(src, y - radius - 1, first, last);
+                x = low;
+                while (x < high)
+                {
+                    coarse[(x - low) * 16 + (row[x] >> 4)]--;
+                    fine[(x - low) * 256 + row[x]]--;
+                    x++;
+                }
+            }
+
+            // the window of the first column, the edge column repeated
+            memset(windowCoarse, 0, sizeof(windowCoarse));
+            x = left - radius;
+            while (x <= left + radius)
+            {
+                add = &coarse[(min(max(x, 0), cols - 1) - low) * 16];
+                j = 0;
+                while (j < 16)
+                {
+                    windowCoarse[j] += add[j];
+                    j++;
+                }
+                x++;
+            }
+            j = 0;
+            while (j < 16)
+            {
+                synced[j] = left - size;
+                j++;
+            }
+
+            x = left;
+            while (x < right)
+            {
+                if (x > left)
+                {
+                    add = &coarse[(min(x + radius, cols - 1) - low) * 16];
+                    take = &coarse[(max(x - radius - 1, 0) - low) * 16];
+                    j = 0;
+                    while (j < 16)
+                    {
+                        windowCoarse[j] += add[j] - take[j];
+                        j++;
+                    }
+                }
+
+                // the 16 values the median is in
+                seen = 0;
+                part = 0;
+                while (seen + windowCoarse[part] <= below)
+                {
+                    seen += windowCoarse[part];
+                    part++;
+                }
+
+                // bring their fine counts to this column, starting over
+                // if that is less work than moving them
+                counts = &windowFine[part * 16];
+                if (2 * (x - synced[part]) > size)
+                {
+                    memset(counts, 0, 16 * sizeof(unsigned short));
+                    synced[part] = x - radius;
+                    while (synced[part] <= x + radius)
+                    {
+                        add = &fine[(min(max(synced[part], 0), cols - 1) -
+                            low) * 256 + part * 16];
+                        j = 0;
+                        while (j < 16)
+                        {
+                            counts[j] += add[j];
+                            j++;
+                        }
+                        synced[part]++;
+                    }
+                }
+                else
+                {
+                    while (synced[part] < x)
+                    {
+                        synced[part]++;
+                        add = &fine[(min(synced[part] + radius, cols - 1) -
+                            low) * 256 + part * 16];
+                        take = &fine[(max(synced[part] - radius - 1, 0) -
+                            low) * 256 + part * 16];
+                        j = 0;
+                        while (j < 16)
+                        {
+                            counts[j] += add[j] - take[j];
+                            j++;
+                        }
+                    }
+                }
+                synced[part] = x;
+
+                j = 0;
+                while (seen + counts[j] <= below)
+                {
+                    seen += counts[j];
+                    j++;
+                }
+                dst[y][x] = (pixel)(part * 16 + j);
+                x++;
+            }
+            y++;
+        }
+        left = right;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function puts the median of the window around each pixel of src
+ * into dst, for red/gray, green and blue, on all the threads. Radius 1
+ * and 2 go through sorting networks, and bigger ones through the
+ * histograms, which take the same time for any radius. src has margin
+ * more rows above row 0 and below its last row, which a band of a bigger
+ * image is given, and past those the edge rows are repeated. The result
+ * is the same for any band of rows.
+ *
+ * @param[in] src - the image, or a band of it.
+ * @param[in] margin - the rows src has above and below its own.
+ * @param[in] radius - the radius of the window.
+ * @param[out] dst - arrays with the rows and cols of src.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   medianRows(band, 3, 3, filtered);
+
+   filtered has the 7x7 medians of band, which has 3 more rows of the
+   image above it and below it.
+   @endverbatim
+
+ ***********************************************************************/
+
+static void medianRows(image& src, int margin, int radius, image& dst)
+{
+    pixel** from[3] = { src.redGray, src.green, src.blue };
+    pixel** to[3] = { dst.redGray, dst.green, dst.blue };
+
+    parallelRows(src.rows, [&](int start, int end)
+    {
+        int c = 0;
+
+        while (c < 3)
+        {
+            if (radius <= 2)
+            {
+                networkRows(from[c], to[c], start, end, -margin,
+                    src.rows - 1 + margin, src.cols, radius);
+            }
+            else
+            {
+                histogramRows(from[c], to[c], start, end, -margin,
+                    src.rows - 1 + margin, src.cols, radius);
+            }
+            c++;
+        }
+    });
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function replaces each pixel of an image with the median of the
+ * window around it, in each of red/gray, green and blue. The medians go
+ * into new arrays, which then replace the old ones.
+ *
+ * @param[in,out] im - the image.
+ * @param[in] radius - the radius of the window, 1 for 3x3.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   medianFilter(im, 2);
+
+   im has had the salt and pepper noise smaller than 3 pixels taken out.
+   @endverbatim
+
+ ***********************************************************************/
+
+void medianFilter(image& im, int radius)
+{
+    image filtered;
+
+    filtered.rows = im.rows;
+    filtered.cols = im.cols;
+    allocateArray(filtered.redGray, im.rows, im.cols);
+    allocateArray(filtered.green, im.rows, im.cols);
+    allocateArray(filtered.blue, im.rows, im.cols);
+    medianRows(im, 0, radius, filtered);
+
+    // free the old arrays and use the new ones
+    freeUpArray(im.redGray, im.rows);
+    freeUpArray(im.green, im.rows);
+    freeUpArray(im.blue, im.rows);
+    im.redGray = filtered.redGray;
+    im.green = filtered.green;
+    im.blue = filtered.blue;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function replaces each pixel of a band of rows from streamRows
+ * with the median of the window around it. The band has radius rows of
+ * margin, and the medians go into a band of their own, made the first
+ * time and kept for the bands after, since the rows around each row are
+ * still needed until the last median is found. Then they are copied
+ * back into the band.
+ *
+ * @param[in,out] band - the band of rows, with radius rows of margin.
+ * @param[in] radius - the radius of the window.
+ * @param[in,out] medians - the band of medians, empty the first time.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   netImage medians;
+
+   streamRows(in, out, "P6", "P6", [&](image& band)
+   {
+       medianBand(band, 2, medians);
+   }, 16 << 20, 2);
+   @endverbatim
+
+ ***********************************************************************/
+
+void medianBand(image& band, int radius, netImage& medians)
+{
+    int i = 0;
+
+    if (medians.empty())
+    {
+        medians = netImage(band.rows, band.cols);
+    }
+    image& filtered = medians.get();
+
+    filtered.rows = band.rows;
+    medianRows(band, radius, radius, filtered);
+    while (i < band.rows)
+    {
+        memcpy(band.redGray[i], filtered.redGray[i], band.cols);
+        memcpy(band.green[i], filtered.green[i], band.cols);
+        memcpy(band.blue[i], filtered.blue[i], band.cols);
+        i++;
+    }
+}
@@ -29,31 +29,19 @@
 
 void flipX(image& im)
 {
-    int temp = 0;
+    const kernelTable& k = kernels();
     int i = 0;
-    int j = 0;
     int r = im.rows - 1;
-    while (i < im.rows / 2)
+
+    // swap the top row with the bottom row for each array
+    // and move one row closer to the middle on both sides
+    while (i < r)
     {
-        while (j < im.cols)
-        {
-            // swap value on top row with the one on bottom row
-            // do this for each array
-            temp = im.redGray[i][j];
-            im.redGray[i][j] = im.redGray[r][j];
-            im.redGray[r][j] = temp;
-            temp = im.blue[i][j];
-            im.blue[i][j] = im.blue[r][j];
-            im.blue[r][j] = temp;
-            temp = im.green[i][j];
-            im.green[i][j] = im.green[r][j];
-            im.green[r][j] = temp;
-            j++;
-        }
-        // move one row closer to the middle on both sides
+        k.swapRows(im.redGray[i], im.redGray[r], im.cols);
+        k.swapRows(im.green[i], im.green[r], im.cols);
+        k.swapRows(im.blue[i], im.blue[r], im.cols);
         i++;
         r--;
-        j = 0;
     }
 }
 
@@ -82,36 +70,153 @@ void flipX(image& im)
 
 void flipY(image& im)
 {
-    int temp = 0;
+    const kernelTable& k = kernels();
     int i = 0;
-    int j = 0;
-    int c = im.cols - 1;
-    while (j < im.cols / 2)
+
+    // reverse every row of each array
+    while (i < im.rows)
+    {
+        k.reverseRow(im.redGray[i], im.cols);
+        k.reverseRow(im.green[i], im.cols);
+        k.reverseRow(im.blue[i], im.cols);
+        i++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function rotates one array by 90 degrees into another. It works
+ * in 16x16 blocks so reads and writes both stay in a few cache lines,
+ * and each block is turned with the transpose kernel. The rows of a
+ * clockwise block are taken from the bottom up, and the rows of a
+ * counterclockwise block are written from the bottom up. Pixels past
+ * the last whole block are copied one at a time. Bands of blocks are
+ * done on separate threads.
+ *
+ * @param[in] src - the array to rotate, rows x cols.
+ * @param[out] dst - the rotated array, cols x rows.
+ * @param[in] rows - the number of rows of src.
+ * @param[in] cols - the number of columns of src.
+ * @param[in] clockwise - true to rotate clockwise.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   rotatePlane(im.redGray, redGrayNew, im.rows, im.cols, true);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void rotatePlane(pixel** src, pixel** dst, int rows, int cols,
+    bool clockwise)
+{
+    const kernelTable& k = kernels();
+    int fullX = cols - cols % 16; // dst rows covered by whole blocks
+    int fullY = rows - rows % 16; // dst cols covered by whole blocks
+    int x;
+    int y;
+
+    parallelRows(fullX / 16, [&](int start, int end)
     {
-        while (i < im.rows)
+        const pixel* from[16];
+        pixel* to[16];
+        int x0;
+        int y0;
+        int m;
+
+        while (start < end)
         {
-            // swap value on left col with the one on right col
-            // do this for each array
-            temp = im.redGray[i][j];
-            im.redGray[i][j] = im.redGray[i][c];
-            im.redGray[i][c] = temp;
-            temp = im.blue[i][j];
-            im.blue[i][j] = im.blue[i][c];
-            im.blue[i][c] = temp;
-            temp = im.green[i][j];
-            im.green[i][j] = im.green[i][c];
-            im.green[i][c] = temp;
-            i++;
+            x0 = start * 16;
+            y0 = 0;
+            while (y0 < fullY)
+            {
+                m = 0;
+                while (m < 16)
+                {
+                    if (clockwise)
+                    {
+                        from[m] = src[rows - 1 - y0 - m] + x0;
+                        to[m] = dst[x0 + m] + y0;
+                    }
+                    else
+                    {
+                        from[m] = src[y0 + m] + cols - 16 - x0;
+                        to[m] = dst[x0 + 15 - m] + y0;
+                    }
+                    m++;
+                }
+                k.transpose16(from, to);
+                y0 += 16;
+            }
+            start++;
+        }
+    });
+
+    // the right and bottom edges that don't fill a block
+    x = 0;
+    while (x < cols)
+    {
+        y = x < fullX ? fullY : 0;
+        while (y < rows)
+        {
+            if (clockwise)
+            {
+                dst[x][y] = src[rows - 1 - y][x];
+            }
+            else
+            {
+                dst[x][y] = src[y][cols - 1 - x];
+            }
+            y++;
         }
-        // move one col closer to the middle on both sides
-        j++;
-        c--;
-        i = 0;
+        x++;
     }
 }
 
 
 
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function rotates one array by 90 degrees into a new array with
+ * the opposite sizes and frees the old one. Turning an image one array
+ * at a time means only one extra array is ever allocated, instead of
+ * holding the old and new image at once.
+ *
+ * @param[in,out] plane - the array to rotate, rows x cols, and then the
+ *                        rotated array, cols x rows.
+ * @param[in] rows - the number of rows of plane.
+ * @param[in] cols - the number of columns of plane.
+ * @param[in] clockwise - true to rotate clockwise.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   rotateArray(im.redGray, im.rows, im.cols, true);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void rotateArray(pixel**& plane, int rows, int cols, bool clockwise)
+{
+    pixel** rotated;
+
+    // rows equals cols of plane, and cols equals rows of plane
+    allocateArray(rotated, cols, rows);
+    rotatePlane(plane, rotated, rows, cols, clockwise);
+    freeUpArray(plane, rows);
+    plane = rotated;
+}
+
+
+
 /** *********************************************************************
  * @author David Hill
  *
@@ -137,45 +242,16 @@ void rotateCW(image& im)
 {
     int r = im.rows;
     int c = im.cols;
-    int i = 0;
-    int j = r - 1;
-    int x = 0;
-    int y = 0;
 
-    // create and allocate 3 new arrays with the opposite sizes
-    // (rows equals cols of im, and cols equals rows of im)
-    pixel** redGrayNew;
-    pixel** greenNew;
-    pixel** blueNew;
-    allocateArray(redGrayNew, c, r);
-    allocateArray(greenNew, c, r);
-    allocateArray(blueNew, c, r);
+    // each row of the original becomes a column of the new array,
+    // with the top row ending up on the right
+    rotateArray(im.redGray, r, c, true);
+    rotateArray(im.green, r, c, true);
+    rotateArray(im.blue, r, c, true);
 
-    // copy each row from the original array (starting at top left)
-    // down each column of the new array (starting from top right)
-    while (x < c)
-    {
-        while (y < r)
-        {
-            redGrayNew[x][y] = im.redGray[j][i];
-            greenNew[x][y] = im.green[j][i];
-            blueNew[x][y] = im.blue[j][i];
-            y++;
-            j--;
-        }
-        i++;
-        x++;
-        y = 0;
-        j = r - 1;
-    }
     // change rows to cols and cols to rows back to im
     im.rows = c;
     im.cols = r;
-
-    // copy new arrays back to the arrays in im
-    im.redGray = redGrayNew;
-    im.blue = blueNew;
-    im.green = greenNew;
 }
 
 
@@ -205,46 +281,16 @@ void rotateCCW(image& im)
 {
     int r = im.rows;
     int c = im.cols;
-    int i = 0;
-    int j = c - 1;
-    int x = 0;
-    int y = 0;
-    
-    // create and allocate 3 new arrays with the opposite sizes
-    // (rows equals cols of im, and cols equals rows of im)
-    pixel** redGrayNew;
-    pixel** greenNew;
-    pixel** blueNew;
-    allocateArray(redGrayNew, c, r);
-    allocateArray(greenNew, c, r);
-    allocateArray(blueNew, c, r);
 
-    // copy each row from the original array (starting from top left)
-    // down each column of the new array (starting from bottom left)
-    while (x < c)
-    {
-        while (y < r)
-        {
-            redGrayNew[x][y] = im.redGray[i][j];
-            greenNew[x][y] = im.green[i][j];
-            blueNew[x][y] = im.blue[i][j];
-            y++;
-            i++;
-        }
-        j--;
-        x++;
-        y = 0;
-        i = 0;
-    }
+    // each row of the original becomes a column of the new array,
+    // with the top row ending up on the right
+    rotateArray(im.redGray, r, c, false);
+    rotateArray(im.green, r, c, false);
+    rotateArray(im.blue, r, c, false);
 
     // change rows to cols and cols to rows back to im
     im.rows = c;
     im.cols = r;
-
-    // copy new arrays back to the arrays in im
-    im.redGray = redGrayNew;
-    im.blue = blueNew;
-    im.green = greenNew;
 }
 
 
@@ -272,20 +318,14 @@ void rotateCCW(image& im)
 
 void grayscale(image& im)
 {
+    const kernelTable& k = kernels();
     int i = 0;
-    int j = 0;
 
     // apply grayscale equation just to each pixel in the redgray array
     while (i < im.rows)
     {
-        while (j < im.cols)
-        {
-             im.redGray[i][j] = (int) (.3 * im.redGray[i][j] + .6 *
-                im.green[i][j] + .1 * im.blue[i][j]);
-            j++;
-        }
+        k.grayRow(im.redGray[i], im.green[i], im.blue[i], im.cols);
         i++;
-        j = 0;
     }
 }
 
@@ -314,49 +354,397 @@ void grayscale(image& im)
 
 void sepia(image& im)
 {
-    int val = 0;
+    const kernelTable& k = kernels();
     int i = 0;
-    int j = 0;
 
     // apply sepia equation to each pixel in each array
     // if value goes over 255, set it back to 255
     while (i < im.rows)
     {
-        while (j < im.cols)
+        k.sepiaRow(im.redGray[i], im.green[i], im.blue[i], im.cols);
+        i++;
+    }
+}
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads the angle, sampling and background out of a
+ * rotate option. The option looks like --rotate=angle[,sampling][,R:G:B]
+ * where angle is in degrees clockwise, sampling is nearest or bilinear
+ * (the default) and R:G:B is the color to put where there is no source
+ * pixel (black by default).
+ *
+ * @param[in] option - the command line option.
+ * @param[out] degrees - the angle to rotate by.
+ * @param[out] bilinear - true for bilinear sampling, false for nearest.
+ * @param[out] fill - the red, green and blue background color.
+ *
+ * @returns true if the option is a valid rotate option, false if not.
+ *
+ * @par Example:
+   @verbatim
+   double degrees;
+   bool bilinear;
+   pixel fill[3];
+
+   parseRotate("--rotate=-1.5,nearest,255:255:255", degrees, bilinear,
+       fill);
+
+   output: true, degrees is -1.5, bilinear is false and fill is white
+   @endverbatim
+
+ ***********************************************************************/
+
+bool parseRotate(string option, double& degrees, bool& bilinear,
+    pixel fill[3])
+{
+    string prefix = "--rotate=";
+    string part;
+    int color[3];
+    char sep1 = 0;
+    char sep2 = 0;
+    int i;
+
+    if (option.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
+    istringstream spec(option.substr(prefix.size()));
+
+    // the angle always comes first
+    getline(spec, part, ',');
+    istringstream angle(part);
+    if (!(angle >> degrees) || angle.peek() != EOF)
+    {
+        return false;
+    }
+
+    bilinear = true;
+    fill[0] = fill[1] = fill[2] = 0;
+
+    // then the sampling and the background, in either order
+    while (getline(spec, part, ','))
+    {
+        if (part == "nearest")
         {
-            int r = im.redGray[i][j];
-            int g = im.green[i][j];
-            int b = im.blue[i][j];
-            val = (int) (0.393 * r + 0.769 * g + 0.189 * b);
-            if (val > 255)
-            {
-                im.redGray[i][j] = 255;
-            }
-            else
-            {
-                im.redGray[i][j] = val;
-            }
-            val = (int) (0.349 * r + 0.686 * g + 0.168 * b);
-            if (val > 255)
-            {
-                im.green[i][j] = 255;
-            }
-            else
+            bilinear = false;
+        }
+        else if (part == "bilinear")
+        {
+            bilinear = true;
+        }
+        else
+        {
+            istringstream rgb(part);
+            if (!(rgb >> color[0] >> sep1 >> color[1] >> sep2 >> color[2])
+                || sep1 != ':' || sep2 != ':' || rgb.peek() != EOF)
             {
-                im.green[i][j] = val;
+                return false;
             }
-            val = (int) (0.272 * r + 0.534 * g + 0.131 * b);
-            if (val > 255)
+            i = 0;
+            while (i < 3)
             {
-                im.blue[i][j] = 255;
+                if (color[i] < 0 || color[i] > 255)
+                {
+                    return false;
+                }
+                fill[i] = (pixel)color[i];
+                i++;
             }
-            else
+        }
+    }
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function rotates an image clockwise by any angle about its
+ * center, keeping the same size. The output is walked in 64 x 64 tiles
+ * so the source pixels each tile reads stay in cache, and the bands of
+ * tiles are split across threads. Inside a tile the source position is
+ * stepped in 16.16 fixed point along each row instead of calling sin
+ * and cos for every pixel. Bilinear sampling blends with 7 bit weights,
+ * 4 pixels at a time.
+ *
+ * @param[in] im - the image to be manipulated
+ * @param[in] degrees - the angle to rotate by, clockwise.
+ * @param[in] bilinear - true for bilinear sampling, false for nearest.
+ * @param[in] fill - the red, green and blue background color.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   image im;
+   pixel white[3] = { 255, 255, 255 };
+
+   rotateAngle(im, 2.5, true, white);
+
+   "im" is now rotated 2.5 degrees clockwise on a white background.
+   @endverbatim
+
+ ***********************************************************************/
+
+void rotateAngle(image& im, double degrees, bool bilinear, pixel fill[3])
+{
+    const int TILE = 64;
+    const long long ONE = 1 << 16; // 1.0 in 16.16 fixed point
+    double radians = degrees * 3.14159265358979323846 / 180.0;
+    double cosA = cos(radians);
+    double sinA = sin(radians);
+    double cx = (im.cols - 1) / 2.0;
+    double cy = (im.rows - 1) / 2.0;
+    long long stepX = llround(cosA * ONE);  // source step per output col
+    long long stepY = llround(-sinA * ONE);
+    long long maxX = (long long)(im.cols - 1) * ONE;
+    long long maxY = (long long)(im.rows - 1) * ONE;
+    long long edge = bilinear ? 0 : ONE - 1; // nearest can round down
+    int tileRows = (im.rows + TILE - 1) / TILE;
+    pixel** redGrayNew;
+    pixel** greenNew;
+    pixel** blueNew;
+
+    allocateArray(redGrayNew, im.rows, im.cols);
+    allocateArray(greenNew, im.rows, im.cols);
+    allocateArray(blueNew, im.rows, im.cols);
+    pixel** src[3] = { im.redGray, im.green, im.blue };
+    pixel** dst[3] = { redGrayNew, greenNew, blueNew };
+
+    parallelRows(tileRows, [&](int startTile, int endTile)
+    {
+        int x0[TILE];
+        int x1[TILE];
+        int y0[TILE];
+        int y1[TILE];
+        short fx[TILE];
+        short fy[TILE];
+        bool inside[TILE];
+        long long sx;
+        long long sy;
+        int top = startTile * TILE;
+        int left;
+        int width;
+        int y;
+        int j;
+        int c;
+        pixel* out;
+
+        while (top < endTile * TILE && top < im.rows)
+        {
+            left = 0;
+            while (left < im.cols)
             {
-                im.blue[i][j] = val;
+                width = im.cols - left < TILE ? im.cols - left : TILE;
+                y = top;
+                while (y < top + TILE && y < im.rows)
+                {
+                    // source position of the first pixel in this span
+                    sx = llround((cx + (left - cx) * cosA +
+                        (y - cy) * sinA) * ONE);
+                    sy = llround((cy - (left - cx) * sinA +
+                        (y - cy) * cosA) * ONE);
+
+                    // (nearest rounds by starting half a pixel over)
+                    if (!bilinear)
+                    {
+                        sx += ONE / 2;
+                        sy += ONE / 2;
+                    }
+
+                    // step across the span finding the source pixels
+                    j = 0;
+                    while (j < width)
+                    {
+                        inside[j] = sx >= 0 && sy >= 0 &&
+                            sx <= maxX + edge && sy <= maxY + edge;
+                        x0[j] = y0[j] = fx[j] = fy[j] = 0;
+                        if (inside[j])
+                        {
+                            x0[j] = (int)(sx >> 16);
+                            y0[j] = (int)(sy >> 16);
+                            fx[j] = (short)((sx >> 9) & 127);
+                            fy[j] = (short)((sy >> 9) & 127);
+                        }
+                        x1[j] = x0[j] + 1 < im.cols ? x0[j] + 1 : x0[j];
+                        y1[j] = y0[j] + 1 < im.rows ? y0[j] + 1 : y0[j];
+                        sx += stepX;
+                        sy += stepY;
+                        j++;
+                    }
+
+                    c = 0;
+                    while (c < 3)
+                    {
+                        out = dst[c][y] + left;
+                        j = 0;
+                        if (bilinear)
+                        {
+#ifdef NETPBM_SSE2
+                            pixel** p = src[c];
+                            int four;
+                            while (j + 4 <= width)
+                            {
+                                // blend across each pair of columns
+                                __m128i t = _mm_madd_epi16(_mm_setr_epi16(
+                                    p[y0[j]][x0[j]], p[y0[j]][x1[j]],
+                                    p[y0[j + 1]][x0[j + 1]],
+                                    p[y0[j + 1]][x1[j + 1]],
+                                    p[y0[j + 2]][x0[j + 2]],
+                                    p[y0[j + 2]][x1[j + 2]],
+                                    p[y0[j + 3]][x0[j + 3]],
+                                    p[y0[j + 3]][x1[j + 3]]),
+                                    _mm_setr_epi16(128 - fx[j], fx[j],
+                                    128 - fx[j + 1], fx[j + 1],
+                                    128 - fx[j + 2], fx[j + 2],
+                                    128 - fx[j + 3], fx[j + 3]));
+                                __m128i b = _mm_madd_epi16(_mm_setr_epi16(
+                                    p[y1[j]][x0[j]], p[y1[j]][x1[j]],
+                                    p[y1[j + 1]][x0[j + 1]],
+                                    p[y1[j + 1]][x1[j + 1]],
+                                    p[y1[j + 2]][x0[j + 2]],
+                                    p[y1[j + 2]][x1[j + 2]],
+                                    p[y1[j + 3]][x0[j + 3]],
+                                    p[y1[j + 3]][x1[j + 3]]),
+                                    _mm_setr_epi16(128 - fx[j], fx[j],
+                                    128 - fx[j + 1], fx[j + 1],
+                                    128 - fx[j + 2], fx[j + 2],
+                                    128 - fx[j + 3], fx[j + 3]));
+
+                                // then blend the top and bottom rows
+                                __m128i tb = _mm_packs_epi32(t, b);
+                                tb = _mm_unpacklo_epi16(tb,
+                                    _mm_srli_si128(tb, 8));
+                                __m128i v = _mm_madd_epi16(tb,
+                                    _mm_setr_epi16(128 - fy[j], fy[j],
+                                    128 - fy[j + 1], fy[j + 1],
+                                    128 - fy[j + 2], fy[j + 2],
+                                    128 - fy[j + 3], fy[j + 3]));
+                                v = _mm_srai_epi32(_mm_add_epi32(v,
+                                    _mm_set1_epi32(1 << 13)), 14);
+                                v = _mm_packs_epi32(v, v);
+                                v = _mm_packus_epi16(v, v);
+                                four = _mm_cvtsi128_si32(v);
+                                memcpy(out + j, &four, 4);
+                                j += 4;
+                            }
+#endif
+                            while (j < width)
+                            {
+                                int t = src[c][y0[j]][x0[j]] *
+                                    (128 - fx[j]) +
+                                    src[c][y0[j]][x1[j]] * fx[j];
+                                int b = src[c][y1[j]][x0[j]] *
+                                    (128 - fx[j]) +
+                                    src[c][y1[j]][x1[j]] * fx[j];
+                                out[j] = (pixel)((t * (128 - fy[j]) +
+                                    b * fy[j] + (1 << 13)) >> 14);
+                                j++;
+                            }
+                        }
+                        else
+                        {
+                            while (j < width)
+                            {
+                                out[j] = src[c][y0[j]][x0[j]];
+                                j++;
+                            }
+                        }
+
+                        // put the background where there was no source
+                        j = 0;
+                        while (j < width)
+                        {
+                            if (!inside[j])
+                            {
+                                out[j] = fill[c];
+                            }
+                            j++;
+                        }
+                        c++;
+                    }
+                    y++;
+                }
+                left += TILE;
             }
-            j++;
+            top += TILE;
         }
+    });
+
+    // free the old arrays and use the new ones
+    freeUpArray(im.redGray, im.rows);
+    freeUpArray(im.green, im.rows);
+    freeUpArray(im.blue, im.rows);
+    im.redGray = redGrayNew;
+    im.green = greenNew;
+    im.blue = blueNew;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function crops an image down to a rectangle. The rectangle is
+ * trimmed to the image first. Nothing is copied if it covers the whole
+ * image.
+ *
+ * @param[in] im - the image to be manipulated
+ * @param[in] area - the rectangle to keep.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   image im;
+   cropRegion area = { 10, 20, 100, 50 };
+
+   crop(im, area);
+
+   "im" is now the 100 x 50 pixels starting at column 10, row 20.
+   @endverbatim
+
+ ***********************************************************************/
+
+void crop(image& im, cropRegion area)
+{
+    pixel** redGrayNew;
+    pixel** greenNew;
+    pixel** blueNew;
+    int i = 0;
+
+    clipRegion(area, im.rows, im.cols);
+    if (area.w == im.cols && area.h == im.rows)
+    {
+        return;
+    }
+
+    // copy the part of each row under the rectangle
+    allocateArray(redGrayNew, area.h, area.w);
+    allocateArray(greenNew, area.h, area.w);
+    allocateArray(blueNew, area.h, area.w);
+    while (i < area.h)
+    {
+        memcpy(redGrayNew[i], im.redGray[area.y + i] + area.x, area.w);
+        memcpy(greenNew[i], im.green[area.y + i] + area.x, area.w);
+        memcpy(blueNew[i], im.blue[area.y + i] + area.x, area.w);
         i++;
-        j = 0;
     }
-}
\ No newline at end of file
+
+    // free the old arrays and use the new ones
+    freeUpArray(im.redGray, im.rows);
+    freeUpArray(im.green, im.rows);
+    freeUpArray(im.blue, im.rows);
+    im.redGray = redGrayNew;
+    im.green = greenNew;
+    im.blue = blueNew;
+    im.rows = area.h;
+    im.cols = area.w;
+}
@@ -0,0 +1,263 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that make every power of two downscale of an image
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function takes the next band of rows of the level above level n
+  * and makes as many rows of level n from them as it can, each the
+  * average of a 2x2 block, on all the threads. A row left without the
+  * one under it waits in pending for the next band, and an odd last row
+  * is dropped, so a level is always half the size rounded down. A level
+  * above that is one row or one column high or wide has it used twice.
+  * The new rows are written to the level's file and then passed on to
+  * make the level below it, so each level only ever holds a band.
+  *
+  * @param[in,out] levels - the levels, each with its file open.
+  * @param[in] n - the level to make rows of.
+  * @param[in] above - the next rows of the level above.
+  * @param[in] ascii - true to write P3, false for P6.
+  *
+  * @returns none
+  *
+  * @par Example:
+    @verbatim
+    addPyramidRows(levels, 0, band, false);
+
+    each level has the rows made from band written to its file.
+    @endverbatim
+
+  ***********************************************************************/
+
+static void addPyramidRows(vector<pyramidLevel>& levels, size_t n,
+    image& above, bool ascii)
+{
+    const kernelTable& k = kernels();
+    pyramidLevel& level = levels[n];
+    pixel** planes[3] = { above.redGray, above.green, above.blue };
+    image& pending = level.pending.get();
+    pixel** waiting[3] = { pending.redGray, pending.green, pending.blue };
+    vector<int> tops;    // the row of above each new row starts at, or
+    vector<int> bottoms; // -1 for pending, and the row under it
+    int i = 0;
+
+    // pair the rows up, starting with the one left from the last band
+    if (level.aboveRows == 1)
+    {
+        tops.push_back(0);
+        bottoms.push_back(0);
+        i = above.rows;
+    }
+    else if (level.waiting && above.rows > 0)
+    {
+        tops.push_back(-1);
+        bottoms.push_back(0);
+        level.waiting = false;
+        i = 1;
+    }
+    while (i + 1 < above.rows)
+    {
+        tops.push_back(i);
+        bottoms.push_back(i + 1);
+        i += 2;
+    }
+    level.received += above.rows;
+
+    // a row left over waits for the next band, unless it is the odd last
+    // row. pending may still be used above, so it is kept at the end
+    auto keepLeftOver = [&]()
+    {
+        int c = 0;
+
+        if (i < above.rows && level.received < level.aboveRows)
+        {
+            while (c < 3)
+            {
+                memcpy(waiting[c][0], planes[c][i], above.cols);
+                c++;
+            }
+            level.waiting = true;
+        }
+    };
+    if (tops.empty())
+    {
+        keepLeftOver();
+        return;
+    }
+
+    netImage made((int)tops.size(), level.cols);
+    image& half = made.get();
+    pixel** halves[3] = { half.redGray, half.green, half.blue };
+    parallelRows(half.rows, [&](int start, int end)
+    {
+        const pixel* top;
+        const pixel* bottom;
+        int color;
+
+        while (start < end)
+        {
+            color = 0;
+            while (color < 3)
+            {
+                top = tops[start] < 0 ? waiting[color][0] :
+                    planes[color][tops[start]];
+                bottom = planes[color][bottoms[start]];
+                if (level.aboveCols == 1)
+                {
+                    halves[color][start][0] = (pixel)((top[0] +
+                        bottom[0] + 1) >> 1);
+                }
+                else
+                {
+                    k.halveRow(top, bottom, halves[color][start],
+                        level.cols);
+                }
+                color++;
+            }
+            start++;
+        }
+    });
+
+    keepLeftOver();
+
+    if (ascii)
+    {
+        writeAsciiRows(level.file, half.redGray, half.green, half.blue,
+            half.rows, half.cols);
+    }
+    else
+    {
+        writeBinaryRows(level.file, half.redGray, half.green, half.blue,
+            half.rows, half.cols);
+    }
+    if (n + 1 < levels.size())
+    {
+        addPyramidRows(levels, n + 1, half, ascii);
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function makes every power of two downscale of a P3 or P6 image,
+ * down to 1x1, in one pass over it. Level N is 1/2^N the size, each
+ * pixel the average of a 2x2 block of level N - 1, and is written to
+ * basename_N.ppm. The image is read a band of rows at a time, and each
+ * band is halved again and again down through the levels as it comes
+ * in, so the input is read once and no level is ever all in memory.
+ *
+ * @param[in] in - the input stream, just past the magic number.
+ * @param[in] inputMagic - P3 or P6.
+ * @param[in] outputMagic - P3 or P6 for the levels.
+ * @param[in] basename - the start of the name of each level's file.
+ * @param[in] limit - the most bytes of rows to hold at once.
+ * @param[out] count - the number of levels written.
+ *
+ * @returns true if every level was written, false if a file didn't open
+ *          or the input ended early
+ *
+ * @par Example:
+   @verbatim
+   int count;
+
+   streamPyramid(in, "P6", "P6", "tiles", 32 << 20, count);
+
+   for a 1024x768 image, tiles_1.ppm is 512x384 and so on down to
+   tiles_10.ppm, which is 1x1, and count is 10.
+   @endverbatim
+
+ ***********************************************************************/
+
+bool streamPyramid(istream& in, string inputMagic, string outputMagic,
+    string basename, long long limit, int& count)
+{
+    image header;
+    int maxValue = 0;
+    int rows;
+    int cols;
+    long long bandRows;
+    int done = 0;
+    size_t n = 0;
+    pixel space;
+
+    readHeader(in, header, maxValue);
+    if (inputMagic == "P6")
+    {
+        in.read((char*)&space, sizeof(pixel));
+    }
+
+    // halve until both sides are 1
+    count = 0;
+    rows = header.rows;
+    cols = header.cols;
+    while (rows > 1 || cols > 1)
+    {
+        rows = max(rows / 2, 1);
+        cols = max(cols / 2, 1);
+        count++;
+    }
+    vector<pyramidLevel> levels(count);
+    rows = header.rows;
+    cols = header.cols;
+    while (n < levels.size())
+    {
+        levels[n].aboveRows = rows;
+        levels[n].aboveCols = cols;
+        rows = max(rows / 2, 1);
+        cols = max(cols / 2, 1);
+        levels[n].rows = rows;
+        levels[n].cols = cols;
+        levels[n].pending = netImage(1, levels[n].aboveCols);
+        if (!openOutput(levels[n].file, basename + "_" + to_string(n + 1) +
+            ".ppm"))
+        {
+            return false;
+        }
+
+        // the same header the writers output
+        levels[n].file << outputMagic << endl;
+        levels[n].file << header.comment;
+        levels[n].file << cols << " " << rows << endl;
+        levels[n].file << maxValue << endl;
+        n++;
+    }
+
+    // the band and the rows it makes in all the levels under it come to
+    // about twice the band
+    bandRows = limit / ((long long)header.cols * 6) / 2 * 2;
+    if (bandRows > header.rows)
+    {
+        bandRows = header.rows;
+    }
+    if (bandRows < 2)
+    {
+        bandRows = 2;
+    }
+    netImage band((int)bandRows, header.cols);
+    image& im = band.get();
+
+    while (done < header.rows && !levels.empty())
+    {
+        im.rows = (int)min(bandRows, (long long)header.rows - done);
+        readRows(in, im, inputMagic);
+        if (in.fail())
+        {
+            break;
+        }
+        addPyramidRows(levels, 0, im, outputMagic == "P3");
+        done += im.rows;
+    }
+    im.rows = (int)bandRows;
+    return levels.empty() || done == header.rows;
+}
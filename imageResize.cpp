@@ -0,0 +1,819 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that change the dimensions of an image
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+/*!
+ * @brief PI used by the lanczos kernel
+ */
+
+const double PI = 3.14159265358979323846;
+
+/*!
+ * @brief STREAM_BATCH number of source rows read at a time when streaming
+ */
+
+const int STREAM_BATCH = 64;
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function is the box filter. Every source pixel under the output
+  * pixel counts the same, which averages the area when shrinking.
+  *
+  * @param[in] x - the distance from the center of the output pixel.
+  *
+  * @returns the weight for that distance.
+  *
+  * @par Example:
+    @verbatim
+    double w = filterBox(0.25);
+
+    w is now 1.0
+    @endverbatim
+
+  ***********************************************************************/
+
+static double filterBox(double x)
+{
+    if (x > -0.5 && x <= 0.5)
+    {
+        return 1.0;
+    }
+    return 0.0;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function is the triangle filter used for bilinear resampling.
+ *
+ * @param[in] x - the distance from the center of the output pixel.
+ *
+ * @returns the weight for that distance.
+ *
+ * @par Example:
+   @verbatim
+   double w = filterBilinear(0.25);
+
+   w is now 0.75
+   @endverbatim
+
+ ***********************************************************************/
+
+static double filterBilinear(double x)
+{
+    x = fabs(x);
+    if (x < 1.0)
+    {
+        return 1.0 - x;
+    }
+    return 0.0;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function is the cubic convolution filter with a = -0.5
+ * (Catmull-Rom) used for bicubic resampling.
+ *
+ * @param[in] x - the distance from the center of the output pixel.
+ *
+ * @returns the weight for that distance.
+ *
+ * @par Example:
+   @verbatim
+   double w = filterBicubic(0.0);
+
+   w is now 1.0
+   @endverbatim
+
+ ***********************************************************************/
+
+static double filterBicubic(double x)
+{
+    const double a = -0.5;
+
+    x = fabs(x);
+    if (x < 1.0)
+    {
+        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+    }
+    if (x < 2.0)
+    {
+        return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+    }
+    return 0.0;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function is the windowed sinc filter with 3 lobes used for
+ * lanczos resampling.
+ *
+ * @param[in] x - the distance from the center of the output pixel.
+ *
+ * @returns the weight for that distance.
+ *
+ * @par Example:
+   @verbatim
+   double w = filterLanczos3(0.0);
+
+   w is now 1.0
+   @endverbatim
+
+ ***********************************************************************/
+
+static double filterLanczos3(double x)
+{
+    double a;
+    double b;
+
+    if (x == 0.0)
+    {
+        return 1.0;
+    }
+    if (x <= -3.0 || x >= 3.0)
+    {
+        return 0.0;
+    }
+    a = PI * x;
+    b = a / 3.0;
+    return (sin(a) / a) * (sin(b) / b);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads the size and filter out of a resize option. The
+ * option looks like --resize=WxH or --resize=WxH,filter where filter is
+ * box, bilinear, bicubic or lanczos3 (the default). Either W or H may be
+ * 0 to keep the aspect ratio of the input.
+ *
+ * @param[in] option - the command line option.
+ * @param[out] newCols - the requested number of columns.
+ * @param[out] newRows - the requested number of rows.
+ * @param[out] filter - the requested filter.
+ *
+ * @returns true if the option is a valid resize option, false if not.
+ *
+ * @par Example:
+   @verbatim
+   int cols;
+   int rows;
+   filterType filter;
+
+   parseResize("--resize=640x0,bicubic", cols, rows, filter);
+
+   output: true, cols is 640, rows is 0 and filter is FILTER_BICUBIC
+   @endverbatim
+
+ ***********************************************************************/
+
+bool parseResize(string option, int& newCols, int& newRows,
+    filterType& filter)
+{
+    string prefix = "--resize=";
+    string spec;
+    string name = "lanczos3";
+    size_t comma;
+    char x = 0;
+
+    if (option.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
+    spec = option.substr(prefix.size());
+
+    // split off the filter name if there is one
+    comma = spec.find(',');
+    if (comma != string::npos)
+    {
+        name = spec.substr(comma + 1);
+        spec = spec.substr(0, comma);
+    }
+
+    // read in WxH and make sure nothing is left over
+    istringstream sizes(spec);
+    if (!(sizes >> newCols >> x >> newRows) || x != 'x' ||
+        sizes.peek() != EOF)
+    {
+        return false;
+    }
+    if (newCols < 0 || newRows < 0 || (newCols == 0 && newRows == 0))
+    {
+        return false;
+    }
+
+    if (name == "box")
+    {
+        filter = FILTER_BOX;
+    }
+    else if (name == "bilinear")
+    {
+        filter = FILTER_BILINEAR;
+    }
+    else if (name == "bicubic")
+    {
+        filter = FILTER_BICUBIC;
+    }
+    else if (name == "lanczos3")
+    {
+        filter = FILTER_LANCZOS3;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function fills in a requested size of 0 so the output keeps the
+ * aspect ratio of the input.
+ *
+ * @param[in] rows - the number of rows of the input.
+ * @param[in] cols - the number of columns of the input.
+ * @param[in,out] newRows - the requested number of rows.
+ * @param[in,out] newCols - the requested number of columns.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   int newRows = 0;
+   int newCols = 100;
+
+   resolveSize(486, 735, newRows, newCols);
+
+   newRows is now 66.
+   @endverbatim
+
+ ***********************************************************************/
+
+void resolveSize(int rows, int cols, int& newRows, int& newCols)
+{
+    if (newCols == 0)
+    {
+        newCols = (int)((double)cols * newRows / rows + 0.5);
+    }
+    if (newRows == 0)
+    {
+        newRows = (int)((double)rows * newCols / cols + 0.5);
+    }
+    if (newCols < 1)
+    {
+        newCols = 1;
+    }
+    if (newRows < 1)
+    {
+        newRows = 1;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function precomputes which source samples contribute to each
+ * output sample along one axis, and how much. When shrinking, the filter
+ * is stretched by the scale so every source sample is covered.
+ *
+ * @param[out] table - the table to fill in.
+ * @param[in] inSize - the number of source samples.
+ * @param[in] outSize - the number of output samples.
+ * @param[in] filter - the filter to use.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   resampleTable table;
+
+   buildResampleTable(table, 735, 100, FILTER_LANCZOS3);
+
+   table now holds the weights for every one of the 100 output columns.
+   @endverbatim
+
+ ***********************************************************************/
+
+void buildResampleTable(resampleTable& table, int inSize, int outSize,
+    filterType filter)
+{
+    double (*kernel)(double) = filterLanczos3;
+    double support = 3.0;
+    double scale = (double)inSize / outSize;
+    double filterScale = scale < 1.0 ? 1.0 : scale;
+    double center;
+    double total;
+    float* w;
+    int first;
+    int last;
+    int i = 0;
+    int k = 0;
+
+    if (filter == FILTER_BOX)
+    {
+        kernel = filterBox;
+        support = 0.5;
+    }
+    else if (filter == FILTER_BILINEAR)
+    {
+        kernel = filterBilinear;
+        support = 1.0;
+    }
+    else if (filter == FILTER_BICUBIC)
+    {
+        kernel = filterBicubic;
+        support = 2.0;
+    }
+    support *= filterScale;
+
+    table.size = outSize;
+    table.maxCount = (int)ceil(support) * 2 + 1;
+    table.first.assign(outSize, 0);
+    table.count.assign(outSize, 0);
+    table.weights.assign((size_t)outSize * table.maxCount, 0.0f);
+
+    while (i < outSize)
+    {
+        // find the source samples under the stretched filter
+        center = (i + 0.5) * scale;
+        first = (int)(center - support + 0.5);
+        last = (int)(center + support + 0.5);
+        if (first < 0)
+        {
+            first = 0;
+        }
+        if (last > inSize)
+        {
+            last = inSize;
+        }
+        if (last - first > table.maxCount)
+        {
+            last = first + table.maxCount;
+        }
+
+        // weigh each one and normalize so the weights add up to 1
+        w = &table.weights[(size_t)i * table.maxCount];
+        total = 0.0;
+        k = 0;
+        while (k < last - first)
+        {
+            w[k] = (float)kernel((k + first - center + 0.5) / filterScale);
+            total += w[k];
+            k++;
+        }
+        if (total == 0.0)
+        {
+            // nothing landed under the filter, so use the nearest sample
+            w[0] = 1.0f;
+            last = first + 1;
+            total = 1.0;
+        }
+        k = 0;
+        while (k < last - first)
+        {
+            w[k] = (float)(w[k] / total);
+            k++;
+        }
+
+        table.first[i] = first;
+        table.count[i] = last - first;
+        i++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function is the horizontal pass. It resamples one row of one
+ * color into floating point output columns using the table. The dot
+ * product for each output column is done 4 source pixels at a time.
+ *
+ * @param[in] src - the source row.
+ * @param[out] dst - the resampled row, table.size wide.
+ * @param[in] table - the weights for the columns.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   float row[100];
+
+   resampleHorizontal(im.redGray[0], row, table);
+
+   row now holds the first row of red resampled to 100 columns.
+   @endverbatim
+
+ ***********************************************************************/
+
+static void resampleHorizontal(const pixel* src, float* dst,
+    const resampleTable& table)
+{
+    int j = 0;
+    int k;
+    int n;
+    float sum;
+    const pixel* s;
+    const float* w;
+
+    while (j < table.size)
+    {
+        s = src + table.first[j];
+        w = &table.weights[(size_t)j * table.maxCount];
+        n = table.count[j];
+        k = 0;
+        sum = 0.0f;
+#ifdef NETPBM_SSE2
+        __m128 acc = _mm_setzero_ps();
+        __m128i zero = _mm_setzero_si128();
+        int four;
+        while (k + 4 <= n)
+        {
+            // widen 4 pixels to floats and multiply by their weights
+            memcpy(&four, s + k, 4);
+            __m128i v = _mm_cvtsi32_si128(four);
+            v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_cvtepi32_ps(v),
+                _mm_loadu_ps(w + k)));
+            k += 4;
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, acc);
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+        while (k < n)
+        {
+            sum += w[k] * s[k];
+            k++;
+        }
+        dst[j] = sum;
+        j++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function is the vertical pass. It blends rows that were already
+ * resampled horizontally into one output row, rounding and clamping to
+ * 0 - 255. The output row is done 4 columns at a time.
+ *
+ * @param[in] rows - the horizontally resampled rows that contribute.
+ * @param[in] w - the weight of each of those rows.
+ * @param[in] n - the number of rows.
+ * @param[out] dst - the output row.
+ * @param[in] width - the number of columns in the output row.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   resampleVertical(rows, weights, 7, newRed[0], 100);
+
+   newRed[0] is now the first output row of red.
+   @endverbatim
+
+ ***********************************************************************/
+
+static void resampleVertical(float* const* rows, const float* w, int n,
+    pixel* dst, int width)
+{
+    int j = 0;
+    int k;
+    long val;
+    float sum;
+
+#ifdef NETPBM_SSE2
+    int four;
+    while (j + 4 <= width)
+    {
+        __m128 acc = _mm_setzero_ps();
+        k = 0;
+        while (k < n)
+        {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(rows[k] + j),
+                _mm_set1_ps(w[k])));
+            k++;
+        }
+
+        // round, then saturate down to 4 pixels
+        __m128i v = _mm_cvtps_epi32(acc);
+        v = _mm_packs_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        four = _mm_cvtsi128_si32(v);
+        memcpy(dst + j, &four, 4);
+        j += 4;
+    }
+#endif
+    while (j < width)
+    {
+        sum = 0.0f;
+        k = 0;
+        while (k < n)
+        {
+            sum += rows[k][j] * w[k];
+            k++;
+        }
+        val = lrintf(sum);
+        if (val < 0)
+        {
+            val = 0;
+        }
+        if (val > 255)
+        {
+            val = 255;
+        }
+        dst[j] = (pixel)val;
+        j++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function resizes an image that is already in memory. The output
+ * rows are split into bands, one per thread. Each band resamples the
+ * source rows it needs horizontally, then blends them vertically.
+ *
+ * @param[in] im - the image to be manipulated
+ * @param[in] newRows - the number of rows to resize to, 0 keeps aspect.
+ * @param[in] newCols - the number of cols to resize to, 0 keeps aspect.
+ * @param[in] filter - the filter to resample with.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   image im;
+
+   resize(im, 0, 100, FILTER_LANCZOS3);
+
+   "im" is now 100 columns wide with the same aspect ratio.
+   @endverbatim
+
+ ***********************************************************************/
+
+void resize(image& im, int newRows, int newCols, filterType filter)
+{
+    resampleTable horiz;
+    resampleTable vert;
+    pixel** redGrayNew;
+    pixel** greenNew;
+    pixel** blueNew;
+
+    resolveSize(im.rows, im.cols, newRows, newCols);
+    buildResampleTable(horiz, im.cols, newCols, filter);
+    buildResampleTable(vert, im.rows, newRows, filter);
+    allocateArray(redGrayNew, newRows, newCols);
+    allocateArray(greenNew, newRows, newCols);
+    allocateArray(blueNew, newRows, newCols);
+
+    pixel** src[3] = { im.redGray, im.green, im.blue };
+    pixel** dst[3] = { redGrayNew, greenNew, blueNew };
+
+    parallelRows(newRows, [&](int start, int end)
+    {
+        // the source rows this band of output rows reads from
+        int low = vert.first[start];
+        int high = vert.first[end - 1] + vert.count[end - 1];
+        vector<float> temp((size_t)(high - low) * newCols);
+        vector<float*> ptrs(vert.maxCount);
+        int c = 0;
+        int r;
+        int y;
+        int k;
+
+        while (c < 3)
+        {
+            r = low;
+            while (r < high)
+            {
+                resampleHorizontal(src[c][r],
+                    &temp[(size_t)(r - low) * newCols], horiz);
+                r++;
+            }
+            y = start;
+            while (y < end)
+            {
+                k = 0;
+                while (k < vert.count[y])
+                {
+                    ptrs[k] = &temp[(size_t)(vert.first[y] + k - low) *
+                        newCols];
+                    k++;
+                }
+                resampleVertical(ptrs.data(),
+                    &vert.weights[(size_t)y * vert.maxCount],
+                    vert.count[y], dst[c][y], newCols);
+                y++;
+            }
+            c++;
+        }
+    });
+
+    // free the old arrays and use the new ones
+    freeUpArray(im.redGray, im.rows);
+    freeUpArray(im.green, im.rows);
+    freeUpArray(im.blue, im.rows);
+    im.redGray = redGrayNew;
+    im.green = greenNew;
+    im.blue = blueNew;
+    im.rows = newRows;
+    im.cols = newCols;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads in a binary image and resizes it while it is
+ * being read, so the full size image is never in memory. Source rows
+ * are read in batches and resampled horizontally on all threads into a
+ * ring that only holds the rows the next output rows still need. Output
+ * rows are blended as soon as all of their source rows have arrived.
+ * Only the resized image is allocated in im.
+ *
+ * @param[in] in - the input stream, just past the magic number.
+ * @param[in] im - the image to fill with the resized data.
+ * @param[in] maxValue - the max value of the pixels
+ * @param[in] area - the part of the input to read.
+ * @param[in] newRows - the number of rows to resize to, 0 keeps aspect.
+ * @param[in] newCols - the number of cols to resize to, 0 keeps aspect.
+ * @param[in] filter - the filter to resample with.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   ifstream in;
+   image im;
+   int maxValue = 255;
+   cropRegion area = { 0, 0, INT_MAX, INT_MAX };
+
+   readBinaryResized(in, im, maxValue, area, 0, 1024, FILTER_BOX);
+
+   im now holds the input averaged down to 1024 columns.
+   @endverbatim
+
+ ***********************************************************************/
+
+void readBinaryResized(istream& in, image& im, int& maxValue,
+    cropRegion area, int newRows, int newCols, filterType filter)
+{
+    resampleTable horiz;
+    resampleTable vert;
+    pixel space;
+    streampos data;
+    int rows;
+    int cols;
+    int capacity;
+    int count;
+    int read = 0; // source rows read so far
+    int y = 0;    // next output row to blend
+    int done;
+
+    // read in the header and the single space after maxValue
+    readHeader(in, im, maxValue);
+    in.read((char*)&space, sizeof(pixel));
+    data = in.tellg();
+
+    // only the rows and columns under area are read
+    clipRegion(area, im.rows, im.cols);
+    rows = area.h;
+    cols = area.w;
+
+    resolveSize(rows, cols, newRows, newCols);
+    buildResampleTable(horiz, cols, newCols, filter);
+    buildResampleTable(vert, rows, newRows, filter);
+    allocateArray(im.redGray, newRows, newCols);
+    allocateArray(im.green, newRows, newCols);
+    allocateArray(im.blue, newRows, newCols);
+    pixel** dst[3] = { im.redGray, im.green, im.blue };
+
+    // the ring has to hold a batch plus the widest vertical window
+    capacity = vert.maxCount + STREAM_BATCH;
+    vector<float> ring((size_t)capacity * 3 * newCols);
+    vector<pixel> raw((size_t)STREAM_BATCH * cols * 3);
+
+    while (y < newRows)
+    {
+        // read in the next batch of source rows
+        count = rows - read;
+        if (count > STREAM_BATCH)
+        {
+            count = STREAM_BATCH;
+        }
+        readBinaryRows(in, data, im.cols, area, read, count, raw.data());
+
+        // split each row into its colors and resample it into the ring
+        parallelRows(count, [&](int start, int end)
+        {
+            vector<pixel> plane(cols);
+            const pixel* line;
+            int slot;
+            int r = start;
+            int c;
+            int j;
+
+            while (r < end)
+            {
+                line = &raw[(size_t)r * cols * 3];
+                slot = (read + r) % capacity;
+                c = 0;
+                while (c < 3)
+                {
+                    j = 0;
+                    while (j < cols)
+                    {
+                        plane[j] = line[j * 3 + c];
+                        j++;
+                    }
+                    resampleHorizontal(plane.data(),
+                        &ring[((size_t)slot * 3 + c) * newCols], horiz);
+                    c++;
+                }
+                r++;
+            }
+        });
+        read += count;
+
+        // blend every output row whose source rows are all in the ring
+        done = y;
+        while (done < newRows &&
+            vert.first[done] + vert.count[done] <= read)
+        {
+            done++;
+        }
+        parallelRows(done - y, [&](int start, int end)
+        {
+            vector<float*> ptrs(vert.maxCount);
+            int o = y + start;
+            int c;
+            int k;
+
+            while (o < y + end)
+            {
+                c = 0;
+                while (c < 3)
+                {
+                    k = 0;
+                    while (k < vert.count[o])
+                    {
+                        ptrs[k] = &ring[((size_t)((vert.first[o] + k) %
+                            capacity) * 3 + c) * newCols];
+                        k++;
+                    }
+                    resampleVertical(ptrs.data(),
+                        &vert.weights[(size_t)o * vert.maxCount],
+                        vert.count[o], dst[c][o], newCols);
+                    c++;
+                }
+                o++;
+            }
+        });
+        y = done;
+    }
+
+    // leave the stream at the end of the image, where any next one starts
+    in.seekg(data + (streamoff)im.rows * im.cols * 3);
+    im.rows = newRows;
+    im.cols = newCols;
+}
@@ -6,55 +6,167 @@
 
 #include "netPBM.h"
 
+#include <mutex>
+#include <map>
+#include <new>
+
+/*!
+ * @brief BLOCK_HEADER bytes in front of each plane that hold its size
+ */
+
+const size_t BLOCK_HEADER = 64;
+
+/*!
+ * @brief spareLock guards the freed planes kept for reuse
+ */
+
+static mutex spareLock;
+
+/*!
+ * @brief spareBlocks freed planes kept for reuse, by size in bytes
+ */
+
+static multimap<size_t, pixel*> spareBlocks;
+
+/*!
+ * @brief spareBytes the bytes held in spareBlocks
+ */
+
+static size_t spareBytes = 0;
+
+/*!
+ * @brief spareLimit the most bytes spareBlocks may hold, 0 keeps none
+ */
+
+static size_t spareLimit = 0;
+
+
+
  /** *********************************************************************
   * @author David Hill
   *
   * @par Description:
-  * This function allocates a 2d array of pixels.
+  * This function sets how many bytes of freed image planes are kept to
+  * be handed out again by allocateArray instead of going back to the
+  * system. It is 0 unless it is set, which keeps none. A program that
+  * runs many jobs, like the server, turns it on so images of the same
+  * size don't keep allocating and freeing the same memory.
   *
-  * @param[in] ptr - the array to be allocated
-  * @param[in] rows - the number of rows in the array
-  * @param[in] cols - the number of columns in the array
+  * @param[in] bytes - the most bytes of freed planes to keep.
   *
-  * @returns none
+  * @returns the limit it had before, so it can be put back
   *
   * @par Example:
     @verbatim
-    pixel** arr;
-    int rows = 20;
-    int cols = 10;
-
-    allocateArray(arr, rows, cols);
+    setBufferPool(256 * 1024 * 1024);
 
-    "arr" is now allocated for that number of rows and cols.
+    up to 256 MB of freed planes are now kept for reuse.
     @endverbatim
 
   ***********************************************************************/
 
+size_t setBufferPool(size_t bytes)
+{
+    lock_guard<mutex> lock(spareLock);
+    multimap<size_t, pixel*>::iterator it;
+    size_t before = spareLimit;
+
+    spareLimit = bytes;
+    // let go of planes past the new limit, biggest first
+    while (spareBytes > spareLimit)
+    {
+        it = prev(spareBlocks.end());
+        spareBytes -= it->first;
+        delete[] it->second;
+        spareBlocks.erase(it);
+    }
+    return before;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function allocates a 2d array of pixels. All of the rows are in
+ * one block, one after the other, so there is one allocation per array
+ * and rows can be read or written together. If a freed block of the
+ * same size is being kept, it is used again. A new block is placed on
+ * the NUMA nodes by placeArray before it is handed out. If there isn't
+ * enough memory it throws bad_alloc, so a server running the job can
+ * turn it down and keep going.
+ *
+ * @param[in] ptr - the array to be allocated
+ * @param[in] rows - the number of rows in the array
+ * @param[in] cols - the number of columns in the array
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   pixel** arr;
+   int rows = 20;
+   int cols = 10;
+
+   allocateArray(arr, rows, cols);
+
+   "arr" is now allocated for that number of rows and cols.
+   @endverbatim
+
+ ***********************************************************************/
+
 void allocateArray(pixel**& ptr, int rows, int cols)
 {
+    size_t size = (size_t)rows * cols;
+    pixel* block = nullptr;
+    multimap<size_t, pixel*>::iterator it;
+    bool placed = true;
     int i;
 
-    // create new ptr
-    ptr = new (nothrow) pixel * [rows];
+    // create new ptr, with a slot in front for the block the rows are in
+    ptr = new (nothrow) pixel * [(size_t)rows + 1];
 
-    // if it is null exit with error message
+    // if it is null, let the job fail without taking the program with it
     if (ptr == nullptr)
     {
-        cout << "Unable to allocate memory" << endl;
-        exit(1);
+        throw bad_alloc();
     }
-    // fill each 1d array
-    // if any of them are null, exit with error message and clean up
-    for (i = 0; i < rows; i++)
+
+    // reuse a kept block of the same size if there is one
+    {
+        lock_guard<mutex> lock(spareLock);
+        it = spareBlocks.find(size);
+        if (it != spareBlocks.end())
+        {
+            block = it->second;
+            spareBytes -= size;
+            spareBlocks.erase(it);
+        }
+    }
+    if (block == nullptr)
     {
-        ptr[i] = new pixel[cols];
-        if (ptr[i] == nullptr)
+        block = new (nothrow) pixel[BLOCK_HEADER + size];
+        if (block == nullptr)
         {
-            freeUpArray(ptr, i);
-            cout << "Unable to allocate memory" << endl;
-            exit(1);
+            delete[] ptr;
+            ptr = nullptr;
+            throw bad_alloc();
         }
+        memcpy(block, &size, sizeof(size));
+        placed = false;
+    }
+
+    // point each row into the block
+    ptr[0] = block;
+    ptr++;
+    for (i = 0; i < rows; i++)
+    {
+        ptr[i] = block + BLOCK_HEADER + (size_t)i * cols;
+    }
+    if (!placed)
+    {
+        placeArray(ptr, rows, cols);
     }
 }
 
@@ -64,10 +176,62 @@ void allocateArray(pixel**& ptr, int rows, int cols)
  * @author David Hill
  *
  * @par Description:
- * This function frees up a 2d array of pixels.
+ * This function makes a 2d array of pixels whose rows point into memory
+ * that belongs to someone else, so the pixels are used where they are
+ * without being copied. freeUpArray only frees the row pointers of an
+ * array made this way and leaves the pixels alone.
  *
- * @param[in] ptr - the array to be freed up
+ * @param[out] ptr - the array to be made
  * @param[in] rows - the number of rows in the array
+ * @param[in] data - the first pixel of the first row
+ * @param[in] stride - the number of pixels from one row to the next
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   vector<pixel> red(rows * cols);
+   pixel** arr;
+
+   wrapArray(arr, rows, red.data(), cols);
+
+   arr[i][j] is now red[i * cols + j].
+   @endverbatim
+
+ ***********************************************************************/
+
+void wrapArray(pixel**& ptr, int rows, pixel* data, size_t stride)
+{
+    int i;
+
+    ptr = new (nothrow) pixel * [(size_t)rows + 1];
+    if (ptr == nullptr)
+    {
+        throw bad_alloc();
+    }
+
+    // no block in front means the pixels aren't ours to free
+    ptr[0] = nullptr;
+    ptr++;
+    for (i = 0; i < rows; i++)
+    {
+        ptr[i] = data + (size_t)i * stride;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function frees up a 2d array of pixels made by allocateArray or
+ * wrapArray. The block of rows is kept for reuse if there is room for
+ * it. The pixels of a wrapped array are left alone.
+ *
+ * @param[in] ptr - the array to be freed up
+ * @param[in] rows - the number of rows in the array (the block knows its
+ *                   own size, so this is no longer needed)
  *
  * @returns none
  *
@@ -85,7 +249,8 @@ void allocateArray(pixel**& ptr, int rows, int cols)
 
 void freeUpArray(pixel**& ptr, int rows)
 {
-    int i;
+    pixel* block;
+    size_t size;
 
     // if the array is null, just return
     if (ptr == nullptr)
@@ -93,10 +258,27 @@ void freeUpArray(pixel**& ptr, int rows)
         return;
     }
 
-    // delete each 1d array
-    for (i = 0; i < rows; i++)
+    (void)rows;
+
+    // the block is in the slot in front of the rows
+    ptr--;
+    block = ptr[0];
+    if (block != nullptr)
     {
-        delete[] ptr[i];
+        memcpy(&size, block, sizeof(size));
+
+        // keep the block if it fits, otherwise give it back
+        {
+            lock_guard<mutex> lock(spareLock);
+            if (spareBytes + size <= spareLimit)
+            {
+                spareBlocks.insert(make_pair(size, block));
+                spareBytes += size;
+                block = nullptr;
+            }
+        }
+        delete[] block;
     }
     delete[] ptr;
-}
\ No newline at end of file
+    ptr = nullptr;
+}
@@ -0,0 +1,497 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that keep a job under a memory budget
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/*!
+ * @brief FRAMES_IN_FLIGHT the most frames --frames has at once, two
+ * waiting in each queue and one in each of the three stages
+ */
+
+const long long FRAMES_IN_FLIGHT = 7;
+
+/*!
+ * @brief PROGRAM_BYTES what the program takes as it starts, before any
+ * job has opened a file or allocated anything
+ */
+
+static const long long PROGRAM_BYTES = peakMemory();
+
+/*!
+ * @brief PLAN_NAMES the name of each memoryStrategy, in order
+ */
+
+static const char* const PLAN_NAMES[] =
+{
+    "in place",
+    "in memory",
+    "row streaming",
+    "tiled",
+    "too big"
+};
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function picks how a job runs so it stays under a budget of memory,
+  * from the size in the header before any pixels are read. It works out the
+  * most the arrays take at once when the whole image is read into memory,
+  * for the reader, the crop and the option the job has, and adds what the
+  * job holds besides the arrays: the program as it was when it started, the
+  * stdin buffer when the input is stdin, the blocks of an ascii input and
+  * each thread's band of ascii text for an ascii output. If that fits, the
+  * image is kept in memory, changed in place by the options that can be. If
+  * not, the options that only look at one row at a time stream a band of
+  * rows from the input to the output, --median= with the rows its window
+  * reaches around the band, and the flips and rotates go through a tiled
+  * scratch file. Anything else, and any job with --crop, --frames or a qoi
+  * file, only runs in memory. A --blend= or --compare always streams, a
+  * band of both images at a time, and so does --pyramid, a band of the
+  * image and the rows it makes in each level.
+  *
+  * @param[in] budget - the most bytes the job may use.
+  * @param[in] header - the image with just its rows and cols read in.
+  * @param[in] area - the part of the input to use.
+  * @param[in] inputMagic - P3, P6 or qoif.
+  * @param[in] outputMagic - the magic number to write out.
+  * @param[in] optionCode - the option, or empty for none.
+  * @param[in] frames - true if every image in the input is done.
+  * @param[in] fromStdin - true if the input is read from stdin.
+  *
+  * @returns the strategy, what the job takes in memory, and the bytes
+  *          of rows or tiles the strategy may hold at once
+  *
+  * @par Example:
+    @verbatim
+    cropRegion area = { 0, 0, INT_MAX, INT_MAX };
+    memoryPlan plan = planMemory(64LL << 20, header, area, "P6", "P6",
+        "--flipY", false, false);
+
+    for a 10000 x 10000 image, plan.strategy is PLAN_ROWS.
+    @endverbatim
+
+  ***********************************************************************/
+
+memoryPlan planMemory(long long budget, image& header, cropRegion area,
+    string inputMagic, string outputMagic, string optionCode, bool frames,
+    bool fromStdin)
+{
+    memoryPlan plan = { PLAN_TOO_BIG, 0, 0 };
+    long long full = (long long)header.rows * header.cols * 3;
+    long long part;       // bytes of the arrays under the crop
+    long long changed;    // bytes of the arrays the option makes
+    long long peak;       // most bytes of arrays at once
+    long long window;     // source rows a resized row is blended from
+    long long overhead = PROGRAM_BYTES; // bytes held besides the arrays
+    long long rowBytes = (long long)header.cols * 6; // a row and its input
+    long long lineBytes = (long long)header.cols * 16; // a row and its text
+    int newRows = 0;
+    int newCols = 0;
+    filterType filter;
+    double degrees;
+    bool bilinear;
+    pixel fill[3];
+    bool resizing = parseResize(optionCode, newCols, newRows, filter);
+    bool rotating = parseRotate(optionCode, degrees, bilinear, fill);
+    bool turning = optionCode == "--rotateCW" ||
+        optionCode == "--rotateCCW";
+    ditherType method;
+    int level;
+    blendMode mode;
+    int weight;
+    bool first;
+    colorChange color;
+    int radius = 0;
+    bool windowed = parseMedian(optionCode, radius);
+    long long histograms = radius > 2 ?
+        (long long)threadCount() * header.cols * 544 : 0; // --median= counts
+    bool pairing = parseBlend(optionCode, mode, weight) ||
+        parseCompare(optionCode, first);
+    bool oneRow = optionCode == "" || optionCode == "--flipY" ||
+        optionCode == "--grayscale" || optionCode == "--sepia" ||
+        parseDither(optionCode, method, level) ||
+        parseColor(optionCode, color);
+    bool plain;
+
+    clipRegion(area, header.rows, header.cols);
+    part = (long long)area.h * area.w * 3;
+
+    // the buffers the readers and writers hold besides the arrays: an
+    // ascii input is read a block at a time and parsed into values
+    // about half its size, and each thread formats a band of ascii
+    // output, at least one row of it
+    if (fromStdin)
+    {
+        overhead += (long long)STDIN_BUFFER;
+    }
+    if (inputMagic == "P1" || inputMagic == "P2" || inputMagic == "P3")
+    {
+        overhead += (long long)ASCII_BLOCK * 2;
+    }
+    if (outputMagic == "P1" || outputMagic == "P2" || outputMagic == "P3")
+    {
+        overhead += threadCount() * max((long long)ASCII_BAND,
+            (long long)header.cols * 12);
+    }
+
+    // a binary input reads just the rows under the crop, the others read
+    // all of it and then copy out the crop
+    peak = inputMagic == "P6" || part == full ? part : full + part;
+
+    // the options that make new arrays hold the old ones too for a while
+    if (resizing)
+    {
+        resolveSize(area.h, area.w, newRows, newCols);
+        changed = (long long)newRows * newCols * 3;
+        window = 6 * ((long long)area.h / newRows + 1);
+        if (inputMagic == "P6")
+        {
+            // resized while it is read, through a ring of float rows
+            peak = changed + (window + 64) * newCols * 12 +
+                (long long)area.w * 192;
+        }
+        else
+        {
+            peak = max(peak, part + changed +
+                (long long)area.h * newCols * 4);
+        }
+    }
+    else if (rotating)
+    {
+        peak = max(peak, part * 2);
+    }
+    else if (turning)
+    {
+        peak = max(peak, part + part / 3);
+    }
+    else if (windowed)
+    {
+        peak = max(peak, part * 2 + histograms);
+    }
+    plan.inMemory = (frames ? peak * FRAMES_IN_FLIGHT : peak) + overhead;
+    if (pairing || optionCode == "--pyramid")
+    {
+        // the two images would both be in memory, or the image and its
+        // levels, which come to a third of it
+        plan.inMemory = (pairing ? full * 2 : full + full / 3) + overhead;
+        if (budget - overhead >= rowBytes * 2)
+        {
+            plan.strategy = PLAN_ROWS;
+            plan.limit = budget - overhead;
+        }
+        return plan;
+    }
+    if (plan.inMemory <= budget)
+    {
+        plan.strategy = resizing || rotating || turning || windowed ?
+            PLAN_IN_MEMORY : PLAN_IN_PLACE;
+        return plan;
+    }
+
+    // the other strategies read the whole of one netpbm image and write
+    // the whole of one out
+    plain = !frames && !resizing && !rotating && part == full &&
+        inputMagic != "qoif" && outputMagic != "qoif";
+    if (plain && oneRow && budget - overhead >= rowBytes)
+    {
+        plan.strategy = PLAN_ROWS;
+        plan.limit = budget - overhead;
+        return plan;
+    }
+
+    // a median holds the window of rows around the band, and the band
+    // of medians
+    if (plain && windowed && (budget - overhead - histograms) / 2 >=
+        (3LL * radius + 1) * header.cols * 3)
+    {
+        plan.strategy = PLAN_ROWS;
+        plan.limit = budget - overhead - histograms;
+        return plan;
+    }
+    if (plain && (oneRow || turning || optionCode == "--flipX") &&
+        budget - overhead - lineBytes >= 8 * TILE_BYTES)
+    {
+        plan.strategy = PLAN_TILED;
+        plan.limit = budget - overhead - lineBytes;
+    }
+    return plan;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function gives the name of a strategy, to report which one a
+ * job is using.
+ *
+ * @param[in] strategy - the strategy.
+ *
+ * @returns its name, like "row streaming"
+ *
+ * @par Example:
+   @verbatim
+   cout << planName(PLAN_TILED) << endl;
+
+   outputs tiled.
+   @endverbatim
+
+ ***********************************************************************/
+
+const char* planName(memoryStrategy strategy)
+{
+    return PLAN_NAMES[strategy];
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds the most memory the program has had in use at
+ * once, its peak resident set size. A server runs many jobs in one
+ * program, so there it is the peak over all of them.
+ *
+ * @returns the peak in bytes, or 0 if it can't be found
+ *
+ * @par Example:
+   @verbatim
+   cout << peakMemory() / (1 << 20) << " MB" << endl;
+
+   outputs something like 95 MB.
+   @endverbatim
+
+ ***********************************************************************/
+
+long long peakMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+        sizeof(counters)))
+    {
+        return 0;
+    }
+    return (long long)counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (long long)usage.ru_maxrss;
+#else
+    return (long long)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function runs a job a band of rows at a time, for the options
+ * that only look at one row at a time, or like --dither carry what they
+ * need from one band to the next in change. The header is written out with
+ * the output magic number, and then each band is read in, changed and
+ * written out before the next is read, so only the band is ever in
+ * memory. The output is the same as reading in the whole image.
+ *
+ * Options like --median= that look at the rows around each row ask for
+ * a margin. The band change is given then has margin more rows of the
+ * input above and below it, im.redGray[-margin] to
+ * im.redGray[im.rows + margin - 1], with the top and bottom rows of the
+ * image repeated past its edges. They are read once, the ones below
+ * ahead of the band, and the ones above kept from the band before, so
+ * just the window of rows around the band is held.
+ *
+ * @param[in] in - the input stream, just past the magic number.
+ * @param[in] out - the output stream.
+ * @param[in] inputMagic - P3 or P6.
+ * @param[in] outputMagic - P1 to P6.
+ * @param[in] change - what to do to each band.
+ * @param[in] limit - the most bytes of rows to hold at once.
+ * @param[in] margin - the rows change needs above and below the band.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   streamRows(in, out, "P6", "P5", grayscale, 16 << 20, 0);
+
+   out now has the image in grayscale, read in 16 MB at a time.
+   @endverbatim
+
+ ***********************************************************************/
+
+void streamRows(istream& in, ostream& out, string inputMagic,
+    string outputMagic, const function<void(image&)>& change,
+    long long limit, int margin)
+{
+    image header;
+    int maxValue = 0;
+    bool binary = inputMagic == "P6";
+    bool gray = outputMagic == "P2" || outputMagic == "P5";
+    bool bitmap = outputMagic == "P1" || outputMagic == "P4";
+    long long bandRows;
+    int done = 0;
+    int ahead = 0; // rows below the band already read in
+    int count;
+    int i;
+    int c;
+    pixel space;
+
+    // read in comments, columns, rows and maxValue, and the single space
+    // after maxValue of a binary file
+    readHeader(in, header, maxValue);
+    if (binary)
+    {
+        in.read((char*)&space, sizeof(pixel));
+    }
+
+    // the window holds the band, the margins on each side of it, and the
+    // rows kept for the top margin of the next band
+    bandRows = limit / ((long long)header.cols * 3) - 3LL * margin;
+    if (bandRows > header.rows)
+    {
+        bandRows = header.rows;
+    }
+    if (bandRows < 1)
+    {
+        bandRows = 1;
+    }
+    netImage window((int)bandRows + 3 * margin, header.cols);
+    image& held = window.get();
+    pixel** planes[3] = { held.redGray, held.green, held.blue };
+    vector<pixel*> order;
+    image im = held;
+    image part = held;
+
+    // the band starts after the top margin
+    im.redGray += margin;
+    im.green += margin;
+    im.blue += margin;
+
+    // copies row from to row to of the band, in each plane
+    auto copyRow = [&](int to, int from)
+    {
+        memcpy(im.redGray[to], im.redGray[from], header.cols);
+        memcpy(im.green[to], im.green[from], header.cols);
+        memcpy(im.blue[to], im.blue[from], header.cols);
+    };
+
+    // output the same header the writers do, bitmaps have no maxValue
+    out << outputMagic << endl;
+    out << header.comment;
+    out << header.cols << " " << header.rows << endl;
+    if (!bitmap)
+    {
+        out << maxValue << endl;
+    }
+
+    while (done < header.rows && in)
+    {
+        im.rows = (int)min(bandRows, (long long)header.rows - done);
+
+        // read the band past the rows read ahead, and the bottom margin
+        count = min(done + im.rows + margin, header.rows) - done - ahead;
+        part.rows = count;
+        part.redGray = im.redGray + ahead;
+        part.green = im.green + ahead;
+        part.blue = im.blue + ahead;
+        {
+            traceSpan span("read rows", done + ahead, done + ahead + count);
+            readRows(in, part, inputMagic);
+        }
+        if (margin > 0)
+        {
+            // repeat the edge rows of the image out past them, and keep
+            // the last rows of the band for the next one before change
+            // can touch them
+            i = 0;
+            while (done == 0 && i < margin)
+            {
+                copyRow(i - margin, 0);
+                i++;
+            }
+            i = ahead + count;
+            while (i < im.rows + margin)
+            {
+                copyRow(i, ahead + count - 1);
+                i++;
+            }
+            i = 0;
+            while (i < margin)
+            {
+                copyRow((int)bandRows + margin + i, im.rows - margin + i);
+                i++;
+            }
+        }
+        {
+            traceSpan span("change rows", done, done + im.rows);
+            change(im);
+        }
+
+        // and write it out, just the red/gray array for grayscale
+        {
+            traceSpan span("write rows", done, done + im.rows);
+            if (bitmap)
+            {
+                writeBitmapRows(out, im.redGray, im.rows, im.cols,
+                    outputMagic == "P1");
+            }
+            else if (outputMagic == "P2" || outputMagic == "P3")
+            {
+                writeAsciiRows(out, im.redGray, gray ? nullptr : im.green,
+                    gray ? nullptr : im.blue, im.rows, im.cols);
+            }
+            else
+            {
+                writeBinaryRows(out, im.redGray, gray ? nullptr : im.green,
+                    gray ? nullptr : im.blue, im.rows, im.cols);
+            }
+        }
+        ahead = count + ahead - im.rows;
+        done += im.rows;
+
+        // the kept rows become the top margin and the rows read ahead
+        // follow them; the rest are free for the next band
+        c = 0;
+        while (margin > 0 && c < 3)
+        {
+            pixel** p = planes[c];
+
+            order.assign(p + bandRows + 2 * margin,
+                p + bandRows + 3 * margin);
+            order.insert(order.end(), p + margin + im.rows,
+                p + margin + im.rows + ahead);
+            order.insert(order.end(), p, p + margin + im.rows);
+            order.insert(order.end(), p + margin + im.rows + ahead,
+                p + bandRows + 2 * margin);
+            copy(order.begin(), order.end(), p);
+            c++;
+        }
+    }
+}
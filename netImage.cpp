@@ -0,0 +1,563 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   the netImage class, an image that owns its arrays
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+/*!
+ * @brief memoryBuffer lets an istream read straight from a block of
+ * memory without copying it
+ */
+
+class memoryBuffer : public streambuf
+{
+public:
+    /*!
+    * @brief points the buffer at length bytes starting at data
+    */
+
+    memoryBuffer(const char* data, size_t length)
+    {
+        char* start = const_cast<char*>(data);
+
+        setg(start, start, start + length);
+    }
+
+protected:
+    /*!
+    * @brief moves the read position, like seekg
+    */
+
+    pos_type seekoff(off_type off, ios_base::seekdir dir,
+        ios_base::openmode which) override
+    {
+        off_type base = 0;
+
+        if (!(which & ios_base::in))
+        {
+            return pos_type(off_type(-1));
+        }
+        if (dir == ios_base::cur)
+        {
+            base = gptr() - eback();
+        }
+        else if (dir == ios_base::end)
+        {
+            base = egptr() - eback();
+        }
+        if (base + off < 0 || base + off > egptr() - eback())
+        {
+            return pos_type(off_type(-1));
+        }
+        setg(eback(), eback() + base + off, egptr());
+        return pos_type(base + off);
+    }
+
+    /*!
+    * @brief moves the read position to pos, like seekg
+    */
+
+    pos_type seekpos(pos_type pos, ios_base::openmode which) override
+    {
+        return seekoff(off_type(pos), ios_base::beg, which);
+    }
+};
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This constructor makes an empty image with no arrays.
+  *
+  * @par Example:
+    @verbatim
+    netImage picture;
+
+    picture.empty() is now true.
+    @endverbatim
+
+  ***********************************************************************/
+
+netImage::netImage()
+{
+    im.rows = 0;
+    im.cols = 0;
+    im.redGray = nullptr;
+    im.green = nullptr;
+    im.blue = nullptr;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This constructor makes a black image of the given size.
+ *
+ * @param[in] rows - the number of rows in the image
+ * @param[in] cols - the number of columns in the image
+ *
+ * @par Example:
+   @verbatim
+   netImage picture(486, 735);
+
+   picture is now a black 735x486 image.
+   @endverbatim
+
+ ***********************************************************************/
+
+netImage::netImage(int rows, int cols) : netImage()
+{
+    size_t size = (size_t)rows * cols;
+
+    im.rows = rows;
+    im.cols = cols;
+    allocateArray(im.redGray, rows, cols);
+    allocateArray(im.green, rows, cols);
+    allocateArray(im.blue, rows, cols);
+
+    // the rows of each array are in one block
+    if (rows > 0)
+    {
+        memset(im.redGray[0], 0, size);
+        memset(im.green[0], 0, size);
+        memset(im.blue[0], 0, size);
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This constructor takes the arrays of another image, which is left
+ * empty.
+ *
+ * @param[in] other - the image to take the arrays of
+ *
+ * @par Example:
+   @verbatim
+   netImage picture(move(other));
+
+   picture now has the arrays "other" had.
+   @endverbatim
+
+ ***********************************************************************/
+
+netImage::netImage(netImage&& other) noexcept : netImage()
+{
+    *this = move(other);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This operator frees the arrays of this image and takes the arrays of
+ * another image, which is left empty.
+ *
+ * @param[in] other - the image to take the arrays of
+ *
+ * @returns this image
+ *
+ * @par Example:
+   @verbatim
+   picture = move(other);
+
+   picture now has the arrays "other" had.
+   @endverbatim
+
+ ***********************************************************************/
+
+netImage& netImage::operator=(netImage&& other) noexcept
+{
+    if (this != &other)
+    {
+        clear();
+        im.magicNumber = move(other.im.magicNumber);
+        im.comment = move(other.im.comment);
+        im.rows = other.im.rows;
+        im.cols = other.im.cols;
+        im.redGray = other.im.redGray;
+        im.green = other.im.green;
+        im.blue = other.im.blue;
+        other.im.rows = 0;
+        other.im.cols = 0;
+        other.im.redGray = nullptr;
+        other.im.green = nullptr;
+        other.im.blue = nullptr;
+    }
+    return *this;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This destructor frees the arrays of the image.
+ *
+ * @par Example:
+   @verbatim
+   {
+       netImage picture(486, 735);
+   }
+
+   the arrays of picture are freed at the end of the block.
+   @endverbatim
+
+ ***********************************************************************/
+
+netImage::~netImage()
+{
+    clear();
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function makes an image whose arrays use the caller's pixels
+ * where they are, without copying them. Each color is its own block
+ * of pixels, with stride pixels from the start of one row to the
+ * next. The pixels have to last as long as the image does. Changes
+ * made in place, like flipX or sepia, are made to the caller's pixels.
+ * Changes that make new arrays, like resize or rotateCW, leave the
+ * caller's pixels alone and give the image arrays of its own.
+ *
+ * @param[in] rows - the number of rows in the image
+ * @param[in] cols - the number of columns in the image
+ * @param[in] red - the first red pixel
+ * @param[in] green - the first green pixel
+ * @param[in] blue - the first blue pixel
+ * @param[in] stride - the number of pixels from one row to the next
+ *
+ * @returns the image
+ *
+ * @par Example:
+   @verbatim
+   vector<pixel> r(rows * cols), g(rows * cols), b(rows * cols);
+   netImage picture = netImage::wrap(rows, cols, r.data(), g.data(),
+       b.data(), cols);
+
+   sepia(picture.get());
+
+   r, g and b are now sepia.
+   @endverbatim
+
+ ***********************************************************************/
+
+netImage netImage::wrap(int rows, int cols, pixel* red, pixel* green,
+    pixel* blue, size_t stride)
+{
+    netImage picture;
+
+    picture.im.magicNumber = "P6";
+    picture.im.rows = rows;
+    picture.im.cols = cols;
+    wrapArray(picture.im.redGray, rows, red, stride);
+    wrapArray(picture.im.green, rows, green, stride);
+    wrapArray(picture.im.blue, rows, blue, stride);
+    return picture;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads a P3, P6 or QOI image from memory, replacing what
+ * the image had. The header is checked before anything is allocated,
+ * so data that is not an image or is cut short is turned down.
+ *
+ * @param[in] data - the bytes of the image file
+ * @param[in] length - the number of bytes
+ *
+ * @returns true if the image was read, false if the data is not a
+ *          whole P3, P6 or QOI image
+ *
+ * @par Example:
+   @verbatim
+   string file;  // the bytes of a ppm file
+   netImage picture;
+
+   if (!picture.decode(file.data(), file.size()))
+       cout << "not a ppm or qoi" << endl;
+   @endverbatim
+
+ ***********************************************************************/
+
+bool netImage::decode(const char* data, size_t length)
+{
+    memoryBuffer buffer(data, length);
+    istream in(&buffer);
+    image header;
+    string magic;
+    streampos start;
+    int maxValue = 0;
+    int channels = 3;
+
+    clear();
+    readMagic(in, magic);
+    if (magic != "P3" && magic != "P6" && magic != "qoif")
+    {
+        return false;
+    }
+
+    // a qoi chunk covers at most 62 pixels, which bounds the size
+    if (magic == "qoif")
+    {
+        im.magicNumber = magic;
+        start = in.tellg();
+        if (!readQoiHeader(in, header, channels) ||
+            (long long)(length - (size_t)in.tellg()) * 62 <
+            (long long)header.rows * header.cols)
+        {
+            clear();
+            return false;
+        }
+        in.seekg(start);
+        readQoi(in, im, maxValue);
+        if (in.fail())
+        {
+            clear();
+            return false;
+        }
+        return true;
+    }
+
+    // check the size before allocating anything
+    start = in.tellg();
+    if (!checkHeader(in, magic, header, maxValue))
+    {
+        return false;
+    }
+    if (magic == "P6" && (long long)(length - (size_t)in.tellg()) <
+        (long long)header.rows * header.cols * 3 + 1)
+    {
+        return false;
+    }
+    in.seekg(start);
+
+    im.magicNumber = magic;
+    if (magic == "P3")
+    {
+        readAscii(in, im, maxValue);
+    }
+    else
+    {
+        readBinary(in, im, maxValue);
+    }
+    if (in.fail())
+    {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes the image to memory as a P2, P3, P5, P6 or QOI
+ * file, with qoif as the magic number for QOI. P2 and P5 are written
+ * from the red/gray array.
+ *
+ * @param[out] data - the bytes of the image file
+ * @param[in] magicNumber - the type of file to write
+ *
+ * @returns true if it was written, false if the image is empty or the
+ *          type is not one of the five
+ *
+ * @par Example:
+   @verbatim
+   string file;
+
+   picture.encode(file, "P6");
+
+   file now holds a binary ppm of picture.
+   @endverbatim
+
+ ***********************************************************************/
+
+bool netImage::encode(string& data, string magicNumber)
+{
+    ostringstream out;
+    string magic = im.magicNumber;
+    int maxValue = 255;
+
+    if (empty() || (magicNumber != "P2" && magicNumber != "P3" &&
+        magicNumber != "P5" && magicNumber != "P6" &&
+        magicNumber != "qoif"))
+    {
+        return false;
+    }
+
+    im.magicNumber = magicNumber;
+    if (magicNumber == "P2")
+    {
+        writeGrayscaleAscii(out, im, maxValue);
+    }
+    else if (magicNumber == "P3")
+    {
+        writeAscii(out, im, maxValue);
+    }
+    else if (magicNumber == "P5")
+    {
+        writeGrayscaleBinary(out, im, maxValue);
+    }
+    else if (magicNumber == "qoif")
+    {
+        writeQoi(out, im, maxValue);
+    }
+    else
+    {
+        writeBinary(out, im, maxValue);
+    }
+    im.magicNumber = magic;
+    data = out.str();
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function frees the arrays of the image and leaves it empty.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   picture.clear();
+
+   picture.empty() is now true.
+   @endverbatim
+
+ ***********************************************************************/
+
+void netImage::clear()
+{
+    freeUpArray(im.redGray, im.rows);
+    freeUpArray(im.green, im.rows);
+    freeUpArray(im.blue, im.rows);
+    im.rows = 0;
+    im.cols = 0;
+    im.magicNumber.clear();
+    im.comment.clear();
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function tells if the image has no arrays.
+ *
+ * @returns true if the image is empty
+ *
+ * @par Example:
+   @verbatim
+   netImage picture;
+
+   picture.empty() is true.
+   @endverbatim
+
+ ***********************************************************************/
+
+bool netImage::empty() const
+{
+    return im.redGray == nullptr;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function returns the number of rows in the image.
+ *
+ * @returns the number of rows
+ *
+ * @par Example:
+   @verbatim
+   netImage picture(486, 735);
+
+   picture.rows() is 486.
+   @endverbatim
+
+ ***********************************************************************/
+
+int netImage::rows() const
+{
+    return im.rows;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function returns the number of columns in the image.
+ *
+ * @returns the number of columns
+ *
+ * @par Example:
+   @verbatim
+   netImage picture(486, 735);
+
+   picture.cols() is 735.
+   @endverbatim
+
+ ***********************************************************************/
+
+int netImage::cols() const
+{
+    return im.cols;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function gives the image struct inside, so it can be passed to
+ * any of the functions that work on an image. Functions that replace
+ * the arrays, like resize, free the old ones, so the image still owns
+ * whatever arrays it ends up with.
+ *
+ * @returns the image struct
+ *
+ * @par Example:
+   @verbatim
+   netImage picture;
+
+   rotateCW(picture.get());
+   @endverbatim
+
+ ***********************************************************************/
+
+image& netImage::get()
+{
+    return im;
+}
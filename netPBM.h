@@ -9,6 +9,21 @@
 #include <iomanip>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <list>
+#include <thread>
+#include <functional>
+#include <sstream>
+#include <cmath>
+#include <cstring>
+#include <climits>
+
+// SSE2 is part of every x64 target and of x86 targets built with it
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NETPBM_SSE2
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -32,6 +47,163 @@ using namespace std;
 typedef unsigned char pixel;
 
 
+/*!
+ * @brief filterType the resampling kernels available to resize
+ */
+
+enum filterType
+{
+    FILTER_BOX,
+    FILTER_BILINEAR,
+    FILTER_BICUBIC,
+    FILTER_LANCZOS3
+};
+
+
+/*!
+ * @brief ditherType the ways --threshold and --dither pick black or white
+ */
+
+enum ditherType
+{
+    DITHER_THRESHOLD,
+    DITHER_FLOYD,
+    DITHER_BAYER
+};
+
+
+/*!
+ * @brief blendMode the ways --blend puts two images together
+ */
+
+enum blendMode
+{
+    BLEND_ALPHA,
+    BLEND_ADD,
+    BLEND_SUBTRACT,
+    BLEND_MULTIPLY,
+    BLEND_SCREEN,
+    BLEND_DIFFERENCE
+};
+
+
+/*!
+ * @brief colorMode what a color space option does to the pixels
+ */
+
+enum colorMode
+{
+    COLOR_TO_YCBCR,
+    COLOR_FROM_YCBCR,
+    COLOR_TO_HSV,
+    COLOR_FROM_HSV,
+    COLOR_TO_HSL,
+    COLOR_FROM_HSL,
+    COLOR_ADJUST
+};
+
+
+/*!
+ * @brief HUE_SECTOR the steps of hue in each sixth of a turn, red to
+ * yellow and so on
+ */
+
+const int HUE_SECTOR = 4096;
+
+/*!
+ * @brief HUE_TURN the steps of hue in a whole turn
+ */
+
+const int HUE_TURN = HUE_SECTOR * 6;
+
+/*!
+ * @brief FULL_SATURATION the saturation of a pure color
+ */
+
+const int FULL_SATURATION = 4095;
+
+/*!
+ * @brief MAX_MEDIAN_RADIUS the biggest radius --median= takes, so the
+ * counts of a window fit in 16 bits
+ */
+
+const int MAX_MEDIAN_RADIUS = 127;
+
+/*!
+ * @brief STDIN_BUFFER bytes of stdin read ahead and kept at once
+ */
+
+const size_t STDIN_BUFFER = (size_t)16 << 20;
+
+/*!
+ * @brief ASCII_BLOCK bytes of ascii values read in and parsed at a time,
+ * less than stdin keeps so the reader can always back up to the end of
+ * the last value
+ */
+
+const size_t ASCII_BLOCK = (size_t)4 << 20;
+
+/*!
+ * @brief ASCII_BAND bytes of ascii text, at most, made by each thread
+ * before the text is written out
+ */
+
+const size_t ASCII_BAND = (size_t)1 << 20;
+
+
+/*!
+ * @brief colorChange the settings of a color space option, in the fixed
+ * point the kernels use
+ */
+
+struct colorChange
+{
+    /*!
+    * @brief mode what it does
+    */
+
+    colorMode mode;
+
+    /*!
+    * @brief matrix for YCbCr, the weights of red, green and blue and the
+    * offset of each output, in 8192ths
+    */
+
+    int matrix[12];
+
+    /*!
+    * @brief hue added to the hue, in 24576ths of a turn
+    */
+
+    int hue;
+
+    /*!
+    * @brief saturation the saturation is scaled by, in 256ths
+    */
+
+    int saturation;
+
+    /*!
+    * @brief value the value is scaled by, in 256ths
+    */
+
+    int value;
+};
+
+
+/*!
+ * @brief synthPattern what writeSynthetic fills a synthetic image with
+ */
+
+enum synthPattern
+{
+    SYNTH_GRADIENT,
+    SYNTH_CHECKER,
+    SYNTH_BARS,
+    SYNTH_NOISE
+};
+
+
 /*!
  * @brief image the image read in from the file
  */
@@ -83,42 +255,857 @@ struct image
     pixel **blue;
 };
 
-// place your function prototypes here
+/*!
+ * @brief isaLevel the instruction sets kernels are compiled for
+ */
 
-/************************************************************************
- *                         Function Prototypes
- ***********************************************************************/
+enum isaLevel { ISA_SCALAR, ISA_SSE2, ISA_SSE42, ISA_AVX2, ISA_AVX512 };
 
-bool openInput(ifstream& in, string file);
+/*!
+ * @brief kernelTable the row kernels built for one instruction set
+ */
 
-bool openOutput(ofstream& out, string file);
+struct kernelTable
+{
+    /*!
+    * @brief the name of the instruction set, like "avx2"
+    */
+    const char* name;
 
-void allocateArray(pixel**& ptr, int rows, int cols);
+    /*!
+    * @brief grayscale red/gray from red, green and blue
+    */
+    void (*grayRow)(pixel* red, const pixel* green, const pixel* blue,
+        int count);
 
-void freeUpArray(pixel**& ptr, int rows);
+    /*!
+    * @brief sepia tone red, green and blue in place
+    */
+    void (*sepiaRow)(pixel* red, pixel* green, pixel* blue, int count);
 
-void readAscii(ifstream& in, image& im, int& maxValue);
+    /*!
+    * @brief reverse the order of the pixels of a row
+    */
+    void (*reverseRow)(pixel* row, int count);
 
-void writeAscii(ofstream& out, image& im, int& maxValue);
+    /*!
+    * @brief swap the pixels of two rows
+    */
+    void (*swapRows)(pixel* a, pixel* b, int count);
 
-void readBinary(ifstream& in, image& im, int& maxValue);
+    /*!
+    * @brief transpose a 16x16 block, dst[k][m] = src[m][k]
+    */
+    void (*transpose16)(const pixel* const* src, pixel* const* dst);
 
-void writeBinary(ofstream& out, image& im, int& maxValue);
+    /*!
+    * @brief split interleaved rgb into three arrays
+    */
+    void (*splitRow)(const pixel* rgb, pixel* red, pixel* green,
+        pixel* blue, int count);
 
-void flipX(image& im);
+    /*!
+    * @brief join three arrays into interleaved rgb
+    */
+    void (*joinRow)(const pixel* red, const pixel* green,
+        const pixel* blue, pixel* rgb, int count);
 
-void flipY(image& im);
+    /*!
+    * @brief write each value as ascii followed by a newline
+    */
+    size_t (*formatValues)(const pixel* values, int count, char* text);
 
-void rotateCW(image& im);
+    /*!
+    * @brief pack gray values into bits, first pixel high, dark ones 1
+    */
+    void (*packRow)(const pixel* gray, int count, pixel* bits);
 
-void rotateCCW(image& im);
+    /*!
+    * @brief blend b into a, saturating sums and rounding products
+    */
+    void (*blendRow)(pixel* a, const pixel* b, int count, blendMode mode,
+        int weight);
 
-void grayscale(image& im);
+    /*!
+    * @brief keep the biggest difference at each pixel, and sum the
+    * squares of the differences
+    */
+    long long (*diffRow)(const pixel* a, const pixel* b, pixel* far,
+        int count);
+
+    /*!
+    * @brief add a row into the ssim sums of each block of 4 columns
+    */
+    void (*ssimRow)(const pixel* a, const pixel* b, int blocks, int* sums);
 
-void writeGrayscaleAscii(ofstream& out, image& im, int& maxValue);
+    /*!
+    * @brief average each 2x2 block of two rows into a row half as wide
+    */
+    void (*halveRow)(const pixel* top, const pixel* bottom, pixel* half,
+        int count);
+
+    /*!
+    * @brief multiply red, green and blue by a fixed point matrix in place
+    */
+    void (*matrixRow)(pixel* red, pixel* green, pixel* blue, int count,
+        const int* matrix);
 
-void writeGrayscaleBinary(ofstream& out, image& im, int& maxValue);
+    /*!
+    * @brief convert between rgb and hsv or hsl, or change the hue,
+    * saturation and value, in place
+    */
+    void (*hsvRow)(pixel* red, pixel* green, pixel* blue, int count,
+        const colorChange& change);
 
-void sepia(image& im);
+    /*!
+    * @brief the median of the size x size window, size 3 or 5, around
+    * each pixel of the middle one of size rows
+    */
+    void (*medianRow)(const pixel* const* rows, int size, pixel* out,
+        int count);
+};
+
+/*!
+ * @brief resampleTable precomputed weights for one axis of a resize
+ */
+
+struct resampleTable
+{
+    /*!
+    * @brief size the number of output samples along this axis
+    */
+
+    int size;
+
+    /*!
+    * @brief maxCount the most source samples any output sample uses
+    */
+
+    int maxCount;
+
+    /*!
+    * @brief first the first source sample used by each output sample
+    */
+
+    vector<int> first;
+
+    /*!
+    * @brief count the number of source samples used by each output sample
+    */
+
+    vector<int> count;
+
+    /*!
+    * @brief weights maxCount normalized weights for each output sample
+    */
+
+    vector<float> weights;
+};
+
+/*!
+ * @brief cropRegion a rectangle of an image to crop to
+ */
+
+struct cropRegion
+{
+    /*!
+    * @brief x the column of the top left corner
+    */
+
+    int x;
+
+    /*!
+    * @brief y the row of the top left corner
+    */
+
+    int y;
+
+    /*!
+    * @brief w the number of columns
+    */
+
+    int w;
+
+    /*!
+    * @brief h the number of rows
+    */
+
+    int h;
+};
+
+/*!
+ * @brief histogram the number of pixels with each value in each color
+ */
+
+struct histogram
+{
+    /*!
+    * @brief count the counts for red/gray, green and blue
+    */
+
+    long long count[3][256];
+};
+
+/*!
+ * @brief compareStats how far apart two images are, from compareRows
+ */
+
+struct compareStats
+{
+    /*!
+    * @brief rows the number of rows compared
+    */
+
+    int rows;
+
+    /*!
+    * @brief cols the number of columns compared
+    */
+
+    int cols;
+
+    /*!
+    * @brief differing the number of pixels with any color different
+    */
+
+    long long differing;
+
+    /*!
+    * @brief maxError the biggest difference of any color
+    */
+
+    int maxError;
+
+    /*!
+    * @brief squared the sums of the squared differences of red/gray,
+    * green and blue
+    */
+
+    long long squared[3];
+
+    /*!
+    * @brief ssim the sums of the ssim of every window of each color
+    */
+
+    double ssim[3];
+
+    /*!
+    * @brief windows the number of windows in each color
+    */
+
+    long long windows;
+
+    /*!
+    * @brief firstX the column of the first pixel that is different, or
+    * -1 if there isn't one
+    */
+
+    int firstX;
+
+    /*!
+    * @brief firstY the row of the first pixel that is different, or -1
+    */
+
+    int firstY;
+};
+
+
+/*!
+ * @brief TILE_SIZE the width and height of a tile of a tiledImage
+ */
+
+const int TILE_SIZE = 256;
+
+/*!
+ * @brief TILE_PLANE the number of pixels in one color of a tile
+ */
+
+const int TILE_PLANE = TILE_SIZE * TILE_SIZE;
+
+/*!
+ * @brief TILE_BYTES the size of a tile, a multiple of 64K so every tile
+ * can be mapped on its own
+ */
+
+const int TILE_BYTES = TILE_PLANE * 3;
+
+
+/*!
+ * @brief tiledImage an image kept in tiles in a memory mapped scratch
+ * file instead of in memory
+ */
+
+struct tiledImage
+{
+    /*!
+    * @brief rows the number of rows of the image
+    */
+
+    long long rows;
+
+    /*!
+    * @brief cols the number of columns of the image
+    */
+
+    long long cols;
+
+    /*!
+    * @brief tilesAcross the number of tiles in each row of tiles
+    */
+
+    long long tilesAcross;
+
+    /*!
+    * @brief tilesDown the number of rows of tiles
+    */
+
+    long long tilesDown;
+
+    /*!
+    * @brief path the name of the scratch file
+    */
+
+    string path;
+
+#ifdef _WIN32
+    /*!
+    * @brief file the handle of the scratch file
+    */
+
+    void* file;
+
+    /*!
+    * @brief mapping the handle of the file mapping
+    */
+
+    void* mapping;
+#else
+    /*!
+    * @brief fd the descriptor of the scratch file
+    */
+
+    int fd;
+#endif
+
+    /*!
+    * @brief views the mapped pixels of each tile, or nullptr
+    */
+
+    vector<pixel*> views;
+
+    /*!
+    * @brief recent the mapped tiles, most recently used first
+    */
+
+    list<size_t> recent;
+
+    /*!
+    * @brief where the place of each mapped tile in recent
+    */
+
+    vector<list<size_t>::iterator> where;
+
+    /*!
+    * @brief mapped the number of tiles mapped right now
+    */
+
+    long long mapped;
+
+    /*!
+    * @brief maxMapped the most tiles that may be mapped at once
+    */
+
+    long long maxMapped;
+};
+
+/*!
+ * @brief netImage an image that owns its arrays and frees them when it
+ * goes away. It can be moved but not copied. It can also wrap pixels
+ * that belong to the caller, read an image from memory and write one
+ * to memory, so a program can use the library without any files.
+ */
+
+class netImage
+{
+public:
+    netImage();
+
+    netImage(int rows, int cols);
+
+    netImage(netImage&& other) noexcept;
+
+    netImage& operator=(netImage&& other) noexcept;
+
+    netImage(const netImage&) = delete;
+
+    netImage& operator=(const netImage&) = delete;
+
+    ~netImage();
+
+    static netImage wrap(int rows, int cols, pixel* red, pixel* green,
+        pixel* blue, size_t stride);
+
+    bool decode(const char* data, size_t length);
+
+    bool encode(string& data, string magicNumber);
+
+    void clear();
+
+    bool empty() const;
+
+    int rows() const;
+
+    int cols() const;
+
+    image& get();
+
+private:
+    /*!
+    * @brief im the image and its arrays
+    */
+
+    image im;
+};
+
+
+/*!
+ * @brief traceSpan a span of time on one thread for the --trace timeline.
+ * It starts when it is made and ends when it goes out of scope, and is
+ * only timed while a job is tracing.
+ */
+
+class traceSpan
+{
+public:
+    traceSpan(const char* name, int first = -1, int last = -1);
+
+    traceSpan(const traceSpan&) = delete;
+
+    traceSpan& operator=(const traceSpan&) = delete;
+
+    ~traceSpan();
+
+private:
+    /*!
+    * @brief name what the thread is doing
+    */
+
+    const char* name;
+
+    /*!
+    * @brief first the first row it works on, or -1
+    */
+
+    int first;
+
+    /*!
+    * @brief last one past the last row it works on
+    */
+
+    int last;
+
+    /*!
+    * @brief begin when it started in nanoseconds, or -1 if not tracing
+    */
+
+    long long begin;
+};
+
+
+/*!
+ * @brief imageFrame one image of a stream of them, with what it was
+ * read from, as it is passed from one stage of pipelineFrames to the next
+ */
+
+struct imageFrame
+{
+    /*!
+    * @brief picture the image and its arrays
+    */
+
+    netImage picture;
+
+    /*!
+    * @brief inputMagic the magic number the frame was read with
+    */
+
+    string inputMagic;
+
+    /*!
+    * @brief maxValue the max value in the header of the frame
+    */
+
+    int maxValue = 0;
+};
+
+/*!
+ * @brief pyramidLevel one level of a --pyramid as it is made, a band of
+ * rows at a time, from the level above it
+ */
+
+struct pyramidLevel
+{
+    /*!
+    * @brief rows the number of rows in the level
+    */
+
+    int rows = 0;
+
+    /*!
+    * @brief cols the number of columns in the level
+    */
+
+    int cols = 0;
+
+    /*!
+    * @brief aboveRows the number of rows in the level above
+    */
+
+    int aboveRows = 0;
+
+    /*!
+    * @brief aboveCols the number of columns in the level above
+    */
+
+    int aboveCols = 0;
+
+    /*!
+    * @brief received the rows of the level above that have come so far
+    */
+
+    int received = 0;
+
+    /*!
+    * @brief pending a row of the level above waiting for the one under it
+    */
+
+    netImage pending;
+
+    /*!
+    * @brief waiting true if pending holds a row
+    */
+
+    bool waiting = false;
+
+    /*!
+    * @brief file where the level is written
+    */
+
+    ofstream file;
+};
+
+/*!
+ * @brief numaPlacement where the pages of big arrays are put on a
+ * machine with more than one NUMA node
+ */
+
+enum numaPlacement
+{
+    NUMA_LOCAL,      // each band on the node of the threads that use it
+    NUMA_INTERLEAVE, // spread page by page over all the nodes
+    NUMA_OFF         // wherever they land, and the threads aren't pinned
+};
+
+/*!
+ * @brief memoryStrategy how a job is run to stay under --max-memory
+ */
+
+enum memoryStrategy
+{
+    PLAN_IN_PLACE,  // the whole image in memory, changed where it is
+    PLAN_IN_MEMORY, // the whole image in memory, changed into new arrays
+    PLAN_ROWS,      // a band of rows at a time from input to output
+    PLAN_TILED,     // out of core in a tiled scratch file
+    PLAN_TOO_BIG    // none of them fit
+};
+
+/*!
+ * @brief memoryPlan the strategy planMemory picked for a job
+ */
+
+struct memoryPlan
+{
+    /*!
+    * @brief strategy how the job is run
+    */
+
+    memoryStrategy strategy;
+
+    /*!
+    * @brief inMemory the bytes the job takes with the whole image in
+    * memory
+    */
+
+    long long inMemory;
+
+    /*!
+    * @brief limit the bytes of rows held at once with PLAN_ROWS, or of
+    * tiles mapped at once with PLAN_TILED
+    */
+
+    long long limit;
+};
+
+// place your function prototypes here
+
+/************************************************************************
+ *                         Function Prototypes
+ ***********************************************************************/
+
+bool openInput(ifstream& in, string file);
+
+bool openOutput(ofstream& out, string file);
+
+bool openInputStream(istream& in, ifstream& file, string name);
+
+bool openOutputStream(ostream& out, ofstream& file, string name);
+
+void allocateArray(pixel**& ptr, int rows, int cols);
+
+void freeUpArray(pixel**& ptr, int rows);
+
+void wrapArray(pixel**& ptr, int rows, pixel* data, size_t stride);
+
+size_t setBufferPool(size_t bytes);
+
+void readHeader(istream& in, image& im, int& maxValue);
+
+bool checkHeader(istream& in, string magicNumber, image& header,
+    int& maxValue);
+
+bool readAsciiValues(istream& in, size_t count,
+    const function<void(size_t, const pixel*, size_t)>& place);
+
+void readAscii(istream& in, image& im, int& maxValue);
+
+void readAsciiRows(istream& in, image& im);
+
+void readRows(istream& in, image& im, string magicNumber);
+
+void writeAsciiRows(ostream& out, pixel** red, pixel** green,
+    pixel** blue, int rows, int cols);
+
+void writeAscii(ostream& out, image& im, int& maxValue);
+
+void readBinary(istream& in, image& im, int& maxValue);
+
+void writeBinaryRows(ostream& out, pixel** red, pixel** green,
+    pixel** blue, int rows, int cols);
+
+void writeBinary(ostream& out, image& im, int& maxValue);
+
+bool parseCrop(string spec, cropRegion& area);
+
+bool clipRegion(cropRegion& area, int rows, int cols);
+
+void readBinaryRows(istream& in, streampos data, int cols,
+    cropRegion area, int row, int count, pixel* buffer);
+
+void readBinaryRegion(istream& in, image& im, int& maxValue,
+    cropRegion area);
+
+void readAsciiRegion(istream& in, image& im, int& maxValue,
+    cropRegion area);
+
+string outputMagic(string optionCode, string outputType);
+
+void readMagic(istream& in, string& magicNumber);
+
+bool readQoiHeader(istream& in, image& im, int& channels);
+
+void readQoi(istream& in, image& im, int& maxValue);
+
+void readQoiRegion(istream& in, image& im, int& maxValue,
+    cropRegion area);
+
+void writeQoi(ostream& out, image& im, int& maxValue);
+
+void writeGrayscaleQoi(ostream& out, image& im, int& maxValue);
+
+void flipX(image& im);
+
+void flipY(image& im);
+
+void rotateCW(image& im);
+
+void rotateCCW(image& im);
+
+void grayscale(image& im);
+
+void writeGrayscaleAscii(ostream& out, image& im, int& maxValue);
+
+void writeGrayscaleBinary(ostream& out, image& im, int& maxValue);
+
+void writeBitmapRows(ostream& out, pixel** gray, int rows, int cols,
+    bool ascii);
+
+void writeBitmapAscii(ostream& out, image& im, int& maxValue);
+
+void writeBitmapBinary(ostream& out, image& im, int& maxValue);
+
+void sepia(image& im);
+
+bool parseRotate(string option, double& degrees, bool& bilinear,
+    pixel fill[3]);
+
+void rotateAngle(image& im, double degrees, bool bilinear, pixel fill[3]);
+
+void crop(image& im, cropRegion area);
+
+bool parseDither(string option, ditherType& method, int& level);
+
+void ditherRows(image& im, ditherType method, int level,
+    vector<int>& errors, int firstRow);
+
+void dither(image& im, ditherType method, int level);
+
+bool parseBlend(string option, blendMode& mode, int& weight);
+
+void blendRows(image& a, image& b, blendMode mode, int weight);
+
+bool parseColor(string option, colorChange& change);
+
+void changeColor(image& im, const colorChange& change);
+
+bool parseMedian(string option, int& radius);
+
+void medianBand(image& band, int radius, netImage& medians);
+
+void medianFilter(image& im, int radius);
+
+bool parseCompare(string option, bool& first);
+
+void compareRows(image& a, image& b, compareStats& stats,
+    vector<int>& carried, int firstRow);
+
+bool compareStreams(istream& in, istream& with, string inputMagic,
+    string secondMagic, bool first, compareStats& stats, long long limit);
+
+void writeCompareJson(ostream& out, compareStats& stats, bool first);
+
+bool streamPyramid(istream& in, string inputMagic, string outputMagic,
+    string basename, long long limit, int& count);
+
+void buildHistogram(image& im, histogram& hist);
+
+void levelsTable(histogram& hist, long long total, pixel lut[3][256]);
+
+void equalizeTable(histogram& hist, long long total, pixel lut[3][256]);
+
+void applyTable(image& im, pixel lut[3][256]);
+
+void autolevels(image& im);
+
+void equalize(image& im);
+
+void writeHistogramJson(ostream& out, image& im, histogram& hist);
+
+bool parseResize(string option, int& newCols, int& newRows,
+    filterType& filter);
+
+void resolveSize(int rows, int cols, int& newRows, int& newCols);
+
+void buildResampleTable(resampleTable& table, int inSize, int outSize,
+    filterType filter);
+
+void resize(image& im, int newRows, int newCols, filterType filter);
+
+void readBinaryResized(istream& in, image& im, int& maxValue,
+    cropRegion area, int newRows, int newCols, filterType filter);
+
+void createTiled(tiledImage& ti, string path, long long rows,
+    long long cols, long long budget);
+
+pixel* tilePointer(tiledImage& ti, long long tx, long long ty);
+
+void unmapTile(tiledImage& ti, size_t index);
+
+void closeTiled(tiledImage& ti);
+
+void readHeaderLarge(istream& in, string& comment, long long& rows,
+    long long& cols, int& maxValue);
+
+void importTiled(istream& in, tiledImage& ti, bool binary);
+
+void exportTiled(ostream& out, tiledImage& ti, string magicNumber,
+    string comment, int maxValue);
+
+void remapTiled(tiledImage& src, tiledImage& dst, string optionCode);
+
+void colorTiled(tiledImage& ti, string optionCode);
+
+void processTiled(istream& in, ostream& out, string inputMagic,
+    string outputMagic, string optionCode, string basename,
+    long long budget);
+
+memoryPlan planMemory(long long budget, image& header, cropRegion area,
+    string inputMagic, string outputMagic, string optionCode, bool frames,
+    bool fromStdin);
+
+const char* planName(memoryStrategy strategy);
+
+long long peakMemory();
+
+void streamRows(istream& in, ostream& out, string inputMagic,
+    string outputMagic, const function<void(image&)>& change,
+    long long limit, int margin);
+
+bool parsePattern(string name, synthPattern& pattern);
+
+void syntheticRows(image& band, int first, int rows, synthPattern pattern,
+    unsigned int seed);
+
+bool writeSynthetic(ostream& out, string magicNumber, int rows, int cols,
+    synthPattern pattern, unsigned int seed);
+
+unsigned long long hash64(const pixel* data, size_t length,
+    unsigned long long seed);
+
+bool cacheKey(string file, string job, string& key);
+
+bool fetchCached(string dir, string key, string outputName);
+
+void storeCached(string dir, string key, string outputName,
+    long long limit);
+
+isaLevel detectIsa();
+
+bool selectKernels(string name, string& chosen);
+
+const kernelTable& kernels();
+
+int threadCount();
+
+void parallelRows(int rows, const function<void(int, int)>& work);
+
+int numaNodes();
+
+int currentNode();
+
+void pinToNode(int node);
+
+bool setNumaPlacement(string name, string& chosen);
+
+void placeArray(pixel** ptr, int rows, int cols);
+
+void countBand(int home);
+
+void numaTraffic(long long& local, long long& remote);
+
+void traceThread(const char* name);
+
+long long startTrace();
+
+bool finishTrace(string file, long long since);
+
+long long pipelineFrames(const function<bool(imageFrame&)>& decode,
+    const function<void(imageFrame&)>& process,
+    const function<void(imageFrame&)>& encode);
+
+int runJob(int argc, char** argv, ostream& report);
+
+int serve(string socketPath, int workers, int queueLimit);
+
+int runClient(string socketPath, int argc, char** argv);
 
 #endif
\ No newline at end of file
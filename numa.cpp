@@ -0,0 +1,629 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that place arrays and threads on NUMA nodes
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <atomic>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <cstdint>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+/*!
+ * @brief PLACE_BYTES arrays smaller than this are left wherever they land
+ */
+
+const size_t PLACE_BYTES = 1 << 20;
+
+/*!
+ * @brief PLACEMENT_NAMES the name of each numaPlacement, in order
+ */
+
+static const char* const PLACEMENT_NAMES[] =
+{
+    "local",
+    "interleave",
+    "off"
+};
+
+/*!
+ * @brief numaTopology the nodes that have cpus, found once
+ */
+
+struct numaTopology
+{
+    /*!
+    * @brief ids the number the system gives each node
+    */
+    vector<int> ids;
+
+    /*!
+    * @brief cpus the cpus of each node, on linux
+    */
+    vector<vector<int>> cpus;
+
+    /*!
+    * @brief cpuNode the node of each cpu, or -1, on linux
+    */
+    vector<int> cpuNode;
+};
+
+/*!
+ * @brief placement how big arrays are placed, local unless --numa says
+ */
+
+static atomic<numaPlacement> placement(NUMA_LOCAL);
+
+/*!
+ * @brief localTiles the tiles of rows run on the node they belong to
+ */
+
+static atomic<long long> localTiles(0);
+
+/*!
+ * @brief remoteTiles the tiles of rows run on another node
+ */
+
+static atomic<long long> remoteTiles(0);
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function reads a list of numbers the way linux writes them in
+  * /sys, like 0-3,8-11, which is 0, 1, 2, 3, 8, 9, 10 and 11.
+  *
+  * @param[in] name - the file with the list.
+  *
+  * @returns the numbers, or none if the file can't be read
+  *
+  * @par Example:
+    @verbatim
+    vector<int> nodes = readList("/sys/devices/system/node/online");
+
+    nodes is now { 0, 1 } on a machine with two nodes.
+    @endverbatim
+
+  ***********************************************************************/
+
+static vector<int> readList(string name)
+{
+    ifstream file(name);
+    vector<int> list;
+    int first;
+    int last;
+
+    while (file >> first)
+    {
+        last = first;
+        if (file.peek() == '-')
+        {
+            file.get();
+            file >> last;
+        }
+        while (first <= last)
+        {
+            list.push_back(first);
+            first++;
+        }
+        if (file.peek() == ',')
+        {
+            file.get();
+        }
+    }
+    return list;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds the NUMA nodes that have cpus, and on linux which
+ * cpus each has. Anywhere it can't tell, there is just one node.
+ *
+ * @returns the nodes
+ *
+ * @par Example:
+   @verbatim
+   numaTopology t = findTopology();
+
+   t.ids is now { 0, 1 } on a machine with two sockets.
+   @endverbatim
+
+ ***********************************************************************/
+
+static numaTopology findTopology()
+{
+    numaTopology t;
+
+#ifdef _WIN32
+    ULONG highest = 0;
+    USHORT node = 0;
+    GROUP_AFFINITY mask;
+
+    if (GetNumaHighestNodeNumber(&highest))
+    {
+        while (node <= highest)
+        {
+            if (GetNumaNodeProcessorMaskEx(node, &mask) && mask.Mask != 0)
+            {
+                t.ids.push_back(node);
+            }
+            node++;
+        }
+    }
+#elif defined(__linux__)
+    vector<int> online = readList("/sys/devices/system/node/online");
+    vector<int> cpus;
+    size_t i = 0;
+
+    while (i < online.size())
+    {
+        cpus = readList("/sys/devices/system/node/node" +
+            to_string(online[i]) + "/cpulist");
+        for (int cpu : cpus)
+        {
+            if (cpu >= (int)t.cpuNode.size())
+            {
+                t.cpuNode.resize((size_t)cpu + 1, -1);
+            }
+            t.cpuNode[cpu] = (int)t.ids.size();
+        }
+        // a node with just memory has no threads to place anything for
+        if (!cpus.empty())
+        {
+            t.ids.push_back(online[i]);
+            t.cpus.push_back(cpus);
+        }
+        i++;
+    }
+#endif
+
+    if (t.ids.size() <= 1)
+    {
+        t.ids.assign(1, 0);
+        t.cpus.clear();
+        t.cpuNode.clear();
+    }
+    return t;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function gives the nodes, finding them the first time it is
+ * called.
+ *
+ * @returns the nodes
+ *
+ * @par Example:
+   @verbatim
+   int count = (int)topology().ids.size();
+   @endverbatim
+
+ ***********************************************************************/
+
+static const numaTopology& topology()
+{
+    static const numaTopology t = findTopology();
+
+    return t;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function returns how many NUMA nodes with cpus the machine has.
+ * Nodes are counted from 0 here, whatever numbers the system gives them.
+ *
+ * @returns the number of nodes, 1 on most machines
+ *
+ * @par Example:
+   @verbatim
+   int nodes = numaNodes();
+
+   nodes is now 2 on a machine with two sockets.
+   @endverbatim
+
+ ***********************************************************************/
+
+int numaNodes()
+{
+    return (int)topology().ids.size();
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function returns the node of the cpu the calling thread is on
+ * right now. A thread that isn't pinned can move, so it is only sure
+ * for one that is.
+ *
+ * @returns the node, from 0 to numaNodes() - 1
+ *
+ * @par Example:
+   @verbatim
+   pinToNode(1);
+   int node = currentNode();
+
+   node is now 1.
+   @endverbatim
+
+ ***********************************************************************/
+
+int currentNode()
+{
+    const numaTopology& t = topology();
+    size_t i = 0;
+
+    if (t.ids.size() == 1)
+    {
+        return 0;
+    }
+#ifdef _WIN32
+    PROCESSOR_NUMBER number;
+    USHORT node;
+
+    GetCurrentProcessorNumberEx(&number);
+    if (GetNumaProcessorNodeEx(&number, &node))
+    {
+        while (i < t.ids.size())
+        {
+            if (t.ids[i] == (int)node)
+            {
+                return (int)i;
+            }
+            i++;
+        }
+    }
+#elif defined(__linux__)
+    int cpu = sched_getcpu();
+
+    (void)i;
+    if (cpu >= 0 && cpu < (int)t.cpuNode.size() && t.cpuNode[cpu] >= 0)
+    {
+        return t.cpuNode[cpu];
+    }
+#else
+    (void)i;
+#endif
+    return 0;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function keeps the calling thread on the cpus of one node, so
+ * the rows it first touches are put in that node's memory and it goes
+ * on working on them there. It does nothing with one node or with
+ * --numa off.
+ *
+ * @param[in] node - the node, from 0 to numaNodes() - 1.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   pinToNode(1);
+
+   the thread now only runs on the cpus of node 1.
+   @endverbatim
+
+ ***********************************************************************/
+
+void pinToNode(int node)
+{
+    const numaTopology& t = topology();
+
+    if (t.ids.size() == 1 || placement == NUMA_OFF)
+    {
+        return;
+    }
+#ifdef _WIN32
+    GROUP_AFFINITY mask;
+
+    if (GetNumaNodeProcessorMaskEx((USHORT)t.ids[node], &mask))
+    {
+        SetThreadGroupAffinity(GetCurrentThread(), &mask, nullptr);
+    }
+#elif defined(__linux__)
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    for (int cpu : t.cpus[node])
+    {
+        if (cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function picks how big arrays are placed from a --numa option.
+ * local puts each part of the rows in the memory of the node whose
+ * threads work on it, interleave spreads the pages over all the nodes, and off
+ * leaves them and the threads wherever they land. Interleave is only
+ * done on linux, anywhere else it is local. The pool's threads are
+ * pinned when it starts, so off only keeps them from being pinned if
+ * it comes before the first job.
+ *
+ * @param[in] name - local, interleave or off.
+ * @param[out] chosen - what was picked, to report.
+ *
+ * @returns true if the name is one of the three, false otherwise
+ *
+ * @par Example:
+   @verbatim
+   string chosen;
+
+   setNumaPlacement("interleave", chosen);
+
+   chosen is now "2 NUMA nodes, interleave placement" on a machine with
+   two sockets.
+   @endverbatim
+
+ ***********************************************************************/
+
+bool setNumaPlacement(string name, string& chosen)
+{
+    int i = 0;
+    int nodes = numaNodes();
+
+    while (i < (int)(sizeof(PLACEMENT_NAMES) / sizeof(PLACEMENT_NAMES[0])))
+    {
+        if (name == PLACEMENT_NAMES[i])
+        {
+            placement = (numaPlacement)i;
+            if (nodes == 1)
+            {
+                chosen = "1 NUMA node, nothing to place";
+                return true;
+            }
+            chosen = to_string(nodes) + " NUMA nodes, " + name +
+                " placement";
+#ifndef __linux__
+            if (placement == NUMA_INTERLEAVE)
+            {
+                chosen += " (not supported here, using local)";
+                placement = NUMA_LOCAL;
+            }
+#endif
+            return true;
+        }
+        i++;
+    }
+    return false;
+}
+
+
+
+#ifdef __linux__
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function gives the whole pages from first to last a memory
+ * policy, so the kernel puts them on the given nodes as they are first
+ * touched. The pages at the ends, which are partly outside, are left.
+ *
+ * @param[in] first - the first byte.
+ * @param[in] last - one past the last byte.
+ * @param[in] mode - MPOL_PREFERRED or MPOL_INTERLEAVE.
+ * @param[in] node - the node, by index, or -1 for all of them.
+ *
+ * @returns true if the policy was set or there are no whole pages
+ *
+ * @par Example:
+   @verbatim
+   bindPages(arr[0], arr[0] + size, MPOL_PREFERRED, 1);
+
+   the pages of arr now go in the memory of node 1.
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool bindPages(pixel* first, pixel* last, int mode, int node)
+{
+    const numaTopology& t = topology();
+    unsigned long mask[16] = { 0 }; // room for 1024 nodes
+    size_t bits = sizeof(mask[0]) * 8;
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)first + page - 1) / page * page;
+    uintptr_t end = (uintptr_t)last / page * page;
+    size_t i = 0;
+
+    while (i < t.ids.size())
+    {
+        if ((node < 0 || node == (int)i) && t.ids[i] < (int)(bits * 16))
+        {
+            mask[t.ids[i] / bits] |= 1UL << (t.ids[i] % bits);
+        }
+        i++;
+    }
+    return end <= start || syscall(SYS_mbind, (void*)start, end - start,
+        mode, mask, bits * 16 + 1, 0) == 0;
+}
+#endif
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function places the pixels of a newly allocated array before
+ * anything touches them. With local placement the rows are split into
+ * one part per node, in order, and each part goes in its node's memory.
+ * parallelRows gives each tile the node of its rows as its home, and
+ * threads take the tiles of their own node first, so most rows are
+ * worked on where they are. Where that can't be set, each tile of rows
+ * is zeroed by parallelRows instead, since a page goes in the memory of
+ * the node that touches it first. With interleave the pages are spread
+ * over the nodes, which evens out the traffic when the tiles don't line
+ * up. Small arrays and machines with one node are left alone.
+ *
+ * @param[in] ptr - the rows of the array.
+ * @param[in] rows - the number of rows in the array.
+ * @param[in] cols - the number of columns in the array.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   pixel** arr;
+
+   allocateArray(arr, 4000, 6000);
+
+   allocateArray calls placeArray(arr, 4000, 6000), and on two nodes
+   rows 0 to 1999 are now in node 0's memory and the rest in node 1's.
+   @endverbatim
+
+ ***********************************************************************/
+
+void placeArray(pixel** ptr, int rows, int cols)
+{
+    size_t size = (size_t)rows * cols;
+    int nodes = numaNodes();
+
+    if (nodes == 1 || size < PLACE_BYTES || placement == NUMA_OFF)
+    {
+        return;
+    }
+
+#ifdef __linux__
+    bool placed = true;
+    int node = 0;
+    int first;
+    int last;
+
+    if (placement == NUMA_INTERLEAVE)
+    {
+        placed = bindPages(ptr[0], ptr[0] + size, MPOL_INTERLEAVE, -1);
+    }
+    while (placement == NUMA_LOCAL && node < nodes && placed)
+    {
+        // the rows whose tiles have this node as their home
+        first = (int)(((long long)rows * node + nodes - 1) / nodes);
+        last = (int)(((long long)rows * (node + 1) + nodes - 1) / nodes);
+        placed = bindPages(ptr[0] + (size_t)first * cols,
+            ptr[0] + (size_t)last * cols, MPOL_PREFERRED, node);
+        node++;
+    }
+    if (placed)
+    {
+        return;
+    }
+#endif
+
+    // touch each tile first from a thread that will work on it
+    parallelRows(rows, [&](int start, int end)
+    {
+        memset(ptr[start], 0, (size_t)(end - start) * cols);
+    });
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function counts a tile of rows parallelRows is about to run, as
+ * local if the thread running it is on the node the tile belongs to and
+ * remote if it isn't. A remote tile reads and writes its rows across
+ * nodes. Nothing is counted with one node.
+ *
+ * @param[in] home - the node the tile belongs to.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   countBand(1);
+
+   if the thread is on node 0, one more tile is counted as remote.
+   @endverbatim
+
+ ***********************************************************************/
+
+void countBand(int home)
+{
+    if (numaNodes() == 1)
+    {
+        return;
+    }
+    if (currentNode() == home)
+    {
+        localTiles++;
+    }
+    else
+    {
+        remoteTiles++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function gives how many tiles of rows have run on their own node
+ * and how many on another since the program started, so a job can
+ * report the traffic across nodes by taking the counts before and after.
+ *
+ * @param[out] local - the tiles run on the node they belong to.
+ * @param[out] remote - the tiles run on another node.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   long long local;
+   long long remote;
+
+   numaTraffic(local, remote);
+   @endverbatim
+
+ ***********************************************************************/
+
+void numaTraffic(long long& local, long long& remote)
+{
+    local = localTiles;
+    remote = remoteTiles;
+}
@@ -0,0 +1,616 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that keep finished outputs so repeated jobs are
+ *          copied instead of redone
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <algorithm>
+#include <mutex>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+/*!
+ * @brief the xxHash64 primes
+ */
+
+const uint64_t PRIME1 = 11400714785074694791ULL;
+const uint64_t PRIME2 = 14029467366897019727ULL;
+const uint64_t PRIME3 = 1609587929392839161ULL;
+const uint64_t PRIME4 = 9650029242287828579ULL;
+const uint64_t PRIME5 = 2870177450012600261ULL;
+
+/*!
+ * @brief HASH_CHUNK the number of bytes of input hashed at a time
+ */
+
+const size_t HASH_CHUNK = 1 << 20;
+
+/*!
+ * @brief statsLock lets one thread at a time update stats.txt; the lock
+ * on stats.lock keeps out other programs using the same cache
+ */
+
+static mutex statsLock;
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function rotates the bits of a 64 bit value to the left.
+  *
+  * @param[in] x - the value to rotate.
+  * @param[in] r - the number of bits to rotate by.
+  *
+  * @returns the rotated value.
+  *
+  * @par Example:
+    @verbatim
+    uint64_t x = rotl64(1, 4);
+
+    x is now 16
+    @endverbatim
+
+  ***********************************************************************/
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function mixes 8 bytes of input into one xxHash64 accumulator.
+ *
+ * @param[in] acc - the accumulator.
+ * @param[in] input - the 8 bytes of input.
+ *
+ * @returns the new accumulator.
+ *
+ * @par Example:
+   @verbatim
+   acc = hashRound(acc, word);
+   @endverbatim
+
+ ***********************************************************************/
+
+static uint64_t hashRound(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME1;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads 8 bytes as a little endian value.
+ *
+ * @param[in] p - the bytes to read.
+ *
+ * @returns the value.
+ *
+ * @par Example:
+   @verbatim
+   uint64_t word = read64(data);
+   @endverbatim
+
+ ***********************************************************************/
+
+static uint64_t read64(const pixel* p)
+{
+    uint64_t v = 0;
+    int i = 7;
+
+    while (i >= 0)
+    {
+        v = (v << 8) | p[i];
+        i--;
+    }
+    return v;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function is the 64 bit xxHash of a block of bytes. It runs four
+ * independent accumulators over 32 bytes at a time, so it is limited by
+ * memory speed rather than by the hashing.
+ *
+ * @param[in] data - the bytes to hash.
+ * @param[in] length - the number of bytes.
+ * @param[in] seed - the starting value, used to chain blocks together.
+ *
+ * @returns the hash.
+ *
+ * @par Example:
+   @verbatim
+   uint64_t h = hash64((const pixel*)"abc", 3, 0);
+
+   h is now 0x44bc2cf5ad770999
+   @endverbatim
+
+ ***********************************************************************/
+
+unsigned long long hash64(const pixel* data, size_t length,
+    unsigned long long seed)
+{
+    const pixel* p = data;
+    const pixel* end = data + length;
+    uint64_t h;
+    uint64_t v1 = seed + PRIME1 + PRIME2;
+    uint64_t v2 = seed + PRIME2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME1;
+    uint64_t v[4];
+    uint32_t four;
+    int i;
+
+    if (length >= 32)
+    {
+        while (p + 32 <= end)
+        {
+            v1 = hashRound(v1, read64(p));
+            v2 = hashRound(v2, read64(p + 8));
+            v3 = hashRound(v3, read64(p + 16));
+            v4 = hashRound(v4, read64(p + 24));
+            p += 32;
+        }
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) +
+            rotl64(v4, 18);
+
+        // fold each accumulator into the result
+        v[0] = v1;
+        v[1] = v2;
+        v[2] = v3;
+        v[3] = v4;
+        i = 0;
+        while (i < 4)
+        {
+            h ^= hashRound(0, v[i]);
+            h = h * PRIME1 + PRIME4;
+            i++;
+        }
+    }
+    else
+    {
+        h = seed + PRIME5;
+    }
+    h += (uint64_t)length;
+
+    // then the bytes left over
+    while (p + 8 <= end)
+    {
+        h ^= hashRound(0, read64(p));
+        h = rotl64(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= end)
+    {
+        four = (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+            (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+        h ^= (uint64_t)four * PRIME1;
+        h = rotl64(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < end)
+    {
+        h ^= (*p) * PRIME5;
+        h = rotl64(h, 11) * PRIME1;
+        p++;
+    }
+
+    // avalanche so every input bit affects every output bit
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function makes the cache key for a job: the hash of every byte
+ * of the input file, chained with the hash of the normalized options.
+ *
+ * @param[in] file - the name of the input file.
+ * @param[in] job - the normalized options and output type.
+ * @param[out] key - the key as 16 hex digits.
+ *
+ * @returns true if the input could be read, false if not.
+ *
+ * @par Example:
+   @verbatim
+   string key;
+
+   cacheKey("image.ppm", "--sepia --binary", key);
+
+   key is now something like "8e0f1cb36a3e9d02"
+   @endverbatim
+
+ ***********************************************************************/
+
+bool cacheKey(string file, string job, string& key)
+{
+    ifstream in(file, ios::in | ios::binary);
+    vector<pixel> chunk(HASH_CHUNK);
+    uint64_t h = 0;
+    streamsize got;
+    ostringstream hex;
+
+    if (!in.is_open())
+    {
+        return false;
+    }
+    while (in)
+    {
+        in.read((char*)chunk.data(), (streamsize)chunk.size());
+        got = in.gcount();
+        if (got > 0)
+        {
+            h = hash64(chunk.data(), (size_t)got, h);
+        }
+    }
+    h = hash64((const pixel*)job.data(), job.size(), h);
+
+    hex << std::hex << setw(16) << setfill('0') << h;
+    key = hex.str();
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function copies one file to another. On Linux it uses
+ * copy_file_range so the data never comes up into the program, and
+ * filesystems that support it share the blocks instead of copying them.
+ * Elsewhere the filesystem library does the copy.
+ *
+ * @param[in] from - the file to copy.
+ * @param[in] to - the file to create or replace.
+ *
+ * @returns true if the copy worked, false if not.
+ *
+ * @par Example:
+   @verbatim
+   copyWhole("cache/8e0f1cb36a3e9d02.ppm", "out.ppm");
+
+   output: true
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool copyWhole(string from, string to)
+{
+    error_code error;
+
+#ifdef __linux__
+    struct stat info;
+    int src = open(from.c_str(), O_RDONLY);
+    int dst = -1;
+    ssize_t done = 1;
+    off_t left = 0;
+
+    if (src >= 0 && fstat(src, &info) == 0)
+    {
+        dst = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        left = info.st_size;
+    }
+    while (dst >= 0 && left > 0 && done > 0)
+    {
+        done = copy_file_range(src, NULL, dst, NULL, (size_t)left, 0);
+        left -= done > 0 ? done : 0;
+    }
+    if (src >= 0)
+    {
+        close(src);
+    }
+    if (dst >= 0)
+    {
+        close(dst);
+        if (left == 0)
+        {
+            return true;
+        }
+    }
+    // fall back when the kernel or filesystem can't do it
+#endif
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing, error);
+    return !error;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function makes a temporary name next to a file that no other
+ * thread or program writing the same file will use, so each writes its
+ * own copy and the last rename wins with a whole file.
+ *
+ * @param[in] path - the file the temporary one will replace.
+ *
+ * @returns the temporary name, ending in .tmp
+ *
+ * @par Example:
+   @verbatim
+   string temp = tempName("cache/stats.txt");
+
+   temp is now something like "cache/stats.txt.4120.7f3a.tmp".
+   @endverbatim
+
+ ***********************************************************************/
+
+static string tempName(string path)
+{
+    ostringstream name;
+
+#ifdef _WIN32
+    name << path << "." << _getpid();
+#else
+    name << path << "." << getpid();
+#endif
+    name << "." << hex << hash<thread::id>()(this_thread::get_id())
+        << ".tmp";
+    return name.str();
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function adds to a counter in the stats.txt file of the cache,
+ * which holds the hits, misses and evictions. Jobs on other threads or
+ * in other programs may count at the same time, so it is done under a
+ * lock on stats.lock.
+ *
+ * @param[in] dir - the cache directory.
+ * @param[in] name - hits, misses or evictions.
+ * @param[in] amount - how much to add.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   countCache("cache", "hits", 1);
+
+   stats.txt now has one more hit.
+   @endverbatim
+
+ ***********************************************************************/
+
+static void countCache(string dir, string name, long long amount)
+{
+    lock_guard<mutex> hold(statsLock);
+    string names[3] = { "hits", "misses", "evictions" };
+    long long values[3] = { 0, 0, 0 };
+    string label;
+    long long value;
+    string path = dir + "/stats.txt";
+    string lockPath = dir + "/stats.lock";
+    string temp = tempName(path);
+    error_code error;
+    int i;
+
+    // hold the lock file while the counters are read and written back,
+    // so no update is lost; the system lets go of it if a program dies
+    fs::create_directories(dir, error);
+#ifdef _WIN32
+    OVERLAPPED whole = {};
+    HANDLE lockFile = CreateFileA(lockPath.c_str(), GENERIC_READ |
+        GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (lockFile != INVALID_HANDLE_VALUE)
+    {
+        LockFileEx(lockFile, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &whole);
+    }
+#else
+    int lockFile = open(lockPath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (lockFile >= 0)
+    {
+        flock(lockFile, LOCK_EX);
+    }
+#endif
+
+    // read in the current counters
+    ifstream in(path);
+    while (in >> label >> value)
+    {
+        i = 0;
+        while (i < 3)
+        {
+            if (label == names[i])
+            {
+                values[i] = value;
+            }
+            i++;
+        }
+    }
+    in.close();
+
+    // write them back with the change, replacing the file in one step
+    ofstream out(temp);
+    i = 0;
+    while (i < 3)
+    {
+        if (name == names[i])
+        {
+            values[i] += amount;
+        }
+        out << names[i] << " " << values[i] << endl;
+        i++;
+    }
+    out.close();
+    fs::rename(temp, path, error);
+
+#ifdef _WIN32
+    if (lockFile != INVALID_HANDLE_VALUE)
+    {
+        UnlockFileEx(lockFile, 0, 1, 0, &whole);
+        CloseHandle(lockFile);
+    }
+#else
+    if (lockFile >= 0)
+    {
+        flock(lockFile, LOCK_UN);
+        close(lockFile);
+    }
+#endif
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function looks for a finished output in the cache. If it is
+ * there, it is copied to the output file, marked as just used, and the
+ * hit is counted. Otherwise the miss is counted.
+ *
+ * @param[in] dir - the cache directory.
+ * @param[in] key - the key of the job.
+ * @param[in] outputName - the name of the output file.
+ *
+ * @returns true if the output came from the cache, false if not.
+ *
+ * @par Example:
+   @verbatim
+   if (fetchCached("cache", key, "out.ppm"))
+   {
+       // nothing left to do
+   }
+   @endverbatim
+
+ ***********************************************************************/
+
+bool fetchCached(string dir, string key, string outputName)
+{
+    string entry = dir + "/" + key + fs::path(outputName).extension()
+        .string();
+    error_code error;
+
+    if (!fs::exists(entry, error) || !copyWhole(entry, outputName))
+    {
+        countCache(dir, "misses", 1);
+        return false;
+    }
+
+    // the modification time is when the entry was last used
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), error);
+    countCache(dir, "hits", 1);
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function copies a finished output into the cache, then removes
+ * the least recently used entries until the cache fits in its size.
+ *
+ * @param[in] dir - the cache directory.
+ * @param[in] key - the key of the job.
+ * @param[in] outputName - the name of the output file.
+ * @param[in] limit - the most bytes the cache may hold.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   storeCached("cache", key, "out.ppm", 1LL << 30);
+
+   out.ppm is now in the cache, which is under 1 GB.
+   @endverbatim
+
+ ***********************************************************************/
+
+void storeCached(string dir, string key, string outputName,
+    long long limit)
+{
+    string entry = dir + "/" + key + fs::path(outputName).extension()
+        .string();
+    string temp = tempName(entry);
+    vector<pair<fs::file_time_type, fs::path>> entries;
+    long long total = 0;
+    long long evicted = 0;
+    error_code error;
+    size_t i = 0;
+
+    // copy under a temporary name of its own so a half written entry is
+    // never used, even with another job storing the same key
+    fs::create_directories(dir, error);
+    if (!copyWhole(outputName, temp))
+    {
+        fs::remove(temp, error);
+        return;
+    }
+    fs::rename(temp, entry, error);
+
+    // add up the entries, oldest first
+    for (const fs::directory_entry& e : fs::directory_iterator(dir, error))
+    {
+        if (e.is_regular_file(error) && e.path().filename() != "stats.txt"
+            && e.path().filename() != "stats.lock" &&
+            e.path().extension() != ".tmp")
+        {
+            entries.push_back(make_pair(e.last_write_time(error),
+                e.path()));
+            total += (long long)e.file_size(error);
+        }
+    }
+    sort(entries.begin(), entries.end());
+
+    // and remove them until the cache fits, keeping the newest one
+    while (total > limit && i + 1 < entries.size())
+    {
+        total -= (long long)fs::file_size(entries[i].second, error);
+        fs::remove(entries[i].second, error);
+        evicted++;
+        i++;
+    }
+    if (evicted > 0)
+    {
+        countCache(dir, "evictions", evicted);
+    }
+}
@@ -0,0 +1,829 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that run jobs in a server over a local socket
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET socketHandle;
+const socketHandle NO_SOCKET = INVALID_SOCKET;
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <csignal>
+typedef int socketHandle;
+const socketHandle NO_SOCKET = -1;
+#endif
+
+namespace fs = std::filesystem;
+
+/*!
+ * @brief SPARE_BUFFERS bytes of freed image planes the server keeps
+ */
+
+const size_t SPARE_BUFFERS = (size_t)256 * 1024 * 1024;
+
+/*!
+ * @brief BUSY_TRIES how many times a client asks a busy server
+ */
+
+const int BUSY_TRIES = 8;
+
+/*!
+ * @brief REQUEST_SECONDS how long the server waits on a client that is
+ * sending its request before it hangs up on it
+ */
+
+const int REQUEST_SECONDS = 10;
+
+/*!
+ * @brief REQUEST_BYTES the longest line a request may have
+ */
+
+const size_t REQUEST_BYTES = 64 * 1024;
+
+/*!
+ * @brief LATENCY_JOBS how many of the latest jobs --stats reports on
+ */
+
+const size_t LATENCY_JOBS = 10000;
+
+/*!
+ * @brief serverJob a job waiting in the server queue
+ */
+
+struct serverJob
+{
+    /*!
+    * @brief the connection to the client that sent the job
+    */
+    socketHandle client;
+
+    /*!
+    * @brief the job's arguments, not counting the program name
+    */
+    vector<string> args;
+
+    /*!
+    * @brief when the server was sent the job
+    */
+    chrono::steady_clock::time_point arrived;
+};
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function closes a socket.
+  *
+  * @param[in] s - the socket to close.
+  *
+  * @returns none
+  *
+  * @par Example:
+    @verbatim
+    closeSocket(client);
+    @endverbatim
+
+  ***********************************************************************/
+
+static void closeSocket(socketHandle s)
+{
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function fills in the address of a local socket from its path.
+ *
+ * @param[in] socketPath - the path of the socket.
+ * @param[out] address - the address to fill in.
+ *
+ * @returns true if the path fits in an address, false if it is too long
+ *
+ * @par Example:
+   @verbatim
+   sockaddr_un address;
+
+   if (!socketAddress("/tmp/thp.sock", address))
+       return 1;
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool socketAddress(string socketPath, sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function starts up sockets. Windows needs this before any socket
+ * is made; elsewhere it does nothing.
+ *
+ * @returns true if sockets can be used, false if not
+ *
+ * @par Example:
+   @verbatim
+   if (!startSockets())
+       return 1;
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool startSockets()
+{
+#ifdef _WIN32
+    WSADATA data;
+
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+    return true;
+#endif
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function sets how long a read from a socket waits for the other
+ * end before it gives up, so a client that stops sending can't hold on
+ * to the server.
+ *
+ * @param[in] s - the socket.
+ * @param[in] seconds - how long each read may wait.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   setReadTimeout(client, 10);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void setReadTimeout(socketHandle s, int seconds)
+{
+#ifdef _WIN32
+    DWORD wait = (DWORD)seconds * 1000;
+#else
+    timeval wait;
+
+    wait.tv_sec = seconds;
+    wait.tv_usec = 0;
+#endif
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&wait,
+        sizeof(wait));
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function sends one line of text over a socket, adding the
+ * newline.
+ *
+ * @param[in] s - the socket to send on.
+ * @param[in] line - the text to send.
+ *
+ * @returns true if it was all sent, false if the other end is gone
+ *
+ * @par Example:
+   @verbatim
+   sendLine(client, "DONE 0");
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool sendLine(socketHandle s, string line)
+{
+    size_t sent = 0;
+    int count;
+
+    line += '\n';
+    while (sent < line.size())
+    {
+        count = (int)send(s, line.c_str() + sent, (int)(line.size() - sent),
+            0);
+        if (count <= 0)
+        {
+            return false;
+        }
+        sent += count;
+    }
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads one line of text from a socket, without the
+ * newline. Bytes read past the newline are kept in pending for the next
+ * call. A line longer than REQUEST_BYTES is taken as a bad client.
+ *
+ * @param[in] s - the socket to read from.
+ * @param[in,out] pending - bytes already read that are not used yet.
+ * @param[out] line - the line that was read.
+ *
+ * @returns true if a line was read, false if the other end is gone
+ *
+ * @par Example:
+   @verbatim
+   string pending;
+   string line;
+
+   while (readLine(server, pending, line))
+       cout << line << endl;
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool readLine(socketHandle s, string& pending, string& line)
+{
+    char buffer[4096];
+    size_t end;
+    int count;
+
+    end = pending.find('\n');
+    while (end == string::npos)
+    {
+        count = (int)recv(s, buffer, sizeof(buffer), 0);
+        if (count <= 0 || pending.size() > REQUEST_BYTES)
+        {
+            return false;
+        }
+        pending.append(buffer, count);
+        end = pending.find('\n');
+    }
+    line = pending.substr(0, end);
+    pending.erase(0, end + 1);
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds a leading option of a job that would change every
+ * job the server runs, not just this one. The kernels and where big
+ * arrays and threads are placed are the whole program's, so a server
+ * picks them when it starts.
+ *
+ * @param[in] args - the job's arguments, not counting the program name.
+ *
+ * @returns the option, or "" if the job has none
+ *
+ * @par Example:
+   @verbatim
+   string option = serverOption({ "--isa", "scalar", "--sepia",
+       "--binary", "out", "image.ppm" });
+
+   option is now "--isa".
+   @endverbatim
+
+ ***********************************************************************/
+
+static string serverOption(const vector<string>& args)
+{
+    size_t i = 0;
+
+    // the leading options come in pairs, but for --frames
+    while (i < args.size() && args[i].compare(0, 2, "--") == 0)
+    {
+        if (args[i] == "--isa" || args[i] == "--numa")
+        {
+            return args[i];
+        }
+        i += args[i] == "--frames" ? 1 : 2;
+    }
+    return "";
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function runs a job for a client. It tells the client the job
+ * has started, runs it, sends back each line it reported, then sends
+ * the status and closes the connection. A job with an option that is
+ * the whole server's, like --isa or --numa, is turned down instead.
+ *
+ * @param[in] job - the job to run.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   runServerJob(job);
+
+   the client now has STARTED, the LOG lines and DONE 0.
+   @endverbatim
+
+ ***********************************************************************/
+
+static void runServerJob(serverJob& job)
+{
+    vector<char*> argv;
+    string program = "thpExam1.exe";
+    ostringstream report;
+    istringstream lines;
+    string line;
+    string option = serverOption(job.args);
+    int status = 1;
+    size_t i = 0;
+
+    sendLine(job.client, "STARTED");
+    argv.push_back(&program[0]);
+    while (i < job.args.size())
+    {
+        argv.push_back(&job.args[i][0]);
+        i++;
+    }
+    argv.push_back(nullptr);
+
+    if (option != "")
+    {
+        report << option << " is set for the whole server when it starts"
+            << endl;
+    }
+    else
+    {
+        // runJob turns down jobs that run out of memory; anything else
+        // that gets out only fails this job
+        try
+        {
+            status = runJob((int)job.args.size() + 1, argv.data(), report);
+        }
+        catch (...)
+        {
+            report << "The job stopped with an error" << endl;
+            status = 1;
+        }
+    }
+
+    lines.str(report.str());
+    while (getline(lines, line))
+    {
+        sendLine(job.client, "LOG " + line);
+    }
+    sendLine(job.client, "DONE " + to_string(status));
+    closeSocket(job.client);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function sends a client how long the latest jobs took, from when
+ * they were sent to when they were done, and so how long the slowest
+ * ones wait behind the rest. It sends the median, the 90th and 99th
+ * percentiles and the longest, then "DONE 0", and closes the
+ * connection.
+ *
+ * @param[in] client - the connection to the client.
+ * @param[in] times - the milliseconds each of the latest jobs took.
+ * @param[in] finished - the jobs done since the server started.
+ * @param[in] waiting - the jobs waiting in the queue.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   sendStats(client, { 12.0, 15.5, 480.25 }, 3, 0);
+
+   the client now has LOG lines with 15.5 ms as the median and 480.25 ms
+   as the longest.
+   @endverbatim
+
+ ***********************************************************************/
+
+static void sendStats(socketHandle client, vector<double> times,
+    long long finished, size_t waiting)
+{
+    ostringstream line;
+
+    line << "Jobs done: " << finished << ", waiting: " << waiting;
+    sendLine(client, "LOG " + line.str());
+    if (!times.empty())
+    {
+        // the nearest rank of each percentile
+        auto rank = [&](double p)
+        {
+            size_t i = (size_t)ceil(p * times.size());
+
+            return times[i > 0 ? i - 1 : 0];
+        };
+        sort(times.begin(), times.end());
+        line.str("");
+        line << fixed << setprecision(2) << "Latency of the last "
+            << times.size() << " jobs: median " << rank(0.5) << " ms, p90 "
+            << rank(0.9) << " ms, p99 " << rank(0.99) << " ms, max "
+            << times.back() << " ms";
+        sendLine(client, "LOG " + line.str());
+    }
+    sendLine(client, "DONE 0");
+    closeSocket(client);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function runs a server that takes jobs over a local socket until
+ * the program is stopped. The threads, thread pool and freed image
+ * buffers stay around between jobs, so a job only pays for its own
+ * work. Up to workers jobs run at once. Jobs wait in a queue after
+ * that, and once queueLimit jobs are waiting new clients are told the
+ * server is busy so they can back off and try again.
+ *
+ * A client sends "ARG value" for each argument and then "RUN". The
+ * server answers "BUSY", or "QUEUED n" with the number of jobs ahead of
+ * it, then "STARTED", "LOG line" for each line the job reports and
+ * "DONE status". A client that sends "STATS" instead of "RUN" is sent how
+ * long the latest jobs took. Each request is read on its own thread,
+ * and a client that goes REQUEST_SECONDS without sending is hung up on,
+ * so a stalled client can't hold up the others.
+ *
+ * @param[in] socketPath - the path of the socket to listen on.
+ * @param[in] workers - how many jobs to run at once.
+ * @param[in] queueLimit - how many jobs may wait before clients are
+ *                         turned away.
+ *
+ * @returns 1 if the socket could not be set up
+ *
+ * @par Example:
+   @verbatim
+   serve("/tmp/thp.sock", 2, 64);
+   @endverbatim
+
+ ***********************************************************************/
+
+int serve(string socketPath, int workers, int queueLimit)
+{
+    deque<serverJob> queue;
+    mutex queueLock;
+    condition_variable queueWake;
+    int reading = 0; // clients still sending their requests
+    vector<thread> threads;
+    mutex statsLock;
+    deque<double> times;  // milliseconds each of the latest jobs took
+    long long finished = 0;
+    sockaddr_un address;
+    socketHandle listener;
+    socketHandle client;
+    bool full;
+    int i = 0;
+
+    if (!socketAddress(socketPath, address) || !startSockets())
+    {
+        cout << "Unable to use socket: " + socketPath << endl;
+        return 1;
+    }
+#ifndef _WIN32
+    // a client that hangs up shouldn't take the server with it
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    remove(socketPath.c_str());
+    if (listener == NO_SOCKET ||
+        ::bind(listener, (sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listener, queueLimit) != 0)
+    {
+        cout << "Unable to use socket: " + socketPath << endl;
+        return 1;
+    }
+    setBufferPool(SPARE_BUFFERS);
+
+    while (i < workers)
+    {
+        threads.push_back(thread([&]
+        {
+            serverJob next;
+
+            while (true)
+            {
+                {
+                    unique_lock<mutex> lock(queueLock);
+                    queueWake.wait(lock, [&] { return !queue.empty(); });
+                    next = move(queue.front());
+                    queue.pop_front();
+                }
+                runServerJob(next);
+
+                lock_guard<mutex> lock(statsLock);
+                times.push_back(chrono::duration<double, milli>(
+                    chrono::steady_clock::now() - next.arrived).count());
+                if (times.size() > LATENCY_JOBS)
+                {
+                    times.pop_front();
+                }
+                finished++;
+            }
+        }));
+        i++;
+    }
+
+    // reads one client's request on its own thread, so a slow client
+    // only holds up itself, and queues the job or sends the stats
+    auto takeRequest = [&](socketHandle from)
+    {
+        serverJob job;
+        vector<double> latest; // a copy of times to send
+        string pending;
+        string line;
+        long long done;
+        size_t waiting;
+
+        job.client = from;
+        setReadTimeout(job.client, REQUEST_SECONDS);
+
+        // read the arguments up to RUN
+        while (readLine(job.client, pending, line) && line != "RUN" &&
+            line != "STATS")
+        {
+            if (line.compare(0, 4, "ARG ") == 0)
+            {
+                job.args.push_back(line.substr(4));
+            }
+        }
+        {
+            lock_guard<mutex> lock(queueLock);
+            reading--;
+        }
+        if (line == "STATS")
+        {
+            {
+                lock_guard<mutex> lock(statsLock);
+                latest.assign(times.begin(), times.end());
+                done = finished;
+            }
+            {
+                lock_guard<mutex> lock(queueLock);
+                waiting = queue.size();
+            }
+            sendStats(job.client, latest, done, waiting);
+            return;
+        }
+        if (line != "RUN")
+        {
+            closeSocket(job.client);
+            return;
+        }
+        job.arrived = chrono::steady_clock::now();
+
+        // QUEUED is sent before a worker can see the job, since the
+        // worker closes the connection when the job is done
+        {
+            lock_guard<mutex> lock(queueLock);
+            waiting = queue.size();
+            if ((int)waiting < queueLimit)
+            {
+                sendLine(job.client, "QUEUED " + to_string(waiting));
+                queue.push_back(job);
+            }
+        }
+        if ((int)waiting >= queueLimit)
+        {
+            sendLine(job.client, "BUSY");
+            closeSocket(job.client);
+            return;
+        }
+        queueWake.notify_one();
+    };
+
+    cout << "Serving on " << socketPath << " with " << workers
+        << " workers" << endl;
+    while (true)
+    {
+        client = accept(listener, nullptr, nullptr);
+        if (client == NO_SOCKET)
+        {
+            continue;
+        }
+
+        // as many clients may be sending requests as may wait in the
+        // queue; past that they are told the server is busy
+        {
+            lock_guard<mutex> lock(queueLock);
+            full = reading >= queueLimit;
+            if (!full)
+            {
+                reading++;
+            }
+        }
+        if (full)
+        {
+            sendLine(client, "BUSY");
+            closeSocket(client);
+            continue;
+        }
+        thread(takeRequest, client).detach();
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function sends a job to a server and outputs what the server
+ * reports. The server may have a different working directory, so the
+ * input, basename, --cache, --with and --trace paths are made absolute
+ * first. If the server is busy it waits and tries again, twice as long
+ * each time. With just --stats, it outputs how long the server's latest
+ * jobs took.
+ *
+ * @param[in] socketPath - the path of the socket the server listens on.
+ * @param[in] argc - the number of arguments, including the socket path.
+ * @param[in] argv - the socket path followed by the job's arguments.
+ *
+ * @returns the status of the job, or 1 if it could not be sent
+ *
+ * @par Example:
+   @verbatim
+   char* args[] = { "/tmp/thp.sock", "--sepia", "--binary", "out",
+       "image.ppm" };
+
+   runClient(args[0], 5, args);
+
+   out.ppm is now a sepia copy of image.ppm.
+   @endverbatim
+
+ ***********************************************************************/
+
+int runClient(string socketPath, int argc, char** argv)
+{
+    vector<string> args(argv + 1, argv + argc);
+    sockaddr_un address;
+    socketHandle server;
+    string pending;
+    string line;
+    int delay = 50; // milliseconds to wait after a BUSY
+    int tries = 0;
+    size_t i = 0;
+    error_code ec;
+
+    if (!socketAddress(socketPath, address) || !startSockets())
+    {
+        cout << "Unable to use socket: " + socketPath << endl;
+        return 1;
+    }
+#ifndef _WIN32
+    // a busy server may hang up before it has read the whole job, and
+    // then it has still sent BUSY to read
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    // the leading options come in pairs, but for --frames, and only
+    // --cache, --with and --trace are paths
+    while (i + 1 < args.size() && (args[i] == "--crop" ||
+        args[i] == "--tiled" || args[i] == "--cache" ||
+        args[i] == "--cache-size" || args[i] == "--isa" ||
+        args[i] == "--max-memory" || args[i] == "--with" ||
+        args[i] == "--numa" || args[i] == "--trace" ||
+        args[i] == "--frames"))
+    {
+        if (args[i] == "--frames")
+        {
+            i++;
+            continue;
+        }
+        if (args[i] == "--with" && args[i + 1] == "-")
+        {
+            cout << "--client can't use - for stdin or stdout" << endl;
+            return 1;
+        }
+        if (args[i] == "--cache" || args[i] == "--with" ||
+            args[i] == "--trace")
+        {
+            args[i + 1] = fs::absolute(args[i + 1], ec).string();
+        }
+        i += 2;
+    }
+    // then the basename and the input are the last two, which have to
+    // be files since the job runs in the server
+    if (args.size() >= i + 3)
+    {
+        if (args[args.size() - 2] == "-" || args[args.size() - 1] == "-")
+        {
+            cout << "--client can't use - for stdin or stdout" << endl;
+            return 1;
+        }
+        args[args.size() - 2] = fs::absolute(args[args.size() - 2],
+            ec).string();
+        args[args.size() - 1] = fs::absolute(args[args.size() - 1],
+            ec).string();
+    }
+
+    while (tries < BUSY_TRIES)
+    {
+        server = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server == NO_SOCKET ||
+            connect(server, (sockaddr*)&address, sizeof(address)) != 0)
+        {
+            cout << "Unable to connect to server: " + socketPath << endl;
+            if (server != NO_SOCKET)
+            {
+                closeSocket(server);
+            }
+            return 1;
+        }
+
+        // --stats alone asks how long the latest jobs took
+        if (args.size() == 1 && args[0] == "--stats")
+        {
+            sendLine(server, "STATS");
+        }
+        else
+        {
+            i = 0;
+            while (i < args.size())
+            {
+                sendLine(server, "ARG " + args[i]);
+                i++;
+            }
+            sendLine(server, "RUN");
+        }
+
+        pending.clear();
+        while (readLine(server, pending, line))
+        {
+            if (line == "BUSY")
+            {
+                break;
+            }
+            if (line.compare(0, 4, "LOG ") == 0)
+            {
+                cout << line.substr(4) << endl;
+            }
+            if (line.compare(0, 5, "DONE ") == 0)
+            {
+                closeSocket(server);
+                return atoi(line.c_str() + 5);
+            }
+        }
+        closeSocket(server);
+        if (line != "BUSY")
+        {
+            cout << "Lost connection to server: " + socketPath << endl;
+            return 1;
+        }
+
+        // back off and try again
+        this_thread::sleep_for(chrono::milliseconds(delay));
+        delay *= 2;
+        tries++;
+    }
+    cout << "Server is busy: " + socketPath << endl;
+    return 1;
+}
@@ -0,0 +1,281 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that make synthetic images of any size for testing
+ *          and benchmarking
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+/*!
+ * @brief PATTERN_NAMES the name of each synthPattern, in order
+ */
+
+static const char* const PATTERN_NAMES[] =
+{
+    "gradient",
+    "checker",
+    "bars",
+    "noise"
+};
+
+/*!
+ * @brief BAR_COLORS the red, green and blue of the eight bars, left to
+ * right
+ */
+
+static const pixel BAR_COLORS[8][3] =
+{
+    { 235, 235, 235 }, { 235, 235, 16 }, { 16, 235, 235 },
+    { 16, 235, 16 }, { 235, 16, 235 }, { 235, 16, 16 },
+    { 16, 16, 235 }, { 16, 16, 16 }
+};
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function finds the pattern with the given name.
+  *
+  * @param[in] name - gradient, checker, bars or noise.
+  * @param[out] pattern - the pattern.
+  *
+  * @returns true if there is a pattern by that name, false otherwise
+  *
+  * @par Example:
+    @verbatim
+    synthPattern pattern;
+
+    parsePattern("noise", pattern);
+
+    pattern is now SYNTH_NOISE.
+    @endverbatim
+
+  ***********************************************************************/
+
+bool parsePattern(string name, synthPattern& pattern)
+{
+    int i = 0;
+
+    while (i < (int)(sizeof(PATTERN_NAMES) / sizeof(PATTERN_NAMES[0])))
+    {
+        if (name == PATTERN_NAMES[i])
+        {
+            pattern = (synthPattern)i;
+            return true;
+        }
+        i++;
+    }
+    return false;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function gives the noise value of one color of one pixel. It only
+ * depends on the seed and where the value is, so every band and every
+ * machine gets the same values.
+ *
+ * @param[in] seed - picks which noise.
+ * @param[in] index - which value, counting every color of every pixel.
+ *
+ * @returns a value from 0 to 255
+ *
+ * @par Example:
+   @verbatim
+   pixel value = noiseValue(1, 0);
+   @endverbatim
+
+ ***********************************************************************/
+
+static pixel noiseValue(unsigned int seed, unsigned long long index)
+{
+    // splitmix64 of the seed and the index
+    unsigned long long z = index + ((unsigned long long)seed << 40) +
+        0x9e3779b97f4a7c15ULL;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (pixel)((z ^ (z >> 31)) >> 56);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function fills a band of rows of a synthetic image on all the
+ * threads. gradient runs red across, green down and blue along the
+ * diagonal, checker is 64 pixel squares of light and dark gray, bars are
+ * eight colored bars across, and noise is a random value in every color,
+ * picked by the seed. The band can be any rows of the image, and gets
+ * the same values it would as part of the whole image.
+ *
+ * @param[in,out] band - the band, with its rows and cols set.
+ * @param[in] first - the row of the image the band starts at.
+ * @param[in] rows - the rows of the whole image.
+ * @param[in] pattern - what to fill it with.
+ * @param[in] seed - picks which noise.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   netImage band(16, 640);
+
+   syntheticRows(band.get(), 32, 480, SYNTH_GRADIENT, 1);
+
+   band has rows 32 to 47 of a 640x480 gradient.
+   @endverbatim
+
+ ***********************************************************************/
+
+void syntheticRows(image& band, int first, int rows, synthPattern pattern,
+    unsigned int seed)
+{
+    int cols = band.cols;
+    int across = max(cols - 1, 1);
+    int down = max(rows - 1, 1);
+
+    parallelRows(band.rows, [&](int start, int end)
+    {
+        int r = start;
+        int c;
+        int y;
+        int bar;
+        unsigned long long index;
+
+        while (r < end)
+        {
+            y = first + r;
+            c = 0;
+            while (c < cols)
+            {
+                if (pattern == SYNTH_GRADIENT)
+                {
+                    band.redGray[r][c] = (pixel)(c * 255LL / across);
+                    band.green[r][c] = (pixel)(y * 255LL / down);
+                    band.blue[r][c] = (pixel)((c + (long long)y) * 255 /
+                        (across + down));
+                }
+                else if (pattern == SYNTH_CHECKER)
+                {
+                    band.redGray[r][c] = ((c / 64 + y / 64) & 1) ? 200 : 55;
+                    band.green[r][c] = band.redGray[r][c];
+                    band.blue[r][c] = band.redGray[r][c];
+                }
+                else if (pattern == SYNTH_BARS)
+                {
+                    bar = (int)(c * 8LL / cols);
+                    band.redGray[r][c] = BAR_COLORS[bar][0];
+                    band.green[r][c] = BAR_COLORS[bar][1];
+                    band.blue[r][c] = BAR_COLORS[bar][2];
+                }
+                else
+                {
+                    index = ((unsigned long long)y * cols + c) * 3;
+                    band.redGray[r][c] = noiseValue(seed, index);
+                    band.green[r][c] = noiseValue(seed, index + 1);
+                    band.blue[r][c] = noiseValue(seed, index + 2);
+                }
+                c++;
+            }
+            r++;
+        }
+    });
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes a synthetic image. P2, P3, P5 and P6 are made and
+ * written a band of rows at a time, so they can be far bigger than
+ * memory. P2 and P5 are the pattern in grayscale. qoif is made whole and
+ * then written. The comment names the pattern and seed, so the same
+ * image can be made again.
+ *
+ * @param[in] out - the output stream.
+ * @param[in] magicNumber - P2, P3, P5, P6 or qoif.
+ * @param[in] rows - the rows of the image.
+ * @param[in] cols - the columns of the image.
+ * @param[in] pattern - what to fill it with.
+ * @param[in] seed - picks which noise.
+ *
+ * @returns true if it was written, false if the magic number isn't one
+ *          of those
+ *
+ * @par Example:
+   @verbatim
+   writeSynthetic(out, "P6", 20000, 30000, SYNTH_NOISE, 7);
+
+   out now has a 600 megapixel image of noise.
+   @endverbatim
+
+ ***********************************************************************/
+
+bool writeSynthetic(ostream& out, string magicNumber, int rows, int cols,
+    synthPattern pattern, unsigned int seed)
+{
+    bool gray = magicNumber == "P2" || magicNumber == "P5";
+    bool ascii = magicNumber == "P2" || magicNumber == "P3";
+    long long bandRows;
+    int maxValue = 255;
+    int done = 0;
+
+    if (magicNumber == "qoif")
+    {
+        netImage whole(rows, cols);
+        image& im = whole.get();
+
+        syntheticRows(im, 0, rows, pattern, seed);
+        im.magicNumber = magicNumber;
+        writeQoi(out, im, maxValue);
+        return true;
+    }
+    if (!gray && !ascii && magicNumber != "P6")
+    {
+        return false;
+    }
+
+    // 16 MB of rows at a time
+    bandRows = min((16LL << 20) / ((long long)cols * 3) + 1,
+        (long long)rows);
+    netImage band((int)bandRows, cols);
+    image& im = band.get();
+
+    out << magicNumber << endl;
+    out << "# synthetic " << PATTERN_NAMES[pattern] << " " << seed << endl;
+    out << cols << " " << rows << endl;
+    out << maxValue << endl;
+    while (done < rows && out)
+    {
+        im.rows = (int)min(bandRows, (long long)rows - done);
+        syntheticRows(im, done, rows, pattern, seed);
+        if (gray)
+        {
+            grayscale(im);
+        }
+        if (ascii)
+        {
+            writeAsciiRows(out, im.redGray, gray ? nullptr : im.green,
+                gray ? nullptr : im.blue, im.rows, im.cols);
+        }
+        else
+        {
+            writeBinaryRows(out, im.redGray, gray ? nullptr : im.green,
+                gray ? nullptr : im.blue, im.rows, im.cols);
+        }
+        done += im.rows;
+    }
+    im.rows = (int)bandRows;
+    return true;
+}
@@ -42,13 +42,123 @@
    @verbatim
    c:\> thpExam1.exe --outputtype basename image.ppm
    c:\> thpExam1.exe [option] --outputtype basename image.ppm
+   c:\> thpExam1.exe --crop x,y,w,h [option] --outputtype basename image.ppm
+   c:\> thpExam1.exe --tiled MB [option] --outputtype basename image.ppm
+   c:\> thpExam1.exe --cache dir [--cache-size MB] [option] --outputtype
+                     basename image.ppm
+   c:\> thpExam1.exe --isa name [option] --outputtype basename image.ppm
+   c:\> thpExam1.exe --frames [option] --outputtype basename image.ppm
+   c:\> thpExam1.exe --max-memory MB [option] --outputtype basename
+                     image.ppm
+   c:\> thpExam1.exe --numa placement [option] --outputtype basename
+                     image.ppm
+   c:\> thpExam1.exe --trace trace.json [option] --outputtype basename
+                     image.ppm
+   c:\> thpExam1.exe --with second.ppm --blend=mode --outputtype basename
+                     image.ppm
+   c:\> thpExam1.exe --with second.ppm --compare[=first] --outputtype
+                     basename image.ppm
+   c:\> thpExam1.exe [--isa name] [--numa placement] --serve socket
+                     [workers] [queue]
+   c:\> thpExam1.exe --client socket [any of the arguments above]
+   c:\> thpExam1.exe --client socket --stats
    d:\> c:\bin\thpExam1.exe --outputtype basename image.ppm
    d:\> c:\bin\thpExam1.exe [option] --outputtype basename image.ppm
 
-        --outputtype - type of data to output, either binary or ascii
-        basename - name of output file
-        image.ppm - name of input file
+        --outputtype - type of data to output, either binary, ascii
+                       or qoi (written to basename.qoi)
+        basename - name of output file, or - to write to stdout
+        image.ppm - name of input file, a P3 or P6 ppm or a qoi file,
+                    or - to read from stdin
+        x,y,w,h - rectangle of the input to use, with x,y the top left
+                  corner (only that part of a binary input is read)
+        MB - process out of core in a tiled scratch file, mapping at
+             most MB megabytes of it at a time (flips, rotateCW,
+             rotateCCW, grayscale and sepia only)
+        dir - keep finished outputs in dir, keyed by a hash of the
+              input and the options, and copy them out when the same
+              job comes in again. The least recently used are removed
+              past --cache-size MB (1024 by default). dir/stats.txt
+              counts the hits, misses and evictions.
+        name - the instruction set for the row kernels: auto (the
+               best this cpu has, the default), scalar, sse2, sse4.2,
+               avx2 or avx512. The output is the same with any of them.
+               A server's is given when it starts and is used for all
+               of its jobs, which can't pick their own.
+        --frames - do every image in the input, one after the other,
+                   and write them all out one after the other. The
+                   next image is read and the last one written while
+                   this one is changed, and the frames per second are
+                   output at the end.
+        --max-memory MB - keep the job under MB megabytes. It runs
+                   in memory if it fits there, a band of rows at a time
+                   with no option, --flipY, --grayscale, --sepia,
+                   --threshold, --dither, a color option or --median=,
+                   or tiled with the other flips and rotates, and is turned
+                   away if none of them fit. What was picked and the
+                   peak memory of the program are output.
+        placement - where the pages of big arrays go on a machine with
+                    more than one NUMA node: local (the default), each
+                    part of the rows on the node of the threads that
+                    work on it, interleave, spread over all the nodes,
+                    or off. The threads are kept on their nodes unless
+                    it is off. How many tiles of rows ran on their own
+                    node and how many on another are output. Like
+                    --isa, a server's is given when it starts.
+        trace.json - where to write a timeline of the job, with what
+                     every thread was doing when: reading, changing
+                     and writing each image or band of rows, and each
+                     tile of rows the threads split the work into. It
+                     is in Chrome's trace-event format, for
+                     chrome://tracing or ui.perfetto.dev.
+        second.ppm - the image --blend= puts together with image.ppm, or
+                     --compare compares it with, a P3 or P6 ppm the same
+                     size, or - to read from stdin. Both are read a band
+                     of rows at a time, side by side.
+        socket - the local socket a server listens on. The server
+                 keeps its threads and buffers between jobs, runs
+                 workers jobs at once (2 by default) and turns clients
+                 away once queue jobs are waiting (64 by default). The
+                 client runs the job on the server and outputs what
+                 the server reports. --stats instead outputs the jobs
+                 done and the median, p90, p99 and longest time the
+                 latest jobs took, from being sent to being done.
         [option] - type of manipulation on image
+                   --flipX, --flipY, --rotateCW, --rotateCCW,
+                   --grayscale, --sepia, --autolevels, --equalize,
+                   --toYCbCr[=601|709] and --fromYCbCr[=601|709]
+                     (full range, BT.601 by default), --toHSV,
+                     --fromHSV, --toHSL and --fromHSL, which put the
+                     other color space in the red, green and blue of
+                     a ppm, the hue as 0 to 255 for a whole turn,
+                   --hue=degrees, --saturation=amount and
+                     --value=amount (amount from 0 to 16, 1 keeps it),
+                   --median=radius (the median of the square of
+                     2 * radius + 1 pixels on a side around each pixel,
+                     radius from 1 to 127),
+                   --threshold[=level] (black below level, 128 by
+                     default), --dither[=floyd|bayer] (Floyd-Steinberg
+                     by default), both written as a black and white
+                     pbm, P4 for binary and P1 for ascii,
+                   --blend=mode with --with, where mode is
+                     alpha[,amount] (amount of second.ppm from 0 to 1,
+                     0.5 by default), add, subtract, multiply, screen or
+                     difference,
+                   --histogram (writes basename.json instead),
+                   --compare with --with (writes basename.json instead,
+                     with the pixels that differ, the biggest difference,
+                     and the mse, psnr and ssim of each color; =first
+                     stops at the first difference; the status is 1 if
+                     the images differ),
+                   --pyramid (writes every halving of the image down to
+                     1x1, basename_1.ppm at half size, basename_2.ppm at
+                     a quarter and so on, in one pass over the input),
+                   --resize=WxH[,filter] where filter is box, bilinear,
+                     bicubic or lanczos3 and a W or H of 0 keeps the
+                     aspect ratio, or
+                   --rotate=angle[,sampling][,R:G:B] where angle is
+                     degrees clockwise, sampling is nearest or bilinear
+                     and R:G:B is the background color
    @endverbatim
  *
  * @section todo_bugs_modification_section Todo, Bugs, and Modifications
@@ -83,6 +193,47 @@
                  and binary.
    Mar  7, 2022  Finished commenting my functions.
    Mar  7, 2022  Finished doxygen.
+   Oct 19, 2026  Added --resize with box, bilinear, bicubic and lanczos3
+                 filters. Binary input is resized while it is read.
+   Oct 19, 2026  Added --rotate for rotating by any angle.
+   Oct 19, 2026  Added --crop. Binary input only reads the cropped rows.
+   Oct 19, 2026  Added --tiled for images that don't fit in memory.
+   Oct 19, 2026  Added --histogram, --autolevels and --equalize.
+   Oct 19, 2026  Added --cache to reuse the outputs of repeated jobs.
+   Oct 19, 2026  Moved the job into runJob and added --serve and --client
+                 so jobs can run in a server that stays running.
+   Oct 19, 2026  Moved everything but main into the netPBMLib library
+                 and added the netImage class, which frees its own
+                 arrays and reads and writes images in memory.
+   Oct 19, 2026  Added row kernels for several instruction sets, picked
+                 with cpuid when the program starts or with --isa, and
+                 replaced the if/else chain of options with tables.
+   Oct 19, 2026  Added reading and writing qoi files.
+   Oct 19, 2026  Added - for reading from stdin and writing to stdout.
+   Oct 19, 2026  Added --frames for files and streams of several images.
+   Oct 19, 2026  Ascii input is parsed in chunks on all the threads.
+   Oct 19, 2026  Ascii output is turned into text on all the threads.
+   Oct 19, 2026  Added --max-memory, which picks how a job runs from the
+                 size of the image. Rotating frees each old array as
+                 soon as it is turned.
+   Oct 19, 2026  Added --threshold and --dither, written as P4 or P1.
+   Oct 19, 2026  Added --with and --blend= for putting two images
+                 together.
+   Oct 19, 2026  Added --compare for the differences, psnr and ssim of
+                 two images.
+   Oct 19, 2026  Added --pyramid, which makes every level of a mipmap in
+                 one pass.
+   Oct 19, 2026  Big arrays are placed on the NUMA nodes of the threads
+                 that work on them, and added --numa.
+   Oct 19, 2026  Threads steal tiles of rows from each other, so big and
+                 small jobs in a server share all the threads. Added
+                 --client socket --stats for the latency of the jobs.
+   Oct 19, 2026  Added --trace for a timeline of what each thread does.
+   Oct 19, 2026  Added imageGen, which makes synthetic images of any size,
+                 and imageBench, which times every job end to end.
+   Oct 19, 2026  Added YCbCr, hsv and hsl conversions and --hue=,
+                 --saturation= and --value=.
+   Oct 19, 2026  Added --median= for taking out salt and pepper noise.
    @endverbatim
 
    Gitlab commit log, <a href = "https://gitlab.cse.sdsmt.edu/
@@ -99,15 +250,13 @@
   * @author David Hill
   *
   * @par Description:
-  * This is the starting point to the program. It will check command line
-  * arguments to see if the input was put in correctly. If there is an
-  * incorrect number of command line arguments, or they were not put in
-  * correctly, an error message will print and the program will exit. 
-  * Otherwise, it will read in what output type, files, and manipulation,
-  * if one exists, and start reading in the file. It will dynamically
-  * allocate 3 2d arrays for the RGB values of the image, perform a
-  * manipulation if there exists one, and then write out the data to the
-  * output file in the format of the output type.
+  * This is the starting point to the program. With --serve it stays
+  * running and takes jobs over a local socket. With --client it sends
+  * its job to a running server. Otherwise it runs the job itself: it
+  * will check command line arguments to see if the input was put in
+  * correctly, and if so read in the image, perform a manipulation if
+  * there exists one, and write out the data to the output file in the
+  * format of the output type.
   *
   *
   * @param[in] argc - the number of arguments from the command prompt.
@@ -123,332 +272,60 @@
 
 int main(int argc, char** argv)
 {
-    string outputType;
-    string optionCode; // only exists if there are 5 arguments
-    string outputName; // name of output file
-    image im;
-    int maxValue = 0; // will always be 255 for this assignment
-    ifstream in;
-    ofstream out;
+    int workers = 2;   // jobs run at once by --serve
+    int queueLimit = 64; // jobs waiting before --serve says it is busy
+    int start = 1;     // where --serve is, after the server's own options
+    int i = 1;
+    bool good = true;
+    string chosen;
 
-    // output error message for invalid # of arguments
-    if (argc != 4 && argc != 5)
+    // --isa and --numa in front of --serve are for every job the server
+    // runs
+    while (start + 2 < argc && ((string)argv[start] == "--isa" ||
+        (string)argv[start] == "--numa"))
     {
-        cout << "Usage: thpExam1.exe --outputtype basename image.ppm"
-            << endl
-            << "or:    thpExam1.exe [option] "
-            << "--outputtype basename image.ppm"
-            << endl;
-        exit(0);
+        start += 2;
     }
-    if (argc == 4)
+    if (argc >= start + 2 && (string)argv[start] == "--serve")
     {
-        // extension will be ppm since grayscale cannot be used here
-        outputName = (string)argv[2] + ".ppm";
-        outputType = argv[1];
-
-        // output error message for invalid outputType
-        if (outputType != "--ascii" && outputType != "--binary")
-        {
-            cout << "Usage: thpExam1.exe "
-                << "--outputtype basename image.ppm"
-                << endl;
-            exit(0);
-        }
-
-        // check if files open correctly
-        if (!openInput(in, argv[3]))
-        {
-            in.close();
-            exit(0);
-        }
-        if (!openOutput(out, outputName))
-        {
-            out.close();
-            exit(0);
-        }
-    }
-    if (argc == 5)
-    {
-        optionCode = argv[1];
-        outputType = argv[2];
-
-        // output error message for incorrect optionCode
-        if (optionCode != "--flipX" && optionCode != "--flipY" &&
-            optionCode != "--rotateCW" && optionCode != "--rotateCCW"
-            && optionCode != "--grayscale" && optionCode != "--sepia")
-        {
-            cout << "Usage: thpExam1.exe [option] "
-                << "--outputtype basename "
-                << "image.ppm" << endl;
-            exit(0);
-        }
-
-        // output error message for incorrect outputType
-        if (outputType != "--ascii" && outputType != "--binary")
-        {
-            cout << "Usage: thpExam1.exe [option] "
-                << "--outputtype basename "
-                << "image.ppm" << endl;
-            exit(0);
-        }
-
-        // change extension name to pgm for grayscale; 
-        // otherwise, use ppm
-        if (optionCode == "--grayscale")
-        {
-            outputName = (string)argv[3] + ".pgm";
-        }
-        else
-        {
-            outputName = (string)argv[3] + ".ppm";
-        }
-
-        // check if files open correctly
-        if (!openInput(in, argv[4]))
+        if (argc >= start + 3)
         {
-            in.close();
-            exit(0);
+            workers = atoi(argv[start + 2]);
         }
-        if (!openOutput(out, outputName))
+        if (argc >= start + 4)
         {
-            out.close();
-            exit(0);
+            queueLimit = atoi(argv[start + 3]);
         }
-    }
-
-    // read in magic number
-    in >> im.magicNumber;
-    
-    // for input, we can only have ppm files, not grayscale ones
-    // if magic number doesn't match the two we can have,
-    // output error message and close files
-    if (im.magicNumber != "P3" && im.magicNumber != "P6")
-    {
-        cout << "Invalid magic number" << endl;
-        in.close();
-        out.close();
-        exit(0);
-    }
-    
-    // read in either ascii or binary data based on what the magic number is
-    // change magic number accordingly based on what the outputType is,
-    // perform an operation based on what optionCode is,
-    // and write out either ascii or binary data based on what outputType is
-    if (im.magicNumber == "P3")
-    {
-        if (outputType == "--ascii")
+        while (i < start && good)
         {
-            
-            if (optionCode == "--grayscale")
-            {
-                im.magicNumber = "P2";
-                readAscii(in, im, maxValue);
-                grayscale(im);
-                writeGrayscaleAscii(out, im, maxValue);
-            }
-            else if (optionCode == "--sepia")
-            {
-                im.magicNumber = "P3";
-                readAscii(in, im, maxValue);
-                sepia(im);
-                writeAscii(out, im, maxValue);
-            }
-            else if (optionCode == "--flipX")
-            {
-                im.magicNumber = "P3";
-                readAscii(in, im, maxValue);
-                flipX(im);
-                writeAscii(out, im, maxValue);
-            }
-            else if (optionCode == "--flipY")
+            good = (string)argv[i] == "--isa" ?
+                selectKernels(argv[i + 1], chosen) :
+                setNumaPlacement(argv[i + 1], chosen);
+            if (good)
             {
-                im.magicNumber = "P3";
-                readAscii(in, im, maxValue);
-                flipY(im);
-                writeAscii(out, im, maxValue);
-            }
-            else if (optionCode == "--rotateCW")
-            {
-                im.magicNumber = "P3";
-                readAscii(in, im, maxValue);
-                rotateCW(im);
-                writeAscii(out, im, maxValue);
-            }
-            else if (optionCode == "--rotateCCW")
-            {
-                im.magicNumber = "P3";
-                readAscii(in, im, maxValue);
-                rotateCCW(im);
-                writeAscii(out, im, maxValue);
-            }
-            else 
-            {
-                readAscii(in, im, maxValue);
-                writeAscii(out, im, maxValue);
+                cout << "Using " << chosen << endl;
             }
+            i += 2;
         }
-        else if (outputType == "--binary")
+        if (!good || workers < 1 || queueLimit < 1 || argc > start + 4)
         {
-            if (optionCode == "--grayscale")
-            {
-                im.magicNumber = "P5";
-                readAscii(in, im, maxValue);
-                grayscale(im);
-                writeGrayscaleBinary(out, im, maxValue);
-            }
-            else if (optionCode == "--sepia")
-            {
-                im.magicNumber = "P6";
-                readAscii(in, im, maxValue);
-                sepia(im);
-                writeBinary(out, im, maxValue);
-            }
-            else if (optionCode == "--flipX")
-            {
-                im.magicNumber = "P6";
-                readAscii(in, im, maxValue);
-                flipX(im);
-                writeBinary(out, im, maxValue);
-            }
-            else if (optionCode == "--flipY")
-            {
-                im.magicNumber = "P6";
-                readAscii(in, im, maxValue);
-                flipY(im);
-                writeBinary(out, im, maxValue);
-            }
-            else if (optionCode == "--rotateCW")
-            {
-                im.magicNumber = "P6";
-                readAscii(in, im, maxValue);
-                rotateCW(im);
-                writeBinary(out, im, maxValue);
-            }
-            else if (optionCode == "--rotateCCW")
-            {
-                im.magicNumber = "P6";
-                readAscii(in, im, maxValue);
-                rotateCCW(im);
-                writeBinary(out, im, maxValue);
-            }
-            else
-            {
-                im.magicNumber = "P6";
-                readAscii(in, im, maxValue);
-                writeBinary(out, im, maxValue);
-            }
+            cout << "Usage: thpExam1.exe [--isa name] [--numa placement] "
+                << "--serve socket" << endl;
+            cout << "                    [workers] [queue]" << endl;
+            return 1;
         }
+        return serve(argv[start + 1], workers, queueLimit);
     }
-    else if (im.magicNumber == "P6")
+    if (argc >= 3 && (string)argv[1] == "--client")
     {
-        if (outputType == "--ascii")
-        {
-            if (optionCode == "--grayscale")
-            {
-                im.magicNumber = "P2";
-                readBinary(in, im, maxValue);
-                grayscale(im);
-                writeGrayscaleAscii(out, im, maxValue);
-            }
-            else if (optionCode == "--sepia")
-            {
-                im.magicNumber = "P3";
-                readBinary(in, im, maxValue);
-                sepia(im);
-                writeAscii(out, im, maxValue);
-            }
-            else if (optionCode == "--flipX")
-            {
-                im.magicNumber = "P3";
-                readBinary(in, im, maxValue);
-                flipX(im);
-                writeAscii(out, im, maxValue);
-            }
-            else if (optionCode == "--flipY")
-            {
-                im.magicNumber = "P3";
-                readBinary(in, im, maxValue);
-                flipY(im);
-                writeAscii(out, im, maxValue);
-            }
-            else if (optionCode == "--rotateCW")
-            {
-                im.magicNumber = "P3";
-                readBinary(in, im, maxValue);
-                rotateCW(im);
-                writeAscii(out, im, maxValue);
-            }
-            else if (optionCode == "--rotateCCW")
-            {
-                im.magicNumber = "P3";
-                readBinary(in, im, maxValue);
-                rotateCCW(im);
-                writeAscii(out, im, maxValue);
-            }
-            else
-            {
-                im.magicNumber = "P3";
-                readBinary(in, im, maxValue);
-                writeAscii(out, im, maxValue);
-            }
-        }
-        else if (outputType == "--binary")
-        {
-            if (optionCode == "--grayscale")
-            {
-                im.magicNumber = "P5";
-                readBinary(in, im, maxValue);
-                grayscale(im);
-                writeGrayscaleBinary(out, im, maxValue);
-            }
-            else if (optionCode == "--sepia")
-            {
-                im.magicNumber = "P6";
-                readBinary(in, im, maxValue);
-                sepia(im);
-                writeBinary(out, im, maxValue);
-            }
-            else if (optionCode == "--flipX")
-            {
-                im.magicNumber = "P6";
-                readBinary(in, im, maxValue);
-                flipX(im);
-                writeBinary(out, im, maxValue);
-            }
-            else if (optionCode == "--flipY")
-            {
-                im.magicNumber = "P6";
-                readBinary(in, im, maxValue);
-                flipY(im);
-                writeBinary(out, im, maxValue);
-            }
-            else if (optionCode == "--rotateCW")
-            {
-                im.magicNumber = "P6";
-                readBinary(in, im, maxValue);
-                rotateCW(im);
-                writeBinary(out, im, maxValue);
-            }
-            else if (optionCode == "--rotateCCW")
-            {
-                im.magicNumber = "P6";
-                readBinary(in, im, maxValue);
-                rotateCCW(im);
-                writeBinary(out, im, maxValue);
-            }
-            else
-            {
-                readBinary(in, im, maxValue);
-                writeBinary(out, im, maxValue);
-            }
-        }
+        return runClient(argv[2], argc - 2, argv + 2);
+    }
+
+    // with - for the basename the image goes to stdout, so anything the
+    // job has to say goes to stderr instead
+    if (argc >= 4 && (string)argv[argc - 2] == "-")
+    {
+        return runJob(argc, argv, cerr);
     }
-    
-    // free up arrays and close files
-    freeUpArray(im.redGray, im.rows);
-    freeUpArray(im.green, im.rows);
-    freeUpArray(im.blue, im.rows);
-    in.close();
-    out.close();
-}
\ No newline at end of file
+    return runJob(argc, argv, cout);
+}
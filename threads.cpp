@@ -0,0 +1,694 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that split image work across threads
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+/*!
+ * @brief TILES_PER_THREAD how many tiles parallelRows cuts the rows into
+ * for each thread, so a thread that finishes early has some to steal
+ */
+
+const int TILES_PER_THREAD = 4;
+
+/*!
+ * @brief DEQUE_SIZE the most tiles one thread's deque holds, more are
+ * run right away by the thread that made them
+ */
+
+const int DEQUE_SIZE = 1024;
+
+/*!
+ * @brief MAX_DEQUES the most threads with a deque at once, the threads
+ * past that run their own tiles
+ */
+
+const int MAX_DEQUES = 256;
+
+/*!
+ * @brief parallelCall one call to parallelRows, shared by its tiles
+ */
+
+struct parallelCall
+{
+    /*!
+    * @brief the function to call for each tile
+    */
+    const function<void(int, int)>* work;
+
+    /*!
+    * @brief the tiles not finished yet, guarded by doneLock
+    */
+    int left;
+
+    /*!
+    * @brief guards left
+    */
+    mutex doneLock;
+
+    /*!
+    * @brief wakes the calling thread when the last tile is finished
+    */
+    condition_variable doneWake;
+};
+
+/*!
+ * @brief tileTask a band of rows of one call to parallelRows
+ */
+
+struct tileTask
+{
+    /*!
+    * @brief the call the tile is part of
+    */
+    parallelCall* call;
+
+    /*!
+    * @brief the first row of the tile
+    */
+    int start;
+
+    /*!
+    * @brief one past the last row of the tile
+    */
+    int end;
+
+    /*!
+    * @brief the NUMA node the rows of the tile are placed on
+    */
+    int home;
+};
+
+/*!
+ * @brief tileDeque the tiles one thread has made and not run yet. Only
+ * that thread adds and takes tiles at the bottom, and any thread can
+ * steal from the top, all without a lock.
+ */
+
+struct tileDeque
+{
+    /*!
+    * @brief the next tile to steal
+    */
+    atomic<long long> top{ 0 };
+
+    /*!
+    * @brief one past the last tile added
+    */
+    atomic<long long> bottom{ 0 };
+
+    /*!
+    * @brief the tiles, by position mod DEQUE_SIZE
+    */
+    atomic<tileTask*> ring[DEQUE_SIZE];
+
+    /*!
+    * @brief the home of each tile, read before it is stolen
+    */
+    atomic<int> homes[DEQUE_SIZE];
+
+    /*!
+    * @brief the node of the thread that owns it, or -1 if it isn't pinned
+    */
+    atomic<int> node{ -1 };
+
+    /*!
+    * @brief true while a thread owns it, false once it can be reused
+    */
+    atomic<bool> inUse{ true };
+};
+
+/*!
+ * @brief dequeOwner the calling thread's deque, given back when the
+ * thread ends so another thread can use it
+ */
+
+struct dequeOwner
+{
+    /*!
+    * @brief the deque, or null until the thread first needs one
+    */
+    tileDeque* deque = nullptr;
+
+    /*!
+    * @brief gives the deque back
+    */
+    ~dequeOwner()
+    {
+        if (deque != nullptr)
+        {
+            deque->inUse = false;
+        }
+    }
+};
+
+/*!
+ * @brief deques every deque a thread has had, never destroyed since
+ * the pool's threads keep stealing from them until the program exits
+ */
+
+static tileDeque* deques[MAX_DEQUES];
+
+/*!
+ * @brief dequeCount how many of deques are made
+ */
+
+static atomic<int> dequeCount(0);
+
+/*!
+ * @brief owner the calling thread's deque
+ */
+
+static thread_local dequeOwner owner;
+
+/*!
+ * @brief waitingTiles the tiles in the deques, which the pool's threads
+ * sleep until there are some of
+ */
+
+static atomic<long long> waitingTiles(0);
+
+/*!
+ * @brief workPool what the pool's threads sleep on and what guards
+ * making deques
+ */
+
+struct workPool
+{
+    /*!
+    * @brief guards making and reusing deques
+    */
+    mutex dequeLock;
+
+    /*!
+    * @brief guards the pool's threads going to sleep
+    */
+    mutex sleepLock;
+
+    /*!
+    * @brief wakes the pool's threads when tiles are added
+    */
+    condition_variable wake;
+};
+
+/*!
+ * @brief pool the pool, made when it is first needed and never destroyed
+ * since its threads are still waiting on it when the program exits
+ */
+
+static workPool* pool = nullptr;
+
+/*!
+ * @brief poolStart starts the pool's threads exactly once
+ */
+
+static once_flag poolStart;
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function returns how many worker threads the operations should
+  * use. It is the number of hardware threads, or 1 if that is unknown.
+  *
+  * @returns the number of threads to use.
+  *
+  * @par Example:
+    @verbatim
+    int n = threadCount();
+
+    n is now 8 on a machine with 8 hardware threads.
+    @endverbatim
+
+  ***********************************************************************/
+
+int threadCount()
+{
+    unsigned int n = thread::hardware_concurrency();
+
+    // hardware_concurrency is allowed to return 0 when it can't tell
+    if (n == 0)
+    {
+        return 1;
+    }
+    return (int)n;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function gives the calling thread its deque, the first time
+ * reusing one a finished thread gave back or making a new one. Past
+ * MAX_DEQUES threads at once there is none, and the thread has to run
+ * its own tiles.
+ *
+ * @param[in] node - the node the thread is pinned to, or -1.
+ *
+ * @returns the deque, or null if there are none left
+ *
+ * @par Example:
+   @verbatim
+   tileDeque* mine = ownDeque(-1);
+   @endverbatim
+
+ ***********************************************************************/
+
+static tileDeque* ownDeque(int node)
+{
+    int count;
+    int i = 0;
+    bool free;
+
+    if (owner.deque != nullptr)
+    {
+        return owner.deque;
+    }
+    lock_guard<mutex> lock(pool->dequeLock);
+    count = dequeCount;
+    while (i < count)
+    {
+        free = false;
+        if (deques[i]->inUse.compare_exchange_strong(free, true))
+        {
+            owner.deque = deques[i];
+            owner.deque->node = node;
+            return owner.deque;
+        }
+        i++;
+    }
+    if (count < MAX_DEQUES)
+    {
+        owner.deque = new tileDeque;
+        owner.deque->node = node;
+        deques[count] = owner.deque;
+        dequeCount = count + 1;
+    }
+    return owner.deque;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function adds a tile to the bottom of the calling thread's own
+ * deque.
+ *
+ * @param[in] d - the calling thread's deque.
+ * @param[in] task - the tile.
+ *
+ * @returns true if it was added, false if the deque is full
+ *
+ * @par Example:
+   @verbatim
+   pushTile(ownDeque(-1), &tiles[0]);
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool pushTile(tileDeque* d, tileTask* task)
+{
+    long long b = d->bottom;
+    long long t = d->top;
+
+    if (b - t >= DEQUE_SIZE)
+    {
+        return false;
+    }
+    d->ring[b % DEQUE_SIZE] = task;
+    d->homes[b % DEQUE_SIZE] = task->home;
+    d->bottom = b + 1;
+    return true;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function takes the tile at the bottom of the calling thread's
+ * own deque, the one it added last. When only one is left, it races any
+ * thread stealing it for the top, and only one of them gets it.
+ *
+ * @param[in] d - the calling thread's deque.
+ * @param[out] task - the tile taken.
+ *
+ * @returns true if it took a tile, false if the deque is empty
+ *
+ * @par Example:
+   @verbatim
+   tileTask* task;
+
+   if (popTile(ownDeque(-1), task))
+   {
+       the tile added last is now in task.
+   }
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool popTile(tileDeque* d, tileTask*& task)
+{
+    long long b = d->bottom - 1;
+    long long t;
+    bool won = true;
+
+    // claim the bottom first, so a thief sees it is gone
+    d->bottom = b;
+    t = d->top;
+    if (t > b)
+    {
+        d->bottom = b + 1;
+        return false;
+    }
+    task = d->ring[b % DEQUE_SIZE];
+    if (t == b)
+    {
+        won = d->top.compare_exchange_strong(t, t + 1);
+        d->bottom = b + 1;
+    }
+    return won;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function steals the tile at the top of another thread's deque,
+ * the one added first. Unless any home will do, it only steals a tile
+ * whose rows are on the node of the thread stealing it.
+ *
+ * @param[in] d - the deque to steal from.
+ * @param[in] node - the node of the thread stealing.
+ * @param[in] anyHome - true to steal a tile from any node.
+ * @param[out] task - the tile stolen.
+ *
+ * @returns true if it stole a tile, false if there was none or another
+ *          thread got it first
+ *
+ * @par Example:
+   @verbatim
+   tileTask* task;
+
+   stealTile(deques[0], 0, true, task);
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool stealTile(tileDeque* d, int node, bool anyHome,
+    tileTask*& task)
+{
+    long long t = d->top;
+    long long b = d->bottom;
+
+    if (t >= b)
+    {
+        return false;
+    }
+    if (!anyHome && d->homes[t % DEQUE_SIZE] != node)
+    {
+        return false;
+    }
+    task = d->ring[t % DEQUE_SIZE];
+    return d->top.compare_exchange_strong(t, t + 1);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function finds the next tile for a thread to run: the last one
+ * it added itself, or else one stolen from another thread, first one
+ * whose rows are on the thread's node and then any.
+ *
+ * @param[in] mine - the thread's deque, or null.
+ * @param[in] node - the thread's node.
+ * @param[out] task - the tile found.
+ *
+ * @returns true if it found a tile, false if there are none to take
+ *
+ * @par Example:
+   @verbatim
+   tileTask* task;
+
+   if (findTile(ownDeque(-1), currentNode(), task))
+   {
+       runTile(task);
+   }
+   @endverbatim
+
+ ***********************************************************************/
+
+static bool findTile(tileDeque* mine, int node, tileTask*& task)
+{
+    int count = dequeCount;
+    int pass = 0;
+    int i;
+
+    if (mine != nullptr && popTile(mine, task))
+    {
+        waitingTiles--;
+        return true;
+    }
+    while (pass < 2)
+    {
+        i = 0;
+        while (i < count)
+        {
+            if (deques[i] != mine &&
+                stealTile(deques[i], node, pass == 1, task))
+            {
+                waitingTiles--;
+                return true;
+            }
+            i++;
+        }
+        pass++;
+    }
+    return false;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function runs a tile and, if it was the last one of its call,
+ * wakes the thread waiting for the call. With --trace the tile is a
+ * span on the thread that ran it.
+ *
+ * @param[in] task - the tile.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   runTile(task);
+   @endverbatim
+
+ ***********************************************************************/
+
+static void runTile(tileTask* task)
+{
+    parallelCall* call = task->call;
+
+    countBand(task->home);
+    {
+        traceSpan span("tile", task->start, task->end);
+        (*call->work)(task->start, task->end);
+    }
+    lock_guard<mutex> done(call->doneLock);
+    call->left--;
+    if (call->left == 0)
+    {
+        call->doneWake.notify_all();
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function is what every pool thread runs. It keeps itself on the
+ * cpus of its node, then runs tiles, stealing them from the threads
+ * that made them, and sleeps while there are none, for as long as the
+ * program runs.
+ *
+ * @param[in] node - the NUMA node the thread works for.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   thread(poolWorker, 0).detach();
+   @endverbatim
+
+ ***********************************************************************/
+
+static void poolWorker(int node)
+{
+    tileDeque* mine;
+    tileTask* task;
+
+    pinToNode(node);
+    traceThread("pool");
+    mine = ownDeque(node);
+    while (true)
+    {
+        if (findTile(mine, node, task))
+        {
+            runTile(task);
+            continue;
+        }
+        unique_lock<mutex> lock(pool->sleepLock);
+        pool->wake.wait(lock, [] { return waitingTiles > 0; });
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function splits the rows 0 to rows - 1 into tiles, a few per
+ * thread, and calls work(start, end) for each tile. The tiles go on the
+ * calling thread's own deque, which it runs from the bottom while the
+ * pool's threads, started the first time and then kept, steal from the
+ * top. A thread with nothing to do steals from any thread that has
+ * tiles waiting, so a big job's tiles spread over every thread that
+ * isn't busy, even while other jobs are running in a server. On a
+ * machine with more than one NUMA node, each tile's home is the node
+ * placeArray put its rows on, and a thread steals tiles from its own
+ * node first. The calling thread runs waiting tiles, its own first,
+ * until every one of its tiles is finished. Small jobs run on the
+ * calling thread.
+ *
+ * @param[in] rows - the number of rows to split up.
+ * @param[in] work - the function to call for each tile of rows.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   image im;
+
+   parallelRows(im.rows, [&](int start, int end)
+   {
+       // process rows start to end - 1 of im
+   });
+   @endverbatim
+
+ ***********************************************************************/
+
+void parallelRows(int rows, const function<void(int, int)>& work)
+{
+    int n = threadCount();
+    int nodes = numaNodes();
+    int tiles = n * TILES_PER_THREAD;
+    int pushed = 0;
+    int node;
+    int i = 0;
+    tileDeque* mine;
+    tileTask* task;
+    parallelCall call;
+
+    if (tiles > rows)
+    {
+        tiles = rows;
+    }
+    if (n <= 1 || tiles <= 1)
+    {
+        if (rows > 0)
+        {
+            work(0, rows);
+        }
+        return;
+    }
+
+    // the pool's threads are spread over the nodes in order
+    call_once(poolStart, []
+    {
+        int t = 1;
+
+        pool = new workPool;
+        while (t < threadCount())
+        {
+            thread(poolWorker, t * numaNodes() / threadCount()).detach();
+            t++;
+        }
+    });
+
+    vector<tileTask> tasks(tiles);
+    call.work = &work;
+    call.left = tiles;
+    mine = ownDeque(-1);
+    while (i < tiles)
+    {
+        tasks[i].call = &call;
+        tasks[i].start = (int)((long long)rows * i / tiles);
+        tasks[i].end = (int)((long long)rows * (i + 1) / tiles);
+        tasks[i].home = (int)((long long)tasks[i].start * nodes / rows);
+
+        // with no room for it, the tile is run now
+        if (mine != nullptr && pushTile(mine, &tasks[i]))
+        {
+            pushed++;
+        }
+        else
+        {
+            runTile(&tasks[i]);
+        }
+        i++;
+    }
+    if (pushed > 0)
+    {
+        {
+            lock_guard<mutex> lock(pool->sleepLock);
+            waitingTiles += pushed;
+        }
+        pool->wake.notify_all();
+    }
+
+    // run waiting tiles until every tile of this call is finished
+    node = mine != nullptr && mine->node >= 0 ? (int)mine->node :
+        currentNode();
+    while (true)
+    {
+        {
+            lock_guard<mutex> done(call.doneLock);
+            if (call.left == 0)
+            {
+                return;
+            }
+        }
+        if (findTile(mine, node, task))
+        {
+            runTile(task);
+        }
+        else
+        {
+            unique_lock<mutex> done(call.doneLock);
+            call.doneWake.wait(done, [&] { return call.left == 0; });
+            return;
+        }
+    }
+}
@@ -0,0 +1,712 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions for images kept in a memory mapped scratch file
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function creates the scratch file for a tiled image and sets it
+  * up so that no more than budget bytes of tiles are mapped at once.
+  * The file is deleted when it is closed, even if the program dies.
+  * If the file can't be created, it throws runtime_error with what went
+  * wrong, so the job can be turned down.
+  *
+  * @param[out] ti - the tiled image to create.
+  * @param[in] path - the name of the scratch file.
+  * @param[in] rows - the number of rows of the image.
+  * @param[in] cols - the number of columns of the image.
+  * @param[in] budget - the most bytes of tiles to have mapped.
+  *
+  * @returns none
+  *
+  * @par Example:
+    @verbatim
+    tiledImage ti;
+
+    createTiled(ti, "out.tiles", 50000, 100000, 256LL << 20);
+
+    ti is now a 100000 x 50000 image backed by out.tiles.
+    @endverbatim
+
+  ***********************************************************************/
+
+void createTiled(tiledImage& ti, string path, long long rows,
+    long long cols, long long budget)
+{
+    long long size;
+
+    ti.rows = rows;
+    ti.cols = cols;
+    ti.tilesAcross = (cols + TILE_SIZE - 1) / TILE_SIZE;
+    ti.tilesDown = (rows + TILE_SIZE - 1) / TILE_SIZE;
+    ti.path = path;
+    ti.recent.clear();
+    ti.mapped = 0;
+    ti.maxMapped = budget / TILE_BYTES;
+    if (ti.maxMapped < 4)
+    {
+        ti.maxMapped = 4;
+    }
+    ti.views.assign((size_t)(ti.tilesAcross * ti.tilesDown), nullptr);
+    ti.where.assign(ti.views.size(), ti.recent.end());
+    size = (long long)ti.views.size() * TILE_BYTES;
+
+#ifdef _WIN32
+    ti.file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+        NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY |
+        FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    ti.mapping = NULL;
+    if (ti.file != INVALID_HANDLE_VALUE)
+    {
+        // creating the mapping also grows the file to its full size
+        ti.mapping = CreateFileMappingA(ti.file, NULL, PAGE_READWRITE,
+            (DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFF), NULL);
+    }
+    if (ti.mapping == NULL)
+    {
+        if (ti.file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(ti.file);
+        }
+        throw runtime_error("Unable to create scratch file: " + path);
+    }
+#else
+    ti.fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (ti.fd < 0 || ftruncate(ti.fd, (off_t)size) != 0)
+    {
+        if (ti.fd >= 0)
+        {
+            close(ti.fd);
+            unlink(path.c_str());
+            ti.fd = -1;
+        }
+        throw runtime_error("Unable to create scratch file: " + path);
+    }
+
+    // the open descriptor keeps the data around until it is closed
+    unlink(path.c_str());
+#endif
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function returns the pixels of one tile, mapping it in if it
+ * isn't already. If the budget is used up, the tile that was used the
+ * longest time ago is unmapped first. A tile holds its red, green and
+ * blue planes one after the other, TILE_SIZE x TILE_SIZE each. The
+ * pointer stays good until maxMapped other tiles of this image have
+ * been asked for.
+ *
+ * @param[in] ti - the tiled image.
+ * @param[in] tx - the column of the tile.
+ * @param[in] ty - the row of the tile.
+ *
+ * @returns a pointer to the first pixel of the tile.
+ *
+ * @par Example:
+   @verbatim
+   pixel* tile = tilePointer(ti, 0, 0);
+
+   tile[0] is now the red value of the top left pixel.
+   @endverbatim
+
+ ***********************************************************************/
+
+pixel* tilePointer(tiledImage& ti, long long tx, long long ty)
+{
+    size_t index = (size_t)(ty * ti.tilesAcross + tx);
+    long long offset = (long long)index * TILE_BYTES;
+    void* view;
+
+    // a mapped tile just moves to the front of the recently used list
+    if (ti.views[index] != nullptr)
+    {
+        ti.recent.splice(ti.recent.begin(), ti.recent, ti.where[index]);
+        return ti.views[index];
+    }
+
+    // make room by unmapping the least recently used tile
+    if (ti.mapped >= ti.maxMapped)
+    {
+        unmapTile(ti, ti.recent.back());
+    }
+
+    // tiles are a multiple of 64K, so every offset is aligned
+#ifdef _WIN32
+    view = MapViewOfFile(ti.mapping, FILE_MAP_ALL_ACCESS,
+        (DWORD)(offset >> 32), (DWORD)(offset & 0xFFFFFFFF), TILE_BYTES);
+    if (view == NULL)
+#else
+    view = mmap(NULL, TILE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED,
+        ti.fd, (off_t)offset);
+    if (view == MAP_FAILED)
+#endif
+    {
+        throw runtime_error("Unable to map scratch file: " + ti.path);
+    }
+
+    ti.views[index] = (pixel*)view;
+    ti.recent.push_front(index);
+    ti.where[index] = ti.recent.begin();
+    ti.mapped++;
+    return ti.views[index];
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function unmaps one tile. The operating system writes it back to
+ * the scratch file when it needs the memory.
+ *
+ * @param[in] ti - the tiled image.
+ * @param[in] index - the index of the tile, row * tilesAcross + column.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   unmapTile(ti, 0);
+
+   the top left tile is no longer mapped.
+   @endverbatim
+
+ ***********************************************************************/
+
+void unmapTile(tiledImage& ti, size_t index)
+{
+    if (ti.views[index] == nullptr)
+    {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(ti.views[index]);
+#else
+    munmap(ti.views[index], TILE_BYTES);
+#endif
+    ti.recent.erase(ti.where[index]);
+    ti.views[index] = nullptr;
+    ti.mapped--;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function unmaps every tile and closes the scratch file, which
+ * deletes it.
+ *
+ * @param[in] ti - the tiled image to close.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   closeTiled(ti);
+
+   the scratch file of ti is gone.
+   @endverbatim
+
+ ***********************************************************************/
+
+void closeTiled(tiledImage& ti)
+{
+    size_t i = 0;
+
+    while (i < ti.views.size())
+    {
+        unmapTile(ti, i);
+        i++;
+    }
+#ifdef _WIN32
+    CloseHandle(ti.mapping);
+    CloseHandle(ti.file);
+#else
+    close(ti.fd);
+#endif
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads the header after the magic number into 64 bit
+ * sizes, so it works for images with more than 2 billion pixels.
+ *
+ * @param[in] in - the input stream.
+ * @param[out] comment - any comment lines.
+ * @param[out] rows - the number of rows.
+ * @param[out] cols - the number of columns.
+ * @param[out] maxValue - the max value of the pixels
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   long long rows;
+   long long cols;
+   string comment;
+   int maxValue;
+
+   readHeaderLarge(in, comment, rows, cols, maxValue);
+   @endverbatim
+
+ ***********************************************************************/
+
+void readHeaderLarge(istream& in, string& comment, long long& rows,
+    long long& cols, int& maxValue)
+{
+    string com;
+    getline(in, com); // read rest of line after magic number
+
+    // while first character of next line is # (35 in ascii)
+    // add this line to comment
+    while (in.peek() == 35)
+    {
+        getline(in, com);
+        comment += com + '\n';
+    }
+    in >> cols;
+    in >> rows;
+    in >> maxValue;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function reads the pixels of an ascii or binary image into a
+ * tiled image one row at a time, splitting each row into its colors.
+ *
+ * @param[in] in - the input stream, just past maxValue.
+ * @param[in] ti - the tiled image to fill.
+ * @param[in] binary - true if the input is P6, false if it is P3.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   importTiled(in, ti, true);
+
+   ti now holds every pixel of the input.
+   @endverbatim
+
+ ***********************************************************************/
+
+void importTiled(istream& in, tiledImage& ti, bool binary)
+{
+    vector<pixel> line((size_t)ti.cols * 3);
+    const kernelTable& k = kernels();
+    pixel space;
+    pixel* tile;
+    long long y = 0;
+    long long x;
+    long long tx;
+    long long j;
+    int num;
+
+    if (binary)
+    {
+        in.read((char*)&space, sizeof(pixel));
+    }
+    while (y < ti.rows)
+    {
+        // read in one row of interleaved pixels
+        if (binary)
+        {
+            in.read((char*)line.data(), (streamsize)line.size());
+        }
+        else
+        {
+            j = 0;
+            while (j < (long long)line.size())
+            {
+                in >> num;
+                line[(size_t)j] = (pixel)num;
+                j++;
+            }
+        }
+
+        // split it across the tiles in this band
+        tx = 0;
+        while (tx < ti.tilesAcross)
+        {
+            tile = tilePointer(ti, tx, y / TILE_SIZE) +
+                (y % TILE_SIZE) * TILE_SIZE;
+            x = tx * TILE_SIZE;
+            j = ti.cols - x < TILE_SIZE ? ti.cols - x : TILE_SIZE;
+            k.splitRow(&line[(size_t)x * 3], tile, tile + TILE_PLANE,
+                tile + 2 * TILE_PLANE, (int)j);
+            tx++;
+        }
+        y++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function writes out a tiled image one row at a time. P2 and P5
+ * write just the red/gray plane like the grayscale writers do.
+ *
+ * @param[in] out - the out stream.
+ * @param[in] ti - the tiled image to write out.
+ * @param[in] magicNumber - P2, P3, P5 or P6.
+ * @param[in] comment - any comment lines.
+ * @param[in] maxValue - the max value of the pixels
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   exportTiled(out, ti, "P6", "", 255);
+
+   out now contains all of the pixels of ti in binary.
+   @endverbatim
+
+ ***********************************************************************/
+
+void exportTiled(ostream& out, tiledImage& ti, string magicNumber,
+    string comment, int maxValue)
+{
+    bool gray = magicNumber == "P2" || magicNumber == "P5";
+    bool binary = magicNumber == "P5" || magicNumber == "P6";
+    int channels = gray ? 1 : 3;
+    vector<pixel> line((size_t)ti.cols * channels);
+    vector<char> text(binary ? 0 : line.size() * 4);
+    const kernelTable& k = kernels();
+    pixel space = '\n';
+    pixel* tile;
+    long long y = 0;
+    long long tx;
+    long long x;
+    long long j;
+
+    // output magic number, any comments, columns and rows, and maxValue
+    out << magicNumber << endl;
+    out << comment;
+    out << ti.cols << " " << ti.rows << endl;
+    out << maxValue;
+    if (binary)
+    {
+        out.write((char*)&space, sizeof(pixel));
+    }
+    else
+    {
+        out << endl;
+    }
+
+    while (y < ti.rows)
+    {
+        // gather one row back together from the tiles in this band
+        tx = 0;
+        while (tx < ti.tilesAcross)
+        {
+            tile = tilePointer(ti, tx, y / TILE_SIZE) +
+                (y % TILE_SIZE) * TILE_SIZE;
+            x = tx * TILE_SIZE;
+            j = ti.cols - x < TILE_SIZE ? ti.cols - x : TILE_SIZE;
+            if (gray)
+            {
+                memcpy(&line[(size_t)x], tile, (size_t)j);
+            }
+            else
+            {
+                k.joinRow(tile, tile + TILE_PLANE, tile + 2 * TILE_PLANE,
+                    &line[(size_t)x * 3], (int)j);
+            }
+            tx++;
+        }
+
+        // and output it
+        if (binary)
+        {
+            out.write((char*)line.data(), (streamsize)line.size());
+        }
+        else
+        {
+            out.write(text.data(), (streamsize)k.formatValues(line.data(),
+                (int)line.size(), text.data()));
+        }
+        y++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function fills dst with a flipped or rotated copy of src, one
+ * output tile at a time. Every row of an output tile comes from at most
+ * two source tiles, so only a few tiles of each image are mapped while
+ * a tile is being filled. dst must already be created with the output
+ * size.
+ *
+ * @param[in] src - the tiled image to read.
+ * @param[in] dst - the tiled image to fill.
+ * @param[in] optionCode - --flipX, --flipY, --rotateCW or --rotateCCW.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   createTiled(dst, "out.tiles2", src.cols, src.rows, budget);
+   remapTiled(src, dst, "--rotateCW");
+
+   dst is now src rotated 90 degrees clockwise.
+   @endverbatim
+
+ ***********************************************************************/
+
+void remapTiled(tiledImage& src, tiledImage& dst, string optionCode)
+{
+    long long ty = 0;
+    long long tx;
+    long long r;
+    long long j;
+    long long y;
+    long long x;
+    long long sy;
+    long long sx;
+    long long curX = -1; // source tile that in points to
+    long long curY = -1;
+    long long syBase = 0; // sy = syBase + syDown * y + syAcross * x
+    long long syDown = 1;
+    long long syAcross = 0;
+    long long sxBase = 0; // sx = sxBase + sxDown * y + sxAcross * x
+    long long sxDown = 0;
+    long long sxAcross = 1;
+    pixel* out;
+    pixel* in = nullptr;
+    size_t at;
+
+    // the source of each output pixel is a line in its row and column,
+    // worked out once for the option instead of for every pixel
+    if (optionCode == "--flipX")
+    {
+        syBase = src.rows - 1;
+        syDown = -1;
+    }
+    else if (optionCode == "--flipY")
+    {
+        sxBase = src.cols - 1;
+        sxAcross = -1;
+    }
+    else if (optionCode == "--rotateCW")
+    {
+        syBase = src.rows - 1;
+        syDown = 0;
+        syAcross = -1;
+        sxDown = 1;
+        sxAcross = 0;
+    }
+    else if (optionCode == "--rotateCCW")
+    {
+        syDown = 0;
+        syAcross = 1;
+        sxBase = src.cols - 1;
+        sxDown = -1;
+        sxAcross = 0;
+    }
+
+    while (ty < dst.tilesDown)
+    {
+        tx = 0;
+        while (tx < dst.tilesAcross)
+        {
+            r = 0;
+            while (r < TILE_SIZE && ty * TILE_SIZE + r < dst.rows)
+            {
+                out = tilePointer(dst, tx, ty) + r * TILE_SIZE;
+                y = ty * TILE_SIZE + r;
+                j = 0;
+                while (j < TILE_SIZE && tx * TILE_SIZE + j < dst.cols)
+                {
+                    // find the source pixel for this output pixel
+                    x = tx * TILE_SIZE + j;
+                    sy = syBase + syDown * y + syAcross * x;
+                    sx = sxBase + sxDown * y + sxAcross * x;
+                    if (sx / TILE_SIZE != curX || sy / TILE_SIZE != curY)
+                    {
+                        curX = sx / TILE_SIZE;
+                        curY = sy / TILE_SIZE;
+                        in = tilePointer(src, curX, curY);
+                    }
+                    at = (size_t)((sy % TILE_SIZE) * TILE_SIZE +
+                        sx % TILE_SIZE);
+                    out[j] = in[at];
+                    out[TILE_PLANE + j] = in[TILE_PLANE + at];
+                    out[2 * TILE_PLANE + j] = in[2 * TILE_PLANE + at];
+                    j++;
+                }
+                r++;
+            }
+            tx++;
+        }
+        ty++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function applies grayscale or sepia to a tiled image in place,
+ * one tile at a time, each row of a tile through the same row kernels
+ * grayscale and sepia use.
+ *
+ * @param[in] ti - the tiled image to be manipulated.
+ * @param[in] optionCode - --grayscale or --sepia.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   colorTiled(ti, "--sepia");
+
+   ti is now a sepia image.
+   @endverbatim
+
+ ***********************************************************************/
+
+void colorTiled(tiledImage& ti, string optionCode)
+{
+    const kernelTable& k = kernels();
+    long long ty = 0;
+    long long tx;
+    long long r;
+    bool gray = optionCode == "--grayscale";
+    pixel* tile;
+
+    while (ty < ti.tilesDown)
+    {
+        tx = 0;
+        while (tx < ti.tilesAcross)
+        {
+            // the padding past the edge is changed too, which is harmless
+            tile = tilePointer(ti, tx, ty);
+            r = 0;
+            while (r < TILE_SIZE)
+            {
+                if (gray)
+                {
+                    k.grayRow(tile, tile + TILE_PLANE, tile + 2 * TILE_PLANE,
+                        TILE_SIZE);
+                }
+                else
+                {
+                    k.sepiaRow(tile, tile + TILE_PLANE,
+                        tile + 2 * TILE_PLANE, TILE_SIZE);
+                }
+                tile += TILE_SIZE;
+                r++;
+            }
+            tx++;
+        }
+        ty++;
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function runs a whole job out of core. The input is copied into
+ * a tiled scratch file, the option is applied tile by tile, and the
+ * result is written out, with no more than budget bytes of tiles
+ * mapped at any time. The scratch files are named after basename.
+ *
+ * @param[in] in - the input stream, just past the magic number.
+ * @param[in] out - the out stream.
+ * @param[in] inputMagic - P3 or P6.
+ * @param[in] outputMagic - the magic number to write out.
+ * @param[in] optionCode - the option, or empty for none.
+ * @param[in] basename - the name of the output without the extension.
+ * @param[in] budget - the most bytes of tiles to have mapped.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   processTiled(in, out, "P6", "P6", "--rotateCW", "big", 512LL << 20);
+
+   out now has the rotated image, using at most 512 MB of tiles.
+   @endverbatim
+
+ ***********************************************************************/
+
+void processTiled(istream& in, ostream& out, string inputMagic,
+    string outputMagic, string optionCode, string basename,
+    long long budget)
+{
+    tiledImage src;
+    tiledImage dst;
+    string comment;
+    long long rows = 0;
+    long long cols = 0;
+    int maxValue = 0;
+    bool swap = optionCode == "--rotateCW" || optionCode == "--rotateCCW";
+
+    readHeaderLarge(in, comment, rows, cols, maxValue);
+
+    // geometric options need a second image, so split the budget
+    if (optionCode == "--flipX" || optionCode == "--flipY" || swap)
+    {
+        createTiled(src, basename + ".tiles", rows, cols, budget / 2);
+        importTiled(in, src, inputMagic == "P6");
+        createTiled(dst, basename + ".tiles2", swap ? cols : rows,
+            swap ? rows : cols, budget / 2);
+        remapTiled(src, dst, optionCode);
+        closeTiled(src);
+        exportTiled(out, dst, outputMagic, comment, maxValue);
+        closeTiled(dst);
+        return;
+    }
+
+    createTiled(src, basename + ".tiles", rows, cols, budget);
+    importTiled(in, src, inputMagic == "P6");
+    if (optionCode == "--grayscale" || optionCode == "--sepia")
+    {
+        colorTiled(src, optionCode);
+    }
+    exportTiled(out, src, outputMagic, comment, maxValue);
+    closeTiled(src);
+}
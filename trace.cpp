@@ -0,0 +1,488 @@
+/** *********************************************************************
+ * @file
+ *
+ * @brief   functions that record a timeline of a job for --trace
+ ***********************************************************************/
+
+#include "netPBM.h"
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <map>
+
+/*!
+ * @brief TRACE_EVENTS how many spans each thread's ring holds, the
+ * oldest are written over after that
+ */
+
+const size_t TRACE_EVENTS = 1 << 16;
+
+/*!
+ * @brief MAX_RINGS the most threads traced at once, the threads past
+ * that are left out of the timeline
+ */
+
+const int MAX_RINGS = 256;
+
+/*!
+ * @brief traceEvent one span of time on one thread
+ */
+
+struct traceEvent
+{
+    /*!
+    * @brief what the thread was doing
+    */
+    const char* name;
+
+    /*!
+    * @brief when it started, in nanoseconds from traceClock
+    */
+    long long begin;
+
+    /*!
+    * @brief when it ended, in nanoseconds from traceClock
+    */
+    long long end;
+
+    /*!
+    * @brief the first row it worked on, or -1
+    */
+    int first;
+
+    /*!
+    * @brief one past the last row it worked on
+    */
+    int last;
+
+    /*!
+    * @brief the number of the thread in the timeline
+    */
+    int thread;
+
+    /*!
+    * @brief what the thread is, like "pool", or null
+    */
+    const char* threadName;
+};
+
+/*!
+ * @brief traceRing the spans of one thread. Only that thread adds to it,
+ * so adding takes no lock, and the writer reads up to head.
+ */
+
+struct traceRing
+{
+    /*!
+    * @brief the spans, by number mod TRACE_EVENTS
+    */
+    vector<traceEvent> events;
+
+    /*!
+    * @brief how many spans have ever been added
+    */
+    atomic<size_t> head{ 0 };
+
+    /*!
+    * @brief true while a thread owns it, false once it can be reused
+    */
+    atomic<bool> inUse{ true };
+};
+
+/*!
+ * @brief ringOwner the calling thread's ring, given back when the thread
+ * ends so another thread can use it
+ */
+
+struct ringOwner
+{
+    /*!
+    * @brief the ring, or null until the thread first needs one
+    */
+    traceRing* ring = nullptr;
+
+    /*!
+    * @brief the thread's number in the timeline, a new one each time a
+    * ring is taken so a reused ring's old spans keep their thread
+    */
+    int thread = 0;
+
+    /*!
+    * @brief what the thread is, or null
+    */
+    const char* name = nullptr;
+
+    /*!
+    * @brief gives the ring back
+    */
+    ~ringOwner()
+    {
+        if (ring != nullptr)
+        {
+            ring->inUse = false;
+        }
+    }
+};
+
+/*!
+ * @brief ringLock guards making and reusing rings
+ */
+
+static mutex ringLock;
+
+/*!
+ * @brief rings every ring a thread has had, never destroyed since
+ * threads may still be adding to them when the program exits
+ */
+
+static traceRing* rings[MAX_RINGS];
+
+/*!
+ * @brief ringCount how many of rings are made
+ */
+
+static int ringCount = 0;
+
+/*!
+ * @brief ringsTaken how many times a thread has taken a ring
+ */
+
+static int ringsTaken = 0;
+
+/*!
+ * @brief myRing the calling thread's ring
+ */
+
+static thread_local ringOwner myRing;
+
+/*!
+ * @brief tracers how many jobs are tracing, spans are only kept while
+ * there is one
+ */
+
+static atomic<int> tracers(0);
+
+
+
+ /** *********************************************************************
+  * @author David Hill
+  *
+  * @par Description:
+  * This function gives the time in nanoseconds since the first time it
+  * was called, which the spans are timed with.
+  *
+  * @returns the time in nanoseconds
+  *
+  * @par Example:
+    @verbatim
+    long long start = traceClock();
+    @endverbatim
+
+  ***********************************************************************/
+
+static long long traceClock()
+{
+    static const chrono::steady_clock::time_point epoch =
+        chrono::steady_clock::now();
+
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now() - epoch).count();
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function gives the calling thread its ring, the first time
+ * reusing one a finished thread gave back or making a new one.
+ *
+ * @returns the ring, or null if there are none left
+ *
+ * @par Example:
+   @verbatim
+   traceRing* ring = ownRing();
+   @endverbatim
+
+ ***********************************************************************/
+
+static traceRing* ownRing()
+{
+    int i = 0;
+    bool free;
+
+    if (myRing.ring != nullptr)
+    {
+        return myRing.ring;
+    }
+    lock_guard<mutex> lock(ringLock);
+    while (i < ringCount)
+    {
+        free = false;
+        if (rings[i]->inUse.compare_exchange_strong(free, true))
+        {
+            myRing.ring = rings[i];
+            myRing.thread = ++ringsTaken;
+            return myRing.ring;
+        }
+        i++;
+    }
+    if (ringCount < MAX_RINGS)
+    {
+        myRing.ring = new traceRing;
+        myRing.ring->events.resize(TRACE_EVENTS);
+        myRing.thread = ++ringsTaken;
+        rings[ringCount] = myRing.ring;
+        ringCount++;
+    }
+    return myRing.ring;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This constructor starts a span of time on the calling thread, which
+ * ends when the span goes out of scope. It is only timed while a job is
+ * tracing, so it costs next to nothing otherwise.
+ *
+ * @param[in] name - what the thread is doing, a string that lasts as
+ *                   long as the program.
+ * @param[in] first - the first row it works on, or -1 for none.
+ * @param[in] last - one past the last row it works on.
+ *
+ * @par Example:
+   @verbatim
+   {
+       traceSpan span("write");
+
+       writeBinary(out, im, maxValue);
+   }
+
+   with --trace, the timeline now has a write span for the call.
+   @endverbatim
+
+ ***********************************************************************/
+
+traceSpan::traceSpan(const char* name, int first, int last) :
+    name(name), first(first), last(last), begin(-1)
+{
+    if (tracers > 0)
+    {
+        begin = traceClock();
+    }
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This destructor ends the span and adds it to the calling thread's
+ * ring. Only the thread adds to its ring, so it needs no lock, and the
+ * span is published by moving the head past it.
+ *
+ * @par Example:
+   @verbatim
+   {
+       traceSpan span("read");
+   }
+
+   the read span is now in the thread's ring.
+   @endverbatim
+
+ ***********************************************************************/
+
+traceSpan::~traceSpan()
+{
+    traceRing* ring;
+    size_t at;
+
+    if (begin < 0)
+    {
+        return;
+    }
+    ring = ownRing();
+    if (ring == nullptr)
+    {
+        return;
+    }
+    at = ring->head.load(memory_order_relaxed);
+    ring->events[at % TRACE_EVENTS] = { name, begin, traceClock(), first,
+        last, myRing.thread, myRing.name };
+    ring->head.store(at + 1, memory_order_release);
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function names the calling thread in the timeline, like "pool"
+ * or "decode". Threads without a name are shown by number. A thread
+ * only gets a ring once it is traced, so naming one costs nothing.
+ *
+ * @param[in] name - the name, a string that lasts as long as the
+ *                   program.
+ *
+ * @returns none
+ *
+ * @par Example:
+   @verbatim
+   traceThread("decode");
+   @endverbatim
+
+ ***********************************************************************/
+
+void traceThread(const char* name)
+{
+    myRing.name = name;
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function starts tracing for a job. Spans are kept on every
+ * thread until finishTrace, and the job's timeline is the spans after
+ * the time this returns.
+ *
+ * @returns the time tracing started, to pass to finishTrace
+ *
+ * @par Example:
+   @verbatim
+   long long since = startTrace();
+   @endverbatim
+
+ ***********************************************************************/
+
+long long startTrace()
+{
+    tracers++;
+    return traceClock();
+}
+
+
+
+/** *********************************************************************
+ * @author David Hill
+ *
+ * @par Description:
+ * This function stops tracing for a job and writes the spans since it
+ * started as a Chrome trace-event file, which chrome://tracing and
+ * Perfetto show as a timeline with a row for each thread. Each span is
+ * a complete event, and the tiles have the rows they worked on. Spans
+ * of other jobs a server ran at the same time are in it too. A ring that
+ * filled up has lost its oldest spans, spans still being added are left
+ * out, and so are spans written over while they were being copied.
+ *
+ * @param[in] file - the file to write.
+ * @param[in] since - the time startTrace returned.
+ *
+ * @returns true if the file was written, false if it didn't open
+ *
+ * @par Example:
+   @verbatim
+   long long since = startTrace();
+
+   ... the job ...
+
+   finishTrace("trace.json", since);
+   @endverbatim
+
+ ***********************************************************************/
+
+bool finishTrace(string file, long long since)
+{
+    vector<traceEvent> spans;
+    vector<traceEvent> window; // the spans copied out of one ring
+    map<int, const char*> names;
+    ofstream out;
+    size_t head;
+    size_t last;
+    size_t at;
+    size_t kept;
+    size_t i = 0;
+    int r = 0;
+    bool first = true;
+
+    tracers--;
+    {
+        lock_guard<mutex> lock(ringLock);
+        while (r < ringCount)
+        {
+            traceRing* ring = rings[r];
+
+            // the owner may be writing the slot after head, which holds
+            // the oldest span, so that one is left out
+            head = ring->head.load(memory_order_acquire);
+            at = head >= TRACE_EVENTS ? head - TRACE_EVENTS + 1 : 0;
+            window.clear();
+            while (at < head)
+            {
+                window.push_back(ring->events[at % TRACE_EVENTS]);
+                at++;
+            }
+
+            // spans the owner wrote over while they were copied are
+            // dropped, the head says how far it has got since
+            atomic_thread_fence(memory_order_acquire);
+            last = ring->head.load(memory_order_relaxed);
+            at = head - window.size();
+            kept = last >= TRACE_EVENTS ? last - TRACE_EVENTS + 1 : 0;
+            kept = kept > at ? kept - at : 0;
+            while (kept < window.size())
+            {
+                if (window[kept].begin >= since)
+                {
+                    spans.push_back(window[kept]);
+                    names[spans.back().thread] = spans.back().threadName;
+                }
+                kept++;
+            }
+            r++;
+        }
+    }
+
+    if (!openOutput(out, file))
+    {
+        return false;
+    }
+    out << "{\"traceEvents\":[" << endl;
+    for (const pair<const int, const char*>& name : names)
+    {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\","
+            << "\"ph\":\"M\",\"pid\":1,\"tid\":" << name.first
+            << ",\"args\":{\"name\":\"" << (name.second != nullptr ?
+            name.second : "thread") << " " << name.first << "\"}}";
+        first = false;
+    }
+
+    // times are in microseconds from when tracing started
+    out << fixed << setprecision(3);
+    while (i < spans.size())
+    {
+        traceEvent& e = spans[i];
+        out << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\","
+            << "\"pid\":1,\"tid\":" << e.thread << ",\"ts\":"
+            << (e.begin - since) / 1000.0 << ",\"dur\":"
+            << (e.end - e.begin) / 1000.0;
+        if (e.first >= 0)
+        {
+            out << ",\"args\":{\"first row\":" << e.first
+                << ",\"rows\":" << e.last - e.first << "}";
+        }
+        out << "}";
+        i++;
+    }
+    out << endl << "],\"displayTimeUnit\":\"ms\"}" << endl;
+    return true;
+}